@@ -0,0 +1,304 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "compiler/driver.h"
+#include "compiler/backend/closure.h"
+#include "compiler/backend/eval.h"
+#include "compiler/backend/vm.h"
+#include "runtime/io.h"
+
+using namespace pie::compiler;
+
+// Runs the programs of bench/ on every engine and reports, for each
+// program and configuration, the time and the allocations of one run of
+// the program (an op), and the peak RSS:
+//
+//   pie_bench [--runs=N] [--json=FILE] [program...]
+//
+// A configuration runs in a child process of its own, so its peak RSS is
+// not the one of the configurations before it, and a crash only loses
+// its row. The program is compiled again before every run, outside of
+// the measured time. The first run warms up and is not counted.
+
+// Set by the build
+#ifndef PIE_BENCH_DIR
+#define PIE_BENCH_DIR "bench/"
+#endif
+#ifndef PIE_LIB_DIR
+#define PIE_LIB_DIR "lib/"
+#endif
+
+// Calls of operator new, which strings, values and the engines allocate
+// through. allocs/op counts these.
+static std::atomic<uint64_t> allocations(0);
+
+void *operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *memory = malloc(size ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void *memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void *memory, size_t) noexcept
+{
+    free(memory);
+}
+
+namespace {
+
+enum class Engine { Tree, Closure, Vm };
+
+struct Config {
+    const char *name;
+    Engine engine;
+    bool optimize;
+    bool jit;
+};
+
+const Config configs[] = {
+    { "tree", Engine::Tree, true, true },
+    { "tree-nojit", Engine::Tree, true, false },
+    { "tree-O0", Engine::Tree, false, false },
+    { "closure", Engine::Closure, true, false },
+    { "vm", Engine::Vm, true, false },
+};
+
+// The programs of bench/ that run as they are, not the generators
+const char *programs[] = {
+    "recursion", "calls", "tail", "accessors", "typed", "loops", "scopes", "strings", "output",
+};
+
+struct Result {
+    bool ok;
+    double ns;      // per op
+    double min_ns;  // of the fastest op
+    double allocs;  // per op
+    long peak_rss;  // KB
+};
+
+const char *engineName(Engine engine)
+{
+    switch (engine) {
+    case Engine::Tree: return "tree";
+    case Engine::Closure: return "closure";
+    case Engine::Vm: return "vm";
+    }
+    return "";
+}
+
+// One op: runs the compiled program, its output included
+bool runOnce(const std::string &path, const Config &config, double &ns, uint64_t &allocs)
+{
+    Driver driver(1);
+    driver.addSearchPath(PIE_LIB_DIR);
+    if (!config.optimize) driver.setOptimize(false, 0);
+    if (driver.compile(path) != Driver::Compiled) {
+        return false;
+    }
+    ModuleNode *module = driver.root();
+
+    uint64_t before = allocations.load(std::memory_order_relaxed);
+    auto start = std::chrono::steady_clock::now();
+    try {
+        if (config.engine == Engine::Tree) {
+            EvalVisitor interpreter;
+            interpreter.setJit(config.jit);
+            interpreter.run(module);
+        } else if (config.engine == Engine::Closure) {
+            ClosureCompilerVisitor engine;
+            engine.run(module);
+        } else {
+            pie::vm::Program program;
+            VmCompilerVistor compiler(program);
+            compiler.compile(module);
+            pie::vm::Interpreter interpreter;
+            interpreter.run(program);
+        }
+        pie::io::flushAll();
+    } catch (const std::exception &e) {
+        fprintf(stderr, "%s (%s): %s\n", path.c_str(), config.name, e.what());
+        return false;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    allocs = allocations.load(std::memory_order_relaxed) - before;
+    return true;
+}
+
+Result measure(const std::string &path, const Config &config, int runs)
+{
+    Result result = { false, 0, 0, 0, 0 };
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return result;
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+
+        // The output of the program is written, to nowhere
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0) dup2(null, 1);
+
+        bool ok = true;
+        double total = 0;
+        uint64_t allocs = 0;
+        for (int i = 0; i <= runs && ok; i++) {
+            double ns = 0;
+            uint64_t count = 0;
+            ok = runOnce(path, config, ns, count);
+            if (i == 0) continue;
+
+            total += ns;
+            allocs += count;
+            result.min_ns = i == 1 ? ns : std::min(result.min_ns, ns);
+        }
+
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        result.ok = ok;
+        result.ns = total / runs;
+        result.allocs = (double)allocs / runs;
+#ifdef __APPLE__
+        result.peak_rss = usage.ru_maxrss / 1024;
+#else
+        result.peak_rss = usage.ru_maxrss;
+#endif
+
+        ssize_t written = write(fds[1], &result, sizeof(result));
+        _exit(written == (ssize_t)sizeof(result) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    if (pid > 0) {
+        if (read(fds[0], &result, sizeof(result)) != (ssize_t)sizeof(result)) {
+            result.ok = false;
+        }
+        waitpid(pid, nullptr, 0);
+    }
+    close(fds[0]);
+    return result;
+}
+
+void printUsage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [options] [program...]\n", prog);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --runs=N     Measured runs of each program and configuration (default 5)\n");
+    fprintf(stderr, "  --json=FILE  Write the results to FILE as JSON\n");
+    fprintf(stderr, "Programs:");
+    for (const char *program : programs) {
+        fprintf(stderr, " %s", program);
+    }
+    fprintf(stderr, "\n");
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    int runs = 5;
+    std::string json_path;
+    std::vector<std::string> selected;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--runs=", 7) == 0) {
+            runs = std::max(1, atoi(argv[i] + 7));
+        } else if (strncmp(argv[i], "--json=", 7) == 0) {
+            json_path = argv[i] + 7;
+        } else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            printUsage(argv[0]);
+            return 0;
+        } else if (argv[i][0] != '-') {
+            selected.push_back(argv[i]);
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (selected.empty()) {
+        selected.assign(std::begin(programs), std::end(programs));
+    }
+
+    std::string json = "{\n  \"runs\": " + std::to_string(runs) + ",\n  \"results\": [";
+    bool failed = false;
+    char line[256];
+
+    printf("%-10s %-11s %14s %14s %12s %10s\n", "program", "config", "ns/op", "min ns", "allocs/op",
+           "peak KB");
+    for (size_t p = 0; p < selected.size(); p++) {
+        std::string path = PIE_BENCH_DIR + selected[p] + ".pie";
+
+        for (const Config &config : configs) {
+            Result result = measure(path, config, runs);
+            failed = failed || !result.ok;
+
+            if (result.ok) {
+                printf("%-10s %-11s %14.0f %14.0f %12.0f %10ld\n", selected[p].c_str(), config.name,
+                       result.ns, result.min_ns, result.allocs, result.peak_rss);
+            } else {
+                printf("%-10s %-11s %14s\n", selected[p].c_str(), config.name, "failed");
+            }
+
+            snprintf(line, sizeof(line),
+                     "\"engine\": \"%s\", \"optimize\": %s, \"jit\": %s, \"ok\": %s, "
+                     "\"ns_per_op\": %.0f, \"min_ns\": %.0f, \"allocs_per_op\": %.0f, \"peak_rss_kb\": %ld",
+                     engineName(config.engine), config.optimize ? "true" : "false",
+                     config.jit ? "true" : "false", result.ok ? "true" : "false",
+                     result.ns, result.min_ns, result.allocs, result.peak_rss);
+            json += (json.back() == '[' ? "\n    " : ",\n    ");
+            json += "{ \"program\": \"" + selected[p] + "\", \"config\": \"" + config.name + "\", " + line + " }";
+        }
+    }
+    json += "\n  ]\n}\n";
+
+    if (!json_path.empty()) {
+        FILE *out = fopen(json_path.c_str(), "wb");
+        if (!out || fputs(json.c_str(), out) < 0 || fclose(out) != 0) {
+            fprintf(stderr, "Failed to write %s\n", json_path.c_str());
+            return 1;
+        }
+    }
+
+    return failed ? 2 : 0;
+}
@@ -0,0 +1,74 @@
+#include <cstdint>
+#include <cstdlib>
+
+#include "compiler/arena.h"
+
+namespace pie { namespace compiler {
+
+Arena::Arena(size_t chunk_size)
+    : chunks(nullptr), cursor(nullptr), limit(nullptr),
+      chunk_size(chunk_size), used(0), reserved(0)
+{
+}
+
+Arena::~Arena()
+{
+    clear();
+}
+
+void *Arena::allocate(size_t size, size_t align)
+{
+    uintptr_t at = ((uintptr_t)cursor + align - 1) & ~(uintptr_t)(align - 1);
+    if (!cursor || at + size > (uintptr_t)limit) {
+        newChunk(size + align);
+        at = ((uintptr_t)cursor + align - 1) & ~(uintptr_t)(align - 1);
+    }
+
+    cursor = (char *)(at + size);
+    used += size;
+    return (void *)at;
+}
+
+void Arena::newChunk(size_t min_size)
+{
+    // Oversized requests get a chunk of their own
+    size_t size = min_size > chunk_size ? min_size : chunk_size;
+    Chunk *chunk = (Chunk *)std::malloc(sizeof(Chunk) + size);
+    if (!chunk) {
+        throw std::bad_alloc();
+    }
+
+    chunk->next = chunks;
+    chunk->size = size;
+    chunks = chunk;
+    cursor = (char *)(chunk + 1);
+    limit = cursor + size;
+    reserved += size;
+}
+
+void Arena::own(void *obj, void (*fn)(void *))
+{
+    cleanups.push_back({ fn, obj });
+}
+
+void Arena::clear()
+{
+    // Destroy in reverse creation order, children before their parents
+    for (size_t i = cleanups.size(); i > 0; i--) {
+        cleanups[i - 1].fn(cleanups[i - 1].obj);
+    }
+    cleanups.clear();
+
+    while (chunks) {
+        Chunk *next = chunks->next;
+        std::free(chunks);
+        chunks = next;
+    }
+
+    cursor = nullptr;
+    limit = nullptr;
+    used = 0;
+    reserved = 0;
+}
+
+}}
@@ -0,0 +1,66 @@
+#ifndef __PIE_ARENA__
+#define __PIE_ARENA__
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace pie { namespace compiler {
+
+// Bump allocator owning everything built by one parse. Objects are never
+// freed one by one: clear() or the destructor runs the destructors of the
+// objects that have one and releases all memory in one go.
+class Arena {
+public:
+    explicit Arena(size_t chunk_size = 32 * 1024);
+    ~Arena();
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    void *allocate(size_t size, size_t align);
+
+    template <typename T, typename... Args>
+    T *make(Args&&... args)
+    {
+        void *mem = allocate(sizeof(T), alignof(T));
+        T *obj = new (mem) T(std::forward<Args>(args)...);
+        if (!std::is_trivially_destructible<T>::value) {
+            own(obj, [](void *p) { static_cast<T*>(p)->~T(); });
+        }
+        return obj;
+    }
+
+    void clear();
+
+    size_t bytesUsed() const { return used; }
+    size_t bytesReserved() const { return reserved; }
+
+private:
+    struct Chunk {
+        Chunk *next;
+        size_t size;
+    };
+
+    struct Cleanup {
+        void (*fn)(void *);
+        void *obj;
+    };
+
+    Chunk *chunks;
+    char *cursor;
+    char *limit;
+    size_t chunk_size;
+    size_t used;
+    size_t reserved;
+    std::vector<Cleanup> cleanups;
+
+    void own(void *obj, void (*fn)(void *));
+    void newChunk(size_t min_size);
+};
+
+}}
+
+#endif
@@ -13,6 +13,23 @@
 #include "compiler/ast/op.h"
 #include "compiler/ast/return.h"
 #include "compiler/ast/if.h"
+#include "compiler/ast/loop.h"
 #include "compiler/ast/block.h"
 
+namespace pie { namespace compiler {
+
+// Calls the visit() of V for the kind of node: a switch on the tag and a
+// direct call, instead of the two virtual calls of node->visit(visitor)
+template <class V>
+inline void dispatch(V *visitor, Node *node)
+{
+	switch (node->kind) {
+	#define AST_NODE(type) case NodeKind::type: visitor->V::visit(static_cast<type *>(node)); return;
+	AST_NODES
+	#undef AST_NODE
+	}
+}
+
+}}
+
 #endif
@@ -5,7 +5,7 @@
 
 namespace pie { namespace compiler {
 
-class AssignNode : public Node
+class AssignNode : public NodeOf<NodeKind::AssignNode>
 {
 public:
 	Node *var;
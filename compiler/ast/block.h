@@ -7,12 +7,13 @@
 
 namespace pie { namespace compiler {
 
-class BlockNode : public Node
+class BlockNode : public NodeOf<NodeKind::BlockNode>
 {
 public:
 	// statements are in children
+	int num_locals;  // lets declared directly in this block
 
-	BlockNode() {}
+	BlockNode() : num_locals(0) {}
 
 	void addStatement(Node *stmt)
 	{
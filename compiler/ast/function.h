@@ -1,6 +1,7 @@
 #ifndef __PIE_AST_FUNCTION__
 #define __PIE_AST_FUNCTION__
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -9,24 +10,37 @@
 namespace pie { namespace compiler {
 
 class TypeNode;
+struct Builtin;
 
-class FunctionNode : public Node
+class FunctionNode : public NodeOf<NodeKind::FunctionNode>
 {
 public:
 	std::string name;
 	int access_level;
 	std::vector<std::pair<std::string, TypeNode *>> params;
 	TypeNode *return_type;
+	int frame_size;  // slots needed by params and locals, set by ResolveVisitor
 
-	FunctionNode() : access_level(0), return_type(nullptr) {}
+	// Tier-up state: calls made by EvalVisitor, and the entry point set
+	// by JitCompiler once the function runs as machine code, with the
+	// parameters (bit i) and result (JitCompiler::kDoubleResult) it
+	// passes as doubles
+	uint32_t call_count;
+	void *native_code;
+	uint32_t native_doubles;
+
+	FunctionNode()
+		: access_level(0), return_type(nullptr), frame_size(0), call_count(0), native_code(nullptr),
+		  native_doubles(0) {}
 	FunctionNode(const std::string &name, int access)
-		: name(name), access_level(access), return_type(nullptr) {}
+		: name(name), access_level(access), return_type(nullptr), frame_size(0),
+		  call_count(0), native_code(nullptr), native_doubles(0) {}
 
 	// statements are in children
 	DEFINE_VISIT(FunctionNode);
 };
 
-class ClosureNode : public Node
+class ClosureNode : public NodeOf<NodeKind::ClosureNode>
 {
 public:
 	std::vector<std::pair<std::string, TypeNode *>> params;
@@ -37,13 +51,31 @@ public:
 	DEFINE_VISIT(ClosureNode);
 };
 
-class FunctionCallNode : public Node
+class FunctionCallNode : public NodeOf<NodeKind::FunctionCallNode>
 {
 public:
+	std::string scope;  // qualifier of a dotted call, "io" in io.print()
 	std::string name;
+	int depth;  // set when the callee is a local, see IdentifierNode
+	int slot;
+
+	// Inline cache of a global callee, valid while cache_epoch equals the
+	// epoch of the global scope it was resolved in
+	uint64_t cache_epoch;
+	FunctionNode *cached_function;
+	const Builtin *cached_builtin;
+
+	FunctionCallNode()
+		: depth(-1), slot(-1), cache_epoch(0), cached_function(nullptr), cached_builtin(nullptr) {}
+	FunctionCallNode(const std::string &name)
+		: name(name), depth(-1), slot(-1), cache_epoch(0), cached_function(nullptr), cached_builtin(nullptr) {}
+	FunctionCallNode(const std::string &scope, const std::string &name)
+		: scope(scope), name(name), depth(-1), slot(-1), cache_epoch(0), cached_function(nullptr), cached_builtin(nullptr) {}
 
-	FunctionCallNode() {}
-	FunctionCallNode(const std::string &name) : name(name) {}
+	std::string qualifiedName() const
+	{
+		return scope.empty() ? name : scope + "." + name;
+	}
 
 	// arguments are in children
 	DEFINE_VISIT(FunctionCallNode);
@@ -7,7 +7,7 @@ namespace pie { namespace compiler {
 
 class BlockNode;
 
-class IfNode : public Node
+class IfNode : public NodeOf<NodeKind::IfNode>
 {
 public:
 	Node *condition;
@@ -7,7 +7,7 @@
 
 namespace pie { namespace compiler {
 
-class ImportNode : public Node
+class ImportNode : public NodeOf<NodeKind::ImportNode>
 {
 public:
 	std::string module_name;
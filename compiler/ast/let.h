@@ -9,15 +9,17 @@ namespace pie { namespace compiler {
 
 class TypeNode;
 
-class LetNode : public Node
+class LetNode : public NodeOf<NodeKind::LetNode>
 {
 public:
 	std::string name;
 	TypeNode *type;
 	Node *value;
+	int depth;  // scope depth of the declaration, set by ResolveVisitor
+	int slot;   // frame slot receiving the value
 
 	LetNode(const std::string &name, TypeNode *type, Node *value)
-		: name(name), type(type), value(value)
+		: name(name), type(type), value(value), depth(-1), slot(-1)
 	{
 		if (value) push(value);
 	}
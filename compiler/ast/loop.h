@@ -0,0 +1,61 @@
+#ifndef __PIE_AST_LOOP__
+#define __PIE_AST_LOOP__
+
+#include "compiler/ast/node.h"
+
+namespace pie { namespace compiler {
+
+class BlockNode;
+
+class WhileNode : public NodeOf<NodeKind::WhileNode>
+{
+public:
+	Node *condition;
+	BlockNode *body;
+
+	WhileNode(Node *cond, BlockNode *body) : condition(cond), body(body)
+	{
+		if (cond) push(cond);
+		if (body) push(reinterpret_cast<Node*>(body));
+	}
+
+	DEFINE_VISIT(WhileNode);
+};
+
+// for (init; condition; step) body, any of the first three may be missing.
+// A let in init is only visible inside the loop.
+class ForNode : public NodeOf<NodeKind::ForNode>
+{
+public:
+	Node *init;
+	Node *condition;
+	Node *step;
+	BlockNode *body;
+
+	ForNode(Node *init, Node *cond, Node *step, BlockNode *body)
+		: init(init), condition(cond), step(step), body(body)
+	{
+		if (init) push(init);
+		if (cond) push(cond);
+		if (step) push(step);
+		if (body) push(reinterpret_cast<Node*>(body));
+	}
+
+	DEFINE_VISIT(ForNode);
+};
+
+class BreakNode : public NodeOf<NodeKind::BreakNode>
+{
+public:
+	DEFINE_VISIT(BreakNode);
+};
+
+class ContinueNode : public NodeOf<NodeKind::ContinueNode>
+{
+public:
+	DEFINE_VISIT(ContinueNode);
+};
+
+}}
+
+#endif
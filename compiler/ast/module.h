@@ -1,6 +1,7 @@
 #ifndef __PIE_AST_MODULE__
 #define __PIE_AST_MODULE__
 
+#include "compiler/arena.h"
 #include "compiler/ast/node.h"
 
 #include <string>
@@ -8,9 +9,14 @@
 
 namespace pie { namespace compiler {
 
-class ModuleNode : public Node
+// A module owns every node, type and string produced by its parse through
+// its arena: deleting the ModuleNode releases the whole tree in one go.
+// Bytecode compiled from it does not reference the AST and may outlive it.
+class ModuleNode : public NodeOf<NodeKind::ModuleNode>
 {
 public:
+	Arena arena;  // declared first so it is destroyed last
+
 	std::string name;
 	std::map<std::string, Node *> symtab;
 	std::vector<ImportNode *> imports;
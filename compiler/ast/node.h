@@ -1,6 +1,7 @@
 #ifndef __PIE_AST_NODE__
 #define __PIE_AST_NODE__
 
+#include <cassert>
 #include <vector>
 
 #define AST_NODES 				\
@@ -15,11 +16,16 @@
 	AST_NODE(IntNode)			\
 	AST_NODE(DoubleNode)		\
 	AST_NODE(StringNode)		\
+	AST_NODE(BoolNode)			\
 	AST_NODE(IdentifierNode)	\
 	AST_NODE(BinaryOpNode)		\
 	AST_NODE(UnaryOpNode)		\
 	AST_NODE(ReturnNode)		\
 	AST_NODE(IfNode)			\
+	AST_NODE(WhileNode)			\
+	AST_NODE(ForNode)			\
+	AST_NODE(BreakNode)			\
+	AST_NODE(ContinueNode)		\
 	AST_NODE(BlockNode)
 
 #define NEW_NODE(type, ...) new type ## Node(__VA_ARGS__)
@@ -43,9 +49,16 @@ class Visitor;
 AST_NODES
 #undef AST_NODE
 
+// The class of a node, one per AST_NODES entry: NodeKind::IntNode
+enum class NodeKind : unsigned char {
+	#define AST_NODE(node) node,
+	AST_NODES
+	#undef AST_NODE
+};
+
 class Node {
 public:
-	Node(): visited(0), attr(0) {}
+	explicit Node(NodeKind kind): visited(0), kind(kind), attr(0), line(0) {}
 
 	void reset()
 	{
@@ -61,11 +74,43 @@ public:
 
 public:
 	bool visited;
+	const NodeKind kind;  // of the most derived class, see isa<>()
 	int attr;
+	int line;  // in the source, 0 when unknown
 
 	std::vector<Node *> children;
 };
 
+// Base of the node classes, tags them with their kind
+template <NodeKind K>
+class NodeOf : public Node {
+public:
+	static constexpr NodeKind node_kind = K;
+
+	NodeOf(): Node(K) {}
+};
+
+// Type tests on the kind tag instead of RTTI, as in LLVM. isa<>() is false
+// and dyn_cast<>() null for a null node, cast<>() asserts the kind.
+template <class T>
+inline bool isa(const Node *node)
+{
+	return node && node->kind == T::node_kind;
+}
+
+template <class T>
+inline T *cast(Node *node)
+{
+	assert(isa<T>(node));
+	return static_cast<T *>(node);
+}
+
+template <class T>
+inline T *dyn_cast(Node *node)
+{
+	return isa<T>(node) ? static_cast<T *>(node) : nullptr;
+}
+
 class Visitor {
 public:
 	virtual void visit(Node *node) = 0;
@@ -31,17 +31,29 @@ enum class UnaryOp {
 	Neg,      // -
 	Not,      // !
 	Inc,      // ++
-	Dec       // --
+	Dec,      // --
+	CastInt,  // inserted by TypeCheckVisitor: Int only, anything else is a type error
+	CastDouble// inserted by TypeCheckVisitor: Double, or Int widened to Double
 };
 
-class BinaryOpNode : public Node
+// Operand type proven by TypeCheckVisitor, selects a specialized form of
+// the operator without tag checks or Int to Double promotion
+enum class OperandType {
+	Any,
+	Int,
+	Double
+};
+
+class BinaryOpNode : public NodeOf<NodeKind::BinaryOpNode>
 {
 public:
 	Node *lhs;
 	Node *rhs;
 	BinaryOp op;
+	OperandType operand_type;
 
-	BinaryOpNode(BinaryOp op, Node *lhs, Node *rhs) : op(op), lhs(lhs), rhs(rhs)
+	BinaryOpNode(BinaryOp op, Node *lhs, Node *rhs)
+		: lhs(lhs), rhs(rhs), op(op), operand_type(OperandType::Any)
 	{
 		push(lhs);
 		push(rhs);
@@ -50,7 +62,7 @@ public:
 	DEFINE_VISIT(BinaryOpNode);
 };
 
-class UnaryOpNode : public Node
+class UnaryOpNode : public NodeOf<NodeKind::UnaryOpNode>
 {
 public:
 	Node *expr;
@@ -7,7 +7,7 @@
 
 namespace pie { namespace compiler {
 
-class IntNode : public Node
+class IntNode : public NodeOf<NodeKind::IntNode>
 {
 public:
 	int64_t value;
@@ -17,7 +17,7 @@ public:
 	DEFINE_VISIT(IntNode);
 };
 
-class DoubleNode : public Node
+class DoubleNode : public NodeOf<NodeKind::DoubleNode>
 {
 public:
 	double value;
@@ -27,7 +27,7 @@ public:
 	DEFINE_VISIT(DoubleNode);
 };
 
-class StringNode : public Node
+class StringNode : public NodeOf<NodeKind::StringNode>
 {
 public:
 	std::string str;
@@ -37,12 +37,25 @@ public:
 	DEFINE_VISIT(StringNode);
 };
 
-class IdentifierNode : public Node
+// Has no literal syntax, only produced by constant folding
+class BoolNode : public NodeOf<NodeKind::BoolNode>
+{
+public:
+	bool value;
+
+	BoolNode(bool value) : value(value) {}
+
+	DEFINE_VISIT(BoolNode);
+};
+
+class IdentifierNode : public NodeOf<NodeKind::IdentifierNode>
 {
 public:
 	std::string name;
+	int depth;  // scope depth of the local, set by ResolveVisitor
+	int slot;   // frame slot of the local, -1 for globals
 
-	IdentifierNode(const std::string &name) : name(name) {}
+	IdentifierNode(const std::string &name) : name(name), depth(-1), slot(-1) {}
 
 	DEFINE_VISIT(IdentifierNode);
 };
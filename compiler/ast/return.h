@@ -5,7 +5,7 @@
 
 namespace pie { namespace compiler {
 
-class ReturnNode : public Node
+class ReturnNode : public NodeOf<NodeKind::ReturnNode>
 {
 public:
 	Node *expr;
@@ -7,7 +7,7 @@
 
 namespace pie { namespace compiler {
 
-class TypeNode : public Node
+class TypeNode : public NodeOf<NodeKind::TypeNode>
 {
 public:
 	std::string name;
@@ -0,0 +1,991 @@
+#include <algorithm>
+
+#include "compiler/backend/closure.h"
+#include "compiler/pass/resolve.h"
+
+namespace pie { namespace compiler {
+
+const size_t ClosureStack::kChunkSize;
+
+ClosureStack::ClosureStack() : current(0), top(nullptr)
+{
+    chunks.push_back({ std::unique_ptr<Value[]>(new Value[kChunkSize]), kChunkSize, nullptr });
+    top = chunks[0].slots.get();
+}
+
+Value *ClosureStack::advance(size_t n, Value *saved_top)
+{
+    current++;
+    size_t size = std::max(n, kChunkSize);
+    if (current == chunks.size()) {
+        chunks.push_back({ std::unique_ptr<Value[]>(new Value[size]), size, nullptr });
+    } else if (chunks[current].size < n) {
+        chunks[current].slots.reset(new Value[size]);
+        chunks[current].size = size;
+    }
+
+    chunks[current].saved_top = saved_top;
+    Value *base = chunks[current].slots.get();
+    top = base + n;
+    return base;
+}
+
+Value *ClosureStack::push(size_t n)
+{
+    const Chunk &chunk = chunks[current];
+    if (top + n <= chunk.slots.get() + chunk.size) {
+        Value *base = top;
+        top += n;
+        return base;
+    }
+    return advance(n, top);
+}
+
+Value *ClosureStack::extend(Value *base, size_t used, size_t n)
+{
+    const Chunk &chunk = chunks[current];
+    if (base + n <= chunk.slots.get() + chunk.size) {
+        top = base + n;
+        return base;
+    }
+
+    Value *moved = advance(n, base);
+    for (size_t i = 0; i < used; i++) {
+        moved[i] = std::move(base[i]);
+    }
+    return moved;
+}
+
+void ClosureStack::pop(Value *base)
+{
+    // A frame that started in an earlier chunk left the later ones empty
+    while (base < chunks[current].slots.get() || base > chunks[current].slots.get() + chunks[current].size) {
+        for (Value *slot = chunks[current].slots.get(); slot < top; slot++) {
+            *slot = Value();
+        }
+        top = chunks[current].saved_top;
+        current--;
+    }
+
+    for (Value *slot = base; slot < top; slot++) {
+        *slot = Value();
+    }
+    top = base;
+}
+
+namespace {
+
+// Binary operators, each mirrors its case in EvalVisitor::visit(BinaryOpNode*)
+struct AddOp {
+    static Value apply(const Value &lhs, const Value &rhs) {
+        if (lhs.type == Value::Type::String || rhs.type == Value::Type::String) {
+            return Value::concat(lhs, rhs);
+        }
+        if (lhs.type == Value::Type::Int && rhs.type == Value::Type::Int) {
+            return Value::makeInt(lhs.int_val + rhs.int_val);
+        }
+        return Value::makeDouble(lhs.toDouble() + rhs.toDouble());
+    }
+};
+
+#define ARITH_OP(name, OP)                                                  \
+    struct name {                                                           \
+        static Value apply(const Value &lhs, const Value &rhs) {           \
+            if (lhs.type == Value::Type::Int && rhs.type == Value::Type::Int) { \
+                return Value::makeInt(lhs.int_val OP rhs.int_val);          \
+            }                                                               \
+            return Value::makeDouble(lhs.toDouble() OP rhs.toDouble());     \
+        }                                                                   \
+    }
+
+ARITH_OP(SubOp, -);
+ARITH_OP(MulOp, *);
+
+struct DivOp {
+    static Value apply(const Value &lhs, const Value &rhs) {
+        if (rhs.toDouble() == 0.0) {
+            throw std::runtime_error("Division by zero");
+        }
+        if (lhs.type == Value::Type::Int && rhs.type == Value::Type::Int) {
+            return Value::makeInt(lhs.int_val / rhs.int_val);
+        }
+        return Value::makeDouble(lhs.toDouble() / rhs.toDouble());
+    }
+};
+
+struct ModOp {
+    static Value apply(const Value &lhs, const Value &rhs) {
+        if (rhs.toInt() == 0) {
+            throw std::runtime_error("Modulo by zero");
+        }
+        return Value::makeInt(lhs.toInt() % rhs.toInt());
+    }
+};
+
+#define COMPARE_OP(name, OP)                                                \
+    struct name {                                                           \
+        static Value apply(const Value &lhs, const Value &rhs) {           \
+            return Value::makeBool(lhs.toDouble() OP rhs.toDouble());      \
+        }                                                                   \
+    }
+
+COMPARE_OP(LtOp, <);
+COMPARE_OP(GtOp, >);
+COMPARE_OP(LeOp, <=);
+COMPARE_OP(GeOp, >=);
+
+static bool equals(const Value &lhs, const Value &rhs)
+{
+    if (lhs.type == Value::Type::String && rhs.type == Value::Type::String) {
+        return String::equals(lhs.string_val, rhs.string_val);
+    }
+    if (lhs.isNumeric() && rhs.isNumeric()) {
+        return lhs.toDouble() == rhs.toDouble();
+    }
+    return lhs.type == rhs.type && lhs.toBool() == rhs.toBool();
+}
+
+struct EqOp {
+    static Value apply(const Value &lhs, const Value &rhs) {
+        return Value::makeBool(equals(lhs, rhs));
+    }
+};
+
+struct NeOp {
+    static Value apply(const Value &lhs, const Value &rhs) {
+        return Value::makeBool(!equals(lhs, rhs));
+    }
+};
+
+// Typed forms for operands proven by TypeCheckVisitor, ints still compare
+// as doubles
+#define TYPED_OP(name, make, field, OP)                                     \
+    struct name {                                                           \
+        static Value apply(const Value &lhs, const Value &rhs) {           \
+            return Value::make(lhs.field OP rhs.field);                     \
+        }                                                                   \
+    }
+
+#define INT_COMPARE_OP(name, OP)                                            \
+    struct name {                                                           \
+        static Value apply(const Value &lhs, const Value &rhs) {           \
+            return Value::makeBool((double)lhs.int_val OP (double)rhs.int_val); \
+        }                                                                   \
+    }
+
+TYPED_OP(AddIntOp, makeInt, int_val, +);
+TYPED_OP(SubIntOp, makeInt, int_val, -);
+TYPED_OP(MulIntOp, makeInt, int_val, *);
+INT_COMPARE_OP(LtIntOp, <);
+INT_COMPARE_OP(GtIntOp, >);
+INT_COMPARE_OP(LeIntOp, <=);
+INT_COMPARE_OP(GeIntOp, >=);
+INT_COMPARE_OP(EqIntOp, ==);
+INT_COMPARE_OP(NeIntOp, !=);
+
+struct DivIntOp {
+    static Value apply(const Value &lhs, const Value &rhs) {
+        if (rhs.int_val == 0) {
+            throw std::runtime_error("Division by zero");
+        }
+        return Value::makeInt(lhs.int_val / rhs.int_val);
+    }
+};
+
+struct ModIntOp {
+    static Value apply(const Value &lhs, const Value &rhs) {
+        if (rhs.int_val == 0) {
+            throw std::runtime_error("Modulo by zero");
+        }
+        return Value::makeInt(lhs.int_val % rhs.int_val);
+    }
+};
+
+TYPED_OP(AddDoubleOp, makeDouble, double_val, +);
+TYPED_OP(SubDoubleOp, makeDouble, double_val, -);
+TYPED_OP(MulDoubleOp, makeDouble, double_val, *);
+TYPED_OP(LtDoubleOp, makeBool, double_val, <);
+TYPED_OP(GtDoubleOp, makeBool, double_val, >);
+TYPED_OP(LeDoubleOp, makeBool, double_val, <=);
+TYPED_OP(GeDoubleOp, makeBool, double_val, >=);
+TYPED_OP(EqDoubleOp, makeBool, double_val, ==);
+TYPED_OP(NeDoubleOp, makeBool, double_val, !=);
+
+struct DivDoubleOp {
+    static Value apply(const Value &lhs, const Value &rhs) {
+        if (rhs.double_val == 0.0) {
+            throw std::runtime_error("Division by zero");
+        }
+        return Value::makeDouble(lhs.double_val / rhs.double_val);
+    }
+};
+
+#undef ARITH_OP
+#undef COMPARE_OP
+#undef TYPED_OP
+#undef INT_COMPARE_OP
+
+// How an operand is read: a local and a constant are used in place, any
+// other expression is evaluated into a temporary
+struct Operand {
+    enum Kind { Expr, Local, Const };
+
+    Kind kind;
+    ClosureExpr expr;
+    int slot;
+    Value value;
+};
+
+struct ExprOperand {
+    ClosureExpr expr;
+    const Value &get(ClosureFrame &frame, Value &tmp) const { tmp = expr(frame); return tmp; }
+};
+
+struct LocalOperand {
+    int slot;
+    const Value &get(ClosureFrame &frame, Value &) const { return frame.slots[slot]; }
+};
+
+struct ConstOperand {
+    Value value;
+    const Value &get(ClosureFrame &, Value &) const { return value; }
+};
+
+template <typename Op, typename L, typename R>
+static ClosureExpr bind(L lhs, R rhs)
+{
+    return [lhs, rhs](ClosureFrame &frame) -> Value {
+        Value lhs_tmp, rhs_tmp;
+        const Value &a = lhs.get(frame, lhs_tmp);
+        const Value &b = rhs.get(frame, rhs_tmp);
+        return Op::apply(a, b);
+    };
+}
+
+template <typename Op, typename L>
+static ClosureExpr bindRhs(L lhs, const Operand &rhs)
+{
+    switch (rhs.kind) {
+        case Operand::Local: return bind<Op>(lhs, LocalOperand{ rhs.slot });
+        case Operand::Const: return bind<Op>(lhs, ConstOperand{ rhs.value });
+        default: return bind<Op>(lhs, ExprOperand{ rhs.expr });
+    }
+}
+
+template <typename Op>
+static ClosureExpr binary(const Operand &lhs, const Operand &rhs)
+{
+    // A local read in place must not change before the rhs is read
+    if (lhs.kind == Operand::Local && rhs.kind != Operand::Expr) {
+        return bindRhs<Op>(LocalOperand{ lhs.slot }, rhs);
+    }
+    return bindRhs<Op>(ExprOperand{ lhs.expr }, rhs);
+}
+
+// Mirrors += and -= in EvalVisitor::visit(BinaryOpNode*)
+static Value update(bool add, OperandType type, const Value &current, const Value &rhs)
+{
+    if (type == OperandType::Int) {
+        return Value::makeInt(add ? current.int_val + rhs.int_val : current.int_val - rhs.int_val);
+    }
+    if (type == OperandType::Double) {
+        return Value::makeDouble(add ? current.double_val + rhs.double_val : current.double_val - rhs.double_val);
+    }
+    if (current.type == Value::Type::Int && rhs.type == Value::Type::Int) {
+        return Value::makeInt(add ? current.int_val + rhs.int_val : current.int_val - rhs.int_val);
+    }
+    return Value::makeDouble(add ? current.toDouble() + rhs.toDouble() : current.toDouble() - rhs.toDouble());
+}
+
+// Pops the frame of a call however it is left
+class FramePop {
+public:
+    FramePop(ClosureStack &stack, Value *base) : stack(stack), base(base) {}
+    ~FramePop() { stack.pop(base); }
+
+private:
+    ClosureStack &stack;
+    Value *base;
+};
+
+}
+
+ClosureCompilerVisitor::ClosureCompilerVisitor() : current_module(nullptr), profiler(nullptr)
+{
+}
+
+Value ClosureCompilerVisitor::run(ModuleNode *module)
+{
+    current_module = module;
+
+    ResolveVisitor resolver;
+    resolver.resolve(module);
+
+    for (FunctionNode *fn : module->functions) {
+        global_env.define(fn->name, Value::makeFunction(fn));
+    }
+
+    for (FunctionNode *fn : module->functions) {
+        compile(fn);
+    }
+
+    auto it = module->symtab.find("main");
+    if (it != module->symtab.end()) {
+        FunctionNode *main_fn = dyn_cast<FunctionNode>(it->second);
+        if (main_fn) {
+            return call(compile(main_fn), stack.push(0), 0);
+        }
+    }
+
+    return Value::makeNil();
+}
+
+ClosureFunction *ClosureCompilerVisitor::compile(FunctionNode *fn)
+{
+    std::unique_ptr<ClosureFunction> &entry = functions[fn];
+    if (entry) return entry.get();
+
+    entry.reset(new ClosureFunction());
+    entry->node = fn;
+    entry->frame_size = fn->frame_size;
+    for (Node *child : fn->children) {
+        if (child) entry->body.push_back(compileStatement(child));
+    }
+    return entry.get();
+}
+
+// The arguments are in args[0 .. nargs), they become the first slots of
+// the callee's frame
+Value ClosureCompilerVisitor::call(ClosureFunction *fn, Value *args, size_t nargs)
+{
+    Value *base = stack.extend(args, nargs, std::max(fn->frame_size, nargs));
+    FramePop pop(stack, base);
+    ProfileScope scope(profiler, fn->node);
+
+    ClosureFrame frame{ base, Value(), nullptr, nullptr, 0, Unwind::None };
+    for (;;) {
+        bool returned = false;
+        for (const ClosureStmt &stmt : fn->body) {
+            if (stmt(frame)) {
+                returned = true;
+                break;
+            }
+        }
+        if (!frame.tail) {
+            return returned ? std::move(frame.ret) : Value::makeNil();
+        }
+
+        // A tail call replaces this frame, so tail recursion runs in
+        // constant stack
+        fn = frame.tail;
+        nargs = frame.tail_nargs;
+        if (profiler) profiler->replace(fn->node);
+        tail_args.assign(std::make_move_iterator(frame.tail_args),
+                         std::make_move_iterator(frame.tail_args + nargs));
+        frame.tail = nullptr;
+
+        stack.pop(base);
+        args = stack.push(nargs);
+        for (size_t i = 0; i < nargs; i++) {
+            args[i] = std::move(tail_args[i]);
+        }
+        base = stack.extend(args, nargs, std::max(fn->frame_size, nargs));
+        frame.slots = base;
+    }
+}
+
+Value ClosureCompilerVisitor::callBuiltin(const Builtin *builtin, Value *args, size_t nargs)
+{
+    checkArity(builtin, nargs);
+    Value value = builtin->fn(Args{ args, nargs });
+    stack.pop(args);
+    return value;
+}
+
+// Mirrors EvalVisitor::linkCall()
+bool ClosureCompilerVisitor::linkCall(FunctionCallNode *node, CallSite *site)
+{
+    std::string name = node->qualifiedName();
+    site->function = nullptr;
+    site->builtin = nullptr;
+
+    const Value *callee = global_env.find(name);
+    if (callee) {
+        if (callee->type == Value::Type::Function) {
+            site->function = compile(callee->function_val);
+        } else if (callee->type == Value::Type::BuiltinFunction) {
+            site->builtin = callee->builtin_val;
+        }
+    } else if (const Builtin *builtin = findBuiltin(name)) {
+        site->builtin = builtin;
+    } else {
+        auto it = current_module->symtab.find(name);
+        if (it == current_module->symtab.end()) return false;
+        FunctionNode *target = dyn_cast<FunctionNode>(it->second);
+        if (!target) return false;
+        site->function = compile(target);
+    }
+
+    site->epoch = global_env.epoch();
+    return true;
+}
+
+ClosureExpr ClosureCompilerVisitor::compileExpr(Node *node)
+{
+    if (!node) {
+        return [](ClosureFrame &) { return Value::makeNil(); };
+    }
+
+    expr = nullptr;
+    stmt = nullptr;
+    node->visit(this);
+
+    if (!expr) {
+        ClosureStmt run = stmt;
+        return [run](ClosureFrame &frame) { run(frame); return Value::makeNil(); };
+    }
+    ClosureExpr result = std::move(expr);
+    expr = nullptr;
+    return result;
+}
+
+ClosureStmt ClosureCompilerVisitor::compileStatement(Node *node)
+{
+    expr = nullptr;
+    stmt = nullptr;
+    node->visit(this);
+
+    if (!stmt) {
+        ClosureExpr value = std::move(expr);
+        expr = nullptr;
+        return [value](ClosureFrame &frame) { value(frame); return false; };
+    }
+    ClosureStmt result = std::move(stmt);
+    stmt = nullptr;
+    return result;
+}
+
+ClosureStmt ClosureCompilerVisitor::compileStatements(const std::vector<Node *> &nodes)
+{
+    std::vector<ClosureStmt> list;
+    for (Node *node : nodes) {
+        if (node) list.push_back(compileStatement(node));
+    }
+
+    if (list.empty()) {
+        return [](ClosureFrame &) { return false; };
+    }
+    if (list.size() == 1) {
+        return list[0];
+    }
+    return [list](ClosureFrame &frame) {
+        for (const ClosureStmt &stmt : list) {
+            if (stmt(frame)) return true;
+        }
+        return false;
+    };
+}
+
+// A tail call of a function hands it to the caller's call() loop through
+// the frame and returns nil
+ClosureExpr ClosureCompilerVisitor::compileCall(FunctionCallNode *node, bool tail)
+{
+    std::vector<ClosureExpr> args;
+    for (Node *child : node->children) {
+        args.push_back(compileExpr(child));
+    }
+
+    std::string name = node->qualifiedName();
+
+    if (node->slot >= 0) {
+        int slot = node->slot;
+        return [this, args, slot, name, tail](ClosureFrame &frame) -> Value {
+            size_t nargs = args.size();
+            Value *argv = stack.push(nargs);
+            try {
+                for (size_t i = 0; i < nargs; i++) {
+                    argv[i] = args[i](frame);
+                }
+            } catch (...) {
+                stack.pop(argv);
+                throw;
+            }
+
+            const Value &callee = frame.slots[slot];
+            if (callee.type == Value::Type::Function) {
+                ClosureFunction *fn = compile(callee.function_val);
+                if (tail) {
+                    frame.tail = fn;
+                    frame.tail_args = argv;
+                    frame.tail_nargs = nargs;
+                    return Value();
+                }
+                return call(fn, argv, nargs);
+            }
+            if (callee.type == Value::Type::BuiltinFunction) {
+                return callBuiltin(callee.builtin_val, argv, nargs);
+            }
+            stack.pop(argv);
+            throw std::runtime_error("Not a function: " + name);
+        };
+    }
+
+    call_sites.emplace_back(new CallSite{ 0, nullptr, nullptr });
+    CallSite *site = call_sites.back().get();
+    return [this, args, site, node, name, tail](ClosureFrame &frame) -> Value {
+        size_t nargs = args.size();
+        Value *argv = stack.push(nargs);
+        try {
+            for (size_t i = 0; i < nargs; i++) {
+                argv[i] = args[i](frame);
+            }
+        } catch (...) {
+            stack.pop(argv);
+            throw;
+        }
+
+        if (site->epoch != global_env.epoch() && !linkCall(node, site)) {
+            stack.pop(argv);
+            throw std::runtime_error("Undefined function: " + name);
+        }
+        if (site->function) {
+            if (tail) {
+                frame.tail = site->function;
+                frame.tail_args = argv;
+                frame.tail_nargs = nargs;
+                return Value();
+            }
+            return call(site->function, argv, nargs);
+        }
+        if (site->builtin) {
+            return callBuiltin(site->builtin, argv, nargs);
+        }
+        stack.pop(argv);
+        throw std::runtime_error("Not a function: " + name);
+    };
+}
+
+ClosureExpr ClosureCompilerVisitor::compileUpdate(BinaryOpNode *node)
+{
+    IdentifierNode *id = dyn_cast<IdentifierNode>(node->lhs);
+    if (!id) {
+        return [](ClosureFrame &) -> Value {
+            throw std::runtime_error("Invalid assignment target");
+        };
+    }
+
+    ClosureExpr rhs = compileExpr(node->rhs);
+    bool add = node->op == BinaryOp::AddAssign;
+    OperandType type = node->operand_type;
+
+    // The current value is read before the rhs runs, like the evaluator
+    if (id->slot >= 0) {
+        int slot = id->slot;
+        return [rhs, slot, add, type](ClosureFrame &frame) {
+            Value current = frame.slots[slot];
+            Value value = update(add, type, current, rhs(frame));
+            frame.slots[slot] = value;
+            return value;
+        };
+    }
+
+    std::string name = id->name;
+    return [this, rhs, name, add, type](ClosureFrame &frame) {
+        Value current = global_env.get(name);
+        Value value = update(add, type, current, rhs(frame));
+        global_env.set(name, value);
+        return value;
+    };
+}
+
+void ClosureCompilerVisitor::visit(Node *node)
+{
+    if (node) {
+        node->visit(this);
+    }
+}
+
+void ClosureCompilerVisitor::visit(ModuleNode *node)
+{
+    expr = [](ClosureFrame &) { return Value::makeNil(); };
+}
+
+void ClosureCompilerVisitor::visit(ImportNode *node)
+{
+    expr = [](ClosureFrame &) { return Value::makeNil(); };
+}
+
+void ClosureCompilerVisitor::visit(FunctionNode *node)
+{
+    expr = [node](ClosureFrame &) { return Value::makeFunction(node); };
+}
+
+void ClosureCompilerVisitor::visit(ClosureNode *node)
+{
+    // The parser makes none, a tree that has one is not run wrong
+    expr = [](ClosureFrame &) -> Value {
+        throw std::runtime_error("Closures are not supported");
+    };
+}
+
+void ClosureCompilerVisitor::visit(FunctionCallNode *node)
+{
+    expr = compileCall(node);
+}
+
+void ClosureCompilerVisitor::visit(AssignNode *node)
+{
+    ClosureExpr value = compileExpr(node->value);
+
+    IdentifierNode *id = dyn_cast<IdentifierNode>(node->var);
+    if (!id) {
+        expr = [value](ClosureFrame &frame) -> Value {
+            value(frame);
+            throw std::runtime_error("Invalid assignment target");
+        };
+    } else if (id->slot >= 0) {
+        int slot = id->slot;
+        expr = [value, slot](ClosureFrame &frame) {
+            Value result = value(frame);
+            frame.slots[slot] = result;
+            return result;
+        };
+    } else {
+        std::string name = id->name;
+        expr = [this, value, name](ClosureFrame &frame) {
+            Value result = value(frame);
+            global_env.set(name, result);
+            return result;
+        };
+    }
+}
+
+void ClosureCompilerVisitor::visit(LetNode *node)
+{
+    int slot = node->slot;
+    if (!node->value) {
+        stmt = [slot](ClosureFrame &frame) { frame.slots[slot] = Value::makeNil(); return false; };
+        return;
+    }
+
+    ClosureExpr value = compileExpr(node->value);
+    stmt = [value, slot](ClosureFrame &frame) { frame.slots[slot] = value(frame); return false; };
+}
+
+void ClosureCompilerVisitor::visit(TypeNode *node)
+{
+    expr = [](ClosureFrame &) { return Value::makeNil(); };
+}
+
+void ClosureCompilerVisitor::visit(IntNode *node)
+{
+    Value value = Value::makeInt(node->value);
+    expr = [value](ClosureFrame &) { return value; };
+}
+
+void ClosureCompilerVisitor::visit(DoubleNode *node)
+{
+    Value value = Value::makeDouble(node->value);
+    expr = [value](ClosureFrame &) { return value; };
+}
+
+void ClosureCompilerVisitor::visit(StringNode *node)
+{
+    Value value = Value::makeString(node->str);
+    expr = [value](ClosureFrame &) { return value; };
+}
+
+void ClosureCompilerVisitor::visit(BoolNode *node)
+{
+    Value value = Value::makeBool(node->value);
+    expr = [value](ClosureFrame &) { return value; };
+}
+
+void ClosureCompilerVisitor::visit(IdentifierNode *node)
+{
+    if (node->slot >= 0) {
+        int slot = node->slot;
+        expr = [slot](ClosureFrame &frame) { return frame.slots[slot]; };
+    } else {
+        std::string name = node->name;
+        expr = [this, name](ClosureFrame &) { return global_env.get(name); };
+    }
+}
+
+void ClosureCompilerVisitor::visit(BinaryOpNode *node)
+{
+    if (node->op == BinaryOp::AddAssign || node->op == BinaryOp::SubAssign) {
+        expr = compileUpdate(node);
+        return;
+    }
+
+    ClosureExpr lhs_expr = compileExpr(node->lhs);
+    ClosureExpr rhs_expr = compileExpr(node->rhs);
+
+    switch (node->op) {
+        case BinaryOp::And:
+            expr = [lhs_expr, rhs_expr](ClosureFrame &frame) {
+                if (!lhs_expr(frame).toBool()) return Value::makeBool(false);
+                return Value::makeBool(rhs_expr(frame).toBool());
+            };
+            return;
+
+        case BinaryOp::Or:
+            expr = [lhs_expr, rhs_expr](ClosureFrame &frame) {
+                if (lhs_expr(frame).toBool()) return Value::makeBool(true);
+                return Value::makeBool(rhs_expr(frame).toBool());
+            };
+            return;
+
+        case BinaryOp::Assign:
+            // Should be handled by AssignNode
+            expr = [lhs_expr, rhs_expr](ClosureFrame &frame) {
+                lhs_expr(frame);
+                return rhs_expr(frame);
+            };
+            return;
+
+        default:
+            break;
+    }
+
+    auto operand = [](Node *node, const ClosureExpr &compiled) {
+        Operand operand{ Operand::Expr, compiled, -1, Value() };
+        IdentifierNode *id = dyn_cast<IdentifierNode>(node);
+        if (id && id->slot >= 0) {
+            operand.kind = Operand::Local;
+            operand.slot = id->slot;
+        } else if (IntNode *lit = dyn_cast<IntNode>(node)) {
+            operand.kind = Operand::Const;
+            operand.value = Value::makeInt(lit->value);
+        } else if (DoubleNode *lit = dyn_cast<DoubleNode>(node)) {
+            operand.kind = Operand::Const;
+            operand.value = Value::makeDouble(lit->value);
+        }
+        return operand;
+    };
+    Operand lhs = operand(node->lhs, lhs_expr);
+    Operand rhs = operand(node->rhs, rhs_expr);
+
+    if (node->operand_type == OperandType::Int) {
+        switch (node->op) {
+            case BinaryOp::Add: expr = binary<AddIntOp>(lhs, rhs); return;
+            case BinaryOp::Sub: expr = binary<SubIntOp>(lhs, rhs); return;
+            case BinaryOp::Mul: expr = binary<MulIntOp>(lhs, rhs); return;
+            case BinaryOp::Div: expr = binary<DivIntOp>(lhs, rhs); return;
+            case BinaryOp::Mod: expr = binary<ModIntOp>(lhs, rhs); return;
+            case BinaryOp::Lt: expr = binary<LtIntOp>(lhs, rhs); return;
+            case BinaryOp::Gt: expr = binary<GtIntOp>(lhs, rhs); return;
+            case BinaryOp::Le: expr = binary<LeIntOp>(lhs, rhs); return;
+            case BinaryOp::Ge: expr = binary<GeIntOp>(lhs, rhs); return;
+            case BinaryOp::Eq: expr = binary<EqIntOp>(lhs, rhs); return;
+            case BinaryOp::Ne: expr = binary<NeIntOp>(lhs, rhs); return;
+            default: break;
+        }
+    } else if (node->operand_type == OperandType::Double) {
+        switch (node->op) {
+            case BinaryOp::Add: expr = binary<AddDoubleOp>(lhs, rhs); return;
+            case BinaryOp::Sub: expr = binary<SubDoubleOp>(lhs, rhs); return;
+            case BinaryOp::Mul: expr = binary<MulDoubleOp>(lhs, rhs); return;
+            case BinaryOp::Div: expr = binary<DivDoubleOp>(lhs, rhs); return;
+            case BinaryOp::Lt: expr = binary<LtDoubleOp>(lhs, rhs); return;
+            case BinaryOp::Gt: expr = binary<GtDoubleOp>(lhs, rhs); return;
+            case BinaryOp::Le: expr = binary<LeDoubleOp>(lhs, rhs); return;
+            case BinaryOp::Ge: expr = binary<GeDoubleOp>(lhs, rhs); return;
+            case BinaryOp::Eq: expr = binary<EqDoubleOp>(lhs, rhs); return;
+            case BinaryOp::Ne: expr = binary<NeDoubleOp>(lhs, rhs); return;
+            default: break;
+        }
+    }
+
+    switch (node->op) {
+        case BinaryOp::Add: expr = binary<AddOp>(lhs, rhs); return;
+        case BinaryOp::Sub: expr = binary<SubOp>(lhs, rhs); return;
+        case BinaryOp::Mul: expr = binary<MulOp>(lhs, rhs); return;
+        case BinaryOp::Div: expr = binary<DivOp>(lhs, rhs); return;
+        case BinaryOp::Mod: expr = binary<ModOp>(lhs, rhs); return;
+        case BinaryOp::Lt: expr = binary<LtOp>(lhs, rhs); return;
+        case BinaryOp::Gt: expr = binary<GtOp>(lhs, rhs); return;
+        case BinaryOp::Le: expr = binary<LeOp>(lhs, rhs); return;
+        case BinaryOp::Ge: expr = binary<GeOp>(lhs, rhs); return;
+        case BinaryOp::Eq: expr = binary<EqOp>(lhs, rhs); return;
+        case BinaryOp::Ne: expr = binary<NeOp>(lhs, rhs); return;
+        default:
+            expr = [lhs_expr, rhs_expr](ClosureFrame &frame) -> Value {
+                lhs_expr(frame);
+                rhs_expr(frame);
+                throw std::runtime_error("Unknown binary operator");
+            };
+            return;
+    }
+}
+
+void ClosureCompilerVisitor::visit(UnaryOpNode *node)
+{
+    ClosureExpr value = compileExpr(node->expr);
+
+    switch (node->op) {
+        case UnaryOp::Neg:
+            expr = [value](ClosureFrame &frame) {
+                Value val = value(frame);
+                if (val.type == Value::Type::Int) return Value::makeInt(-val.int_val);
+                return Value::makeDouble(-val.toDouble());
+            };
+            break;
+
+        case UnaryOp::Not:
+            expr = [value](ClosureFrame &frame) { return Value::makeBool(!value(frame).toBool()); };
+            break;
+
+        case UnaryOp::CastInt:
+            expr = [value](ClosureFrame &frame) {
+                Value val = value(frame);
+                if (val.type != Value::Type::Int) {
+                    throw std::runtime_error(std::string("Type error: expected int, got ") + val.typeName());
+                }
+                return val;
+            };
+            break;
+
+        case UnaryOp::CastDouble:
+            expr = [value](ClosureFrame &frame) {
+                Value val = value(frame);
+                if (val.type == Value::Type::Int) return Value::makeDouble((double)val.int_val);
+                if (val.type != Value::Type::Double) {
+                    throw std::runtime_error(std::string("Type error: expected double, got ") + val.typeName());
+                }
+                return val;
+            };
+            break;
+
+        case UnaryOp::Inc:
+        case UnaryOp::Dec:
+            // As for closures
+            expr = [](ClosureFrame &) -> Value {
+                throw std::runtime_error("Increment and decrement are not supported");
+            };
+            break;
+
+        default:
+            expr = [value](ClosureFrame &frame) -> Value {
+                value(frame);
+                throw std::runtime_error("Unknown unary operator");
+            };
+            break;
+    }
+}
+
+void ClosureCompilerVisitor::visit(ReturnNode *node)
+{
+    if (!node->expr) {
+        stmt = [](ClosureFrame &frame) { frame.ret = Value::makeNil(); return true; };
+        return;
+    }
+
+    FunctionCallNode *call = dyn_cast<FunctionCallNode>(node->expr);
+    if (call) {
+        ClosureExpr value = compileCall(call, true);
+        stmt = [value](ClosureFrame &frame) {
+            Value result = value(frame);
+            if (!frame.tail) frame.ret = std::move(result);
+            return true;
+        };
+        return;
+    }
+
+    ClosureExpr value = compileExpr(node->expr);
+    stmt = [value](ClosureFrame &frame) { frame.ret = value(frame); return true; };
+}
+
+void ClosureCompilerVisitor::visit(IfNode *node)
+{
+    ClosureExpr cond = compileExpr(node->condition);
+    ClosureStmt then_stmt = node->then_block
+        ? compileStatements(node->then_block->children)
+        : ClosureStmt([](ClosureFrame &) { return false; });
+
+    if (!node->else_block) {
+        stmt = [cond, then_stmt](ClosureFrame &frame) {
+            return cond(frame).toBool() ? then_stmt(frame) : false;
+        };
+        return;
+    }
+
+    ClosureStmt else_stmt = compileStatement(node->else_block);
+    stmt = [cond, then_stmt, else_stmt](ClosureFrame &frame) {
+        return cond(frame).toBool() ? then_stmt(frame) : else_stmt(frame);
+    };
+}
+
+void ClosureCompilerVisitor::visit(BlockNode *node)
+{
+    stmt = compileStatements(node->children);
+}
+
+ClosureStmt ClosureCompilerVisitor::compileBody(BlockNode *body)
+{
+    if (!body) {
+        return [](ClosureFrame &) { return false; };
+    }
+    return compileStatements(body->children);
+}
+
+void ClosureCompilerVisitor::visit(WhileNode *node)
+{
+    ClosureExpr cond = compileExpr(node->condition);
+    ClosureStmt body = compileBody(node->body);
+
+    stmt = [cond, body](ClosureFrame &frame) {
+        while (cond(frame).toBool()) {
+            if (body(frame)) {
+                if (frame.jump == Unwind::None) return true;
+                if (frame.jump == Unwind::Break) {
+                    frame.jump = Unwind::None;
+                    break;
+                }
+                frame.jump = Unwind::None;
+            }
+        }
+        return false;
+    };
+}
+
+void ClosureCompilerVisitor::visit(ForNode *node)
+{
+    ClosureStmt init = node->init
+        ? compileStatement(node->init)
+        : ClosureStmt([](ClosureFrame &) { return false; });
+    ClosureExpr cond = node->condition
+        ? compileExpr(node->condition)
+        : ClosureExpr([](ClosureFrame &) { return Value::makeBool(true); });
+    ClosureExpr step = node->step
+        ? compileExpr(node->step)
+        : ClosureExpr([](ClosureFrame &) { return Value(); });
+    ClosureStmt body = compileBody(node->body);
+
+    stmt = [init, cond, step, body](ClosureFrame &frame) {
+        for (init(frame); cond(frame).toBool(); step(frame)) {
+            if (body(frame)) {
+                if (frame.jump == Unwind::None) return true;
+                if (frame.jump == Unwind::Break) {
+                    frame.jump = Unwind::None;
+                    break;
+                }
+                frame.jump = Unwind::None;
+            }
+        }
+        return false;
+    };
+}
+
+void ClosureCompilerVisitor::visit(BreakNode *node)
+{
+    stmt = [](ClosureFrame &frame) { frame.jump = Unwind::Break; return true; };
+}
+
+void ClosureCompilerVisitor::visit(ContinueNode *node)
+{
+    stmt = [](ClosureFrame &frame) { frame.jump = Unwind::Continue; return true; };
+}
+
+}}
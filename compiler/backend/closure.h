@@ -0,0 +1,126 @@
+#ifndef __PIE_BACKEND_CLOSURE__
+#define __PIE_BACKEND_CLOSURE__
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "compiler/ast.h"
+#include "compiler/backend/eval.h"
+
+namespace pie { namespace compiler {
+
+struct ClosureFunction;
+
+// Locals of a running call, slots were assigned by ResolveVisitor
+struct ClosureFrame {
+    Value *slots;
+    Value ret;  // set by a return statement
+
+    // Set by return f(...) instead of ret: the call that replaces this
+    // one, its arguments are on the stack above the frame
+    ClosureFunction *tail;
+    Value *tail_args;
+    size_t tail_nargs;
+    Unwind jump;  // Break or Continue, reset by the innermost loop
+};
+
+// Compiled expressions return their value, statements return true once a
+// return ran and left its value in the frame, or a break or continue set
+// frame.jump
+typedef std::function<Value(ClosureFrame &)> ClosureExpr;
+typedef std::function<bool(ClosureFrame &)> ClosureStmt;
+
+struct ClosureFunction {
+    FunctionNode *node;
+    size_t frame_size;
+    std::vector<ClosureStmt> body;
+};
+
+// Stack of call frames in fixed chunks, so a frame never moves while its
+// function runs. Slots above the top are always nil.
+class ClosureStack {
+public:
+    ClosureStack();
+
+    Value *push(size_t n);
+    // Grows the top frame at base from used to n slots, it may move
+    Value *extend(Value *base, size_t used, size_t n);
+    // Drops every slot from base up, releasing their values
+    void pop(Value *base);
+
+private:
+    struct Chunk {
+        std::unique_ptr<Value[]> slots;
+        size_t size;
+        Value *saved_top;  // top of the previous chunk when this one was entered
+    };
+
+    static const size_t kChunkSize = 64 * 1024;
+
+    std::vector<Chunk> chunks;
+    size_t current;
+    Value *top;
+
+    Value *advance(size_t n, Value *saved_top);
+};
+
+// Execution engine that compiles every function once into a tree of
+// pre-bound callables instead of visiting the AST on each run.
+//
+// Operators are picked when compiling: typed forms for operands proven by
+// TypeCheckVisitor, direct reads for local and constant operands. Runtime
+// behaviour and error messages match EvalVisitor; there is no debugger.
+class ClosureCompilerVisitor : public Visitor
+{
+public:
+    ClosureCompilerVisitor();
+
+    // Every call is recorded on the stack of profiler, see Profiler
+    void setProfiler(Profiler *profiler) { this->profiler = profiler; }
+
+    Value run(ModuleNode *module);
+
+    void visit(Node *node) override;
+
+    #define AST_NODE DECLARE_VISIT
+    AST_NODES
+    #undef AST_NODE
+
+private:
+    // Inline cache of a call to a global, see FunctionCallNode
+    struct CallSite {
+        uint64_t epoch;
+        ClosureFunction *function;
+        const Builtin *builtin;
+    };
+
+    Environment global_env;
+    ModuleNode *current_module;
+    Profiler *profiler;
+    std::map<FunctionNode *, std::unique_ptr<ClosureFunction>> functions;
+    std::vector<std::unique_ptr<CallSite>> call_sites;
+    ClosureStack stack;
+    std::vector<Value> tail_args;  // arguments of a tail call in flight
+
+    ClosureExpr expr;  // closure of the visited expression
+    ClosureStmt stmt;  // closure of the visited statement
+
+    ClosureFunction *compile(FunctionNode *fn);
+    ClosureExpr compileExpr(Node *node);
+    ClosureStmt compileStatement(Node *node);
+    ClosureStmt compileStatements(const std::vector<Node *> &nodes);
+    ClosureStmt compileBody(BlockNode *body);
+    ClosureExpr compileUpdate(BinaryOpNode *node);
+    ClosureExpr compileCall(FunctionCallNode *node, bool tail = false);
+
+    bool linkCall(FunctionCallNode *node, CallSite *site);
+    Value call(ClosureFunction *fn, Value *args, size_t nargs);
+    Value callBuiltin(const Builtin *builtin, Value *args, size_t nargs);
+};
+
+}}
+
+#endif
@@ -1,24 +1,48 @@
 #include "compiler/backend/eval.h"
 #include "compiler/backend/print.h"
+#include "compiler/pass/resolve.h"
+#include "runtime/io.h"
+#include <algorithm>
 #include <iostream>
 #include <cstdlib>
 #include <sstream>
 #include <cctype>
+#include <cstring>
 
 namespace pie { namespace compiler {
 
-EvalVisitor::EvalVisitor()
-    : env(&global_env), current_module(nullptr), debug_mode(false), debug_continue(false), debug_step(0), debug_depth(0)
+template <class Debug>
+BasicEvalVisitor<Debug>::BasicEvalVisitor()
+    : unwind(Unwind::None), tail_function(nullptr), tail_nargs(0),
+      current_module(nullptr), frame_base(0), stack_top(0),
+      jit_enabled(false), jit_threshold(JitCompiler::kDefaultThreshold), profiler(nullptr),
+      debug_continue(false), debug_step(0), debug_depth(0), debug_frame(0), break_entered(nullptr)
 {
-    registerBuiltins();
+    stack.resize(1024);
 }
 
-void EvalVisitor::setDebugMode(bool enabled)
+template <class Debug>
+void BasicEvalVisitor<Debug>::breakAtLine(int line)
 {
-    debug_mode = enabled;
-    debug_continue = false;
-    debug_step = 0;
-    debug_depth = 0;
+    if (line <= 0) return;
+    if ((size_t)line >= break_lines.size()) break_lines.resize(line + 1);
+    break_lines[line] = true;
+    if (!current_module) debug_continue = true;
+}
+
+template <class Debug>
+void BasicEvalVisitor<Debug>::breakAtFunction(const std::string &name)
+{
+    break_names.insert(name);
+    if (!current_module) debug_continue = true;
+    if (current_module) debugFindFunctions();
+}
+
+template <class Debug>
+void BasicEvalVisitor<Debug>::setJit(bool enabled, uint32_t threshold)
+{
+    jit_enabled = enabled;
+    jit_threshold = threshold;
 }
 
 static std::string trimLine(const std::string &line)
@@ -40,19 +64,20 @@ static std::string trimLine(const std::string &line)
     return line.substr(start, end - start);
 }
 
-std::string EvalVisitor::debugNodeText(Node *node)
+template <class Debug>
+std::string BasicEvalVisitor<Debug>::debugNodeText(Node *node)
 {
     if (!node) {
         return "<null>";
     }
 
-    if (ModuleNode *module = dynamic_cast<ModuleNode*>(node)) {
+    if (ModuleNode *module = dyn_cast<ModuleNode>(node)) {
         return "module " + module->name;
     }
-    if (FunctionNode *fn = dynamic_cast<FunctionNode*>(node)) {
+    if (FunctionNode *fn = dyn_cast<FunctionNode>(node)) {
         return "fn " + fn->name;
     }
-    if (BlockNode *block = dynamic_cast<BlockNode*>(node)) {
+    if (BlockNode *block = dyn_cast<BlockNode>(node)) {
         std::stringstream ss;
         ss << "block(" << block->children.size() << " statements)";
         return ss.str();
@@ -72,76 +97,199 @@ std::string EvalVisitor::debugNodeText(Node *node)
     return "<node>";
 }
 
-void EvalVisitor::debugPrintEnvironment() const
+template <class Debug>
+void BasicEvalVisitor<Debug>::debugPrintEnvironment() const
 {
     std::cout << "      scope chain:" << std::endl;
 
-    const Environment *scope = env;
-    size_t depth = 0;
-    while (scope) {
-        std::cout << "        [scope " << depth << "]";
-        const auto &vars = scope->variables();
-        if (vars.empty()) {
+    // Locals of the running call, innermost block first
+    int innermost = 0;
+    for (size_t i = debug_frame; i < debug_locals.size(); i++) {
+        if (debug_locals[i].depth > innermost) innermost = debug_locals[i].depth;
+    }
+
+    size_t scope = 0;
+    for (int depth = innermost; depth >= 0; depth--, scope++) {
+        std::cout << "        [scope " << scope << "]";
+        bool empty = true;
+        for (size_t i = debug_frame; i < debug_locals.size(); i++) {
+            if (debug_locals[i].depth == depth) empty = false;
+        }
+        if (empty) {
             std::cout << " (empty)";
         }
         std::cout << std::endl;
 
-        for (const auto &entry : vars) {
-            std::cout << "          " << entry.first << " = " << entry.second.toString() << std::endl;
+        for (size_t i = debug_frame; i < debug_locals.size(); i++) {
+            const DebugLocal &local = debug_locals[i];
+            if (local.depth != depth) continue;
+            std::cout << "          " << local.name << " = " << stack[frame_base + local.slot].toString() << std::endl;
         }
+    }
+
+    std::cout << "        [scope " << scope << "]";
+    const auto &vars = global_env.variables();
+    if (vars.empty()) {
+        std::cout << " (empty)";
+    }
+    std::cout << std::endl;
 
-        scope = scope->parentEnv();
-        depth++;
+    for (const auto &entry : vars) {
+        std::cout << "          " << entry.first << " = " << entry.second.toString() << std::endl;
     }
 }
 
-void EvalVisitor::debugPrintHelp() const
+template <class Debug>
+void BasicEvalVisitor<Debug>::debugPrintHelp() const
 {
     std::cout << "[debug] commands:" << std::endl;
     std::cout << "        s/step (or empty): step to next node" << std::endl;
-    std::cout << "        c/continue: run without stopping" << std::endl;
+    std::cout << "        c/continue: run to the next breakpoint" << std::endl;
+    std::cout << "        b <line>, b <function>: stop at a line or on entering a function" << std::endl;
+    std::cout << "        d <line>, d <function>: delete a breakpoint" << std::endl;
+    std::cout << "        b/break: list breakpoints" << std::endl;
     std::cout << "        p/print: print all scopes" << std::endl;
     std::cout << "        p <name>: print one variable from the scope chain" << std::endl;
     std::cout << "        h/help: show this help" << std::endl;
     std::cout << "        q/quit: stop program execution" << std::endl;
 }
 
-void EvalVisitor::debugPrintValue(const std::string &name) const
+template <class Debug>
+void BasicEvalVisitor<Debug>::debugPrintValue(const std::string &name) const
 {
+    for (size_t i = debug_locals.size(); i > debug_frame; i--) {
+        const DebugLocal &local = debug_locals[i - 1];
+        if (local.name == name) {
+            std::cout << "[debug] " << name << " = " << stack[frame_base + local.slot].toString() << std::endl;
+            return;
+        }
+    }
+
     try {
-        Value value = env->get(name);
+        Value value = global_env.get(name);
         std::cout << "[debug] " << name << " = " << value.toString() << std::endl;
     } catch (const std::exception &) {
         std::cout << "[debug] variable not found: " << name << std::endl;
     }
 }
 
-void EvalVisitor::debugBefore(Node *node)
+// Lines, then functions
+template <class Debug>
+void BasicEvalVisitor<Debug>::debugPrintBreakpoints() const
 {
-    if (!debug_mode) {
-        return;
+    std::cout << "[debug] breakpoints:";
+    bool none = true;
+    for (size_t line = 0; line < break_lines.size(); line++) {
+        if (break_lines[line]) {
+            std::cout << " line " << line;
+            none = false;
+        }
     }
+    for (const std::string &name : break_names) {
+        std::cout << " fn " << name;
+        none = false;
+    }
+    std::cout << (none ? " (none)" : "") << std::endl;
+}
 
+// Finds the functions of break_names, drops the names of none
+template <class Debug>
+void BasicEvalVisitor<Debug>::debugFindFunctions()
+{
+    break_functions.clear();
+    for (FunctionNode *fn : current_module->functions) {
+        if (break_names.count(fn->name)) {
+            break_functions.insert(fn);
+        }
+    }
+
+    for (auto it = break_names.begin(); it != break_names.end(); ) {
+        bool found = false;
+        for (const FunctionNode *fn : break_functions) {
+            found = found || fn->name == *it;
+        }
+        if (found) {
+            ++it;
+        } else {
+            std::cout << "[debug] no function: " << *it << std::endl;
+            it = break_names.erase(it);
+        }
+    }
+}
+
+// b and d: where is a line number or a function name
+template <class Debug>
+void BasicEvalVisitor<Debug>::debugSetBreakpoint(const std::string &where, bool set)
+{
+    bool digits = !where.empty();
+    for (char c : where) {
+        digits = digits && std::isdigit(static_cast<unsigned char>(c));
+    }
+
+    if (digits) {
+        int line = std::atoi(where.c_str());
+        if (set) {
+            breakAtLine(line);
+        } else if ((size_t)line < break_lines.size()) {
+            break_lines[line] = false;
+        }
+    } else if (set) {
+        breakAtFunction(where);
+    } else {
+        break_names.erase(where);
+        debugFindFunctions();
+    }
+    debugPrintBreakpoints();
+}
+
+template <class Debug>
+void BasicEvalVisitor<Debug>::debugBefore(Node *node)
+{
     debug_step++;
-    std::cout << "[debug] step " << debug_step << " depth " << debug_depth << ": " << debugNodeText(node) << std::endl;
-    debugPrintEnvironment();
 
-    if (debug_continue) {
+    // A running program only stops at a breakpoint, it looks at the line
+    // of the node and prints nothing on the way
+    int line = node->line;
+    bool at_line = line > 0 && (size_t)line < break_lines.size() && break_lines[line];
+    if (debug_continue && !at_line && !break_entered) {
         return;
     }
 
+    // The program's own output comes first
+    pie::io::out().flush();
+
+    if (debug_continue) {
+        if (break_entered) {
+            std::cout << "[debug] breakpoint: fn " << break_entered->name << std::endl;
+        } else {
+            std::cout << "[debug] breakpoint: line " << line << std::endl;
+        }
+        debug_continue = false;
+    }
+    break_entered = nullptr;
+
+    std::cout << "[debug] step " << debug_step << " depth " << debug_depth;
+    if (line > 0) {
+        std::cout << " line " << line;
+    }
+    std::cout << ": " << debugNodeText(node) << std::endl;
+    debugPrintEnvironment();
     debugPrintHelp();
 
     while (true) {
         std::cout << "[debug] command [h for help]: ";
         std::string command;
         if (!std::getline(std::cin, command)) {
+            // Without input the remaining breakpoints cannot be used
+            break_lines.clear();
+            break_functions.clear();
             debug_continue = true;
             std::cout << std::endl;
             return;
         }
 
         std::string trimmed = trimLine(command);
+        bool has_arg = trimmed.size() > 2 && std::isspace(static_cast<unsigned char>(trimmed[1]));
         if (trimmed == "" || trimmed == "s" || trimmed == "step" || trimmed == "n" || trimmed == "next") {
             return;
         }
@@ -153,10 +301,18 @@ void EvalVisitor::debugBefore(Node *node)
             debugPrintEnvironment();
             continue;
         }
-        if (trimmed.size() > 2 && trimmed[0] == 'p' && std::isspace(static_cast<unsigned char>(trimmed[1]))) {
+        if (has_arg && trimmed[0] == 'p') {
             debugPrintValue(trimLine(trimmed.substr(2)));
             continue;
         }
+        if (trimmed == "b" || trimmed == "break") {
+            debugPrintBreakpoints();
+            continue;
+        }
+        if (has_arg && (trimmed[0] == 'b' || trimmed[0] == 'd')) {
+            debugSetBreakpoint(trimLine(trimmed.substr(2)), trimmed[0] == 'b');
+            continue;
+        }
         if (trimmed == "h" || trimmed == "help") {
             debugPrintHelp();
             continue;
@@ -170,71 +326,193 @@ void EvalVisitor::debugBefore(Node *node)
     }
 }
 
-void EvalVisitor::registerBuiltins()
+// Writes args from first on, print separates them with spaces and ends
+// the line, write runs them together
+static void writeValues(pie::io::Writer &writer, Args args, size_t first, bool line)
 {
-    // print function
-    global_env.define("print", Value::makeBuiltin([](std::vector<Value> &args) -> Value {
-        for (size_t i = 0; i < args.size(); i++) {
-            if (i > 0) std::cout << " ";
-            std::cout << args[i].toString();
+    for (size_t i = first; i < args.size(); i++) {
+        if (line && i > first) writer.put(' ');
+        if (args[i].type == Value::Type::String) {
+            String *str = args[i].string_val;
+            writer.write(str->data(), str->length());
+        } else {
+            writer.write(args[i].toString());
         }
-        std::cout << std::endl;
-        return Value::makeNil();
-    }));
+    }
+    if (line) writer.put('\n');
+    writer.done();
+}
 
-    // io.print function (same as print)
-    global_env.define("io.print", Value::makeBuiltin([](std::vector<Value> &args) -> Value {
-        for (size_t i = 0; i < args.size(); i++) {
-            if (i > 0) std::cout << " ";
-            std::cout << args[i].toString();
-        }
-        std::cout << std::endl;
+static pie::io::Writer &handleWriter(Args args, const char *name)
+{
+    pie::io::Writer *writer = args.empty() ? nullptr : pie::io::writer(args[0].toInt());
+    if (!writer || args[0].type != Value::Type::Int) {
+        throw std::runtime_error(std::string(name) + ": not an open file handle");
+    }
+    return *writer;
+}
+
+// print and io.print write a line to the buffered stdout of std.io
+static Value builtinPrint(Args args)
+{
+    writeValues(pie::io::out(), args, 0, true);
+    return Value::makeNil();
+}
+
+// io.write: no separators, no newline
+static Value builtinWrite(Args args)
+{
+    writeValues(pie::io::out(), args, 0, false);
+    return Value::makeNil();
+}
+
+static Value builtinEprint(Args args)
+{
+    writeValues(pie::io::err(), args, 0, true);
+    return Value::makeNil();
+}
+
+// io.open(path, append): a handle for io.fprint and io.fwrite, nil on failure
+static Value builtinOpen(Args args)
+{
+    if (args[0].type != Value::Type::String) return Value::makeNil();
+    bool append = args.size() > 1 && args[1].toBool();
+    int64_t handle = pie::io::open(args[0].string_val->str(), append);
+    return handle < 0 ? Value::makeNil() : Value::makeInt(handle);
+}
+
+static Value builtinFprint(Args args)
+{
+    writeValues(handleWriter(args, "io.fprint"), args, 1, true);
+    return Value::makeNil();
+}
+
+static Value builtinFwrite(Args args)
+{
+    writeValues(handleWriter(args, "io.fwrite"), args, 1, false);
+    return Value::makeNil();
+}
+
+// io.flush(handle), every writer without one
+static Value builtinFlush(Args args)
+{
+    if (args.empty()) {
+        pie::io::flushAll();
         return Value::makeNil();
-    }));
+    }
+    return Value::makeBool(handleWriter(args, "io.flush").flush());
+}
 
-    // exit function
-    global_env.define("exit", Value::makeBuiltin([](std::vector<Value> &args) -> Value {
-        int code = 0;
-        if (!args.empty()) {
-            code = (int)args[0].toInt();
-        }
-        std::exit(code);
-        return Value::makeNil();  // Never reached
-    }));
+static Value builtinClose(Args args)
+{
+    return Value::makeBool(pie::io::close(args[0].toInt()));
+}
 
-    // len function for strings
-    global_env.define("len", Value::makeBuiltin([](std::vector<Value> &args) -> Value {
-        if (args.empty()) return Value::makeInt(0);
-        if (args[0].type == Value::Type::String) {
-            return Value::makeInt(args[0].string_val.length());
-        }
-        return Value::makeInt(0);
-    }));
+static Value builtinExit(Args args)
+{
+    int code = 0;
+    if (!args.empty()) {
+        code = (int)args[0].toInt();
+    }
+    pie::io::flushAll();
+    std::exit(code);
+    return Value::makeNil();  // Never reached
+}
 
-    // type function
-    global_env.define("type", Value::makeBuiltin([](std::vector<Value> &args) -> Value {
-        if (args.empty()) return Value::makeString("nil");
-        switch (args[0].type) {
-            case Value::Type::Nil: return Value::makeString("nil");
-            case Value::Type::Int: return Value::makeString("int");
-            case Value::Type::Double: return Value::makeString("double");
-            case Value::Type::Bool: return Value::makeString("bool");
-            case Value::Type::String: return Value::makeString("string");
-            case Value::Type::Function: return Value::makeString("function");
-            case Value::Type::BuiltinFunction: return Value::makeString("builtin");
-            default: return Value::makeString("unknown");
-        }
-    }));
+// len function for strings
+static Value builtinLen(Args args)
+{
+    if (args[0].type == Value::Type::String) {
+        return Value::makeInt(args[0].string_val->length());
+    }
+    return Value::makeInt(0);
+}
+
+// substr(s, start, length): shares the bytes of s
+static Value builtinSubstr(Args args)
+{
+    if (args[0].type != Value::Type::String) return Value::makeNil();
+    int64_t start = args.size() > 1 ? std::max<int64_t>(args[1].toInt(), 0) : 0;
+    int64_t length = args.size() > 2 ? std::max<int64_t>(args[2].toInt(), 0) : INT64_MAX;
+    Value val;
+    val.type = Value::Type::String;
+    val.string_val = String::slice(args[0].string_val, (size_t)start, (size_t)length);
+    return val;
+}
+
+static Value builtinType(Args args)
+{
+    return Value::makeString(args[0].typeName());
 }
 
-Value EvalVisitor::evaluate(Node *node)
+// Sorted by name, findBuiltin() searches it
+static constexpr Builtin builtins[] = {
+    { "exit", builtinExit, 0, 1, false },
+    { "io.close", builtinClose, 1, 1, false },
+    { "io.eprint", builtinEprint, 0, Builtin::kVariadic, false },
+    { "io.flush", builtinFlush, 0, 1, false },
+    { "io.fprint", builtinFprint, 1, Builtin::kVariadic, false },
+    { "io.fwrite", builtinFwrite, 1, Builtin::kVariadic, false },
+    { "io.open", builtinOpen, 1, 2, false },
+    { "io.print", builtinPrint, 0, Builtin::kVariadic, false },
+    { "io.write", builtinWrite, 0, Builtin::kVariadic, false },
+    { "len", builtinLen, 1, 1, true },
+    { "print", builtinPrint, 0, Builtin::kVariadic, false },
+    { "substr", builtinSubstr, 1, 3, true },
+    { "type", builtinType, 1, 1, true },
+};
+
+static constexpr bool nameBefore(const char *a, const char *b)
+{
+    return *a == *b ? *a != '\0' && nameBefore(a + 1, b + 1) : (unsigned char)*a < (unsigned char)*b;
+}
+
+static constexpr bool sortedByName(const Builtin *table, size_t count)
+{
+    return count < 2 || (nameBefore(table[0].name, table[1].name) && sortedByName(table + 1, count - 1));
+}
+
+static_assert(sortedByName(builtins, sizeof(builtins) / sizeof(builtins[0])),
+              "builtins must be sorted by name");
+
+void arityError(const Builtin *builtin, size_t nargs)
+{
+    std::string expected;
+    if (builtin->max_args == Builtin::kVariadic) {
+        expected = "at least " + std::to_string(builtin->min_args);
+    } else if (builtin->min_args == builtin->max_args) {
+        expected = std::to_string(builtin->min_args);
+    } else {
+        expected = std::to_string(builtin->min_args) + " to " + std::to_string(builtin->max_args);
+    }
+    bool one = builtin->min_args == 1 && builtin->max_args == 1;
+    throw std::runtime_error(std::string(builtin->name) + ": expected " + expected +
+                             (one ? " argument" : " arguments") + ", got " + std::to_string(nargs));
+}
+
+const Builtin *findBuiltin(const std::string &name)
+{
+    const Builtin *end = builtins + sizeof(builtins) / sizeof(builtins[0]);
+    const Builtin *it = std::lower_bound(builtins, end, name.c_str(), [](const Builtin &builtin, const char *key) {
+        return strcmp(builtin.name, key) < 0;
+    });
+    return it != end && strcmp(it->name, name.c_str()) == 0 ? it : nullptr;
+}
+
+template <class Debug>
+Value BasicEvalVisitor<Debug>::evaluate(Node *node)
 {
     if (!node) return Value::makeNil();
 
+    if (!Debug::enabled) {
+        dispatch(this, node);
+        return result;
+    }
+
     debugBefore(node);
     debug_depth++;
     try {
-        node->visit(this);
+        dispatch(this, node);
     } catch (...) {
         debug_depth--;
         throw;
@@ -244,10 +522,23 @@ Value EvalVisitor::evaluate(Node *node)
     return result;
 }
 
-Value EvalVisitor::run(ModuleNode *module)
+template <class Debug>
+Value BasicEvalVisitor<Debug>::run(ModuleNode *module)
 {
     current_module = module;
 
+    // Assign frame slots to all locals
+    ResolveVisitor resolver;
+    resolver.resolve(module);
+    if (Debug::enabled) {
+        debugFindFunctions();
+    }
+
+    // Native code cannot be stepped through
+    if (jit_enabled && !Debug::enabled && JitCompiler::supported()) {
+        jit.reset(new JitCompiler(module));
+    }
+
     // First, register all functions in the global scope
     for (FunctionNode *fn : module->functions) {
         global_env.define(fn->name, Value::makeFunction(fn));
@@ -255,10 +546,9 @@ Value EvalVisitor::run(ModuleNode *module)
 
     // Find and call main function
     if (module->symtab.find("main") != module->symtab.end()) {
-        FunctionNode *main_fn = dynamic_cast<FunctionNode*>(module->symtab["main"]);
+        FunctionNode *main_fn = dyn_cast<FunctionNode>(module->symtab["main"]);
         if (main_fn) {
-            std::vector<Value> args;
-            return callFunction(main_fn, args);
+            return callFunction(main_fn, stack_top, 0);
         }
     }
 
@@ -267,164 +557,354 @@ Value EvalVisitor::run(ModuleNode *module)
 
 namespace {
 
-class EnvScopeGuard {
+// Restores the caller's frame when a call returns or unwinds
+class FrameGuard {
 public:
-    EnvScopeGuard(Environment *&slot, Environment *replacement)
-        : slot(slot), previous(slot)
+    FrameGuard(size_t &frame_base, size_t &stack_top, size_t base)
+        : frame_base(frame_base), stack_top(stack_top),
+          saved_base(frame_base), saved_top(base)
     {
-        slot = replacement;
     }
 
-    ~EnvScopeGuard()
+    ~FrameGuard()
     {
-        slot = previous;
+        frame_base = saved_base;
+        stack_top = saved_top;
     }
 
 private:
-    Environment *&slot;
-    Environment *previous;
+    size_t &frame_base;
+    size_t &stack_top;
+    size_t saved_base;
+    size_t saved_top;
 };
 
 }
 
-Value EvalVisitor::callFunction(FunctionNode *fn, std::vector<Value> &args)
+template <class Debug>
+void BasicEvalVisitor<Debug>::reserveStack(size_t size)
 {
-    // Create new environment for function scope
-    Environment func_env(&global_env);
-    EnvScopeGuard guard(env, &func_env);
-
-    // Bind parameters
-    for (size_t i = 0; i < fn->params.size() && i < args.size(); i++) {
-        func_env.define(fn->params[i].first, args[i]);
+    if (size > stack.size()) {
+        stack.resize(std::max(size, stack.size() * 2));
     }
+}
 
-    // Execute function body
-    Value return_val = Value::makeNil();
-    try {
+// The arguments are already stored in stack[base .. base + nargs), they
+// become the first slots of the callee's frame
+template <class Debug>
+Value BasicEvalVisitor<Debug>::callFunction(FunctionNode *fn, size_t base, size_t nargs)
+{
+    FrameGuard guard(frame_base, stack_top, base);
+    ProfileScope scope(profiler, fn);
+
+    // A tail call replaces the running function and goes around again
+    for (;;) {
+        // Hot numeric functions run as machine code, see JitCompiler
+        if (jit && nargs == fn->params.size() && nargs <= JitCompiler::kMaxParams &&
+            (fn->native_code || (++fn->call_count == jit_threshold && jit->compile(fn)))) {
+            int64_t args[JitCompiler::kMaxParams];
+            size_t i = 0;
+            for (; i < nargs; i++) {
+                const Value &arg = stack[base + i];
+                if (!(fn->native_doubles & (1u << i))) {
+                    if (arg.type != Value::Type::Int) break;
+                    args[i] = arg.int_val;
+                } else if (arg.isNumeric()) {
+                    // An int is widened, like the guard of the parameter
+                    double d = arg.toDouble();
+                    memcpy(&args[i], &d, sizeof(d));
+                } else {
+                    break;
+                }
+            }
+            if (i == nargs) {
+                for (i = base; i < base + nargs; i++) {
+                    stack[i] = Value();
+                }
+                int64_t raw = JitCompiler::invoke(fn, args);
+                if (fn->native_doubles & JitCompiler::kDoubleResult) {
+                    double d;
+                    memcpy(&d, &raw, sizeof(d));
+                    return Value::makeDouble(d);
+                }
+                return Value::makeInt(raw);
+            }
+        }
+
+        size_t frame_size = std::max((size_t)fn->frame_size, nargs);
+        reserveStack(base + frame_size);
+
+        // Parameters without an argument are nil
+        for (size_t i = nargs; i < fn->params.size(); i++) {
+            stack[base + i] = Value::makeNil();
+        }
+
+        frame_base = base;
+        stack_top = base + frame_size;
+
+        size_t saved_debug_frame = debug_frame;
+        if (Debug::enabled) {
+            debug_frame = debug_locals.size();
+            for (size_t i = 0; i < fn->params.size(); i++) {
+                debug_locals.push_back({ fn->params[i].first, 0, (int)i });
+            }
+            if (debug_continue && break_functions.count(fn)) {
+                break_entered = fn;
+            }
+        }
+
+        // Execute function body
+        Value return_val = Value::makeNil();
         for (Node *stmt : fn->children) {
             evaluate(stmt);
+            if (unwind == Unwind::Return) {
+                return_val = std::move(return_value);
+                unwind = Unwind::None;
+                break;
+            }
+            if (unwind == Unwind::TailCall) break;
+        }
+
+        if (Debug::enabled) {
+            debug_locals.resize(debug_frame);
+            debug_frame = saved_debug_frame;
+        }
+
+        if (unwind == Unwind::TailCall) {
+            // The arguments already sit in the first slots, drop the rest
+            unwind = Unwind::None;
+            fn = tail_function;
+            nargs = tail_nargs;
+            if (profiler) profiler->replace(fn);
+            for (size_t i = base + nargs; i < base + frame_size; i++) {
+                stack[i] = Value();
+            }
+            continue;
+        }
+
+        // Release the frame so strings do not outlive the call
+        for (size_t i = base; i < base + frame_size; i++) {
+            stack[i] = Value();
         }
-    } catch (ReturnException &ret) {
-        return_val = ret.value;
+
+        return return_val;
     }
+}
 
-    return return_val;
+template <class Debug>
+Value BasicEvalVisitor<Debug>::callBuiltin(const Builtin *builtin, size_t base, size_t nargs)
+{
+    checkArity(builtin, nargs);
+    Value value = builtin->fn(Args{ stack.data() + base, nargs });
+    for (size_t i = base; i < base + nargs; i++) {
+        stack[i] = Value();
+    }
+    stack_top = base;
+    return value;
 }
 
-void EvalVisitor::visit(Node *node)
+template <class Debug>
+void BasicEvalVisitor<Debug>::visit(Node *node)
 {
     if (node) {
-        node->visit(this);
+        dispatch(this, node);
     }
 }
 
-void EvalVisitor::visit(ModuleNode *node)
+template <class Debug>
+void BasicEvalVisitor<Debug>::visit(ModuleNode *node)
 {
     // Module evaluation is handled by run()
     result = Value::makeNil();
 }
 
-void EvalVisitor::visit(ImportNode *node)
+template <class Debug>
+void BasicEvalVisitor<Debug>::visit(ImportNode *node)
 {
-    // Imports are not executed at runtime
+    // Imports are bound by the Driver before the program runs
     result = Value::makeNil();
 }
 
-void EvalVisitor::visit(FunctionNode *node)
+template <class Debug>
+void BasicEvalVisitor<Debug>::visit(FunctionNode *node)
 {
     // Function declarations just register the function
     result = Value::makeFunction(node);
 }
 
-void EvalVisitor::visit(ClosureNode *node)
+template <class Debug>
+void BasicEvalVisitor<Debug>::visit(ClosureNode *node)
 {
-    // TODO: Implement closures properly
-    result = Value::makeNil();
+    // The parser makes none, a tree that has one is not run wrong
+    throw std::runtime_error("Closures are not supported");
 }
 
-void EvalVisitor::visit(FunctionCallNode *node)
+template <class Debug>
+void BasicEvalVisitor<Debug>::visit(FunctionCallNode *node)
 {
-    // Evaluate arguments
-    std::vector<Value> args;
-    for (Node *child : node->children) {
-        args.push_back(evaluate(child));
+    FunctionNode *fn;
+    const Builtin *builtin;
+    size_t base = stack_top;
+    loadCall(node, base, fn, builtin);
+
+    if (fn) {
+        result = callFunction(fn, base, node->children.size());
+    } else {
+        result = callBuiltin(builtin, base, node->children.size());
+    }
+}
+
+// Evaluates the arguments straight into the slots of the callee's frame
+// at base, then finds the callee
+template <class Debug>
+void BasicEvalVisitor<Debug>::loadCall(FunctionCallNode *node, size_t base, FunctionNode *&fn, const Builtin *&builtin)
+{
+    size_t nargs = node->children.size();
+    reserveStack(base + nargs);
+    for (size_t i = 0; i < nargs; i++) {
+        Value arg = evaluate(node->children[i]);
+        stack[base + i] = std::move(arg);
+        stack_top = base + i + 1;
     }
 
     // Look up the function
-    Value func_val;
-    try {
-        func_val = env->get(node->name);
-    } catch (...) {
-        // Try to find in module symtab
-        if (current_module && current_module->symtab.find(node->name) != current_module->symtab.end()) {
-            FunctionNode *fn = dynamic_cast<FunctionNode*>(current_module->symtab[node->name]);
-            if (fn) {
-                result = callFunction(fn, args);
-                return;
-            }
+    fn = nullptr;
+    builtin = nullptr;
+    if (node->slot >= 0) {
+        const Value &callee = stack[frame_base + node->slot];
+        if (callee.type == Value::Type::Function) {
+            fn = callee.function_val;
+        } else if (callee.type == Value::Type::BuiltinFunction) {
+            builtin = callee.builtin_val;
+        }
+    } else {
+        // A cached callee costs one compare, globals are only looked up
+        // again after one of them was redefined
+        if (node->cache_epoch != global_env.epoch() && !linkCall(node)) {
+            throw std::runtime_error("Undefined function: " + node->qualifiedName());
         }
-        throw std::runtime_error("Undefined function: " + node->name);
+        fn = node->cached_function;
+        builtin = node->cached_builtin;
+    }
+
+    if (!fn && !builtin) {
+        throw std::runtime_error("Not a function: " + node->qualifiedName());
     }
+}
 
-    if (func_val.type == Value::Type::Function) {
-        result = callFunction(func_val.function_val, args);
-    } else if (func_val.type == Value::Type::BuiltinFunction) {
-        result = func_val.builtin_val(args);
+// Fill the inline cache of a call to a global, false if it is undefined
+template <class Debug>
+bool BasicEvalVisitor<Debug>::linkCall(FunctionCallNode *node)
+{
+    std::string name = node->qualifiedName();
+    node->cached_function = nullptr;
+    node->cached_builtin = nullptr;
+
+    const Value *callee = global_env.find(name);
+    if (callee) {
+        if (callee->type == Value::Type::Function) {
+            node->cached_function = callee->function_val;
+        } else if (callee->type == Value::Type::BuiltinFunction) {
+            node->cached_builtin = callee->builtin_val;
+        }
+    } else if (const Builtin *builtin = findBuiltin(name)) {
+        node->cached_builtin = builtin;
     } else {
-        throw std::runtime_error("Not a function: " + node->name);
+        // Try to find in module symtab
+        if (!current_module) return false;
+        auto it = current_module->symtab.find(name);
+        if (it == current_module->symtab.end()) return false;
+        FunctionNode *target = dyn_cast<FunctionNode>(it->second);
+        if (!target) return false;
+        node->cached_function = target;
     }
+
+    node->cache_epoch = global_env.epoch();
+    return true;
 }
 
-void EvalVisitor::visit(AssignNode *node)
+template <class Debug>
+void BasicEvalVisitor<Debug>::visit(AssignNode *node)
 {
     Value value = evaluate(node->value);
 
-    IdentifierNode *id = dynamic_cast<IdentifierNode*>(node->var);
+    IdentifierNode *id = dyn_cast<IdentifierNode>(node->var);
     if (id) {
-        env->set(id->name, value);
+        if (id->slot >= 0) {
+            stack[frame_base + id->slot] = value;
+        } else {
+            global_env.set(id->name, value);
+        }
         result = value;
     } else {
         throw std::runtime_error("Invalid assignment target");
     }
 }
 
-void EvalVisitor::visit(LetNode *node)
+template <class Debug>
+void BasicEvalVisitor<Debug>::visit(LetNode *node)
 {
     Value value = Value::makeNil();
     if (node->value) {
         value = evaluate(node->value);
     }
-    env->define(node->name, value);
+    stack[frame_base + node->slot] = value;
     result = value;
+
+    if (Debug::enabled) {
+        // A redeclaration in the same scope reuses the debugger entry
+        for (size_t i = debug_locals.size(); i > debug_frame; i--) {
+            const DebugLocal &local = debug_locals[i - 1];
+            if (local.depth < node->depth) break;
+            if (local.depth == node->depth && local.name == node->name) return;
+        }
+        debug_locals.push_back({ node->name, node->depth, node->slot });
+    }
 }
 
-void EvalVisitor::visit(TypeNode *node)
+template <class Debug>
+void BasicEvalVisitor<Debug>::visit(TypeNode *node)
 {
     // Types are not evaluated at runtime
     result = Value::makeNil();
 }
 
-void EvalVisitor::visit(IntNode *node)
+template <class Debug>
+void BasicEvalVisitor<Debug>::visit(IntNode *node)
 {
     result = Value::makeInt(node->value);
 }
 
-void EvalVisitor::visit(DoubleNode *node)
+template <class Debug>
+void BasicEvalVisitor<Debug>::visit(DoubleNode *node)
 {
     result = Value::makeDouble(node->value);
 }
 
-void EvalVisitor::visit(StringNode *node)
+template <class Debug>
+void BasicEvalVisitor<Debug>::visit(StringNode *node)
 {
     result = Value::makeString(node->str);
 }
 
-void EvalVisitor::visit(IdentifierNode *node)
+template <class Debug>
+void BasicEvalVisitor<Debug>::visit(BoolNode *node)
 {
-    result = env->get(node->name);
+    result = Value::makeBool(node->value);
 }
 
-void EvalVisitor::visit(BinaryOpNode *node)
+template <class Debug>
+void BasicEvalVisitor<Debug>::visit(IdentifierNode *node)
+{
+    if (node->slot >= 0) {
+        result = stack[frame_base + node->slot];
+    } else {
+        result = global_env.get(node->name);
+    }
+}
+
+template <class Debug>
+void BasicEvalVisitor<Debug>::visit(BinaryOpNode *node)
 {
     // Special case for logical operators (short-circuit evaluation)
     if (node->op == BinaryOp::And) {
@@ -451,16 +931,21 @@ void EvalVisitor::visit(BinaryOpNode *node)
 
     // Special case for assignment operators
     if (node->op == BinaryOp::AddAssign || node->op == BinaryOp::SubAssign) {
-        IdentifierNode *id = dynamic_cast<IdentifierNode*>(node->lhs);
+        IdentifierNode *id = dyn_cast<IdentifierNode>(node->lhs);
         if (!id) {
             throw std::runtime_error("Invalid assignment target");
         }
 
-        Value current = env->get(id->name);
+        Value current = id->slot >= 0 ? stack[frame_base + id->slot] : global_env.get(id->name);
         Value rhs = evaluate(node->rhs);
         Value new_val;
 
-        if (node->op == BinaryOp::AddAssign) {
+        bool add = node->op == BinaryOp::AddAssign;
+        if (node->operand_type == OperandType::Int) {
+            new_val = Value::makeInt(add ? current.int_val + rhs.int_val : current.int_val - rhs.int_val);
+        } else if (node->operand_type == OperandType::Double) {
+            new_val = Value::makeDouble(add ? current.double_val + rhs.double_val : current.double_val - rhs.double_val);
+        } else if (node->op == BinaryOp::AddAssign) {
             if (current.type == Value::Type::Int && rhs.type == Value::Type::Int) {
                 new_val = Value::makeInt(current.int_val + rhs.int_val);
             } else {
@@ -474,7 +959,11 @@ void EvalVisitor::visit(BinaryOpNode *node)
             }
         }
 
-        env->set(id->name, new_val);
+        if (id->slot >= 0) {
+            stack[frame_base + id->slot] = new_val;
+        } else {
+            global_env.set(id->name, new_val);
+        }
         result = new_val;
         return;
     }
@@ -482,10 +971,54 @@ void EvalVisitor::visit(BinaryOpNode *node)
     Value lhs = evaluate(node->lhs);
     Value rhs = evaluate(node->rhs);
 
+    // Operand types proven by TypeCheckVisitor, no tag checks needed
+    if (node->operand_type == OperandType::Int) {
+        int64_t a = lhs.int_val, b = rhs.int_val;
+        switch (node->op) {
+            case BinaryOp::Add: result = Value::makeInt(a + b); return;
+            case BinaryOp::Sub: result = Value::makeInt(a - b); return;
+            case BinaryOp::Mul: result = Value::makeInt(a * b); return;
+            case BinaryOp::Div:
+                if (b == 0) throw std::runtime_error("Division by zero");
+                result = Value::makeInt(a / b);
+                return;
+            case BinaryOp::Mod:
+                if (b == 0) throw std::runtime_error("Modulo by zero");
+                result = Value::makeInt(a % b);
+                return;
+            // Compared as doubles like the generic path
+            case BinaryOp::Lt: result = Value::makeBool((double)a < (double)b); return;
+            case BinaryOp::Gt: result = Value::makeBool((double)a > (double)b); return;
+            case BinaryOp::Le: result = Value::makeBool((double)a <= (double)b); return;
+            case BinaryOp::Ge: result = Value::makeBool((double)a >= (double)b); return;
+            case BinaryOp::Eq: result = Value::makeBool((double)a == (double)b); return;
+            case BinaryOp::Ne: result = Value::makeBool((double)a != (double)b); return;
+            default: break;
+        }
+    } else if (node->operand_type == OperandType::Double) {
+        double a = lhs.double_val, b = rhs.double_val;
+        switch (node->op) {
+            case BinaryOp::Add: result = Value::makeDouble(a + b); return;
+            case BinaryOp::Sub: result = Value::makeDouble(a - b); return;
+            case BinaryOp::Mul: result = Value::makeDouble(a * b); return;
+            case BinaryOp::Div:
+                if (b == 0.0) throw std::runtime_error("Division by zero");
+                result = Value::makeDouble(a / b);
+                return;
+            case BinaryOp::Lt: result = Value::makeBool(a < b); return;
+            case BinaryOp::Gt: result = Value::makeBool(a > b); return;
+            case BinaryOp::Le: result = Value::makeBool(a <= b); return;
+            case BinaryOp::Ge: result = Value::makeBool(a >= b); return;
+            case BinaryOp::Eq: result = Value::makeBool(a == b); return;
+            case BinaryOp::Ne: result = Value::makeBool(a != b); return;
+            default: break;
+        }
+    }
+
     switch (node->op) {
         case BinaryOp::Add:
             if (lhs.type == Value::Type::String || rhs.type == Value::Type::String) {
-                result = Value::makeString(lhs.toString() + rhs.toString());
+                result = Value::concat(lhs, rhs);
             } else if (lhs.type == Value::Type::Int && rhs.type == Value::Type::Int) {
                 result = Value::makeInt(lhs.int_val + rhs.int_val);
             } else {
@@ -545,7 +1078,7 @@ void EvalVisitor::visit(BinaryOpNode *node)
 
         case BinaryOp::Eq:
             if (lhs.type == Value::Type::String && rhs.type == Value::Type::String) {
-                result = Value::makeBool(lhs.string_val == rhs.string_val);
+                result = Value::makeBool(String::equals(lhs.string_val, rhs.string_val));
             } else if (lhs.isNumeric() && rhs.isNumeric()) {
                 result = Value::makeBool(lhs.toDouble() == rhs.toDouble());
             } else {
@@ -555,7 +1088,7 @@ void EvalVisitor::visit(BinaryOpNode *node)
 
         case BinaryOp::Ne:
             if (lhs.type == Value::Type::String && rhs.type == Value::Type::String) {
-                result = Value::makeBool(lhs.string_val != rhs.string_val);
+                result = Value::makeBool(!String::equals(lhs.string_val, rhs.string_val));
             } else if (lhs.isNumeric() && rhs.isNumeric()) {
                 result = Value::makeBool(lhs.toDouble() != rhs.toDouble());
             } else {
@@ -573,7 +1106,8 @@ void EvalVisitor::visit(BinaryOpNode *node)
     }
 }
 
-void EvalVisitor::visit(UnaryOpNode *node)
+template <class Debug>
+void BasicEvalVisitor<Debug>::visit(UnaryOpNode *node)
 {
     Value val = evaluate(node->expr);
 
@@ -590,27 +1124,68 @@ void EvalVisitor::visit(UnaryOpNode *node)
             result = Value::makeBool(!val.toBool());
             break;
 
-        case UnaryOp::Inc:
-        case UnaryOp::Dec:
-            // TODO: Implement increment/decrement
+        case UnaryOp::CastInt:
+            if (val.type != Value::Type::Int) {
+                throw std::runtime_error(std::string("Type error: expected int, got ") + val.typeName());
+            }
             result = val;
             break;
 
+        case UnaryOp::CastDouble:
+            if (val.type == Value::Type::Int) {
+                result = Value::makeDouble((double)val.int_val);
+            } else if (val.type == Value::Type::Double) {
+                result = val;
+            } else {
+                throw std::runtime_error(std::string("Type error: expected double, got ") + val.typeName());
+            }
+            break;
+
+        case UnaryOp::Inc:
+        case UnaryOp::Dec:
+            // As for closures
+            throw std::runtime_error("Increment and decrement are not supported");
+
         default:
             throw std::runtime_error("Unknown unary operator");
     }
 }
 
-void EvalVisitor::visit(ReturnNode *node)
+template <class Debug>
+void BasicEvalVisitor<Debug>::visit(ReturnNode *node)
 {
-    Value val = Value::makeNil();
-    if (node->expr) {
-        val = evaluate(node->expr);
+    result = Value::makeNil();
+
+    // return f(...) reuses the running frame, so tail recursion runs in
+    // constant stack. The debugger keeps every frame.
+    FunctionCallNode *call = dyn_cast<FunctionCallNode>(node->expr);
+    if (call && !Debug::enabled) {
+        FunctionNode *fn;
+        const Builtin *builtin;
+        size_t base = stack_top;
+        size_t nargs = call->children.size();
+        loadCall(call, base, fn, builtin);
+
+        if (fn) {
+            for (size_t i = 0; i < nargs; i++) {
+                stack[frame_base + i] = std::move(stack[base + i]);
+            }
+            tail_function = fn;
+            tail_nargs = nargs;
+            unwind = Unwind::TailCall;
+        } else {
+            return_value = callBuiltin(builtin, base, nargs);
+            unwind = Unwind::Return;
+        }
+        return;
     }
-    throw ReturnException(val);
+
+    return_value = node->expr ? evaluate(node->expr) : Value::makeNil();
+    unwind = Unwind::Return;
 }
 
-void EvalVisitor::visit(IfNode *node)
+template <class Debug>
+void BasicEvalVisitor<Debug>::visit(IfNode *node)
 {
     Value cond = evaluate(node->condition);
 
@@ -625,17 +1200,176 @@ void EvalVisitor::visit(IfNode *node)
     result = Value::makeNil();
 }
 
-void EvalVisitor::visit(BlockNode *node)
+template <class Debug>
+void BasicEvalVisitor<Debug>::visit(BlockNode *node)
 {
-    // Create new scope for block
-    Environment block_env(env);
-    EnvScopeGuard guard(env, &block_env);
+    size_t debug_mark = Debug::enabled ? debug_locals.size() : 0;
 
+    // Block locals already have their own slots in the frame
     for (Node *stmt : node->children) {
         evaluate(stmt);
+        if (unwind != Unwind::None) {
+            break;
+        }
+    }
+
+    if (Debug::enabled) {
+        debug_locals.resize(debug_mark);
+    }
+
+    result = Value::makeNil();
+}
+
+// Runs one iteration, false once the loop has to stop. Break and continue
+// end here, return and tail calls keep unwinding.
+template <class Debug>
+bool BasicEvalVisitor<Debug>::loopBody(BlockNode *body)
+{
+    if (body) {
+        evaluate(body);
+    }
+
+    switch (unwind) {
+        case Unwind::None:
+            return true;
+        case Unwind::Continue:
+            unwind = Unwind::None;
+            return true;
+        case Unwind::Break:
+            unwind = Unwind::None;
+            return false;
+        default:
+            return false;
+    }
+}
+
+template <class Debug>
+void BasicEvalVisitor<Debug>::visit(WhileNode *node)
+{
+    // The body reuses its frame slots, nothing is allocated per iteration
+    while (evaluate(node->condition).toBool()) {
+        if (!loopBody(node->body)) {
+            break;
+        }
+    }
+
+    result = Value::makeNil();
+}
+
+// A for loop counting a local against a constant or another local,
+// `i < n; i += k` and the other orderings
+static bool countedLoop(ForNode *node, BinaryOpNode *&cond, int &slot, int64_t &delta)
+{
+    cond = dyn_cast<BinaryOpNode>(node->condition);
+    BinaryOpNode *step = dyn_cast<BinaryOpNode>(node->step);
+    if (!cond || !step) {
+        return false;
+    }
+
+    switch (cond->op) {
+        case BinaryOp::Lt: case BinaryOp::Le: case BinaryOp::Gt: case BinaryOp::Ge:
+            break;
+        default:
+            return false;
+    }
+    if (step->op != BinaryOp::AddAssign && step->op != BinaryOp::SubAssign) {
+        return false;
+    }
+
+    IdentifierNode *counter = dyn_cast<IdentifierNode>(cond->lhs);
+    IdentifierNode *bound = dyn_cast<IdentifierNode>(cond->rhs);
+    if (!dyn_cast<IntNode>(cond->rhs) && !(bound && bound->slot >= 0)) {
+        return false;
+    }
+
+    IdentifierNode *target = dyn_cast<IdentifierNode>(step->lhs);
+    IntNode *amount = dyn_cast<IntNode>(step->rhs);
+    if (!counter || !target || !amount || counter->slot < 0 || target->slot != counter->slot) {
+        return false;
+    }
+
+    slot = counter->slot;
+    delta = step->op == BinaryOp::AddAssign ? amount->value : -amount->value;
+    return true;
+}
+
+template <class Debug>
+void BasicEvalVisitor<Debug>::visit(ForNode *node)
+{
+    size_t debug_mark = Debug::enabled ? debug_locals.size() : 0;
+
+    if (node->init) {
+        evaluate(node->init);
+    }
+
+    BinaryOpNode *cond;
+    int slot;
+    int64_t delta;
+    if (!Debug::enabled && countedLoop(node, cond, slot, delta)) {
+        // Int counters are compared and stepped in place, anything else
+        // goes through the nodes. The stack may grow inside the body, so
+        // the counter is looked up again on every use.
+        IntNode *const_bound = dyn_cast<IntNode>(cond->rhs);
+        int bound_slot = const_bound ? -1 : static_cast<IdentifierNode*>(cond->rhs)->slot;
+        for (;;) {
+            Value bound = const_bound ? Value::makeInt(const_bound->value) : stack[frame_base + bound_slot];
+            Value counter = stack[frame_base + slot];
+            bool more;
+            if (counter.type == Value::Type::Int && bound.type == Value::Type::Int) {
+                double a = (double)counter.int_val, b = (double)bound.int_val;
+                switch (cond->op) {
+                    case BinaryOp::Lt: more = a < b; break;
+                    case BinaryOp::Le: more = a <= b; break;
+                    case BinaryOp::Gt: more = a > b; break;
+                    default: more = a >= b; break;
+                }
+            } else {
+                more = evaluate(node->condition).toBool();
+            }
+            if (!more || !loopBody(node->body)) {
+                break;
+            }
+
+            Value &current = stack[frame_base + slot];
+            if (current.type == Value::Type::Int) {
+                current = Value::makeInt(current.int_val + delta);
+            } else {
+                evaluate(node->step);
+            }
+        }
+    } else {
+        while (!node->condition || evaluate(node->condition).toBool()) {
+            if (!loopBody(node->body)) {
+                break;
+            }
+            if (node->step) {
+                evaluate(node->step);
+            }
+        }
+    }
+
+    if (Debug::enabled) {
+        debug_locals.resize(debug_mark);
     }
 
     result = Value::makeNil();
 }
 
+template <class Debug>
+void BasicEvalVisitor<Debug>::visit(BreakNode *node)
+{
+    unwind = Unwind::Break;
+    result = Value::makeNil();
+}
+
+template <class Debug>
+void BasicEvalVisitor<Debug>::visit(ContinueNode *node)
+{
+    unwind = Unwind::Continue;
+    result = Value::makeNil();
+}
+
+template class BasicEvalVisitor<NoDebug>;
+template class BasicEvalVisitor<WithDebug>;
+
 }}
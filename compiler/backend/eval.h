@@ -3,17 +3,56 @@
 
 #include <string>
 #include <map>
+#include <set>
 #include <vector>
 #include <stdexcept>
-#include <functional>
+#include <memory>
+#include <cstdint>
+#include <atomic>
 
 #include "compiler/ast.h"
+#include "compiler/backend/jit.h"
+#include "compiler/backend/profile.h"
+#include "runtime/string.h"
 
 namespace pie { namespace compiler {
 
-// Runtime value representation
+struct Value;
+struct Args;
+
+typedef Value (*NativeFn)(Args args);
+
+// Native function, an entry of the table every interpreter shares. A call
+// with fewer than min_args or more than max_args arguments fails before fn
+// runs. A pure builtin computes its result from its arguments only and has
+// no other effect: the optimizer folds its calls on constants.
+struct Builtin {
+    static const uint8_t kVariadic = 255;  // as max_args, no limit
+
+    const char *name;
+    NativeFn fn;
+    uint8_t min_args;
+    uint8_t max_args;
+    bool pure;
+};
+
+// The builtin called name, null when there is none
+const Builtin *findBuiltin(const std::string &name);
+
+// The error of a call to builtin with a number of arguments it does not take
+[[noreturn]] void arityError(const Builtin *builtin, size_t nargs);
+
+inline void checkArity(const Builtin *builtin, size_t nargs)
+{
+    if (nargs < builtin->min_args || (nargs > builtin->max_args && builtin->max_args != Builtin::kVariadic)) {
+        arityError(builtin, nargs);
+    }
+}
+
+// Runtime value representation: a type tag plus an 8 byte payload. Strings
+// and builtins live on the heap, only strings are owned by the value.
 struct Value {
-    enum class Type {
+    enum class Type : uint8_t {
         Nil,
         Int,
         Double,
@@ -24,14 +63,52 @@ struct Value {
     };
 
     Type type;
-    int64_t int_val;
-    double double_val;
-    bool bool_val;
-    std::string string_val;
-    FunctionNode *function_val;
-    std::function<Value(std::vector<Value>&)> builtin_val;
+    union {
+        uint64_t bits;
+        int64_t int_val;
+        double double_val;
+        bool bool_val;
+        String *string_val;
+        FunctionNode *function_val;
+        const Builtin *builtin_val;
+    };
 
-    Value() : type(Type::Nil), int_val(0), double_val(0.0), bool_val(false), function_val(nullptr) {}
+    Value() : type(Type::Nil), bits(0) {}
+
+    Value(const Value &other) : type(other.type), bits(other.bits)
+    {
+        if (type == Type::String) string_val->refcount++;
+    }
+
+    Value(Value &&other) noexcept : type(other.type), bits(other.bits)
+    {
+        other.type = Type::Nil;
+    }
+
+    ~Value()
+    {
+        release();
+    }
+
+    Value &operator=(const Value &other)
+    {
+        if (other.type == Type::String) other.string_val->refcount++;
+        release();
+        type = other.type;
+        bits = other.bits;
+        return *this;
+    }
+
+    Value &operator=(Value &&other) noexcept
+    {
+        if (this != &other) {
+            release();
+            type = other.type;
+            bits = other.bits;
+            other.type = Type::Nil;
+        }
+        return *this;
+    }
 
     static Value makeNil() {
         return Value();
@@ -61,7 +138,24 @@ struct Value {
     static Value makeString(const std::string &v) {
         Value val;
         val.type = Type::String;
-        val.string_val = v;
+        val.string_val = String::make(v);
+        return val;
+    }
+
+    static Value makeString(std::string &&v) {
+        Value val;
+        val.type = Type::String;
+        val.string_val = String::make(std::move(v));
+        return val;
+    }
+
+    // Shares the bytes of string operands, see String::concat
+    static Value concat(const Value &lhs, const Value &rhs) {
+        Value l = lhs.type == Type::String ? lhs : makeString(lhs.toString());
+        Value r = rhs.type == Type::String ? rhs : makeString(rhs.toString());
+        Value val;
+        val.type = Type::String;
+        val.string_val = String::concat(l.string_val, r.string_val);
         return val;
     }
 
@@ -72,7 +166,7 @@ struct Value {
         return val;
     }
 
-    static Value makeBuiltin(std::function<Value(std::vector<Value>&)> fn) {
+    static Value makeBuiltin(const Builtin *fn) {
         Value val;
         val.type = Type::BuiltinFunction;
         val.builtin_val = fn;
@@ -98,7 +192,7 @@ struct Value {
             case Type::Bool: return bool_val;
             case Type::Int: return int_val != 0;
             case Type::Double: return double_val != 0.0;
-            case Type::String: return !string_val.empty();
+            case Type::String: return !string_val->empty();
             default: return true;
         }
     }
@@ -109,32 +203,82 @@ struct Value {
             case Type::Bool: return bool_val ? "true" : "false";
             case Type::Int: return std::to_string(int_val);
             case Type::Double: return std::to_string(double_val);
-            case Type::String: return string_val;
+            case Type::String: return string_val->str();
             case Type::Function: return "<function>";
             case Type::BuiltinFunction: return "<builtin>";
             default: return "<unknown>";
         }
     }
 
+    // Name reported by the type() builtin and in type errors
+    const char *typeName() const {
+        switch (type) {
+            case Type::Nil: return "nil";
+            case Type::Int: return "int";
+            case Type::Double: return "double";
+            case Type::Bool: return "bool";
+            case Type::String: return "string";
+            case Type::Function: return "function";
+            case Type::BuiltinFunction: return "builtin";
+            default: return "unknown";
+        }
+    }
+
     bool isNumeric() const {
         return type == Type::Int || type == Type::Double;
     }
+
+private:
+    void release()
+    {
+        if (type == Type::String) {
+            String::release(string_val);
+        }
+    }
 };
 
-// Exception for return statements
-class ReturnException : public std::exception {
-public:
-    Value value;
-    ReturnException(const Value &v) : value(v) {}
+static_assert(sizeof(Value) == 16, "Value should stay a tag plus one word");
+
+// The arguments of a native call, in place in the caller's frame: a call
+// copies and allocates nothing. The builtin may move them out.
+struct Args {
+    Value *values;
+    size_t count;
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    Value &operator[](size_t i) const { return values[i]; }
 };
 
-// Environment for variable storage
+// Control flow leaving the current statement list. Statement loops stop
+// as soon as it is set, the owner of the target resets it to None.
+enum class Unwind {
+    None,
+    Return,     // return_value holds the result for callFunction
+    TailCall,   // callFunction runs tail_function on the same frame
+    Break,      // reset by the innermost loop, which stops
+    Continue    // reset by the innermost loop, which runs its next iteration
+};
+
+// Environment for global variable storage, locals live in call frames.
+// The builtins are not stored: a name the root does not define is looked
+// up in their table, defining it there shadows the builtin.
 class Environment {
 public:
-    Environment(Environment *parent = nullptr) : parent(parent) {}
+    Environment(Environment *parent = nullptr) : parent(parent), current_epoch(nextEpoch()) {}
 
     void define(const std::string &name, const Value &value) {
         vars[name] = value;
+        current_epoch = nextEpoch();
+    }
+
+    // Undefined names give nullptr instead of throwing, builtins too
+    const Value *find(const std::string &name) const {
+        auto it = vars.find(name);
+        if (it != vars.end()) {
+            return &it->second;
+        }
+        return parent ? parent->find(name) : nullptr;
     }
 
     Value get(const std::string &name) const {
@@ -145,6 +289,9 @@ public:
         if (parent) {
             return parent->get(name);
         }
+        if (const Builtin *builtin = findBuiltin(name)) {
+            return Value::makeBuiltin(builtin);
+        }
         throw std::runtime_error("Undefined variable: " + name);
     }
 
@@ -152,19 +299,24 @@ public:
         auto it = vars.find(name);
         if (it != vars.end()) return true;
         if (parent) return parent->has(name);
-        return false;
+        return findBuiltin(name) != nullptr;
     }
 
     void set(const std::string &name, const Value &value) {
         auto it = vars.find(name);
         if (it != vars.end()) {
             it->second = value;
+            current_epoch = nextEpoch();
             return;
         }
         if (parent) {
             parent->set(name, value);
             return;
         }
+        if (findBuiltin(name)) {
+            define(name, value);
+            return;
+        }
         throw std::runtime_error("Undefined variable: " + name);
     }
 
@@ -176,17 +328,51 @@ public:
         return parent;
     }
 
+    // Changes on every define or set. Epochs are unique across all
+    // environments, so a cached lookup is valid only where it was made.
+    uint64_t epoch() const {
+        return current_epoch;
+    }
+
 private:
     std::map<std::string, Value> vars;
     Environment *parent;
+    uint64_t current_epoch;
+
+    static uint64_t nextEpoch() {
+        static std::atomic<uint64_t> counter(0);
+        return ++counter;
+    }
+};
+
+// Compile-time debugger policy of BasicEvalVisitor. Without the debugger
+// no node pays for it: every hook is an if on a constant.
+struct NoDebug {
+    static constexpr bool enabled = false;
+};
+
+// Stops before every node when stepping, at breakpoints when continuing
+struct WithDebug {
+    static constexpr bool enabled = true;
 };
 
 // The interpreter visitor
-class EvalVisitor : public Visitor
+template <class Debug>
+class BasicEvalVisitor : public Visitor
 {
 public:
-    EvalVisitor();
-    void setDebugMode(bool enabled);
+    BasicEvalVisitor();
+    // Compiles int functions to machine code once called threshold times,
+    // never under the debugger
+    void setJit(bool enabled, uint32_t threshold = JitCompiler::kDefaultThreshold);
+    // Every call is recorded on the stack of profiler, see Profiler
+    void setProfiler(Profiler *profiler) { this->profiler = profiler; }
+
+    // Debugger breakpoints on the statements of a line, or on entering a
+    // function. With one set before run(), the program runs until it hits
+    // one instead of stopping at the first node.
+    void breakAtLine(int line);
+    void breakAtFunction(const std::string &name);
 
     Value evaluate(Node *node);
     Value run(ModuleNode *module);
@@ -198,24 +384,66 @@ public:
     #undef AST_NODE
 
 private:
+    // A local visible to the debugger, recorded only in debug mode
+    struct DebugLocal {
+        std::string name;
+        int depth;
+        int slot;
+    };
+
     Value result;
-    Environment *env;
+    Unwind unwind;
+    Value return_value;
+    FunctionNode *tail_function;  // callee of a return f(...), see Unwind
+    size_t tail_nargs;
     Environment global_env;
     ModuleNode *current_module;
-    bool debug_mode;
+
+    // Flat call frames: the locals of the running function are
+    // stack[frame_base + slot], slots were assigned by ResolveVisitor
+    std::vector<Value> stack;
+    size_t frame_base;
+    size_t stack_top;
+
+    bool jit_enabled;
+    uint32_t jit_threshold;
+    std::unique_ptr<JitCompiler> jit;
+    Profiler *profiler;
+
     bool debug_continue;
     size_t debug_step;
     size_t debug_depth;
-
-    void registerBuiltins();
-    Value callFunction(FunctionNode *fn, std::vector<Value> &args);
+    std::vector<DebugLocal> debug_locals;
+    size_t debug_frame;  // first entry of debug_locals in the running call
+    std::vector<bool> break_lines;  // indexed by line
+    std::set<std::string> break_names;
+    std::set<const FunctionNode *> break_functions;  // break_names found in the module
+    const FunctionNode *break_entered;  // hit since the last stop, or null
+
+    Value callFunction(FunctionNode *fn, size_t base, size_t nargs);
+    Value callBuiltin(const Builtin *builtin, size_t base, size_t nargs);
+    void loadCall(FunctionCallNode *node, size_t base, FunctionNode *&fn, const Builtin *&builtin);
+    bool linkCall(FunctionCallNode *node);
+    bool loopBody(BlockNode *body);
+    void reserveStack(size_t size);
     void debugBefore(Node *node);
+    void debugSetBreakpoint(const std::string &where, bool set);
+    void debugFindFunctions();
+    void debugPrintBreakpoints() const;
     std::string debugNodeText(Node *node);
     void debugPrintEnvironment() const;
     void debugPrintHelp() const;
     void debugPrintValue(const std::string &name) const;
 };
 
+// Both are compiled in eval.cpp
+extern template class BasicEvalVisitor<NoDebug>;
+extern template class BasicEvalVisitor<WithDebug>;
+
+typedef BasicEvalVisitor<NoDebug> EvalVisitor;
+// The interpreter under --debug
+typedef BasicEvalVisitor<WithDebug> DebugEvalVisitor;
+
 }}
 
 #endif
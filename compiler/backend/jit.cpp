@@ -0,0 +1,779 @@
+#include <algorithm>
+#include <cstring>
+
+#include "compiler/backend/jit.h"
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__FreeBSD__))
+#define PIE_JIT_X64 1
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#define PIE_JIT_X64 0
+#endif
+
+namespace pie { namespace compiler {
+
+const uint32_t JitCompiler::kDefaultThreshold;
+const size_t JitCompiler::kMaxParams;
+
+namespace {
+
+// The type a value crosses into or out of native code with, see
+// JitCompiler
+static OperandType declared(TypeNode *type)
+{
+    if (type && !type->is_array && type->name == "double") return OperandType::Double;
+    return OperandType::Int;
+}
+
+static uint32_t signature(FunctionNode *fn)
+{
+    uint32_t doubles = 0;
+    for (size_t i = 0; i < fn->params.size(); i++) {
+        if (declared(fn->params[i].second) == OperandType::Double) doubles |= 1u << i;
+    }
+    if (declared(fn->return_type) == OperandType::Double) doubles |= JitCompiler::kDoubleResult;
+    return doubles;
+}
+
+// Emits the machine code of one function, a stack machine over rax:
+// every expression leaves its value in rax, a double as its bits, the lhs
+// of a binary operator waits on the native stack while the rhs runs.
+//
+// Frame: local slot s at [rbp - 8 * (s + 1)], then the argument arrays of
+// the call sites. Callees are entered through their native_code field, so
+// a call works whichever function of a group is installed first.
+class Emitter {
+public:
+    std::vector<uint8_t> code;
+    std::vector<FunctionNode *> callees;
+
+    Emitter(FunctionNode *fn, const std::map<std::string, FunctionNode *> &globals,
+            const std::set<std::string> &assigned)
+        : fn(fn), globals(globals), assigned(assigned), depth(0), call_slots(0), body(0)
+    {
+    }
+
+    // False when fn does not qualify, see JitCompiler
+    bool emit()
+    {
+        if (fn->params.size() > JitCompiler::kMaxParams) return false;
+
+        // push rbp; mov rbp, rsp; sub rsp, frame
+        bytes({ 0x55, 0x48, 0x89, 0xe5, 0x48, 0x81, 0xec });
+        size_t frame_at = code.size();
+        imm32(0);
+
+        // Arguments arrive as an array in rdi
+        types.assign(std::max((size_t)fn->frame_size, fn->params.size()), OperandType::Int);
+        for (size_t i = 0; i < fn->params.size(); i++) {
+            bytes({ 0x48, 0x8b, 0x87 });  // mov rax, [rdi + disp32]
+            imm32((int32_t)(8 * i));
+            storeLocal((int)i);
+            types[i] = declared(fn->params[i].second);
+        }
+        body = newLabel();
+        bind(body);
+
+        bool reachable = true;
+        for (Node *stmt : fn->children) {
+            if (!statement(stmt, reachable)) return false;
+        }
+        // Falling off the end returns nil
+        if (reachable) return false;
+
+        for (const Fixup &fixup : fixups) {
+            patch32(fixup.at, (int32_t)(labels[fixup.label] - (fixup.at + 4)));
+        }
+
+        size_t frame = 8 * (fn->frame_size + call_slots);
+        frame = (frame + 15) & ~(size_t)15;
+        patch32(frame_at, (int32_t)frame);
+        return true;
+    }
+
+private:
+    struct Fixup {
+        size_t at;
+        int label;
+    };
+
+    // Targets of break and continue in the innermost loop
+    struct Loop {
+        int next;
+        int end;
+        bool broken;  // a break jumps to end
+    };
+
+    FunctionNode *fn;
+    const std::map<std::string, FunctionNode *> &globals;
+    const std::set<std::string> &assigned;
+    int depth;       // values pushed on the native stack
+    int call_slots;  // argument slots reserved below the locals
+    int body;        // label after the prologue
+    std::vector<OperandType> types;  // of each local slot, as of its last let
+    std::vector<size_t> labels;
+    std::vector<Fixup> fixups;
+    std::vector<Loop> loops;
+
+    void byte(uint8_t b) { code.push_back(b); }
+
+    void bytes(std::initializer_list<uint8_t> list)
+    {
+        code.insert(code.end(), list.begin(), list.end());
+    }
+
+    void imm32(int32_t v)
+    {
+        uint8_t raw[4];
+        memcpy(raw, &v, 4);
+        code.insert(code.end(), raw, raw + 4);
+    }
+
+    void imm64(int64_t v)
+    {
+        uint8_t raw[8];
+        memcpy(raw, &v, 8);
+        code.insert(code.end(), raw, raw + 8);
+    }
+
+    static int64_t bits(double v)
+    {
+        int64_t raw;
+        memcpy(&raw, &v, 8);
+        return raw;
+    }
+
+    void patch32(size_t at, int32_t v)
+    {
+        memcpy(&code[at], &v, 4);
+    }
+
+    int newLabel()
+    {
+        labels.push_back(0);
+        return (int)labels.size() - 1;
+    }
+
+    void bind(int label)
+    {
+        labels[label] = code.size();
+    }
+
+    void jump(int label)
+    {
+        byte(0xe9);
+        fixups.push_back({ code.size(), label });
+        imm32(0);
+    }
+
+    void jumpIf(uint8_t cc, int label)
+    {
+        bytes({ 0x0f, cc });
+        fixups.push_back({ code.size(), label });
+        imm32(0);
+    }
+
+    static int32_t slotDisp(int slot)
+    {
+        return -8 * (slot + 1);
+    }
+
+    void loadLocal(int slot)
+    {
+        bytes({ 0x48, 0x8b, 0x85 });  // mov rax, [rbp + disp32]
+        imm32(slotDisp(slot));
+    }
+
+    void storeLocal(int slot)
+    {
+        bytes({ 0x48, 0x89, 0x85 });  // mov [rbp + disp32], rax
+        imm32(slotDisp(slot));
+    }
+
+    void push()
+    {
+        byte(0x50);  // push rax
+        depth++;
+    }
+
+    void popRcx()
+    {
+        // mov rcx, rax; pop rax
+        bytes({ 0x48, 0x89, 0xc1, 0x58 });
+        depth--;
+    }
+
+    // Converts the int in rax to a double
+    void widen()
+    {
+        bytes({ 0xf2, 0x48, 0x0f, 0x2a, 0xc0 });  // cvtsi2sd xmm0, rax
+        bytes({ 0x66, 0x48, 0x0f, 0x7e, 0xc0 });  // movq rax, xmm0
+    }
+
+    // Moves the operands in rax and rcx to xmm0 and xmm1 as doubles
+    void doubles(OperandType lhs, OperandType rhs)
+    {
+        if (lhs == OperandType::Int) {
+            bytes({ 0xf2, 0x48, 0x0f, 0x2a, 0xc0 });  // cvtsi2sd xmm0, rax
+        } else {
+            bytes({ 0x66, 0x48, 0x0f, 0x6e, 0xc0 });  // movq xmm0, rax
+        }
+        if (rhs == OperandType::Int) {
+            bytes({ 0xf2, 0x48, 0x0f, 0x2a, 0xc9 });  // cvtsi2sd xmm1, rcx
+        } else {
+            bytes({ 0x66, 0x48, 0x0f, 0x6e, 0xc9 });  // movq xmm1, rcx
+        }
+    }
+
+    static bool isLeaf(Node *node)
+    {
+        if (dyn_cast<IntNode>(node) || dyn_cast<DoubleNode>(node)) return true;
+        IdentifierNode *id = dyn_cast<IdentifierNode>(node);
+        return id && id->slot >= 0;
+    }
+
+    // Leaves lhs in rax and rhs in rcx, a leaf rhs is loaded directly
+    bool operands(Node *lhs, Node *rhs, OperandType &left, OperandType &right)
+    {
+        if (isLeaf(rhs)) {
+            if (!expression(lhs, left)) return false;
+            if (IntNode *lit = dyn_cast<IntNode>(rhs)) {
+                bytes({ 0x48, 0xb9 });  // mov rcx, imm64
+                imm64(lit->value);
+                right = OperandType::Int;
+            } else if (DoubleNode *lit = dyn_cast<DoubleNode>(rhs)) {
+                bytes({ 0x48, 0xb9 });  // mov rcx, imm64
+                imm64(bits(lit->value));
+                right = OperandType::Double;
+            } else {
+                int slot = static_cast<IdentifierNode*>(rhs)->slot;
+                bytes({ 0x48, 0x8b, 0x8d });  // mov rcx, [rbp + disp32]
+                imm32(slotDisp(slot));
+                right = types[slot];
+            }
+            return true;
+        }
+
+        if (!expression(lhs, left)) return false;
+        push();
+        if (!expression(rhs, right)) return false;
+        popRcx();
+        return true;
+    }
+
+    // The operand types must be the ones TypeCheckVisitor proved, if any:
+    // a specialized operator reads its operands without tag checks
+    static bool agrees(BinaryOpNode *op, OperandType left, OperandType right)
+    {
+        return op->operand_type == OperandType::Any ||
+               (left == op->operand_type && right == op->operand_type);
+    }
+
+    // Emits node, which must leave a value of the type wanted: the
+    // evaluator would store or return any other as it is
+    bool value(Node *node, OperandType wanted)
+    {
+        OperandType type;
+        return expression(node, type) && type == wanted;
+    }
+
+    bool statement(Node *node, bool &reachable)
+    {
+        if (!node || !reachable) return true;
+
+        if (ReturnNode *ret = dyn_cast<ReturnNode>(node)) {
+            if (FunctionCallNode *call = dyn_cast<FunctionCallNode>(ret->expr)) {
+                reachable = false;
+                return tailCall(call);
+            }
+            if (!ret->expr || !value(ret->expr, declared(fn->return_type))) return false;
+            bytes({ 0x48, 0x89, 0xec, 0x5d, 0xc3 });  // mov rsp, rbp; pop rbp; ret
+            reachable = false;
+            return true;
+        }
+
+        if (LetNode *let = dyn_cast<LetNode>(node)) {
+            if (!let->value || !expression(let->value, types[let->slot])) return false;
+            storeLocal(let->slot);
+            return true;
+        }
+
+        if (BlockNode *block = dyn_cast<BlockNode>(node)) {
+            for (Node *stmt : block->children) {
+                if (!statement(stmt, reachable)) return false;
+            }
+            return true;
+        }
+
+        if (IfNode *branch = dyn_cast<IfNode>(node)) {
+            int otherwise = newLabel();
+            if (!condition(branch->condition, otherwise, false)) return false;
+
+            bool then_reachable = true;
+            if (!statement(branch->then_block, then_reachable)) return false;
+
+            if (!branch->else_block) {
+                bind(otherwise);
+                return true;
+            }
+
+            int end = newLabel();
+            if (then_reachable) jump(end);
+            bind(otherwise);
+            bool else_reachable = true;
+            if (!statement(branch->else_block, else_reachable)) return false;
+            bind(end);
+            reachable = then_reachable || else_reachable;
+            return true;
+        }
+
+        if (WhileNode *loop = dyn_cast<WhileNode>(node)) {
+            int start = newLabel();
+            bind(start);
+            return loopBody(loop->condition, loop->body, nullptr, start, reachable);
+        }
+
+        if (ForNode *loop = dyn_cast<ForNode>(node)) {
+            if (!statement(loop->init, reachable)) return false;
+            int start = newLabel();
+            bind(start);
+            return loopBody(loop->condition, loop->body, loop->step, start, reachable);
+        }
+
+        if (dyn_cast<BreakNode>(node) || dyn_cast<ContinueNode>(node)) {
+            if (loops.empty()) return false;
+            Loop &loop = loops.back();
+            if (dyn_cast<BreakNode>(node)) {
+                loop.broken = true;
+                jump(loop.end);
+            } else {
+                jump(loop.next);
+            }
+            reachable = false;
+            return true;
+        }
+
+        OperandType type;
+        return expression(node, type);
+    }
+
+    // The rest of a loop whose condition starts at label start: the body,
+    // the step, where continue goes, and the jump back
+    bool loopBody(Node *cond, BlockNode *body, Node *step, int start, bool &reachable)
+    {
+        IntNode *constant = dyn_cast<IntNode>(cond);
+        bool endless = !cond || (constant && constant->value != 0);
+
+        Loop loop = { newLabel(), newLabel(), false };
+        if (!endless && !condition(cond, loop.end, false)) return false;
+
+        loops.push_back(loop);
+        bool body_reachable = true;
+        bool ok = statement(body, body_reachable);
+        loop = loops.back();
+        loops.pop_back();
+        if (!ok) return false;
+
+        bind(loop.next);
+        OperandType type;
+        if (step && !expression(step, type)) return false;
+        jump(start);
+        bind(loop.end);
+
+        // Only a break leaves an endless loop
+        reachable = !endless || loop.broken;
+        return true;
+    }
+
+    // Jumps to label when the truth of node equals when
+    bool condition(Node *node, int label, bool when)
+    {
+        if (UnaryOpNode *op = dyn_cast<UnaryOpNode>(node)) {
+            if (op->op == UnaryOp::Not) return condition(op->expr, label, !when);
+        }
+
+        BinaryOpNode *op = dyn_cast<BinaryOpNode>(node);
+        if (op && (op->op == BinaryOp::And || op->op == BinaryOp::Or)) {
+            // Short-circuit: the lhs alone decides when it is false for
+            // And, true for Or
+            bool decides = op->op == BinaryOp::Or;
+            if (when == decides) {
+                return condition(op->lhs, label, when) && condition(op->rhs, label, when);
+            }
+            int skip = newLabel();
+            if (!condition(op->lhs, skip, decides)) return false;
+            if (!condition(op->rhs, label, when)) return false;
+            bind(skip);
+            return true;
+        }
+
+        if (op && isComparison(op->op)) {
+            // Ints compare as doubles, like the evaluator
+            OperandType left, right;
+            if (!operands(op->lhs, op->rhs, left, right) || !agrees(op, left, right)) return false;
+            doubles(left, right);
+            comparison(op->op, label, when);
+            return true;
+        }
+
+        // The truth of a double is not an int test
+        if (!value(node, OperandType::Int)) return false;
+        bytes({ 0x48, 0x85, 0xc0 });  // test rax, rax
+        jumpIf(when ? 0x85 : 0x84, label);
+        return true;
+    }
+
+    static bool isComparison(BinaryOp op)
+    {
+        switch (op) {
+            case BinaryOp::Lt:
+            case BinaryOp::Gt:
+            case BinaryOp::Le:
+            case BinaryOp::Ge:
+            case BinaryOp::Eq:
+            case BinaryOp::Ne:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // Jumps to label when comparing xmm0 to xmm1 with op gives when. A NaN
+    // compares unordered, which sets ZF, PF and CF: only ja, jae and a jp
+    // check leave it false like the evaluator.
+    void comparison(BinaryOp op, int label, bool when)
+    {
+        if (op == BinaryOp::Eq || op == BinaryOp::Ne) {
+            bytes({ 0x66, 0x0f, 0x2e, 0xc1 });  // ucomisd xmm0, xmm1
+            if ((op == BinaryOp::Eq) == when) {
+                int unordered = newLabel();
+                jumpIf(0x8a, unordered);  // jp
+                jumpIf(0x84, label);      // je
+                bind(unordered);
+            } else {
+                jumpIf(0x85, label);  // jne
+                jumpIf(0x8a, label);  // jp
+            }
+            return;
+        }
+
+        // a < b is b > a
+        if (op == BinaryOp::Lt || op == BinaryOp::Le) {
+            bytes({ 0x66, 0x0f, 0x2e, 0xc8 });  // ucomisd xmm1, xmm0
+        } else {
+            bytes({ 0x66, 0x0f, 0x2e, 0xc1 });  // ucomisd xmm0, xmm1
+        }
+        uint8_t cc = op == BinaryOp::Lt || op == BinaryOp::Gt ? 0x87 : 0x83;  // ja, jae
+        // The negations jbe and jb differ in the low bit
+        jumpIf(when ? cc : (uint8_t)(cc ^ 1), label);
+    }
+
+    // Emits node, type is set to the type of the value it leaves in rax
+    bool expression(Node *node, OperandType &type)
+    {
+        if (!node) return false;
+
+        if (IntNode *lit = dyn_cast<IntNode>(node)) {
+            bytes({ 0x48, 0xb8 });  // mov rax, imm64
+            imm64(lit->value);
+            type = OperandType::Int;
+            return true;
+        }
+
+        if (DoubleNode *lit = dyn_cast<DoubleNode>(node)) {
+            bytes({ 0x48, 0xb8 });  // mov rax, imm64
+            imm64(bits(lit->value));
+            type = OperandType::Double;
+            return true;
+        }
+
+        if (IdentifierNode *id = dyn_cast<IdentifierNode>(node)) {
+            if (id->slot < 0) return false;
+            loadLocal(id->slot);
+            type = types[id->slot];
+            return true;
+        }
+
+        if (AssignNode *assign = dyn_cast<AssignNode>(node)) {
+            // A local keeps the type of its let
+            IdentifierNode *id = dyn_cast<IdentifierNode>(assign->var);
+            if (!id || id->slot < 0 || !value(assign->value, types[id->slot])) return false;
+            storeLocal(id->slot);
+            type = types[id->slot];
+            return true;
+        }
+
+        if (UnaryOpNode *op = dyn_cast<UnaryOpNode>(node)) {
+            if (!expression(op->expr, type)) return false;
+            switch (op->op) {
+                case UnaryOp::Neg:
+                    if (type == OperandType::Int) {
+                        bytes({ 0x48, 0xf7, 0xd8 });  // neg rax
+                    } else {
+                        bytes({ 0x48, 0x0f, 0xba, 0xf8, 0x3f });  // btc rax, 63
+                    }
+                    return true;
+                case UnaryOp::CastInt:
+                    // A double would be a type error
+                    return type == OperandType::Int;
+                case UnaryOp::CastDouble:
+                    if (type == OperandType::Int) widen();
+                    type = OperandType::Double;
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        if (FunctionCallNode *call = dyn_cast<FunctionCallNode>(node)) {
+            return callExpression(call, type);
+        }
+
+        BinaryOpNode *op = dyn_cast<BinaryOpNode>(node);
+        if (!op) return false;
+
+        OperandType left, right;
+        if (op->op == BinaryOp::AddAssign || op->op == BinaryOp::SubAssign) {
+            IdentifierNode *id = dyn_cast<IdentifierNode>(op->lhs);
+            if (!id || id->slot < 0) return false;
+            // The current value is read before the rhs runs
+            if (!operands(id, op->rhs, left, right) || !agrees(op, left, right)) return false;
+            if (left == OperandType::Int && right == OperandType::Double) return false;
+            if (!arithmetic(op->op == BinaryOp::AddAssign ? BinaryOp::Add : BinaryOp::Sub, left, right, type)) {
+                return false;
+            }
+            storeLocal(id->slot);
+            return true;
+        }
+
+        switch (op->op) {
+            case BinaryOp::Add:
+            case BinaryOp::Sub:
+            case BinaryOp::Mul:
+                if (!operands(op->lhs, op->rhs, left, right) || !agrees(op, left, right)) return false;
+                return arithmetic(op->op, left, right, type);
+            default:
+                // Comparisons make bools, only conditions use them
+                return false;
+        }
+    }
+
+    // Applies an arithmetic operator to rax and rcx, an int is widened when
+    // the other side is a double
+    bool arithmetic(BinaryOp op, OperandType left, OperandType right, OperandType &type)
+    {
+        if (left == OperandType::Int && right == OperandType::Int) {
+            switch (op) {
+                case BinaryOp::Add: bytes({ 0x48, 0x01, 0xc8 }); break;        // add rax, rcx
+                case BinaryOp::Sub: bytes({ 0x48, 0x29, 0xc8 }); break;        // sub rax, rcx
+                case BinaryOp::Mul: bytes({ 0x48, 0x0f, 0xaf, 0xc1 }); break;  // imul rax, rcx
+                default: return false;
+            }
+            type = OperandType::Int;
+            return true;
+        }
+
+        doubles(left, right);
+        switch (op) {
+            case BinaryOp::Add: bytes({ 0xf2, 0x0f, 0x58, 0xc1 }); break;  // addsd xmm0, xmm1
+            case BinaryOp::Sub: bytes({ 0xf2, 0x0f, 0x5c, 0xc1 }); break;  // subsd xmm0, xmm1
+            case BinaryOp::Mul: bytes({ 0xf2, 0x0f, 0x59, 0xc1 }); break;  // mulsd xmm0, xmm1
+            default: return false;
+        }
+        bytes({ 0x66, 0x48, 0x0f, 0x7e, 0xc0 });  // movq rax, xmm0
+        type = OperandType::Double;
+        return true;
+    }
+
+    // The module function a call binds to, null when it may be anything else
+    FunctionNode *callee(FunctionCallNode *call)
+    {
+        if (!call->scope.empty() || call->slot >= 0 || assigned.count(call->name)) return nullptr;
+
+        auto it = globals.find(call->name);
+        if (it == globals.end()) return nullptr;
+
+        // A missing argument would be nil
+        if (call->children.size() != it->second->params.size()) return nullptr;
+        return it->second;
+    }
+
+    // Stores the arguments of a call to target to slots first, first - 1,
+    // ..., so the array ascends in memory, returns first or -1
+    int arguments(FunctionCallNode *call, FunctionNode *target)
+    {
+        int nargs = (int)call->children.size();
+        int first = fn->frame_size + call_slots + nargs - 1;
+        call_slots += nargs;
+        for (int i = 0; i < nargs; i++) {
+            // An int passed as a double is widened, like the guard of the
+            // parameter does
+            OperandType type, wanted = declared(target->params[i].second);
+            if (!expression(call->children[i], type)) return -1;
+            if (type != wanted) {
+                if (wanted == OperandType::Int) return -1;
+                widen();
+            }
+            storeLocal(first - i);
+        }
+        return first;
+    }
+
+    bool callExpression(FunctionCallNode *call, OperandType &type)
+    {
+        FunctionNode *target = callee(call);
+        int first = target ? arguments(call, target) : -1;
+        if (first < 0) return false;
+
+        bytes({ 0x48, 0x8d, 0xbd });  // lea rdi, [rbp + disp32]
+        imm32(slotDisp(first));
+
+        // Calls need a 16 byte aligned stack
+        bool pad = depth % 2 != 0;
+        if (pad) bytes({ 0x48, 0x83, 0xec, 0x08 });  // sub rsp, 8
+        bytes({ 0x48, 0xb8 });  // mov rax, &target->native_code
+        imm64((int64_t)(intptr_t)&target->native_code);
+        bytes({ 0xff, 0x10 });  // call [rax]
+        if (pad) bytes({ 0x48, 0x83, 0xc4, 0x08 });  // add rsp, 8
+
+        callees.push_back(target);
+        type = declared(target->return_type);
+        return true;
+    }
+
+    // return fn(...) jumps back to the body with the new arguments. Other
+    // tail calls do not qualify: the evaluator runs them in constant
+    // stack, native calls would not.
+    bool tailCall(FunctionCallNode *call)
+    {
+        int first = callee(call) == fn ? arguments(call, fn) : -1;
+        if (first < 0) return false;
+
+        for (size_t i = 0; i < fn->params.size(); i++) {
+            loadLocal(first - (int)i);
+            storeLocal((int)i);
+        }
+        jump(body);
+        return true;
+    }
+};
+
+static void collectAssigned(Node *node, std::set<std::string> &names)
+{
+    if (!node) return;
+
+    IdentifierNode *id = nullptr;
+    if (AssignNode *assign = dyn_cast<AssignNode>(node)) {
+        id = dyn_cast<IdentifierNode>(assign->var);
+    } else if (BinaryOpNode *op = dyn_cast<BinaryOpNode>(node)) {
+        if (op->op == BinaryOp::AddAssign || op->op == BinaryOp::SubAssign) {
+            id = dyn_cast<IdentifierNode>(op->lhs);
+        }
+    }
+    if (id) names.insert(id->name);
+
+    for (Node *child : node->children) {
+        collectAssigned(child, names);
+    }
+}
+
+}
+
+JitCompiler::JitCompiler(ModuleNode *module)
+{
+    // Later definitions win, like in the global environment
+    for (FunctionNode *fn : module->functions) {
+        globals[fn->name] = fn;
+        collectAssigned(fn, assigned);
+    }
+}
+
+JitCompiler::~JitCompiler()
+{
+    for (CodeBlock &block : blocks) {
+        release(block);
+    }
+}
+
+bool JitCompiler::supported()
+{
+    return PIE_JIT_X64;
+}
+
+bool JitCompiler::compile(FunctionNode *fn)
+{
+    if (fn->native_code) return true;
+    if (!supported() || rejected.count(fn)) return false;
+
+    // The callees are compiled along, the group is installed only once
+    // all of them qualify
+    std::vector<std::pair<FunctionNode *, CodeBlock>> group;
+    std::set<FunctionNode *> seen;
+    std::vector<FunctionNode *> pending(1, fn);
+    bool ok = true;
+
+    while (ok && !pending.empty()) {
+        FunctionNode *next = pending.back();
+        pending.pop_back();
+        if (next->native_code || !seen.insert(next).second) continue;
+
+        Emitter emitter(next, globals, assigned);
+        CodeBlock block;
+        if (rejected.count(next) || !emitter.emit() || !install(emitter.code, block)) {
+            rejected.insert(next);
+            ok = false;
+            break;
+        }
+        group.push_back(std::make_pair(next, block));
+        pending.insert(pending.end(), emitter.callees.begin(), emitter.callees.end());
+    }
+
+    if (!ok) {
+        for (auto &entry : group) {
+            release(entry.second);
+        }
+        rejected.insert(fn);
+        return false;
+    }
+
+    for (auto &entry : group) {
+        entry.first->native_doubles = signature(entry.first);
+        entry.first->native_code = entry.second.memory;
+        blocks.push_back(entry.second);
+    }
+    return true;
+}
+
+// Copies code into fresh pages and makes them executable
+bool JitCompiler::install(const std::vector<uint8_t> &code, CodeBlock &block)
+{
+#if PIE_JIT_X64
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t size = (code.size() + page - 1) / page * page;
+    void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) return false;
+
+    memcpy(memory, code.data(), code.size());
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        return false;
+    }
+
+    block.memory = memory;
+    block.size = size;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void JitCompiler::release(CodeBlock &block)
+{
+#if PIE_JIT_X64
+    munmap(block.memory, block.size);
+#endif
+    block.memory = nullptr;
+}
+
+}}
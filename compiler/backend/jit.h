@@ -0,0 +1,76 @@
+#ifndef __PIE_BACKEND_JIT__
+#define __PIE_BACKEND_JIT__
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "compiler/ast.h"
+
+namespace pie { namespace compiler {
+
+// Baseline template JIT for numeric functions on x86-64.
+//
+// A function qualifies when every value it computes is an int or a double
+// whose type is known where it is emitted: parameters are doubles when
+// annotated so and ints otherwise, a local has the type of its let, and
+// the result is a double when annotated so. Arithmetic (+, -, *, unary -),
+// comparisons used as conditions, loops, and calls to other qualifying
+// functions of the module qualify; an int argument is widened to a double
+// parameter, any other mismatch does not qualify. It must return a value
+// on every path, and a returned call may only recurse into itself, as a
+// jump. Its body is then emitted as machine code into mmap'd memory, every
+// function it calls is compiled with it. Anything else (strings, builtins,
+// division) keeps running in EvalVisitor.
+//
+// Values cross into native code untagged, a double as its bits, and double
+// operators run on SSE2 scalars. Compiled code is entered through
+// FunctionNode::native_code as a NativeFunction, FunctionNode::native_doubles
+// tells which arguments and result are doubles.
+class JitCompiler
+{
+public:
+    typedef int64_t (*NativeFunction)(const int64_t *args);
+
+    static const uint32_t kDefaultThreshold = 100;  // calls before compiling
+    static const size_t kMaxParams = 16;
+    static const uint32_t kDoubleResult = 1u << 31;  // in native_doubles
+
+    // The module must already be resolved
+    explicit JitCompiler(ModuleNode *module);
+    ~JitCompiler();
+
+    JitCompiler(const JitCompiler &) = delete;
+    JitCompiler &operator=(const JitCompiler &) = delete;
+
+    // Whether this build can emit code for the host
+    static bool supported();
+
+    // Compiles fn and its callees, false when one of them does not qualify
+    bool compile(FunctionNode *fn);
+
+    static int64_t invoke(FunctionNode *fn, const int64_t *args)
+    {
+        return reinterpret_cast<NativeFunction>(fn->native_code)(args);
+    }
+
+private:
+    struct CodeBlock {
+        void *memory;
+        size_t size;
+    };
+
+    std::map<std::string, FunctionNode *> globals;  // callee each name binds to
+    std::set<std::string> assigned;  // names that may be rebound at runtime
+    std::set<FunctionNode *> rejected;
+    std::vector<CodeBlock> blocks;
+
+    bool install(const std::vector<uint8_t> &code, CodeBlock &block);
+    void release(CodeBlock &block);
+};
+
+}}
+
+#endif
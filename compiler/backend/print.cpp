@@ -45,6 +45,8 @@ std::string PrintVisitor::unaryOpToString(UnaryOp op)
         case UnaryOp::Not: return "!";
         case UnaryOp::Inc: return "++";
         case UnaryOp::Dec: return "--";
+        case UnaryOp::CastInt: return "(int)";
+        case UnaryOp::CastDouble: return "(double)";
         default: return "?";
     }
 }
@@ -158,6 +160,9 @@ void PrintVisitor::visit(ClosureNode *node)
 
 void PrintVisitor::visit(FunctionCallNode *node)
 {
+    if (!node->scope.empty()) {
+        out << node->scope << ".";
+    }
     out << node->name << "(";
 
     bool first = true;
@@ -213,6 +218,11 @@ void PrintVisitor::visit(StringNode *node)
     out << "\"" << node->str << "\"";
 }
 
+void PrintVisitor::visit(BoolNode *node)
+{
+    out << (node->value ? "true" : "false");
+}
+
 void PrintVisitor::visit(IdentifierNode *node)
 {
     out << node->name;
@@ -261,6 +271,50 @@ void PrintVisitor::visit(IfNode *node)
     }
 }
 
+void PrintVisitor::visit(WhileNode *node)
+{
+    out << "while (";
+    if (node->condition) {
+        node->condition->visit(this);
+    }
+    out << ") ";
+
+    if (node->body) {
+        node->body->visit(this);
+    }
+}
+
+void PrintVisitor::visit(ForNode *node)
+{
+    out << "for (";
+    if (node->init) {
+        node->init->visit(this);
+    }
+    out << "; ";
+    if (node->condition) {
+        node->condition->visit(this);
+    }
+    out << "; ";
+    if (node->step) {
+        node->step->visit(this);
+    }
+    out << ") ";
+
+    if (node->body) {
+        node->body->visit(this);
+    }
+}
+
+void PrintVisitor::visit(BreakNode *node)
+{
+    out << "break";
+}
+
+void PrintVisitor::visit(ContinueNode *node)
+{
+    out << "continue";
+}
+
 void PrintVisitor::visit(BlockNode *node)
 {
     out << "{";
@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <signal.h>
+#include <sys/time.h>
+#define PIE_PROFILE_TIMER 1
+#else
+#define PIE_PROFILE_TIMER 0
+#endif
+
+#include "compiler/backend/profile.h"
+
+namespace pie { namespace compiler {
+
+namespace {
+
+// Slots of the sample buffer, 32 MB that are only touched as they fill:
+// over an hour of samples 8 frames deep
+const size_t kBufferSlots = 4 << 20;
+
+std::atomic<Profiler *> active(nullptr);
+
+std::string label(const FunctionNode *fn)
+{
+    return fn->line > 0 ? fn->name + ":" + std::to_string(fn->line) : fn->name;
+}
+
+}
+
+Profiler::Profiler(unsigned interval)
+    : interval(std::max(interval, 1u)), depth(0), buffer(nullptr), capacity(0),
+      used(0), taken(0), lost(0), running(false), started(0), seconds(0)
+{
+}
+
+Profiler::~Profiler()
+{
+    stop();
+    delete[] buffer;
+}
+
+bool Profiler::supported()
+{
+    return PIE_PROFILE_TIMER;
+}
+
+bool Profiler::start()
+{
+#if PIE_PROFILE_TIMER
+    Profiler *none = nullptr;
+    if (running || !active.compare_exchange_strong(none, this)) {
+        return false;
+    }
+
+    if (!buffer) {
+        buffer = new uintptr_t[kBufferSlots];
+        capacity = kBufferSlots;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+
+    struct itimerval timer;
+    timer.it_interval.tv_sec = interval / 1000000;
+    timer.it_interval.tv_usec = interval % 1000000;
+    timer.it_value = timer.it_interval;
+
+    if (sigaction(SIGPROF, &action, nullptr) != 0 || setitimer(ITIMER_PROF, &timer, nullptr) != 0) {
+        active = nullptr;
+        return false;
+    }
+    running = true;
+    started = std::clock();
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Profiler::stop()
+{
+#if PIE_PROFILE_TIMER
+    if (!running) return;
+
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, nullptr);
+
+    // A signal still pending is dropped
+    signal(SIGPROF, SIG_IGN);
+    active = nullptr;
+    running = false;
+    seconds += (double)(std::clock() - started) / CLOCKS_PER_SEC;
+#endif
+}
+
+void Profiler::handler(int)
+{
+    if (Profiler *profiler = active.load(std::memory_order_relaxed)) {
+        profiler->sample();
+    }
+}
+
+void Profiler::sample()
+{
+    size_t n = depth.load(std::memory_order_relaxed);
+    std::atomic_signal_fence(std::memory_order_acquire);
+    size_t count = std::min(n, kMaxDepth);
+
+    size_t at = used.load(std::memory_order_relaxed);
+    if (at + count + 1 > capacity) {
+        lost.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    buffer[at] = n;
+    for (size_t i = 0; i < count; i++) {
+        buffer[at + 1 + i] = (uintptr_t)frames[i].load(std::memory_order_relaxed);
+    }
+    used.store(at + count + 1, std::memory_order_relaxed);
+    taken.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Profiler::writeFolded(std::ostream &out) const
+{
+    std::map<std::string, size_t> stacks;
+    std::string stack;
+
+    for (size_t at = 0, end = used; at < end; ) {
+        size_t n = buffer[at];
+        size_t count = std::min(n, kMaxDepth);
+
+        stack.clear();
+        for (size_t i = 0; i < count; i++) {
+            if (i > 0) stack += ';';
+            stack += label((const FunctionNode *)buffer[at + 1 + i]);
+        }
+        if (n > count) stack += ";[deeper]";
+        if (n == 0) stack = "[outside]";
+
+        stacks[stack]++;
+        at += count + 1;
+    }
+
+    for (auto &entry : stacks) {
+        out << entry.first << " " << entry.second << "\n";
+    }
+}
+
+void Profiler::writeSummary(std::ostream &out, size_t top) const
+{
+    struct Counts {
+        std::string name;
+        size_t self;
+        size_t total;
+    };
+    std::map<const FunctionNode *, Counts> functions;
+    std::set<const FunctionNode *> seen;
+
+    for (size_t at = 0, end = used; at < end; ) {
+        size_t n = buffer[at];
+        size_t count = std::min(n, kMaxDepth);
+
+        // A recursive function counts once per sample in its total
+        seen.clear();
+        for (size_t i = 0; i < count; i++) {
+            const FunctionNode *fn = (const FunctionNode *)buffer[at + 1 + i];
+            Counts &counts = functions[fn];
+            if (counts.name.empty()) counts.name = label(fn);
+            if (seen.insert(fn).second) counts.total++;
+            if (i + 1 == n) counts.self++;
+        }
+        at += count + 1;
+    }
+
+    std::vector<Counts> sorted;
+    for (auto &entry : functions) {
+        sorted.push_back(entry.second);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const Counts &a, const Counts &b) {
+        return a.self != b.self ? a.self > b.self : a.total > b.total;
+    });
+
+    size_t samples = taken;
+    double ms = seconds * 1000.0 / std::max<size_t>(samples, 1);
+    char line[256];
+    snprintf(line, sizeof(line), "%zu samples in %.1fms of CPU time", samples, seconds * 1000.0);
+    out << line;
+    if (lost > 0) out << ", " << lost << " dropped";
+    out << "\n";
+    if (samples == 0) return;
+
+    out << "   self          total         function\n";
+    for (size_t i = 0; i < sorted.size() && i < top; i++) {
+        const Counts &counts = sorted[i];
+        snprintf(line, sizeof(line), "%6.1f%% %6.1fms %6.1f%% %6.1fms  %s\n",
+                 100.0 * counts.self / samples, counts.self * ms,
+                 100.0 * counts.total / samples, counts.total * ms,
+                 counts.name.c_str());
+        out << line;
+    }
+}
+
+}}
@@ -0,0 +1,115 @@
+#ifndef __PIE_BACKEND_PROFILE__
+#define __PIE_BACKEND_PROFILE__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <ostream>
+
+#include "compiler/ast.h"
+
+namespace pie { namespace compiler {
+
+// Sampling profiler of the Pie call stack, see --profile.
+//
+// An engine given a Profiler calls enter() and leave() around every
+// function it runs, which keeps the stack of running functions in a
+// fixed array. A SIGPROF timer then copies that array into a sample
+// buffer allocated up front: the signal handler neither allocates nor
+// locks. Functions running as machine code count as the function that
+// entered them, builtins as their caller.
+//
+// After stop(), samples are written as folded stacks, one line per
+// distinct stack with its count ("main:7;fib:1 42"), the input of
+// flamegraph.pl, and summed per function. The kernel may fire the timer
+// less often than asked (at every scheduler tick, 4ms with HZ=250), times
+// are shares of the CPU time measured between start() and stop().
+class Profiler {
+public:
+    static constexpr unsigned kDefaultInterval = 1000;  // microseconds of CPU time
+    static constexpr size_t kMaxDepth = 512;        // deeper frames are not sampled
+
+    explicit Profiler(unsigned interval = kDefaultInterval);
+    ~Profiler();
+
+    Profiler(const Profiler &) = delete;
+    Profiler &operator=(const Profiler &) = delete;
+
+    // Whether this build has a SIGPROF timer
+    static bool supported();
+
+    // Only one profiler runs at a time: the timer is per process. False
+    // when the timer cannot be set.
+    bool start();
+    void stop();
+
+    void enter(const FunctionNode *fn)
+    {
+        size_t at = depth.load(std::memory_order_relaxed);
+        if (at < kMaxDepth) frames[at].store(fn, std::memory_order_relaxed);
+        std::atomic_signal_fence(std::memory_order_release);
+        depth.store(at + 1, std::memory_order_relaxed);
+    }
+
+    void leave()
+    {
+        depth.store(depth.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+    }
+
+    // A tail call runs fn in the frame of the running function
+    void replace(const FunctionNode *fn)
+    {
+        size_t at = depth.load(std::memory_order_relaxed);
+        if (at > 0 && at <= kMaxDepth) frames[at - 1].store(fn, std::memory_order_relaxed);
+    }
+
+    size_t samples() const { return taken; }
+    // Samples that found the buffer full
+    size_t dropped() const { return lost; }
+
+    // Folded stacks, root first, for flamegraph.pl
+    void writeFolded(std::ostream &out) const;
+    // The top functions by self time, with their total time
+    void writeSummary(std::ostream &out, size_t top) const;
+
+private:
+    unsigned interval;
+    std::atomic<const FunctionNode *> frames[kMaxDepth];
+    std::atomic<size_t> depth;
+
+    // Samples one after the other: the depth, then the frames root first
+    uintptr_t *buffer;
+    size_t capacity;
+    std::atomic<size_t> used;
+    std::atomic<size_t> taken;
+    std::atomic<size_t> lost;
+    bool running;
+    std::clock_t started;
+    double seconds;  // of CPU time while running
+
+    static void handler(int signal);
+    void sample();
+};
+
+// Keeps fn on the stack of profiler while in scope, does nothing without
+// a profiler
+class ProfileScope {
+public:
+    ProfileScope(Profiler *profiler, const FunctionNode *fn) : profiler(profiler)
+    {
+        if (profiler) profiler->enter(fn);
+    }
+
+    ~ProfileScope()
+    {
+        if (profiler) profiler->leave();
+    }
+
+private:
+    Profiler *profiler;
+};
+
+}}
+
+#endif
@@ -1,7 +1,662 @@
+#include <stdexcept>
+
 #include "compiler/backend/vm.h"
 
 namespace pie { namespace compiler {
 
-/* It should accept bytecodes and execute them */
+using vm::Opcode;
+
+static const int kMaxRegisters = 0xffff;
+
+// Whether evaluating node may assign the local called name. Operands that
+// are read before such an expression runs must be copied out first.
+static bool assignsTo(Node *node, const std::string &name)
+{
+    if (!node) return false;
+
+    if (AssignNode *assign = dyn_cast<AssignNode>(node)) {
+        IdentifierNode *id = dyn_cast<IdentifierNode>(assign->var);
+        if (id && id->name == name) return true;
+    } else if (BinaryOpNode *op = dyn_cast<BinaryOpNode>(node)) {
+        if (op->op == BinaryOp::AddAssign || op->op == BinaryOp::SubAssign) {
+            IdentifierNode *id = dyn_cast<IdentifierNode>(op->lhs);
+            if (id && id->name == name) return true;
+        }
+    }
+
+    for (Node *child : node->children) {
+        if (assignsTo(child, name)) return true;
+    }
+    return false;
+}
+
+VmCompilerVistor::VmCompilerVistor(vm::Program &program)
+    : program(program), function(nullptr), local_top(0), free_reg(0), target(-1)
+{
+}
+
+void VmCompilerVistor::compile(ModuleNode *module)
+{
+    vm::registerBuiltins(program);
+
+    // Functions are globals, declare all of them before compiling any body
+    std::vector<std::pair<FunctionNode *, vm::Function *>> pending;
+    for (FunctionNode *node : module->functions) {
+        vm::Function *fn = program.newFunction(node->name);
+        program.defineGlobal(node->name, vm::Value::makeFunction(fn));
+        pending.push_back(std::make_pair(node, fn));
+    }
+
+    for (auto &entry : pending) {
+        compileFunction(entry.first, entry.second);
+    }
+
+    auto it = module->symtab.find("main");
+    if (it != module->symtab.end()) {
+        for (auto &entry : pending) {
+            if (entry.first == it->second) {
+                program.main = entry.second;
+            }
+        }
+    }
+}
+
+void VmCompilerVistor::compileFunction(FunctionNode *node, vm::Function *fn)
+{
+    function = fn;
+    scopes.clear();
+    scopes.push_back(std::map<std::string, int>());
+    local_top = 0;
+    free_reg = 0;
+
+    // Parameters occupy the first registers, the caller stores the
+    // arguments there directly
+    fn->num_params = (uint16_t)node->params.size();
+    for (size_t i = 0; i < node->params.size(); i++) {
+        scopes.back()[node->params[i].first] = allocReg();
+    }
+    local_top = free_reg;
+
+    for (Node *stmt : node->children) {
+        compileStatement(stmt);
+    }
+    emit(Opcode::ReturnNil);
+
+    function = nullptr;
+}
+
+void VmCompilerVistor::compileStatement(Node *node)
+{
+    target = -1;
+    node->visit(this);
+    free_reg = local_top;
+}
+
+void VmCompilerVistor::compileExpr(Node *node, int dst)
+{
+    int saved_target = target;
+    int mark = free_reg;
+
+    target = dst;
+    node->visit(this);
+
+    target = saved_target;
+    free_reg = mark;
+}
+
+int VmCompilerVistor::compileAnyReg(Node *node, Node *later)
+{
+    IdentifierNode *id = dyn_cast<IdentifierNode>(node);
+    if (id) {
+        int reg = lookupLocal(id->name);
+        if (reg >= 0 && !assignsTo(later, id->name)) {
+            return reg;
+        }
+    }
+
+    int reg = allocReg();
+    compileExpr(node, reg);
+    return reg;
+}
+
+int VmCompilerVistor::allocReg()
+{
+    if (free_reg >= kMaxRegisters) {
+        throw std::runtime_error("Too many registers in function: " + function->name);
+    }
+
+    int reg = free_reg++;
+    if (free_reg > function->num_regs) {
+        function->num_regs = (uint16_t)free_reg;
+    }
+    return reg;
+}
+
+int VmCompilerVistor::lookupLocal(const std::string &name) const
+{
+    for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+        auto it = scope->find(name);
+        if (it != scope->end()) {
+            return it->second;
+        }
+    }
+    return -1;
+}
+
+uint32_t VmCompilerVistor::addConstant(const vm::Value &value)
+{
+    std::vector<vm::Value> &constants = function->constants;
+    for (size_t i = 0; i < constants.size(); i++) {
+        const vm::Value &k = constants[i];
+        if (k.type != value.type) continue;
+        if (k.type == vm::Value::Type::String) {
+            if (String::equals(k.string_val, value.string_val)) return (uint32_t)i;
+        } else if (k.bits == value.bits) {
+            return (uint32_t)i;
+        }
+    }
+
+    constants.push_back(value);
+    return (uint32_t)(constants.size() - 1);
+}
+
+void VmCompilerVistor::emit(Opcode op, int a, int b, int c)
+{
+    function->code.push_back(vm::Instruction(op, (uint16_t)a, (uint16_t)b, (uint16_t)c));
+}
+
+void VmCompilerVistor::emitBx(Opcode op, int a, uint32_t bx)
+{
+    vm::Instruction ins(op, (uint16_t)a);
+    ins.setBx(bx);
+    function->code.push_back(ins);
+}
+
+size_t VmCompilerVistor::emitJump(Opcode op, int a)
+{
+    emit(op, a);
+    return function->code.size() - 1;
+}
+
+void VmCompilerVistor::patchJump(size_t at)
+{
+    patchJump(at, function->code.size());
+}
+
+// Points the jump at to the instruction to, backwards for loops
+void VmCompilerVistor::patchJump(size_t at, size_t to)
+{
+    int32_t offset = (int32_t)to - (int32_t)(at + 1);
+    function->code[at].setBx((uint32_t)offset);
+}
+
+void VmCompilerVistor::visit(Node *node)
+{
+    if (node) {
+        node->visit(this);
+    }
+}
+
+void VmCompilerVistor::visit(ModuleNode *node)
+{
+    // Modules are compiled by compile()
+}
+
+void VmCompilerVistor::visit(ImportNode *node)
+{
+    // Imports are not executed at runtime
+    if (target >= 0) emit(Opcode::LoadNil, target);
+}
+
+void VmCompilerVistor::visit(FunctionNode *node)
+{
+    // Function declarations are registered as globals by compile()
+    if (target >= 0) emit(Opcode::LoadNil, target);
+}
+
+void VmCompilerVistor::visit(ClosureNode *node)
+{
+    // The parser makes none, a tree that has one is not run wrong
+    throw std::runtime_error("Closures are not supported");
+}
+
+void VmCompilerVistor::compileCall(FunctionCallNode *node, int dst, bool tail)
+{
+    int mark = free_reg;
+
+    // The callee slot doubles as the result register, reuse dst when it is
+    // the topmost register so the result needs no extra move
+    int base = (dst >= 0 && dst + 1 == free_reg) ? dst : allocReg();
+
+    for (Node *arg : node->children) {
+        int reg = allocReg();
+        compileExpr(arg, reg);
+    }
+
+    int nargs = (int)node->children.size();
+    int local = node->scope.empty() ? lookupLocal(node->name) : -1;
+    if (local >= 0) {
+        emit(Opcode::Move, base, local);
+        emit(tail ? Opcode::TailCall : Opcode::Call, base, nargs,
+             addConstant(vm::Value::makeString(node->name)));
+    } else {
+        uint32_t slot = program.globalSlot(node->qualifiedName());
+        if (slot > 0xffff) {
+            throw std::runtime_error("Too many globals");
+        }
+        emit(tail ? Opcode::TailCallGlobal : Opcode::CallGlobal, base, nargs, slot);
+    }
+
+    free_reg = mark;
+    if (dst >= 0 && dst != base) {
+        emit(Opcode::Move, dst, base);
+    }
+}
+
+void VmCompilerVistor::visit(FunctionCallNode *node)
+{
+    compileCall(node, target);
+}
+
+void VmCompilerVistor::visit(AssignNode *node)
+{
+    int dst = target;
+
+    IdentifierNode *id = dyn_cast<IdentifierNode>(node->var);
+    if (!id) {
+        throw std::runtime_error("Invalid assignment target");
+    }
+
+    int reg = lookupLocal(id->name);
+    if (reg >= 0) {
+        compileExpr(node->value, reg);
+        if (dst >= 0 && dst != reg) emit(Opcode::Move, dst, reg);
+        return;
+    }
+
+    uint32_t slot = program.globalSlot(id->name);
+    int value = dst >= 0 ? dst : allocReg();
+    compileExpr(node->value, value);
+    emitBx(Opcode::StoreGlobal, value, slot);
+}
+
+void VmCompilerVistor::visit(LetNode *node)
+{
+    int dst = target;
+    int reg;
+
+    auto &scope = scopes.back();
+    auto it = scope.find(node->name);
+    if (it != scope.end()) {
+        // Redeclaring in the same scope overwrites the variable
+        reg = it->second;
+    } else {
+        reg = allocReg();
+    }
+
+    if (node->value) {
+        compileExpr(node->value, reg);
+    } else {
+        emit(Opcode::LoadNil, reg);
+    }
+
+    if (it == scope.end()) {
+        scope[node->name] = reg;
+        local_top = reg + 1;
+    }
+
+    if (dst >= 0 && dst != reg) emit(Opcode::Move, dst, reg);
+}
+
+void VmCompilerVistor::visit(TypeNode *node)
+{
+    // Types are not evaluated at runtime
+    if (target >= 0) emit(Opcode::LoadNil, target);
+}
+
+void VmCompilerVistor::visit(IntNode *node)
+{
+    int dst = target >= 0 ? target : allocReg();
+    emitBx(Opcode::LoadK, dst, addConstant(vm::Value::makeInt(node->value)));
+}
+
+void VmCompilerVistor::visit(DoubleNode *node)
+{
+    int dst = target >= 0 ? target : allocReg();
+    emitBx(Opcode::LoadK, dst, addConstant(vm::Value::makeDouble(node->value)));
+}
+
+void VmCompilerVistor::visit(StringNode *node)
+{
+    int dst = target >= 0 ? target : allocReg();
+    emitBx(Opcode::LoadK, dst, addConstant(vm::Value::makeString(node->str)));
+}
+
+void VmCompilerVistor::visit(BoolNode *node)
+{
+    int dst = target >= 0 ? target : allocReg();
+    emitBx(Opcode::LoadK, dst, addConstant(vm::Value::makeBool(node->value)));
+}
+
+void VmCompilerVistor::visit(IdentifierNode *node)
+{
+    int dst = target;
+
+    int reg = lookupLocal(node->name);
+    if (reg >= 0) {
+        if (dst >= 0 && dst != reg) emit(Opcode::Move, dst, reg);
+        return;
+    }
+
+    if (dst < 0) dst = allocReg();
+    emitBx(Opcode::LoadGlobal, dst, program.globalSlot(node->name));
+}
+
+// Opcode for an operator whose operands TypeCheckVisitor proved to be ints
+// (or doubles), generic when there is none
+static Opcode typedOpcode(BinaryOp op, bool ints, Opcode generic, bool &swap)
+{
+    switch (op) {
+        case BinaryOp::Add: return ints ? Opcode::AddI : Opcode::AddD;
+        case BinaryOp::Sub: return ints ? Opcode::SubI : Opcode::SubD;
+        case BinaryOp::Mul: return ints ? Opcode::MulI : Opcode::MulD;
+        case BinaryOp::Div: return ints ? Opcode::DivI : Opcode::DivD;
+        case BinaryOp::Mod: return ints ? Opcode::ModI : generic;
+        case BinaryOp::Lt: return ints ? Opcode::LtI : Opcode::LtD;
+        case BinaryOp::Le: return ints ? Opcode::LeI : Opcode::LeD;
+        case BinaryOp::Gt: swap = true; return ints ? Opcode::LtI : Opcode::LtD;
+        case BinaryOp::Ge: swap = true; return ints ? Opcode::LeI : Opcode::LeD;
+        case BinaryOp::Eq: return ints ? Opcode::EqI : Opcode::EqD;
+        case BinaryOp::Ne: return ints ? Opcode::NeI : Opcode::NeD;
+        default: return generic;
+    }
+}
+
+void VmCompilerVistor::compileUpdate(BinaryOpNode *node, int dst)
+{
+    IdentifierNode *id = dyn_cast<IdentifierNode>(node->lhs);
+    if (!id) {
+        throw std::runtime_error("Invalid assignment target");
+    }
+
+    // += only adds numbers, -= behaves like a plain subtraction
+    bool add = node->op == BinaryOp::AddAssign;
+    Opcode op = add ? Opcode::AddNum : Opcode::Sub;
+    if (node->operand_type == OperandType::Int) {
+        op = add ? Opcode::AddI : Opcode::SubI;
+    } else if (node->operand_type == OperandType::Double) {
+        op = add ? Opcode::AddD : Opcode::SubD;
+    }
+    int mark = free_reg;
+
+    int reg = lookupLocal(id->name);
+    if (reg >= 0) {
+        int current = reg;
+        if (assignsTo(node->rhs, id->name)) {
+            current = allocReg();
+            emit(Opcode::Move, current, reg);
+        }
+        int rhs = compileAnyReg(node->rhs);
+        emit(op, reg, current, rhs);
+        if (dst >= 0 && dst != reg) emit(Opcode::Move, dst, reg);
+    } else {
+        uint32_t slot = program.globalSlot(id->name);
+        int current = allocReg();
+        emitBx(Opcode::LoadGlobal, current, slot);
+        int rhs = compileAnyReg(node->rhs);
+        emit(op, current, current, rhs);
+        emitBx(Opcode::StoreGlobal, current, slot);
+        if (dst >= 0) emit(Opcode::Move, dst, current);
+    }
+
+    free_reg = mark;
+}
+
+void VmCompilerVistor::visit(BinaryOpNode *node)
+{
+    if (node->op == BinaryOp::AddAssign || node->op == BinaryOp::SubAssign) {
+        compileUpdate(node, target);
+        return;
+    }
+
+    int dst = target >= 0 ? target : allocReg();
+    int mark = free_reg;
+
+    // Short-circuit operators write their result in two steps, so never
+    // let them clobber a local the right hand side may still read
+    if (node->op == BinaryOp::And || node->op == BinaryOp::Or) {
+        int out = dst < local_top ? allocReg() : dst;
+        compileExpr(node->lhs, out);
+        emit(Opcode::Bool, out, out);
+        size_t skip = emitJump(node->op == BinaryOp::And ? Opcode::JmpIfNot : Opcode::JmpIf, out);
+        compileExpr(node->rhs, out);
+        emit(Opcode::Bool, out, out);
+        patchJump(skip);
+        if (out != dst) emit(Opcode::Move, dst, out);
+        free_reg = mark;
+        return;
+    }
+
+    Opcode op;
+    switch (node->op) {
+        case BinaryOp::Add: op = Opcode::Add; break;
+        case BinaryOp::Sub: op = Opcode::Sub; break;
+        case BinaryOp::Mul: op = Opcode::Mul; break;
+        case BinaryOp::Div: op = Opcode::Div; break;
+        case BinaryOp::Mod: op = Opcode::Mod; break;
+        case BinaryOp::Lt: op = Opcode::Lt; break;
+        case BinaryOp::Gt: op = Opcode::Gt; break;
+        case BinaryOp::Le: op = Opcode::Le; break;
+        case BinaryOp::Ge: op = Opcode::Ge; break;
+        case BinaryOp::Eq: op = Opcode::Eq; break;
+        case BinaryOp::Ne: op = Opcode::Ne; break;
+        case BinaryOp::Assign:
+            // Should be handled by AssignNode
+            compileAnyReg(node->lhs);
+            compileExpr(node->rhs, dst);
+            free_reg = mark;
+            return;
+        default:
+            throw std::runtime_error("Unknown binary operator");
+    }
+
+    // Gt and Ge have no typed forms, they run as Lt and Le with swapped
+    // operands once both are in registers
+    bool swap = false;
+    if (node->operand_type != OperandType::Any) {
+        op = typedOpcode(node->op, node->operand_type == OperandType::Int, op, swap);
+    }
+
+    int lhs = compileAnyReg(node->lhs, node->rhs);
+    int rhs = compileAnyReg(node->rhs);
+    if (swap) {
+        emit(op, dst, rhs, lhs);
+    } else {
+        emit(op, dst, lhs, rhs);
+    }
+    free_reg = mark;
+}
+
+void VmCompilerVistor::visit(UnaryOpNode *node)
+{
+    int dst = target >= 0 ? target : allocReg();
+    int mark = free_reg;
+
+    switch (node->op) {
+        case UnaryOp::Neg:
+            emit(Opcode::Neg, dst, compileAnyReg(node->expr));
+            break;
+
+        case UnaryOp::Not:
+            emit(Opcode::Not, dst, compileAnyReg(node->expr));
+            break;
+
+        case UnaryOp::CastInt:
+            emit(Opcode::CastInt, dst, compileAnyReg(node->expr));
+            break;
+
+        case UnaryOp::CastDouble:
+            emit(Opcode::CastDouble, dst, compileAnyReg(node->expr));
+            break;
+
+        case UnaryOp::Inc:
+        case UnaryOp::Dec:
+            // As for closures
+            throw std::runtime_error("Increment and decrement are not supported");
+
+        default:
+            throw std::runtime_error("Unknown unary operator");
+    }
+
+    free_reg = mark;
+}
+
+void VmCompilerVistor::visit(ReturnNode *node)
+{
+    if (!node->expr) {
+        emit(Opcode::ReturnNil);
+        return;
+    }
+
+    // A returned call reuses the frame
+    FunctionCallNode *call = dyn_cast<FunctionCallNode>(node->expr);
+    if (call) {
+        compileCall(call, -1, true);
+        return;
+    }
+
+    emit(Opcode::Return, compileAnyReg(node->expr));
+}
+
+void VmCompilerVistor::visit(IfNode *node)
+{
+    int dst = target;
+    int mark = free_reg;
+
+    int cond = compileAnyReg(node->condition);
+    size_t skip_then = emitJump(Opcode::JmpIfNot, cond);
+    free_reg = mark;
+
+    target = -1;
+    if (node->then_block) {
+        node->then_block->visit(this);
+    }
+
+    if (node->else_block) {
+        size_t skip_else = emitJump(Opcode::Jmp);
+        patchJump(skip_then);
+        target = -1;
+        node->else_block->visit(this);
+        patchJump(skip_else);
+    } else {
+        patchJump(skip_then);
+    }
+
+    if (dst >= 0) emit(Opcode::LoadNil, dst);
+}
+
+void VmCompilerVistor::visit(BlockNode *node)
+{
+    int dst = target;
+    int saved_top = local_top;
+
+    scopes.push_back(std::map<std::string, int>());
+    for (Node *stmt : node->children) {
+        compileStatement(stmt);
+    }
+    scopes.pop_back();
+
+    local_top = saved_top;
+    free_reg = saved_top;
+
+    if (dst >= 0) emit(Opcode::LoadNil, dst);
+}
+
+// Compiles a loop body, the break and continue jumps it emits are left in
+// loops.back() for the caller to patch
+void VmCompilerVistor::compileLoopBody(BlockNode *body)
+{
+    loops.push_back(LoopJumps());
+    if (body) {
+        compileStatement(body);
+    }
+}
+
+void VmCompilerVistor::visit(WhileNode *node)
+{
+    int dst = target;
+
+    size_t start = function->code.size();
+    int cond = compileAnyReg(node->condition);
+    size_t exit = emitJump(Opcode::JmpIfNot, cond);
+    free_reg = local_top;
+
+    compileLoopBody(node->body);
+    for (size_t at : loops.back().continues) {
+        patchJump(at, start);
+    }
+    patchJump(emitJump(Opcode::Jmp), start);
+
+    patchJump(exit);
+    for (size_t at : loops.back().breaks) {
+        patchJump(at);
+    }
+    loops.pop_back();
+
+    if (dst >= 0) emit(Opcode::LoadNil, dst);
+}
+
+void VmCompilerVistor::visit(ForNode *node)
+{
+    int dst = target;
+    int saved_top = local_top;
+
+    // A let in init gets a register of its own for the whole loop
+    scopes.push_back(std::map<std::string, int>());
+    if (node->init) {
+        compileStatement(node->init);
+    }
+
+    size_t start = function->code.size();
+    size_t exit = 0;
+    if (node->condition) {
+        int cond = compileAnyReg(node->condition);
+        exit = emitJump(Opcode::JmpIfNot, cond);
+        free_reg = local_top;
+    }
+
+    compileLoopBody(node->body);
+    for (size_t at : loops.back().continues) {
+        patchJump(at);
+    }
+    if (node->step) {
+        compileStatement(node->step);
+    }
+    patchJump(emitJump(Opcode::Jmp), start);
+
+    if (node->condition) {
+        patchJump(exit);
+    }
+    for (size_t at : loops.back().breaks) {
+        patchJump(at);
+    }
+    loops.pop_back();
+    scopes.pop_back();
+
+    local_top = saved_top;
+    free_reg = saved_top;
+
+    if (dst >= 0) emit(Opcode::LoadNil, dst);
+}
+
+void VmCompilerVistor::visit(BreakNode *node)
+{
+    loops.back().breaks.push_back(emitJump(Opcode::Jmp));
+}
+
+void VmCompilerVistor::visit(ContinueNode *node)
+{
+    loops.back().continues.push_back(emitJump(Opcode::Jmp));
+}
 
 }}
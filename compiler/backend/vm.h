@@ -1,21 +1,69 @@
 #ifndef __PIE_BACKEND_VM__
 #define __PIE_BACKEND_VM__
 
+#include <map>
+#include <string>
+#include <vector>
+
 #include "compiler/ast.h"
 #include "compiler/ast/op.h"
 #include "compiler/ast/primitive.h"
 #include "compiler/ast/assign.h"
 
-#include "runtime/vm/bytecode.h"
+#include "runtime/vm/vm.h"
 
 namespace pie { namespace compiler {
 
-
-class VmCompilerVistor : Visitor 
+// Compiles a ModuleNode into register bytecode for pie::vm::Interpreter.
+//
+// Locals live in registers allocated in declaration order, temporaries are
+// allocated above them and released after every statement. Names that are
+// not locals resolve to global slots (functions and builtins).
+class VmCompilerVistor : public Visitor
 {
+public:
+    VmCompilerVistor(vm::Program &program);
+
+    void compile(ModuleNode *module);
+
+    void visit(Node *node) override;
+
+    #define AST_NODE DECLARE_VISIT
+    AST_NODES
+    #undef AST_NODE
 
+private:
+    // Jumps out of the loop being compiled, patched once its end is known
+    struct LoopJumps {
+        std::vector<size_t> breaks;
+        std::vector<size_t> continues;
+    };
+
+    vm::Program &program;
+    vm::Function *function;
+    std::vector<std::map<std::string, int>> scopes;
+    int local_top;  // first register above the visible locals
+    int free_reg;   // first free temporary register
+    int target;     // register receiving the value of the visited expression
+    std::vector<LoopJumps> loops;
+
+    void compileFunction(FunctionNode *node, vm::Function *fn);
+    void compileStatement(Node *node);
+    void compileExpr(Node *node, int dst);
+    int compileAnyReg(Node *node, Node *later = nullptr);
+    void compileCall(FunctionCallNode *node, int dst, bool tail = false);
+    void compileUpdate(BinaryOpNode *node, int dst);
+
+    int allocReg();
+    int lookupLocal(const std::string &name) const;
+    uint32_t addConstant(const vm::Value &value);
+    void emit(vm::Opcode op, int a = 0, int b = 0, int c = 0);
+    void emitBx(vm::Opcode op, int a, uint32_t bx);
+    size_t emitJump(vm::Opcode op, int a = 0);
+    void patchJump(size_t at);
+    void patchJump(size_t at, size_t to);
+    void compileLoopBody(BlockNode *body);
 };
 
 }}
 #endif
-
@@ -0,0 +1,639 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <cstring>
+#include <atomic>
+#include <memory>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "compiler/cache.h"
+#include "compiler/source.h"
+
+namespace pie { namespace compiler {
+
+namespace {
+
+const uint32_t kMagic = 0x43454950;      // "PIEC"
+const uint32_t kByteOrder = 0x01020304;  // entries are only read on the same kind of host
+
+struct Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t reserved;
+    uint64_t key;
+    uint64_t size;      // bytes of records after the header
+    uint64_t checksum;  // fnv1a() of those bytes
+};
+
+// FNV-1a of n bytes, continuing from hash
+uint64_t fnv1a(uint64_t hash, const char *bytes, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        hash ^= (uint8_t)bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+const uint64_t kFnvBasis = 0xcbf29ce484222325ull;
+
+// One record per node: its tag and line, then its fields, then the records
+// of the nodes it points to
+enum Tag : uint8_t {
+    Null,
+    Module,
+    Import,
+    Function,
+    Closure,
+    Call,
+    Assign,
+    Let,
+    Type,
+    Int,
+    Double,
+    String,
+    Bool,
+    Identifier,
+    Binary,
+    Unary,
+    Return,
+    If,
+    While,
+    For,
+    Break,
+    Continue,
+    Block
+};
+
+class Writer : public Visitor {
+public:
+    std::string out;
+
+    void node(Node *node)
+    {
+        if (node) {
+            node->visit(this);
+        } else {
+            u8(Null);
+        }
+    }
+
+    void visit(Node *node) override
+    {
+        node->visit(this);
+    }
+
+    void visit(ModuleNode *node) override
+    {
+        tag(Module, node);
+        str(node->name);
+        u32((uint32_t)node->imports.size());
+        for (ImportNode *import : node->imports) {
+            this->node(import);
+        }
+        u32((uint32_t)node->functions.size());
+        for (FunctionNode *fn : node->functions) {
+            this->node(fn);
+        }
+    }
+
+    void visit(ImportNode *node) override
+    {
+        tag(Import, node);
+        str(node->module_name);
+        u32((uint32_t)node->access_level);
+        u8(node->import_all);
+    }
+
+    void visit(FunctionNode *node) override
+    {
+        tag(Function, node);
+        str(node->name);
+        u32((uint32_t)node->access_level);
+        params(node->params);
+        this->node(node->return_type);
+        children(node);
+    }
+
+    void visit(ClosureNode *node) override
+    {
+        tag(Closure, node);
+        params(node->params);
+        this->node(node->return_type);
+        children(node);
+    }
+
+    void visit(FunctionCallNode *node) override
+    {
+        tag(Call, node);
+        str(node->scope);
+        str(node->name);
+        children(node);
+    }
+
+    void visit(AssignNode *node) override
+    {
+        tag(Assign, node);
+        this->node(node->var);
+        this->node(node->value);
+    }
+
+    void visit(LetNode *node) override
+    {
+        tag(Let, node);
+        str(node->name);
+        this->node(node->type);
+        this->node(node->value);
+    }
+
+    void visit(TypeNode *node) override
+    {
+        tag(Type, node);
+        str(node->name);
+        u8(node->is_array);
+    }
+
+    void visit(IntNode *node) override
+    {
+        tag(Int, node);
+        raw(&node->value, sizeof(node->value));
+    }
+
+    void visit(DoubleNode *node) override
+    {
+        tag(Double, node);
+        raw(&node->value, sizeof(node->value));
+    }
+
+    void visit(StringNode *node) override
+    {
+        tag(String, node);
+        str(node->str);
+    }
+
+    void visit(BoolNode *node) override
+    {
+        tag(Bool, node);
+        u8(node->value);
+    }
+
+    void visit(IdentifierNode *node) override
+    {
+        tag(Identifier, node);
+        str(node->name);
+    }
+
+    void visit(BinaryOpNode *node) override
+    {
+        tag(Binary, node);
+        u8((uint8_t)node->op);
+        u8((uint8_t)node->operand_type);
+        this->node(node->lhs);
+        this->node(node->rhs);
+    }
+
+    void visit(UnaryOpNode *node) override
+    {
+        tag(Unary, node);
+        u8((uint8_t)node->op);
+        this->node(node->expr);
+    }
+
+    void visit(ReturnNode *node) override
+    {
+        tag(Return, node);
+        this->node(node->expr);
+    }
+
+    void visit(IfNode *node) override
+    {
+        tag(If, node);
+        this->node(node->condition);
+        this->node(reinterpret_cast<Node*>(node->then_block));
+        this->node(node->else_block);
+    }
+
+    void visit(WhileNode *node) override
+    {
+        tag(While, node);
+        this->node(node->condition);
+        this->node(reinterpret_cast<Node*>(node->body));
+    }
+
+    void visit(ForNode *node) override
+    {
+        tag(For, node);
+        this->node(node->init);
+        this->node(node->condition);
+        this->node(node->step);
+        this->node(reinterpret_cast<Node*>(node->body));
+    }
+
+    void visit(BreakNode *node) override
+    {
+        tag(Break, node);
+    }
+
+    void visit(ContinueNode *node) override
+    {
+        tag(Continue, node);
+    }
+
+    void visit(BlockNode *node) override
+    {
+        tag(Block, node);
+        children(node);
+    }
+
+private:
+    void raw(const void *bytes, size_t length) { out.append((const char *)bytes, length); }
+
+    void tag(Tag tag, Node *node)
+    {
+        u8(tag);
+        u32((uint32_t)node->line);
+    }
+
+    void u8(uint8_t value) { out.push_back((char)value); }
+    void u32(uint32_t value) { raw(&value, sizeof(value)); }
+
+    void str(const std::string &value)
+    {
+        u32((uint32_t)value.size());
+        out.append(value);
+    }
+
+    void params(const std::vector<std::pair<std::string, TypeNode *>> &params)
+    {
+        u32((uint32_t)params.size());
+        for (auto &param : params) {
+            str(param.first);
+            node(param.second);
+        }
+    }
+
+    void children(Node *parent)
+    {
+        u32((uint32_t)parent->children.size());
+        for (Node *child : parent->children) {
+            node(child);
+        }
+    }
+};
+
+// Rebuilds the nodes of a Writer into arena. Any read past the end or
+// record of the wrong kind clears ok, the caller drops what was built.
+class Reader {
+public:
+    bool ok;
+
+    Reader(const char *at, const char *end, Arena &arena) : ok(true), at(at), end(end), arena(arena) {}
+
+    bool done() const { return at == end; }
+
+    bool module(ModuleNode *module)
+    {
+        if (u8() != Module) return false;
+        module->line = (int)u32();
+        module->name = str();
+
+        uint32_t imports = u32();
+        for (uint32_t i = 0; ok && i < imports; i++) {
+            ImportNode *import = expect<ImportNode>(node());
+            if (!import) return false;
+            module->imports.push_back(import);
+            module->push(import);
+        }
+
+        // Later definitions win, as when parsed
+        uint32_t functions = u32();
+        for (uint32_t i = 0; ok && i < functions; i++) {
+            FunctionNode *fn = expect<FunctionNode>(node());
+            if (!fn) return false;
+            module->functions.push_back(fn);
+            module->symtab[fn->name] = fn;
+        }
+        return ok;
+    }
+
+    Node *node()
+    {
+        if (!ok) return nullptr;
+
+        uint8_t tag = u8();
+        if (tag == Null) return nullptr;
+        int line = (int)u32();
+        Node *node = record(tag);
+        if (node) node->line = line;
+        return node;
+    }
+
+private:
+    const char *at;
+    const char *end;
+    Arena &arena;
+
+    // The fields and children of a node after its tag and line
+    Node *record(uint8_t tag)
+    {
+        switch (tag) {
+        case Import: {
+            std::string name = str();
+            int access = (int)u32();
+            bool all = u8() != 0;
+            return arena.make<ImportNode>(name, access, all);
+        }
+        case Function: {
+            std::string name = str();
+            FunctionNode *fn = arena.make<FunctionNode>(name, (int)u32());
+            params(fn->params);
+            fn->return_type = expect<TypeNode>(node());
+            children(fn);
+            return fn;
+        }
+        case Closure: {
+            ClosureNode *closure = arena.make<ClosureNode>();
+            params(closure->params);
+            closure->return_type = expect<TypeNode>(node());
+            children(closure);
+            return closure;
+        }
+        case Call: {
+            std::string scope = str();
+            FunctionCallNode *call = arena.make<FunctionCallNode>(scope, str());
+            children(call);
+            return call;
+        }
+        case Assign: {
+            Node *var = node();
+            return arena.make<AssignNode>(var, node());
+        }
+        case Let: {
+            std::string name = str();
+            TypeNode *type = expect<TypeNode>(node());
+            return arena.make<LetNode>(name, type, node());
+        }
+        case Type: {
+            std::string name = str();
+            return arena.make<TypeNode>(name, u8() != 0);
+        }
+        case Int: {
+            int64_t value = 0;
+            raw(&value, sizeof(value));
+            return arena.make<IntNode>(value);
+        }
+        case Double: {
+            double value = 0;
+            raw(&value, sizeof(value));
+            return arena.make<DoubleNode>(value);
+        }
+        case String:
+            return arena.make<StringNode>(str());
+        case Bool:
+            return arena.make<BoolNode>(u8() != 0);
+        case Identifier:
+            return arena.make<IdentifierNode>(str());
+        case Binary: {
+            uint8_t op = u8();
+            uint8_t type = u8();
+            if (op > (uint8_t)BinaryOp::Dot || type > (uint8_t)OperandType::Double) {
+                ok = false;
+                return nullptr;
+            }
+            Node *lhs = node();
+            BinaryOpNode *binary = arena.make<BinaryOpNode>((BinaryOp)op, lhs, node());
+            binary->operand_type = (OperandType)type;
+            return binary;
+        }
+        case Unary: {
+            uint8_t op = u8();
+            if (op > (uint8_t)UnaryOp::CastDouble) {
+                ok = false;
+                return nullptr;
+            }
+            return arena.make<UnaryOpNode>((UnaryOp)op, node());
+        }
+        case Return:
+            return arena.make<ReturnNode>(node());
+        case If: {
+            Node *cond = node();
+            BlockNode *then_block = expect<BlockNode>(node());
+            return arena.make<IfNode>(cond, then_block, node());
+        }
+        case While: {
+            Node *cond = node();
+            return arena.make<WhileNode>(cond, expect<BlockNode>(node()));
+        }
+        case For: {
+            Node *init = node();
+            Node *cond = node();
+            Node *step = node();
+            return arena.make<ForNode>(init, cond, step, expect<BlockNode>(node()));
+        }
+        case Break:
+            return arena.make<BreakNode>();
+        case Continue:
+            return arena.make<ContinueNode>();
+        case Block: {
+            BlockNode *block = arena.make<BlockNode>();
+            children(block);
+            return block;
+        }
+        default:
+            ok = false;
+            return nullptr;
+        }
+    }
+
+    void raw(void *bytes, size_t length)
+    {
+        if ((size_t)(end - at) < length) {
+            ok = false;
+            memset(bytes, 0, length);
+            return;
+        }
+        memcpy(bytes, at, length);
+        at += length;
+    }
+
+    uint8_t u8()
+    {
+        uint8_t value;
+        raw(&value, sizeof(value));
+        return value;
+    }
+
+    uint32_t u32()
+    {
+        uint32_t value;
+        raw(&value, sizeof(value));
+        return value;
+    }
+
+    std::string str()
+    {
+        uint32_t length = u32();
+        if ((size_t)(end - at) < length) {
+            ok = false;
+            return std::string();
+        }
+        std::string value(at, length);
+        at += length;
+        return value;
+    }
+
+    // A node where only one kind may be, null stays null
+    template <typename T>
+    T *expect(Node *node)
+    {
+        if (!node) return nullptr;
+        T *typed = dyn_cast<T>(node);
+        if (!typed) ok = false;
+        return typed;
+    }
+
+    void params(std::vector<std::pair<std::string, TypeNode *>> &params)
+    {
+        uint32_t count = u32();
+        for (uint32_t i = 0; ok && i < count; i++) {
+            std::string name = str();
+            params.push_back(std::make_pair(name, expect<TypeNode>(node())));
+        }
+    }
+
+    void children(Node *parent)
+    {
+        uint32_t count = u32();
+        for (uint32_t i = 0; ok && i < count; i++) {
+            parent->push(node());
+        }
+    }
+};
+
+// Creates dir and its parents, true when it exists afterwards
+bool makeDirs(const std::string &dir)
+{
+    for (size_t slash = dir.find('/', 1); ; slash = dir.find('/', slash + 1)) {
+        std::string prefix = dir.substr(0, slash);
+        if (!prefix.empty()) mkdir(prefix.c_str(), 0755);
+        if (slash == std::string::npos) break;
+    }
+    struct stat st;
+    return stat(dir.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+}
+
+ModuleCache::ModuleCache(const std::string &dir)
+    : dir(dir.empty() || dir.back() == '/' ? dir : dir + "/")
+{
+}
+
+std::string ModuleCache::defaultDir()
+{
+    if (const char *xdg = getenv("XDG_CACHE_HOME")) {
+        if (*xdg) return std::string(xdg) + "/pie";
+    }
+    if (const char *home = getenv("HOME")) {
+        if (*home) return std::string(home) + "/.cache/pie";
+    }
+    return "";
+}
+
+uint64_t ModuleCache::key(const char *text, size_t length, const std::string &options)
+{
+    // FNV-1a over the text, the options and the version
+    uint32_t version = kVersion;
+    uint64_t hash = fnv1a(kFnvBasis, text, length);
+    hash = fnv1a(hash, options.data(), options.size());
+    return fnv1a(hash, (const char *)&version, sizeof(version));
+}
+
+std::string ModuleCache::path(uint64_t key) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.pic", (unsigned long long)key);
+    return dir + name;
+}
+
+ModuleNode *ModuleCache::load(uint64_t key) const
+{
+    Source entry;
+    if (!entry.open(path(key))) {
+        return nullptr;
+    }
+    return decode(entry.data(), entry.size(), key);
+}
+
+ModuleNode *ModuleCache::decode(const char *data, size_t size, uint64_t key)
+{
+    if (size < sizeof(Header)) {
+        return nullptr;
+    }
+
+    Header header;
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != kMagic || header.version != kVersion || header.byte_order != kByteOrder ||
+        header.key != key || header.size != size - sizeof(Header) ||
+        header.checksum != fnv1a(kFnvBasis, data + sizeof(Header), header.size)) {
+        return nullptr;
+    }
+
+    std::unique_ptr<ModuleNode> module(new ModuleNode());
+    Reader reader(data + sizeof(Header), data + size, module->arena);
+    if (!reader.module(module.get()) || !reader.done()) {
+        return nullptr;
+    }
+    return module.release();
+}
+
+bool ModuleCache::store(uint64_t key, ModuleNode *module) const
+{
+    if (!makeDirs(dir)) {
+        return false;
+    }
+
+    std::string entry = encode(key, module);
+
+    // A unique name per writer: readers only ever see whole entries
+    static std::atomic<unsigned> serial(0);
+    std::string target = path(key);
+    std::string temp = target + "." + std::to_string(getpid()) + "." + std::to_string(serial++);
+
+    FILE *file = fopen(temp.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    bool written = fwrite(entry.data(), 1, entry.size(), file) == entry.size();
+    written = fclose(file) == 0 && written;
+
+    if (!written || rename(temp.c_str(), target.c_str()) != 0) {
+        remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+std::string ModuleCache::encode(uint64_t key, ModuleNode *module)
+{
+    Writer writer;
+    module->visit(&writer);
+
+    Header header;
+    header.magic = kMagic;
+    header.version = kVersion;
+    header.byte_order = kByteOrder;
+    header.reserved = 0;
+    header.key = key;
+    header.size = writer.out.size();
+    header.checksum = fnv1a(kFnvBasis, writer.out.data(), writer.out.size());
+
+    std::string entry((const char *)&header, sizeof(header));
+    entry += writer.out;
+    return entry;
+}
+
+}}
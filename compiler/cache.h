@@ -0,0 +1,55 @@
+#ifndef __PIE_CACHE__
+#define __PIE_CACHE__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "compiler/ast.h"
+
+namespace pie { namespace compiler {
+
+// On-disk cache of analysed modules, so an unchanged module is neither
+// parsed nor analysed again by the next run.
+//
+// An entry is the tree of one module as left by the analysis, written in
+// preorder into a binary file named after its key. Loading maps the file
+// and rebuilds the nodes into a new arena in one pass: pointers come from
+// the order of the records, strings are copied out of the mapping. An
+// entry with another version, a broken layout or bytes that do not match
+// its checksum is a miss.
+class ModuleCache {
+public:
+    // Changes whenever the layout or the analysis does
+    static const uint32_t kVersion = 4;
+
+    explicit ModuleCache(const std::string &dir);
+
+    // Where entries go by default: $XDG_CACHE_HOME/pie or ~/.cache/pie,
+    // empty when neither is known
+    static std::string defaultDir();
+
+    // Key of a module: its source text and what the analysis was asked to
+    // do. Analysing a module never looks at its imports.
+    static uint64_t key(const char *text, size_t length, const std::string &options);
+
+    // The module stored under key, null on a miss
+    ModuleNode *load(uint64_t key) const;
+    // The module of an entry already in memory, null unless it has key
+    static ModuleNode *decode(const char *data, size_t size, uint64_t key);
+
+    // Safe to call from several threads and processes at once: an entry is
+    // written to a temporary file, then renamed into place
+    bool store(uint64_t key, ModuleNode *module) const;
+    // The entry store() writes
+    static std::string encode(uint64_t key, ModuleNode *module);
+
+private:
+    std::string dir;
+
+    std::string path(uint64_t key) const;
+};
+
+}}
+
+#endif
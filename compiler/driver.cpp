@@ -0,0 +1,490 @@
+#include <stdio.h>
+#include <algorithm>
+#include <set>
+#include <thread>
+
+#include "compiler/driver.h"
+#include "compiler/parser.h"
+#include "compiler/scanner.h"
+#include "compiler/source.h"
+#include "compiler/pass/inline.h"
+#include "compiler/pass/optimize.h"
+#include "compiler/pass/typecheck.h"
+
+namespace pie { namespace compiler {
+
+static unsigned defaultThreads()
+{
+    unsigned cores = std::thread::hardware_concurrency();
+    return cores > 0 ? cores : 1;
+}
+
+// Modules of the runtime: an import of one without a file is native, its
+// calls go to the builtins
+static bool isNative(const std::string &name)
+{
+    return name == "std" || name == "std.io";
+}
+
+Driver::Driver(unsigned threads)
+    : pool(threads > 0 ? threads : defaultThreads()),
+      typecheck(true), optimize(true), inline_budget(InlineVisitor::kDefaultBudget),
+      report(nullptr), failed(false)
+{
+}
+
+Driver::~Driver()
+{
+}
+
+void Driver::setCacheDir(const std::string &dir)
+{
+    cache.reset(dir.empty() ? nullptr : new ModuleCache(dir));
+}
+
+void Driver::setLibrary(const EmbeddedModule *modules, size_t count)
+{
+    library.clear();
+    for (size_t i = 0; i < count; i++) {
+        library[modules[i].name] = &modules[i];
+    }
+}
+
+std::string Driver::analysisOptions() const
+{
+    return "typecheck=" + std::to_string(typecheck) + " optimize=" + std::to_string(optimize) +
+           " inline=" + std::to_string(optimize ? inline_budget : 0);
+}
+
+void Driver::addSearchPath(const std::string &dir)
+{
+    search.push_back(dir.empty() || dir.back() == '/' ? dir : dir + "/");
+}
+
+Driver::Result Driver::compile(const std::string &path)
+{
+    size_t slash = path.rfind('/');
+    search.push_back(slash == std::string::npos ? "" : path.substr(0, slash + 1));
+
+    options = analysisOptions();
+
+    // Parse everything first: a module is analysed after its imports, the
+    // whole graph has to be known for that
+    Unit *main = load(path, "");
+    pool.wait();
+
+    if (failed) {
+        return ParseFailed;
+    }
+    if (!main->module) {
+        fprintf(stderr, "Failed to open file: %s\n", path.c_str());
+        return OpenFailed;
+    }
+
+    // Any other import without a file is a mistake in the program
+    bool unresolved = false;
+    for (Unit *unit : found) {
+        for (auto &binding : unit->bindings) {
+            const std::string &name = binding.first->module_name;
+            if (binding.second || isNative(name)) continue;
+            fprintf(stderr, "Unknown module: %s (imported from %s)\n", name.c_str(), unit->path.c_str());
+            unresolved = true;
+        }
+    }
+    if (unresolved) {
+        return LinkFailed;
+    }
+
+    for (Unit *unit : found) {
+        if (!unit->module) continue;
+
+        std::vector<Unit *> imports;
+        for (auto &binding : unit->bindings) {
+            Unit *import = binding.second;
+            if (import && import->module && import != unit &&
+                std::find(imports.begin(), imports.end(), import) == imports.end()) {
+                imports.push_back(import);
+                import->users.push_back(unit);
+            }
+        }
+        unit->imports.swap(imports);
+        unit->pending = (int)unit->imports.size();
+    }
+
+    for (Unit *unit : found) {
+        if (unit->module && unit->pending == 0) {
+            schedule(unit);
+        }
+    }
+    pool.wait();
+
+    // Modules of an import cycle wait on each other: start the cycle at the
+    // first one found. A negative count never drops back to zero, so the
+    // module is not scheduled a second time when its imports are done.
+    for (Unit *unit : found) {
+        if (unit->module && !unit->analysed) {
+            unit->pending = -1;
+            schedule(unit);
+            pool.wait();
+        }
+    }
+
+    for (Unit *unit : done) {
+        order.push_back(unit->module.get());
+        if (report) {
+            *report << unit->report.str();
+        }
+    }
+
+    return link(main) ? Compiled : LinkFailed;
+}
+
+ModuleNode *Driver::root() const
+{
+    return found.empty() ? nullptr : found.front()->module.get();
+}
+
+Driver::Unit *Driver::load(const std::string &path, const std::string &name,
+                           const EmbeddedModule *embedded)
+{
+    std::lock_guard<std::mutex> held(lock);
+
+    std::unique_ptr<Unit> &slot = units[path];
+    if (!slot) {
+        slot.reset(new Unit(path, name, embedded));
+        found.push_back(slot.get());
+
+        Unit *unit = slot.get();
+        pool.submit([this, unit] { parse(unit); });
+    }
+    return slot.get();
+}
+
+// a/b.pie for a.b
+static std::string moduleFile(const std::string &name)
+{
+    std::string file = name;
+    std::replace(file.begin(), file.end(), '.', '/');
+    return file + ".pie";
+}
+
+std::string Driver::resolve(const std::string &name) const
+{
+    std::string file = moduleFile(name);
+    for (const std::string &dir : search) {
+        std::string path = dir + file;
+        if (FILE *exists = fopen(path.c_str(), "rb")) {
+            fclose(exists);
+            return path;
+        }
+    }
+    return "";
+}
+
+void Driver::parse(Unit *unit)
+{
+    Source source;
+    std::unique_ptr<ModuleNode> module;
+
+    if (const EmbeddedModule *embedded = unit->embedded) {
+        unit->key = ModuleCache::key(embedded->text, embedded->length, options);
+        if (!report) {
+            module.reset(ModuleCache::decode(embedded->entry, embedded->entry_size, unit->key));
+            unit->cached = module != nullptr;
+        }
+        if (!module) {
+            source.copy(unit->path, embedded->text, embedded->length);
+        }
+    } else {
+        // A missing program is reported by compile()
+        if (!source.open(unit->path)) {
+            return;
+        }
+
+        if (cache) {
+            unit->key = ModuleCache::key(source.data(), source.size(), options);
+            if (!report) {
+                module.reset(cache->load(unit->key));
+                unit->cached = module != nullptr;
+            }
+        }
+    }
+
+    if (!module) {
+        Scanner scanner(source);
+        Parser parser(scanner);
+
+        int ret = parser.parse();
+        module.reset(parser.module);
+
+        if (ret != 0) {
+            fprintf(stderr, "Failed to parse: %s\n", unit->path.c_str());
+            std::lock_guard<std::mutex> held(lock);
+            failed = true;
+            return;
+        }
+    }
+
+    // Imports are parsed while this module waits for analysis. One
+    // without a file stays unbound, compile() reports it unless it is
+    // native.
+    for (ImportNode *import : module->imports) {
+        Unit *imported = nullptr;
+        auto embedded = library.find(import->module_name);
+        if (embedded != library.end()) {
+            imported = load("<lib>/" + moduleFile(import->module_name), import->module_name, embedded->second);
+        } else {
+            std::string path = resolve(import->module_name);
+            if (!path.empty()) imported = load(path, import->module_name);
+        }
+        unit->bindings.push_back(std::make_pair(import, imported));
+    }
+
+    unit->module = std::move(module);
+}
+
+void Driver::analyse(Unit *unit)
+{
+    // A module from the cache was analysed by an earlier run
+    if (!unit->cached) {
+        ModuleNode *module = unit->module.get();
+
+        if (typecheck) {
+            TypeCheckVisitor checker;
+            checker.check(module);
+        }
+
+        if (optimize) {
+            OptimizeVisitor optimizer;
+            optimizer.optimize(module);
+
+            if (inline_budget > 0) {
+                InlineVisitor inliner(inline_budget);
+                if (report) inliner.setReport(&unit->report);
+                inliner.inlineCalls(module);
+
+                // Constant arguments may fold with the inlined bodies
+                optimizer.optimize(module);
+            }
+        }
+
+        // Linking renames the functions it binds, the entry is written
+        // before that
+        if (cache && !unit->embedded) {
+            cache->store(unit->key, module);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> held(lock);
+        unit->analysed = true;
+        done.push_back(unit);
+    }
+
+    for (Unit *user : unit->users) {
+        if (--user->pending == 0) {
+            schedule(user);
+        }
+    }
+}
+
+void Driver::schedule(Unit *unit)
+{
+    pool.submit([this, unit] { analyse(unit); });
+}
+
+// Names a function declares: its parameters and every let in its body,
+// calls of those are calls of locals
+static void collectLocals(Node *node, std::set<std::string> &names)
+{
+    if (LetNode *let = dyn_cast<LetNode>(node)) {
+        names.insert(let->name);
+    }
+    for (Node *child : node->children) {
+        if (child) collectLocals(child, names);
+    }
+}
+
+// Calls, and identifiers that may name a function as a value (let f = sq)
+static void collectCalls(Node *node, std::vector<FunctionCallNode *> &calls,
+                         std::vector<IdentifierNode *> &ids)
+{
+    if (FunctionCallNode *call = dyn_cast<FunctionCallNode>(node)) {
+        calls.push_back(call);
+    } else if (IdentifierNode *id = dyn_cast<IdentifierNode>(node)) {
+        ids.push_back(id);
+    }
+    for (Node *child : node->children) {
+        if (child) collectCalls(child, calls, ids);
+    }
+}
+
+// Binds calls from the functions of the program to the functions of the
+// modules it imports, then the calls of those, and so on. A bound function
+// is renamed to its qualified name and added to the program, as are its
+// calls: nothing the program never calls is added. A function used as a
+// value is bound the same way.
+bool Driver::link(Unit *root)
+{
+    ModuleNode *program = root->module.get();
+    std::set<FunctionNode *> bound;
+    std::vector<std::pair<Unit *, FunctionNode *>> work;
+    for (FunctionNode *fn : program->functions) {
+        work.push_back(std::make_pair(root, fn));
+    }
+
+    // The name the program knows target by, the program's own functions
+    // keep theirs
+    auto bind = [&](Unit *owner, FunctionNode *target) -> const std::string & {
+        if (owner != root && bound.insert(target).second) {
+            target->name = owner->name + "." + target->name;
+            program->symtab[target->name] = target;
+            program->functions.push_back(target);
+            work.push_back(std::make_pair(owner, target));
+        }
+        return target->name;
+    };
+
+    while (!work.empty()) {
+        Unit *unit = work.back().first;
+        FunctionNode *fn = work.back().second;
+        work.pop_back();
+
+        std::set<std::string> locals;
+        for (auto &param : fn->params) {
+            locals.insert(param.first);
+        }
+        collectLocals(fn, locals);
+
+        std::vector<FunctionCallNode *> calls;
+        std::vector<IdentifierNode *> ids;
+        collectCalls(fn, calls, ids);
+
+        for (FunctionCallNode *call : calls) {
+            if (call->scope.empty() && locals.count(call->name)) continue;
+
+            Unit *owner = nullptr;
+            FunctionNode *target = lookup(unit, call->scope, call->name, owner);
+            if (!target) continue;
+
+            if (owner != unit && target->access_level == 0) {
+                fprintf(stderr, "Private function: %s (called from %s)\n",
+                        call->qualifiedName().c_str(), unit->path.c_str());
+                return false;
+            }
+
+            call->name = bind(owner, target);
+            call->scope.clear();
+        }
+
+        for (IdentifierNode *id : ids) {
+            if (locals.count(id->name)) continue;
+
+            Unit *owner = nullptr;
+            FunctionNode *target = lookup(unit, "", id->name, owner);
+            if (target) id->name = bind(owner, target);
+        }
+    }
+
+    return true;
+}
+
+// The function scope.name names: one of the module's own, then one
+// exported by a module it imports with .*, or the function of a module
+// scope qualifies
+FunctionNode *Driver::lookup(Unit *unit, const std::string &scope, const std::string &name,
+                             Unit *&owner)
+{
+    std::vector<Unit *> seen;
+
+    if (scope.empty()) {
+        auto it = unit->module->symtab.find(name);
+        if (it != unit->module->symtab.end()) {
+            owner = unit;
+            return dyn_cast<FunctionNode>(it->second);
+        }
+
+        for (auto &binding : unit->bindings) {
+            if (!binding.first->import_all || !binding.second) continue;
+            if (FunctionNode *fn = exported(binding.second, name, owner, seen)) {
+                return fn;
+            }
+        }
+        return nullptr;
+    }
+
+    Unit *module = qualifier(unit, scope, false, seen);
+    if (!module) return nullptr;
+
+    // A private function is found too, the caller reports it
+    auto it = module->module->symtab.find(name);
+    if (it != module->module->symtab.end()) {
+        owner = module;
+        return dyn_cast<FunctionNode>(it->second);
+    }
+    seen.clear();
+    return exported(module, name, owner, seen);
+}
+
+// Public functions of a module, with those of the modules it imports with
+// "pub import a.*"
+FunctionNode *Driver::exported(Unit *unit, const std::string &name, Unit *&owner,
+                               std::vector<Unit *> &seen)
+{
+    if (!unit->module || std::find(seen.begin(), seen.end(), unit) != seen.end()) {
+        return nullptr;
+    }
+    seen.push_back(unit);
+
+    auto it = unit->module->symtab.find(name);
+    if (it != unit->module->symtab.end()) {
+        FunctionNode *fn = dyn_cast<FunctionNode>(it->second);
+        if (fn && fn->access_level > 0) {
+            owner = unit;
+            return fn;
+        }
+    }
+
+    for (auto &binding : unit->bindings) {
+        ImportNode *import = binding.first;
+        if (!import->access_level || !import->import_all || !binding.second) continue;
+        if (FunctionNode *fn = exported(binding.second, name, owner, seen)) {
+            return fn;
+        }
+    }
+    return nullptr;
+}
+
+// The module "scope.f()" calls: one imported as scope or as a.b.scope, or
+// one of those a module it imports re-exports with "pub import"
+Driver::Unit *Driver::qualifier(Unit *unit, const std::string &scope, bool public_only,
+                                std::vector<Unit *> &seen)
+{
+    if (std::find(seen.begin(), seen.end(), unit) != seen.end()) {
+        return nullptr;
+    }
+    seen.push_back(unit);
+
+    for (auto &binding : unit->bindings) {
+        ImportNode *import = binding.first;
+        if (!binding.second || binding.first->import_all) continue;
+        if (public_only && !import->access_level) continue;
+
+        const std::string &name = import->module_name;
+        size_t dot = name.rfind('.');
+        if (name == scope || (dot != std::string::npos && name.compare(dot + 1, std::string::npos, scope) == 0)) {
+            return binding.second;
+        }
+    }
+
+    for (auto &binding : unit->bindings) {
+        if (!binding.second || !binding.second->module) continue;
+        if (public_only && !binding.first->access_level) continue;
+        if (Unit *module = qualifier(binding.second, scope, true, seen)) {
+            return module;
+        }
+    }
+    return nullptr;
+}
+
+}}
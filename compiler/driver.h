@@ -0,0 +1,141 @@
+#ifndef __PIE_DRIVER__
+#define __PIE_DRIVER__
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "compiler/ast.h"
+#include "compiler/cache.h"
+#include "compiler/pool.h"
+
+namespace pie { namespace compiler {
+
+// A module built into the binary: its text, and its cache entry as the
+// default options analyse it. tools/snapshot.cpp generates them.
+struct EmbeddedModule {
+    const char *name;  // as imported
+    const char *text;
+    size_t length;
+    const char *entry;
+    size_t entry_size;
+};
+
+// Loads, compiles and links a program with every module reachable
+// through its imports, see doc/module-system.md.
+//
+// Modules are parsed on a TaskPool as their imports are discovered, then
+// analysed (type checked, optimized and inlined) as soon as everything
+// they import is: independent modules compile in parallel. Each module is
+// parsed by its own Scanner and Parser into its own arena, nothing is
+// shared between the tasks but the driver's tables. A module is parsed
+// once however many modules import it.
+//
+// Analysed modules are kept in a ModuleCache when one is set, an unchanged
+// module is then loaded from it instead of being parsed and analysed.
+//
+// Linking then binds the calls of the program, starting from its own
+// functions, to the functions they name in other modules. Only functions
+// reached that way are added to the program, under their qualified name.
+class Driver {
+public:
+    enum Result { Compiled, OpenFailed, ParseFailed, LinkFailed };
+
+    // 0 threads uses one per core
+    explicit Driver(unsigned threads = 0);
+    ~Driver();
+
+    Driver(const Driver &) = delete;
+    Driver &operator=(const Driver &) = delete;
+
+    // Modules imported by name before the search path is looked at, the
+    // standard library in pie. Their entries are used when the options
+    // are the default ones, their text is compiled otherwise.
+    void setLibrary(const EmbeddedModule *modules, size_t count);
+    // Directories "import a.b" looks for a/b.pie in, in order. The
+    // directory of the program is searched last.
+    void addSearchPath(const std::string &dir);
+
+    void setTypeCheck(bool enabled) { typecheck = enabled; }
+    // An inline budget of 0 only folds constants
+    void setOptimize(bool enabled, int budget) { optimize = enabled; inline_budget = budget; }
+    // Inlined call sites are printed module by module, imports first.
+    // Modules are not loaded from the cache then, it has no report.
+    void setInlineReport(std::ostream *out) { report = out; }
+    // Keeps analysed modules in dir, none when dir is empty
+    void setCacheDir(const std::string &dir);
+    // What the analysis is asked to do, part of the cache keys
+    std::string analysisOptions() const;
+
+    // Errors are printed on stderr
+    Result compile(const std::string &path);
+
+    // Module of the file given to compile(), with the functions it uses
+    // from other modules
+    ModuleNode *root() const;
+    // Every compiled module, each after the modules it imports
+    const std::vector<ModuleNode *> &modules() const { return order; }
+
+private:
+    struct Unit {
+        std::string path;
+        std::string name;                    // as imported, prefixes linked functions
+        const EmbeddedModule *embedded;      // null for files
+        std::unique_ptr<ModuleNode> module;  // null until parsed
+        std::vector<std::pair<ImportNode *, Unit *>> bindings;  // null for native modules
+        std::vector<Unit *> imports;
+        std::vector<Unit *> users;
+        std::atomic<int> pending;            // imports not analysed yet
+        bool analysed;
+        uint64_t key;                        // in the cache
+        bool cached;                         // loaded from the cache, analysed already
+        std::ostringstream report;
+
+        Unit(const std::string &path, const std::string &name, const EmbeddedModule *embedded)
+            : path(path), name(name), embedded(embedded), pending(0), analysed(false), key(0),
+              cached(false) {}
+    };
+
+    TaskPool pool;
+    bool typecheck;
+    bool optimize;
+    int inline_budget;
+    std::ostream *report;
+    std::unique_ptr<ModuleCache> cache;
+    std::string options;  // of the analysis, part of cache keys
+
+    std::map<std::string, const EmbeddedModule *> library;  // by name
+    std::vector<std::string> search;
+    std::mutex lock;   // guards units, found, done and failed
+    std::map<std::string, std::unique_ptr<Unit>> units;  // by path
+    std::vector<Unit *> found;                           // in discovery order
+    std::vector<Unit *> done;                            // in analysis order
+    std::vector<ModuleNode *> order;
+    bool failed;
+
+    Unit *load(const std::string &path, const std::string &name,
+               const EmbeddedModule *embedded = nullptr);
+    void parse(Unit *unit);
+    void analyse(Unit *unit);
+    void schedule(Unit *unit);
+
+    // Path of the module file, empty when there is none
+    std::string resolve(const std::string &name) const;
+
+    bool link(Unit *root);
+    FunctionNode *lookup(Unit *unit, const std::string &scope, const std::string &name,
+                         Unit *&owner);
+    FunctionNode *exported(Unit *unit, const std::string &name, Unit *&owner,
+                           std::vector<Unit *> &seen);
+    Unit *qualifier(Unit *unit, const std::string &scope, bool public_only,
+                    std::vector<Unit *> &seen);
+};
+
+}}
+
+#endif
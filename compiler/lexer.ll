@@ -16,7 +16,7 @@
 
 #if DEBUG_LEX
 # define DBG_TOKEN(t) do { 								\
-	if (getenv("DEBUG_LEX")) {						\
+	if (_scanner->m_debug) {						\
 		printf("T:%d\t%s \"%s\"\n", yylineno, #t, yytext);	\
 	} 													\
 } while(0)
@@ -30,9 +30,19 @@
 } while(0)
 
 #include "compiler/scanner.h"
+#include "compiler/source.h"
 #include "compiler/parser.tab.hpp"
 
-static std::string string_buffer;
+// Adds c to the string literal being scanned, at is where its escape
+// sequence starts. The first escape copies the literal up to there.
+static void appendEscape(pie::compiler::Scanner *s, const char *at, char c)
+{
+	if (!s->m_escaped) {
+		s->m_decoded.emplace_back(s->m_string.data, at - s->m_string.data);
+		s->m_escaped = true;
+	}
+	s->m_decoded.back() += c;
+}
 
 %}
 
@@ -57,6 +67,10 @@ NEWLINE 		("\r"|"\n"|"\r\n")
 "if"			{ RETURN_TOKEN(T_IF); }
 "else"			{ RETURN_TOKEN(T_ELSE); }
 "return"		{ RETURN_TOKEN(T_RETURN); }
+"while"			{ RETURN_TOKEN(T_WHILE); }
+"for"			{ RETURN_TOKEN(T_FOR); }
+"break"			{ RETURN_TOKEN(T_BREAK); }
+"continue"		{ RETURN_TOKEN(T_CONTINUE); }
 
 "module"		{ RETURN_TOKEN(T_MODULE); }
 "import"		{ RETURN_TOKEN(T_IMPORT); }
@@ -105,20 +119,33 @@ NEWLINE 		("\r"|"\n"|"\r\n")
 
 \" {
 	BEGIN(ST_STRING);
-	string_buffer.clear();
+	_scanner->m_string.data = yytext + 1;
+	_scanner->m_string.length = 0;
+	_scanner->m_escaped = false;
 }
 
 <ST_STRING>\" {
 	BEGIN(INITIAL);
+	if (_scanner->m_escaped) {
+		const std::string &decoded = _scanner->m_decoded.back();
+		_scanner->m_string.data = decoded.data();
+		_scanner->m_string.length = (uint32_t)decoded.size();
+	} else {
+		_scanner->m_string.length = (uint32_t)(yytext - _scanner->m_string.data);
+	}
 	RETURN_TOKEN(T_STRING);
 }
 
-<ST_STRING>\\n  { string_buffer += '\n'; }
-<ST_STRING>\\t  { string_buffer += '\t'; }
-<ST_STRING>\\r  { string_buffer += '\r'; }
-<ST_STRING>\\\\ { string_buffer += '\\'; }
-<ST_STRING>\\\" { string_buffer += '"'; }
-<ST_STRING>[^\\\"]+ { string_buffer += yytext; }
+<ST_STRING>\\n  { appendEscape(_scanner, yytext, '\n'); }
+<ST_STRING>\\t  { appendEscape(_scanner, yytext, '\t'); }
+<ST_STRING>\\r  { appendEscape(_scanner, yytext, '\r'); }
+<ST_STRING>\\\\ { appendEscape(_scanner, yytext, '\\'); }
+<ST_STRING>\\\" { appendEscape(_scanner, yytext, '"'); }
+<ST_STRING>[^\\\"]+ {
+	if (_scanner->m_escaped) {
+		_scanner->m_decoded.back().append(yytext, yyleng);
+	}
+}
 
 
 [a-zA-Z_][a-zA-Z0-9_]*	{ RETURN_TOKEN(T_IDENTIFIER); }
@@ -129,17 +156,20 @@ NEWLINE 		("\r"|"\n"|"\r\n")
 
 namespace pie { namespace compiler {
 
-Scanner::Scanner(FILE *file)
+Scanner::Scanner(Source &source)
 {
 	m_line = 0;
-	m_filename = "Unknown";
-	m_file = file ? file : stdin;
+	m_filename = source.path();
+	m_string.data = nullptr;
+	m_string.length = 0;
+	m_escaped = false;
+	m_debug = getenv("DEBUG_LEX") != nullptr;
 
-    yylex_init_extra(this, (yyscan_t*)&m_yyscanner);
+	yylex_init_extra(this, (yyscan_t*)&m_yyscanner);
 
-	if (file) {
-		yy_switch_to_buffer(yy_create_buffer(file, YY_BUF_SIZE, (yyscan_t)m_yyscanner), (yyscan_t)m_yyscanner);
-	}
+	// The text ends in two NULs, flex scans it where it is
+	yy_scan_buffer(source.data(), source.size() + 2, (yyscan_t)m_yyscanner);
+	yyset_lineno(1, (yyscan_t)m_yyscanner);
 }
 
 int Scanner::scan()
@@ -167,9 +197,9 @@ int Scanner::tokenLength() const
 	return yyget_leng((yyscan_t)m_yyscanner);
 }
 
-const std::string &Scanner::stringValue() const
+int Scanner::line() const
 {
-	return string_buffer;
+	return yyget_lineno((yyscan_t)m_yyscanner);
 }
 
 Scanner::~Scanner()
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
 
@@ -8,14 +9,15 @@
 
 namespace pie { namespace compiler {
 
-Parser::Parser(Scanner &s) : scanner(s), function(nullptr)
+Parser::Parser(Scanner &s) : scanner(s), function(nullptr), loops(0)
 {
     module = new ModuleNode();
 }
 
 void Parser::parseFatal(std::string msg)
 {
-    fprintf(stderr, "Parse error at line %d: %s\n", scanner.m_line, msg.c_str());
+    // m_line counts the newlines before the token
+    fprintf(stderr, "Parse error at line %d: %s\n", scanner.m_line + 1, msg.c_str());
 }
 
 int Parser::scan(void *token_ptr)
@@ -23,16 +25,28 @@ int Parser::scan(void *token_ptr)
     YYSTYPE *token = (YYSTYPE *)token_ptr;
     int tok = scanner.scan();
 
-    // Fill in the semantic value based on token type
+    // Token text stays a view of the source, the grammar actions copy
+    // what ends up in the AST
     if (tok == T_IDENTIFIER) {
-        token->str = new std::string(scanner.tokenText(), scanner.tokenLength());
+        token->text.data = scanner.tokenText();
+        token->text.length = (uint32_t)scanner.tokenLength();
     } else if (tok == T_NUMBER) {
-        token->num = atoll(scanner.tokenText());
+        const char *digits = scanner.tokenText();
+        int n = scanner.tokenLength();
+        int64_t value = 0;
+        for (int i = 0; i < n; i++) {
+            int digit = digits[i] - '0';
+            if (value > (INT64_MAX - digit) / 10) {
+                parseFatal("integer literal out of range: " + std::string(digits, n));
+                return T_ERROR;
+            }
+            value = value * 10 + digit;
+        }
+        token->num = value;
     } else if (tok == T_DOUBLE) {
-        token->dbl = atof(scanner.tokenText());
+        token->dbl = strtod(scanner.tokenText(), nullptr);
     } else if (tok == T_STRING) {
-        // For strings, use the accumulated string buffer content
-        token->str = new std::string(scanner.stringValue());
+        token->text = scanner.stringValue();
     } else if (tok == T_ACC_PUBLIC) {
         token->visibility = 1;
     }
@@ -43,37 +57,46 @@ int Parser::scan(void *token_ptr)
 // AST building helpers
 Node *Parser::makeInt(int64_t value)
 {
-    return new IntNode(value);
+    return make<IntNode>(value);
 }
 
 Node *Parser::makeDouble(double value)
 {
-    return new DoubleNode(value);
+    return make<DoubleNode>(value);
 }
 
 Node *Parser::makeString(const std::string &str)
 {
-    return new StringNode(str);
+    return make<StringNode>(str);
 }
 
 Node *Parser::makeIdentifier(const std::string &name)
 {
-    return new IdentifierNode(name);
+    return make<IdentifierNode>(name);
 }
 
 Node *Parser::makeBinaryOp(BinaryOp op, Node *lhs, Node *rhs)
 {
-    return new BinaryOpNode(op, lhs, rhs);
+    return make<BinaryOpNode>(op, lhs, rhs);
 }
 
 Node *Parser::makeUnaryOp(UnaryOp op, Node *expr)
 {
-    return new UnaryOpNode(op, expr);
+    return make<UnaryOpNode>(op, expr);
 }
 
 Node *Parser::makeFunctionCall(const std::string &name, std::vector<Node*> &args)
 {
-    FunctionCallNode *call = new FunctionCallNode(name);
+    FunctionCallNode *call = make<FunctionCallNode>(name);
+    for (Node *arg : args) {
+        call->push(arg);
+    }
+    return call;
+}
+
+Node *Parser::makeFunctionCall(const std::string &scope, const std::string &name, std::vector<Node*> &args)
+{
+    FunctionCallNode *call = make<FunctionCallNode>(scope, name);
     for (Node *arg : args) {
         call->push(arg);
     }
@@ -82,32 +105,42 @@ Node *Parser::makeFunctionCall(const std::string &name, std::vector<Node*> &args
 
 Node *Parser::makeLet(const std::string &name, TypeNode *type, Node *value)
 {
-    return new LetNode(name, type, value);
+    return make<LetNode>(name, type, value);
 }
 
 Node *Parser::makeAssign(Node *var, Node *value)
 {
-    return new AssignNode(var, value);
+    return make<AssignNode>(var, value);
 }
 
 Node *Parser::makeReturn(Node *expr)
 {
-    return new ReturnNode(expr);
+    return make<ReturnNode>(expr);
 }
 
 Node *Parser::makeIf(Node *cond, BlockNode *then_block, Node *else_block)
 {
-    return new IfNode(cond, then_block, else_block);
+    return make<IfNode>(cond, then_block, else_block);
+}
+
+Node *Parser::makeWhile(Node *cond, BlockNode *body)
+{
+    return make<WhileNode>(cond, body);
+}
+
+Node *Parser::makeFor(Node *init, Node *cond, Node *step, BlockNode *body)
+{
+    return make<ForNode>(init, cond, step, body);
 }
 
 BlockNode *Parser::makeBlock()
 {
-    return new BlockNode();
+    return make<BlockNode>();
 }
 
 TypeNode *Parser::makeType(const std::string &name, bool isArray)
 {
-    return new TypeNode(name, isArray);
+    return make<TypeNode>(name, isArray);
 }
 
 }}
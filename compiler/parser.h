@@ -3,6 +3,7 @@
 
 #include <string>
 #include <stack>
+#include <utility>
 #include <vector>
 
 #include "compiler/ast.h"
@@ -26,6 +27,13 @@ public:
 	int parse();
 	void parseFatal(std::string msg);
 
+	// Allocates in the arena of the module being parsed
+	template <typename T, typename... Args>
+	T *make(Args&&... args)
+	{
+		return module->arena.make<T>(std::forward<Args>(args)...);
+	}
+
 	// AST building helpers
 	Node *makeInt(int64_t value);
 	Node *makeDouble(double value);
@@ -34,19 +42,23 @@ public:
 	Node *makeBinaryOp(BinaryOp op, Node *lhs, Node *rhs);
 	Node *makeUnaryOp(UnaryOp op, Node *expr);
 	Node *makeFunctionCall(const std::string &name, std::vector<Node*> &args);
+	Node *makeFunctionCall(const std::string &scope, const std::string &name, std::vector<Node*> &args);
 	Node *makeLet(const std::string &name, TypeNode *type, Node *value);
 	Node *makeAssign(Node *var, Node *value);
 	Node *makeReturn(Node *expr);
 	Node *makeIf(Node *cond, BlockNode *then_block, Node *else_block);
+	Node *makeWhile(Node *cond, BlockNode *body);
+	Node *makeFor(Node *init, Node *cond, Node *step, BlockNode *body);
 	BlockNode *makeBlock();
 	TypeNode *makeType(const std::string &name, bool isArray);
 
 public:
 	Scanner &scanner;
 
-	ModuleNode *module;             // current parsed module
+	ModuleNode *module;             // current parsed module, owned by the caller
 	FunctionNode *function;         // current parsed function
 	std::stack<BlockNode*> blocks;  // block stack for nested blocks
+	int loops;                      // loops around the statement being parsed
 };
 
 }}
@@ -3,6 +3,7 @@
 #include <vector>
 #include <utility>
 #include "compiler/ast.h"
+#include "compiler/scanner.h"
 
 namespace pie { namespace compiler {
     class Parser;
@@ -18,14 +19,15 @@ namespace pie { namespace compiler {
 #ifdef yyerror
 #undef yyerror
 #endif
-#define yyerror(p, msg) p->parseFatal(msg)
+#define yyerror(loc, p, msg) p->parseFatal(msg)
 
 using namespace pie::compiler;
 
-static int yylex(YYSTYPE *token, pie::compiler::Parser *_p);
+static int yylex(YYSTYPE *token, YYLTYPE *location, pie::compiler::Parser *_p);
 }
 
 %define api.pure
+%locations
 %lex-param {pie::compiler::Parser *_p}
 %parse-param {pie::compiler::Parser *_p}
 
@@ -34,6 +36,7 @@ static int yylex(YYSTYPE *token, pie::compiler::Parser *_p);
     pie::compiler::BlockNode *block;
     pie::compiler::TypeNode *type;
     std::string *str;
+    pie::compiler::TokenText text;
     int64_t num;
     double dbl;
     int visibility;
@@ -41,9 +44,7 @@ static int yylex(YYSTYPE *token, pie::compiler::Parser *_p);
     std::vector<std::pair<std::string, pie::compiler::TypeNode*>> *param_list;
 }
 
-%destructor { delete $$; } <str>
-%destructor { delete $$; } <node_list>
-%destructor { delete $$; } <param_list>
+/* Semantic values are allocated in the module arena, nothing to free here */
 
 /* Precedence from lowest to highest */
 %right '='
@@ -79,6 +80,8 @@ static int yylex(YYSTYPE *token, pie::compiler::Parser *_p);
 
 %token T_WHILE
 %token T_FOR
+%token T_BREAK
+%token T_CONTINUE
 
 %right T_INC T_DEC
 
@@ -86,10 +89,10 @@ static int yylex(YYSTYPE *token, pie::compiler::Parser *_p);
 
 %token T_WHITESPACE
 
-%token <str> T_STRING
+%token <text> T_STRING
 %token <num> T_NUMBER
 %token <dbl> T_DOUBLE
-%token <str> T_IDENTIFIER
+%token <text> T_IDENTIFIER
 
 %token T_ERROR
 
@@ -102,6 +105,9 @@ static int yylex(YYSTYPE *token, pie::compiler::Parser *_p);
 %type <node> func_decl_stmt
 %type <node> expr
 %type <node> if_stmt
+%type <node> loop_stmt
+%type <node> for_init
+%type <node> for_expr
 %type <block> func_body
 %type <block> block
 %type <type> type_name
@@ -116,12 +122,19 @@ static int yylex(YYSTYPE *token, pie::compiler::Parser *_p);
 %%
 
 start:
-    module_decl_stmt import_stmts statements { $$ = _p->module; }
+    module_decl_stmt declarations { $$ = _p->module; }
 ;
 
-import_stmts:
-    import_stmts import_stmt
-    | /* Empty */
+/* Imports and functions share one list: both may start with a visibility,
+   the keyword after it tells them apart */
+declarations:
+    /* Empty */
+    | declarations import_stmt
+    | declarations statement {
+        if ($2 && _p->function) {
+            _p->function->push($2);
+        }
+    }
 ;
 
 visibility:
@@ -132,46 +145,32 @@ visibility:
 module_decl_stmt:
     T_MODULE symbol_name {
         _p->module->name = *$2;
-        delete $2;
         $$ = _p->module;
     }
 ;
 
 import_stmt:
     visibility T_IMPORT symbol_name {
-        ImportNode *imp = new ImportNode(*$3, $1, false);
+        ImportNode *imp = _p->make<ImportNode>(*$3, $1, false);
         _p->module->imports.push_back(imp);
         _p->module->push(imp);
-        delete $3;
         $$ = imp;
     }
     | visibility T_IMPORT symbol_name '.' '*' {
-        ImportNode *imp = new ImportNode(*$3, $1, true);
+        ImportNode *imp = _p->make<ImportNode>(*$3, $1, true);
         _p->module->imports.push_back(imp);
         _p->module->push(imp);
-        delete $3;
         $$ = imp;
     }
 ;
 
-statements:
-    /* Empty */
-    | statements statement {
-        if ($2 && _p->function) {
-            _p->function->push($2);
-        }
-    }
-;
-
 statement:
     func_decl_stmt { $$ = $1; }
     | T_LET T_IDENTIFIER '=' expr {
-        $$ = _p->makeLet(*$2, nullptr, $4);
-        delete $2;
+        $$ = _p->makeLet($2.str(), nullptr, $4);
     }
     | T_LET T_IDENTIFIER ':' type_name '=' expr {
-        $$ = _p->makeLet(*$2, $4, $6);
-        delete $2;
+        $$ = _p->makeLet($2.str(), $4, $6);
     }
     | T_RETURN expr {
         $$ = _p->makeReturn($2);
@@ -180,18 +179,33 @@ statement:
         $$ = _p->makeReturn(nullptr);
     }
     | if_stmt { $$ = $1; }
+    | loop_stmt { $$ = $1; }
+    | T_BREAK {
+        if (_p->loops == 0) {
+            _p->parseFatal("break outside of a loop");
+            YYABORT;
+        }
+        $$ = _p->make<BreakNode>();
+    }
+    | T_CONTINUE {
+        if (_p->loops == 0) {
+            _p->parseFatal("continue outside of a loop");
+            YYABORT;
+        }
+        $$ = _p->make<ContinueNode>();
+    }
     | expr { $$ = $1; }
 ;
 
 
 arguments:
-    /* Empty */ { $$ = new std::vector<Node*>(); }
+    /* Empty */ { $$ = _p->make<std::vector<Node*>>(); }
     | argument_list { $$ = $1; }
 ;
 
 argument_list:
     expr {
-        $$ = new std::vector<Node*>();
+        $$ = _p->make<std::vector<Node*>>();
         $$->push_back($1);
     }
     | argument_list ',' expr {
@@ -212,6 +226,30 @@ if_stmt:
     }
 ;
 
+loop_stmt:
+    T_WHILE '(' expr ')' { _p->loops++; } block {
+        _p->loops--;
+        $$ = _p->makeWhile($3, $6);
+    }
+    | T_FOR '(' for_init ';' for_expr ';' for_expr ')' { _p->loops++; } block {
+        _p->loops--;
+        $$ = _p->makeFor($3, $5, $7, $10);
+    }
+;
+
+for_init:
+    /* Empty */ { $$ = nullptr; }
+    | T_LET T_IDENTIFIER '=' expr {
+        $$ = _p->makeLet($2.str(), nullptr, $4);
+    }
+    | expr { $$ = $1; }
+;
+
+for_expr:
+    /* Empty */ { $$ = nullptr; }
+    | expr { $$ = $1; }
+;
+
 block:
     '{' {
         _p->blocks.push(_p->makeBlock());
@@ -229,6 +267,9 @@ block_statements:
 
 block_statement:
     statement {
+        if ($1 && !$1->line) {
+            $1->line = @1.first_line;
+        }
         if ($1 && !_p->blocks.empty()) {
             _p->blocks.top()->addStatement($1);
         }
@@ -237,16 +278,15 @@ block_statement:
 
 func_decl_stmt:
     visibility T_FUNC T_IDENTIFIER '(' parameter_list ')' return_type {
-        FunctionNode *fn = new FunctionNode(*$3, $1);
+        FunctionNode *fn = _p->make<FunctionNode>($3.str(), $1);
+        fn->line = @2.first_line;
         if ($5) {
             fn->params = *$5;
-            delete $5;
         }
         fn->return_type = $7;
         _p->function = fn;
         _p->module->functions.push_back(fn);
-        _p->module->symtab[*$3] = fn;
-        delete $3;
+        _p->module->symtab[fn->name] = fn;
     }
     func_body {
         // Function body statements are already added to _p->function
@@ -258,12 +298,10 @@ func_decl_stmt:
 type_name:
     /* Empty */ { $$ = nullptr; }
     | T_IDENTIFIER {
-        $$ = _p->makeType(*$1, false);
-        delete $1;
+        $$ = _p->makeType($1.str(), false);
     }
     | T_IDENTIFIER '[' ']' {
-        $$ = _p->makeType(*$1, true);
-        delete $1;
+        $$ = _p->makeType($1.str(), true);
     }
 ;
 
@@ -285,6 +323,9 @@ func_body_statements:
 
 func_body_statement:
     statement {
+        if ($1 && !$1->line) {
+            $1->line = @1.first_line;
+        }
         if ($1 && _p->function) {
             _p->function->push($1);
         }
@@ -292,39 +333,34 @@ func_body_statement:
 ;
 
 parameter_list:
-    /* Empty */ { $$ = new std::vector<std::pair<std::string, TypeNode*>>(); }
+    /* Empty */ { $$ = _p->make<std::vector<std::pair<std::string, TypeNode*>>>(); }
     | parameter_list_inner { $$ = $1; }
 ;
 
 parameter_list_inner:
     T_IDENTIFIER {
-        $$ = new std::vector<std::pair<std::string, TypeNode*>>();
-        $$->push_back(std::make_pair(*$1, (TypeNode*)nullptr));
-        delete $1;
+        $$ = _p->make<std::vector<std::pair<std::string, TypeNode*>>>();
+        $$->push_back(std::make_pair($1.str(), (TypeNode*)nullptr));
     }
     | T_IDENTIFIER ':' type_name {
-        $$ = new std::vector<std::pair<std::string, TypeNode*>>();
-        $$->push_back(std::make_pair(*$1, $3));
-        delete $1;
+        $$ = _p->make<std::vector<std::pair<std::string, TypeNode*>>>();
+        $$->push_back(std::make_pair($1.str(), $3));
     }
     | parameter_list_inner ',' T_IDENTIFIER {
         $$ = $1;
-        $$->push_back(std::make_pair(*$3, (TypeNode*)nullptr));
-        delete $3;
+        $$->push_back(std::make_pair($3.str(), (TypeNode*)nullptr));
     }
     | parameter_list_inner ',' T_IDENTIFIER ':' type_name {
         $$ = $1;
-        $$->push_back(std::make_pair(*$3, $5));
-        delete $3;
+        $$->push_back(std::make_pair($3.str(), $5));
     }
 ;
 
 symbol_name:
-    T_IDENTIFIER { $$ = $1; }
+    T_IDENTIFIER { $$ = _p->make<std::string>($1.data, $1.length); }
     | symbol_name '.' T_IDENTIFIER {
         *$1 += ".";
-        *$1 += *$3;
-        delete $3;
+        $1->append($3.data, $3.length);
         $$ = $1;
     }
 ;
@@ -333,41 +369,28 @@ expr:
     T_NUMBER {
         $$ = _p->makeInt($1);
     }
+    | T_ERROR {
+        // Already reported by Parser::scan
+        YYABORT;
+    }
     | T_DOUBLE {
         $$ = _p->makeDouble($1);
     }
     | T_STRING {
-        $$ = _p->makeString(*$1);
-        delete $1;
+        $$ = _p->makeString($1.str());
     }
     | T_IDENTIFIER {
-        $$ = _p->makeIdentifier(*$1);
-        delete $1;
+        $$ = _p->makeIdentifier($1.str());
     }
     | T_IDENTIFIER '=' expr {
-        Node *var = _p->makeIdentifier(*$1);
-        delete $1;
+        Node *var = _p->makeIdentifier($1.str());
         $$ = _p->makeAssign(var, $3);
     }
     | T_IDENTIFIER '(' arguments ')' {
-        std::vector<Node*> args;
-        if ($3) {
-            args = *$3;
-            delete $3;
-        }
-        $$ = _p->makeFunctionCall(*$1, args);
-        delete $1;
+        $$ = _p->makeFunctionCall($1.str(), *$3);
     }
     | symbol_name '.' T_IDENTIFIER '(' arguments ')' {
-        std::string fullName = *$1 + "." + *$3;
-        std::vector<Node*> args;
-        if ($5) {
-            args = *$5;
-            delete $5;
-        }
-        $$ = _p->makeFunctionCall(fullName, args);
-        delete $1;
-        delete $3;
+        $$ = _p->makeFunctionCall(*$1, $3.str(), *$5);
     }
     | expr '+' expr {
         $$ = _p->makeBinaryOp(BinaryOp::Add, $1, $3);
@@ -382,13 +405,11 @@ expr:
         $$ = _p->makeBinaryOp(BinaryOp::Div, $1, $3);
     }
     | T_IDENTIFIER T_PLUS_EQUAL expr {
-        Node *var = _p->makeIdentifier(*$1);
-        delete $1;
+        Node *var = _p->makeIdentifier($1.str());
         $$ = _p->makeBinaryOp(BinaryOp::AddAssign, var, $3);
     }
     | T_IDENTIFIER T_MINUS_EQUAL expr {
-        Node *var = _p->makeIdentifier(*$1);
-        delete $1;
+        Node *var = _p->makeIdentifier($1.str());
         $$ = _p->makeBinaryOp(BinaryOp::SubAssign, var, $3);
     }
     | expr '<' expr {
@@ -428,9 +449,11 @@ expr:
 
 %%
 
-static int yylex(YYSTYPE *token, pie::compiler::Parser *_p)
+static int yylex(YYSTYPE *token, YYLTYPE *location, pie::compiler::Parser *_p)
 {
     int tok = _p->scan(token);
+    location->first_line = location->last_line = _p->scanner.line();
+    location->first_column = location->last_column = 0;
     return tok;
 }
 
@@ -0,0 +1,815 @@
+#include "compiler/pass/inline.h"
+
+namespace pie { namespace compiler {
+
+static void replaceChild(Node *parent, Node *old_child, Node *new_child)
+{
+    for (Node *&child : parent->children) {
+        if (child == old_child) {
+            child = new_child;
+            return;
+        }
+    }
+}
+
+static int countNodes(Node *node)
+{
+    if (!node) return 0;
+
+    int count = 1;
+    for (Node *child : node->children) {
+        count += countNodes(child);
+    }
+    return count;
+}
+
+// Only statements and expressions can be copied into another function,
+// loops stay in their own
+static bool cloneable(Node *node)
+{
+    if (!node) return true;
+
+    if (!dyn_cast<IntNode>(node) && !dyn_cast<DoubleNode>(node) &&
+        !dyn_cast<StringNode>(node) && !dyn_cast<BoolNode>(node) &&
+        !dyn_cast<IdentifierNode>(node) && !dyn_cast<BinaryOpNode>(node) &&
+        !dyn_cast<UnaryOpNode>(node) && !dyn_cast<FunctionCallNode>(node) &&
+        !dyn_cast<AssignNode>(node) && !dyn_cast<LetNode>(node) &&
+        !dyn_cast<ReturnNode>(node) && !dyn_cast<IfNode>(node) &&
+        !dyn_cast<BlockNode>(node)) {
+        return false;
+    }
+
+    for (Node *child : node->children) {
+        if (!cloneable(child)) return false;
+    }
+    return true;
+}
+
+static bool containsReturn(Node *node)
+{
+    if (!node) return false;
+    if (dyn_cast<ReturnNode>(node)) return true;
+
+    for (Node *child : node->children) {
+        if (containsReturn(child)) return true;
+    }
+    return false;
+}
+
+// Name written by an assignment or a compound assignment, nullptr otherwise
+static const std::string *assignedName(Node *node)
+{
+    IdentifierNode *id = nullptr;
+    if (AssignNode *assign = dyn_cast<AssignNode>(node)) {
+        id = dyn_cast<IdentifierNode>(assign->var);
+    } else if (BinaryOpNode *op = dyn_cast<BinaryOpNode>(node)) {
+        if (op->op == BinaryOp::AddAssign || op->op == BinaryOp::SubAssign) {
+            id = dyn_cast<IdentifierNode>(op->lhs);
+        }
+    }
+    return id ? &id->name : nullptr;
+}
+
+static bool containsAssign(Node *node)
+{
+    if (!node) return false;
+    if (assignedName(node)) return true;
+
+    for (Node *child : node->children) {
+        if (containsAssign(child)) return true;
+    }
+    return false;
+}
+
+static void collectAssigned(Node *node, std::set<std::string> &names)
+{
+    if (!node) return;
+
+    if (const std::string *name = assignedName(node)) {
+        names.insert(*name);
+    }
+    for (Node *child : node->children) {
+        collectAssigned(child, names);
+    }
+}
+
+// Names the body uses without declaring them, in the scoping rules of
+// ResolveVisitor
+static void collectFree(Node *node, std::vector<std::set<std::string>> &scopes,
+                        std::set<std::string> &names)
+{
+    if (!node) return;
+
+    auto bound = [&scopes](const std::string &name) {
+        for (const auto &scope : scopes) {
+            if (scope.count(name)) return true;
+        }
+        return false;
+    };
+
+    if (LetNode *let = dyn_cast<LetNode>(node)) {
+        collectFree(let->value, scopes, names);
+        scopes.back().insert(let->name);
+        return;
+    }
+
+    if (BlockNode *block = dyn_cast<BlockNode>(node)) {
+        scopes.push_back(std::set<std::string>());
+        for (Node *child : block->children) {
+            collectFree(child, scopes, names);
+        }
+        scopes.pop_back();
+        return;
+    }
+
+    if (IdentifierNode *id = dyn_cast<IdentifierNode>(node)) {
+        if (!bound(id->name)) names.insert(id->name);
+    } else if (FunctionCallNode *call = dyn_cast<FunctionCallNode>(node)) {
+        if (call->scope.empty() && !bound(call->name)) names.insert(call->name);
+    }
+
+    for (Node *child : node->children) {
+        collectFree(child, scopes, names);
+    }
+}
+
+// Evaluation order of an inlined expression: which parameter each read
+// refers to, -1 for anything that may have a visible effect or fail
+struct Event {
+    int param;
+    bool conditional;
+};
+
+static bool collectEvents(Node *node, const std::map<std::string, int> &params,
+                          bool conditional, std::vector<Event> &events)
+{
+    if (!node) return true;
+
+    if (dyn_cast<IntNode>(node) || dyn_cast<DoubleNode>(node) ||
+        dyn_cast<StringNode>(node) || dyn_cast<BoolNode>(node)) {
+        return true;
+    }
+
+    if (IdentifierNode *id = dyn_cast<IdentifierNode>(node)) {
+        auto it = params.find(id->name);
+        // A global read fails when the name is undefined
+        events.push_back({ it != params.end() ? it->second : -1, conditional });
+        return true;
+    }
+
+    if (FunctionCallNode *call = dyn_cast<FunctionCallNode>(node)) {
+        if (call->scope.empty() && params.count(call->name)) return false;
+        for (Node *arg : call->children) {
+            if (!collectEvents(arg, params, conditional, events)) return false;
+        }
+        events.push_back({ -1, conditional });
+        return true;
+    }
+
+    if (AssignNode *assign = dyn_cast<AssignNode>(node)) {
+        const std::string *name = assignedName(assign);
+        if (!name || params.count(*name)) return false;
+        if (!collectEvents(assign->value, params, conditional, events)) return false;
+        events.push_back({ -1, conditional });
+        return true;
+    }
+
+    if (UnaryOpNode *op = dyn_cast<UnaryOpNode>(node)) {
+        if (!collectEvents(op->expr, params, conditional, events)) return false;
+        // A cast fails on a value of the wrong type
+        if (op->op == UnaryOp::CastInt || op->op == UnaryOp::CastDouble) {
+            events.push_back({ -1, conditional });
+        }
+        return true;
+    }
+
+    BinaryOpNode *op = dyn_cast<BinaryOpNode>(node);
+    if (!op) return false;
+
+    switch (op->op) {
+        case BinaryOp::AddAssign:
+        case BinaryOp::SubAssign:
+        {
+            const std::string *name = assignedName(op);
+            if (!name || params.count(*name)) return false;
+            events.push_back({ -1, conditional });
+            if (!collectEvents(op->rhs, params, conditional, events)) return false;
+            events.push_back({ -1, conditional });
+            return true;
+        }
+
+        case BinaryOp::And:
+        case BinaryOp::Or:
+            return collectEvents(op->lhs, params, conditional, events) &&
+                   collectEvents(op->rhs, params, true, events);
+
+        case BinaryOp::Div:
+        case BinaryOp::Mod:
+            if (!collectEvents(op->lhs, params, conditional, events)) return false;
+            if (!collectEvents(op->rhs, params, conditional, events)) return false;
+            events.push_back({ -1, conditional });
+            return true;
+
+        default:
+            return collectEvents(op->lhs, params, conditional, events) &&
+                   collectEvents(op->rhs, params, conditional, events);
+    }
+}
+
+static Node *copyLeaf(Arena *arena, Node *node)
+{
+    if (IntNode *lit = dyn_cast<IntNode>(node)) return arena->make<IntNode>(lit->value);
+    if (DoubleNode *lit = dyn_cast<DoubleNode>(node)) return arena->make<DoubleNode>(lit->value);
+    if (StringNode *lit = dyn_cast<StringNode>(node)) return arena->make<StringNode>(lit->str);
+    if (BoolNode *lit = dyn_cast<BoolNode>(node)) return arena->make<BoolNode>(lit->value);
+    if (IdentifierNode *id = dyn_cast<IdentifierNode>(node)) return arena->make<IdentifierNode>(id->name);
+    return nullptr;
+}
+
+InlineVisitor::InlineVisitor(int budget)
+    : module(nullptr), arena(nullptr), budget(budget), report(nullptr), sites(0),
+      caller(nullptr), result(nullptr)
+{
+}
+
+void InlineVisitor::inlineCalls(ModuleNode *module)
+{
+    this->module = module;
+    arena = &module->arena;
+
+    // A function rebound at runtime may not be what the call site sees
+    for (FunctionNode *fn : module->functions) {
+        collectAssigned(fn, assigned);
+    }
+
+    for (FunctionNode *fn : module->functions) {
+        if (states[fn] == State::Pending) {
+            process(fn);
+        }
+    }
+
+    if (report) {
+        *report << "inline: " << sites << " call site" << (sites == 1 ? "" : "s")
+                << " inlined" << std::endl;
+    }
+
+    this->module = nullptr;
+    arena = nullptr;
+}
+
+void InlineVisitor::process(FunctionNode *fn)
+{
+    // Runs in the middle of rewriting a call of the current function
+    Node *saved_result = result;
+    FunctionNode *saved_caller = caller;
+    std::vector<std::set<std::string>> saved_scopes;
+    saved_scopes.swap(scopes);
+
+    states[fn] = State::Active;
+    active.push_back(fn);
+
+    caller = fn;
+    scopes.push_back(std::set<std::string>());
+    for (const auto &param : fn->params) {
+        scopes.back().insert(param.first);
+    }
+
+    rewriteStatements(fn);
+
+    active.pop_back();
+    states[fn] = State::Done;
+    analyze(fn);
+
+    caller = saved_caller;
+    scopes.swap(saved_scopes);
+    result = saved_result;
+}
+
+void InlineVisitor::analyze(FunctionNode *fn)
+{
+    Candidate &cand = candidates[fn];
+    cand.inlinable = false;
+    cand.size = countNodes(fn) - 1;
+    cand.expr = nullptr;
+
+    if (recursive.count(fn) || assigned.count(fn->name) || cand.size > budget) return;
+
+    auto it = module->symtab.find(fn->name);
+    if (it == module->symtab.end() || it->second != fn) return;
+
+    std::set<std::string> params;
+    for (const auto &param : fn->params) {
+        if (!params.insert(param.first).second) return;
+    }
+
+    // Only a trailing return can be dropped when splicing the body
+    for (size_t i = 0; i < fn->children.size(); i++) {
+        Node *stmt = fn->children[i];
+        if (!cloneable(stmt)) return;
+        bool last = i + 1 == fn->children.size();
+        if (containsReturn(stmt) && !(last && dyn_cast<ReturnNode>(stmt))) return;
+    }
+
+    if (fn->children.size() == 1) {
+        ReturnNode *ret = dyn_cast<ReturnNode>(fn->children[0]);
+        if (ret && ret->expr) cand.expr = ret->expr;
+    }
+
+    std::vector<std::set<std::string>> callee_scopes(1, params);
+    for (Node *stmt : fn->children) {
+        collectFree(stmt, callee_scopes, cand.free_names);
+    }
+
+    cand.inlinable = true;
+}
+
+// The module function a call reaches at runtime, if it can be known now
+FunctionNode *InlineVisitor::calleeOf(FunctionCallNode *call)
+{
+    if (!call->scope.empty() || isLocal(call->name)) return nullptr;
+
+    auto it = module->symtab.find(call->name);
+    if (it == module->symtab.end()) return nullptr;
+    return dyn_cast<FunctionNode>(it->second);
+}
+
+// Processes fn first if needed, nullptr when it must not be inlined
+const InlineVisitor::Candidate *InlineVisitor::candidateFor(FunctionNode *fn)
+{
+    State state = states[fn];
+    if (state == State::Pending) {
+        process(fn);
+    } else if (state == State::Active) {
+        // Every function from fn to the current one is on a cycle
+        for (size_t i = active.size(); i > 0; i--) {
+            recursive.insert(active[i - 1]);
+            if (active[i - 1] == fn) break;
+        }
+        return nullptr;
+    }
+
+    const Candidate &cand = candidates[fn];
+    return cand.inlinable ? &cand : nullptr;
+}
+
+bool InlineVisitor::isLocal(const std::string &name) const
+{
+    for (const auto &scope : scopes) {
+        if (scope.count(name)) return true;
+    }
+    return false;
+}
+
+// Whether a caller local would capture a global the callee refers to
+bool InlineVisitor::shadowed(const Candidate &cand) const
+{
+    for (const std::string &name : cand.free_names) {
+        if (isLocal(name)) return true;
+    }
+    return false;
+}
+
+void InlineVisitor::logInline(FunctionNode *callee, const char *how, int size)
+{
+    sites++;
+    if (report) {
+        *report << "inline: " << callee->name << " into " << caller->name
+                << " (" << how << ", size " << size << ")" << std::endl;
+    }
+}
+
+Node *InlineVisitor::rewrite(Node *node)
+{
+    if (!node) return nullptr;
+
+    result = node;
+    node->visit(this);
+    return result;
+}
+
+void InlineVisitor::rewriteStatements(Node *node)
+{
+    for (Node *&stmt : node->children) {
+        FunctionCallNode *call = dyn_cast<FunctionCallNode>(stmt);
+        if (!call) {
+            stmt = rewrite(stmt);
+            continue;
+        }
+
+        for (Node *&arg : call->children) {
+            arg = rewrite(arg);
+        }
+
+        FunctionNode *callee = calleeOf(call);
+        const Candidate *cand = callee ? candidateFor(callee) : nullptr;
+        if (cand && !shadowed(*cand)) {
+            stmt = inlineStatement(call, callee, *cand);
+        }
+    }
+}
+
+BlockNode *InlineVisitor::inlineStatement(FunctionCallNode *call, FunctionNode *callee, const Candidate &cand)
+{
+    int site = sites + 1;
+    BlockNode *block = arena->make<BlockNode>();
+
+    // Arguments are evaluated in order before the body, missing ones are nil
+    renames.assign(1, std::map<std::string, std::string>());
+    size_t nargs = call->children.size();
+    for (size_t i = 0; i < callee->params.size(); i++) {
+        const std::string &param = callee->params[i].first;
+        std::string name = param + "$" + std::to_string(site);
+        block->addStatement(arena->make<LetNode>(name, nullptr, i < nargs ? call->children[i] : nullptr));
+        renames.back()[param] = name;
+    }
+    for (size_t i = callee->params.size(); i < nargs; i++) {
+        block->addStatement(call->children[i]);
+    }
+
+    renames.push_back(std::map<std::string, std::string>());
+    for (Node *stmt : callee->children) {
+        ReturnNode *ret = dyn_cast<ReturnNode>(stmt);
+        if (ret) {
+            // Trailing return: its value is unused, only its effects remain
+            if (ret->expr) block->addStatement(clone(ret->expr));
+            break;
+        }
+        block->addStatement(clone(stmt));
+    }
+    renames.clear();
+
+    logInline(callee, "statement", cand.size);
+    return block;
+}
+
+Node *InlineVisitor::inlineExpression(FunctionCallNode *call, FunctionNode *callee, const Candidate &cand)
+{
+    if (!cand.expr || !substitutable(callee, cand.expr, call->children)) return call;
+
+    substitutes.clear();
+    substituted.clear();
+    for (size_t i = 0; i < callee->params.size(); i++) {
+        substitutes[callee->params[i].first] = call->children[i];
+    }
+    Node *expr = clone(cand.expr);
+    substitutes.clear();
+
+    logInline(callee, "expression", cand.size);
+    return expr;
+}
+
+// Arguments that are literals or caller locals can be read any number of
+// times. Any other argument must be read exactly once, unconditionally, in
+// argument order and before anything observable happens in the callee.
+bool InlineVisitor::substitutable(FunctionNode *callee, Node *expr, const std::vector<Node *> &args) const
+{
+    if (args.size() != callee->params.size()) return false;
+
+    std::map<std::string, int> params;
+    for (size_t i = 0; i < callee->params.size(); i++) {
+        params[callee->params[i].first] = (int)i;
+    }
+
+    std::vector<Event> events;
+    if (!collectEvents(expr, params, false, events)) return false;
+
+    size_t first_effect = events.size();
+    for (size_t i = 0; i < events.size(); i++) {
+        if (events[i].param < 0) {
+            first_effect = i;
+            break;
+        }
+    }
+
+    size_t next = 0;
+    for (size_t i = 0; i < args.size(); i++) {
+        Node *arg = args[i];
+        IdentifierNode *id = dyn_cast<IdentifierNode>(arg);
+        if ((id && isLocal(id->name)) || dyn_cast<IntNode>(arg) || dyn_cast<DoubleNode>(arg) ||
+            dyn_cast<StringNode>(arg) || dyn_cast<BoolNode>(arg)) {
+            continue;
+        }
+
+        // It could change a local another argument reads
+        if (containsAssign(arg)) return false;
+
+        int uses = 0;
+        size_t at = 0;
+        for (size_t j = 0; j < events.size(); j++) {
+            if (events[j].param == (int)i) {
+                uses++;
+                at = j;
+                if (events[j].conditional) return false;
+            }
+        }
+        if (uses != 1 || at >= first_effect || at < next) return false;
+        next = at + 1;
+    }
+
+    return true;
+}
+
+std::string InlineVisitor::rename(const std::string &name) const
+{
+    for (size_t i = renames.size(); i > 0; i--) {
+        auto it = renames[i - 1].find(name);
+        if (it != renames[i - 1].end()) return it->second;
+    }
+    return name;
+}
+
+// Deep copy of a callee statement or expression into the module arena,
+// statements keep their line
+Node *InlineVisitor::clone(Node *node)
+{
+    Node *copy = cloneNode(node);
+    if (copy && !copy->line) copy->line = node->line;
+    return copy;
+}
+
+Node *InlineVisitor::cloneNode(Node *node)
+{
+    if (!node) return nullptr;
+
+    if (IdentifierNode *id = dyn_cast<IdentifierNode>(node)) {
+        auto it = substitutes.find(id->name);
+        if (it != substitutes.end()) {
+            // The first read takes the argument itself, further reads
+            // only happen for literals and caller locals
+            if (substituted.insert(id->name).second) return it->second;
+            return copyLeaf(arena, it->second);
+        }
+        return arena->make<IdentifierNode>(rename(id->name));
+    }
+
+    if (Node *leaf = copyLeaf(arena, node)) {
+        return leaf;
+    }
+
+    if (BinaryOpNode *op = dyn_cast<BinaryOpNode>(node)) {
+        Node *lhs = clone(op->lhs);
+        Node *rhs = clone(op->rhs);
+        BinaryOpNode *copy = arena->make<BinaryOpNode>(op->op, lhs, rhs);
+        copy->operand_type = op->operand_type;
+        return copy;
+    }
+
+    if (UnaryOpNode *op = dyn_cast<UnaryOpNode>(node)) {
+        return arena->make<UnaryOpNode>(op->op, clone(op->expr));
+    }
+
+    if (FunctionCallNode *call = dyn_cast<FunctionCallNode>(node)) {
+        FunctionCallNode *copy = call->scope.empty()
+            ? arena->make<FunctionCallNode>(rename(call->name))
+            : arena->make<FunctionCallNode>(call->scope, call->name);
+        for (Node *arg : call->children) {
+            copy->push(clone(arg));
+        }
+        return copy;
+    }
+
+    if (AssignNode *assign = dyn_cast<AssignNode>(node)) {
+        Node *var = clone(assign->var);
+        Node *value = clone(assign->value);
+        return arena->make<AssignNode>(var, value);
+    }
+
+    if (LetNode *let = dyn_cast<LetNode>(node)) {
+        // The initializer still sees an outer variable of the same name
+        Node *value = clone(let->value);
+        std::string name = let->name + "$" + std::to_string(sites + 1);
+        renames.back()[let->name] = name;
+        return arena->make<LetNode>(name, let->type, value);
+    }
+
+    if (ReturnNode *ret = dyn_cast<ReturnNode>(node)) {
+        return arena->make<ReturnNode>(clone(ret->expr));
+    }
+
+    if (IfNode *stmt = dyn_cast<IfNode>(node)) {
+        Node *cond = clone(stmt->condition);
+        BlockNode *then_block = static_cast<BlockNode*>(clone(stmt->then_block));
+        Node *else_block = clone(stmt->else_block);
+        return arena->make<IfNode>(cond, then_block, else_block);
+    }
+
+    if (BlockNode *block = dyn_cast<BlockNode>(node)) {
+        BlockNode *copy = arena->make<BlockNode>();
+        renames.push_back(std::map<std::string, std::string>());
+        for (Node *stmt : block->children) {
+            copy->addStatement(clone(stmt));
+        }
+        renames.pop_back();
+        return copy;
+    }
+
+    return nullptr;
+}
+
+void InlineVisitor::visit(Node *node)
+{
+    if (node) {
+        node->visit(this);
+    }
+}
+
+void InlineVisitor::visit(ModuleNode *node)
+{
+    inlineCalls(node);
+    result = node;
+}
+
+void InlineVisitor::visit(ImportNode *node)
+{
+}
+
+void InlineVisitor::visit(FunctionNode *node)
+{
+    // Nested declarations are processed from the module's function list
+}
+
+void InlineVisitor::visit(ClosureNode *node)
+{
+}
+
+void InlineVisitor::visit(FunctionCallNode *node)
+{
+    for (Node *&arg : node->children) {
+        arg = rewrite(arg);
+    }
+
+    result = node;
+    FunctionNode *callee = calleeOf(node);
+    const Candidate *cand = callee ? candidateFor(callee) : nullptr;
+    if (cand && !shadowed(*cand)) {
+        result = inlineExpression(node, callee, *cand);
+    }
+}
+
+void InlineVisitor::visit(AssignNode *node)
+{
+    Node *value = rewrite(node->value);
+    for (Node *&child : node->children) {
+        if (child == node->value) child = value;
+    }
+    node->value = value;
+    result = node;
+}
+
+void InlineVisitor::visit(LetNode *node)
+{
+    if (node->value) {
+        Node *value = rewrite(node->value);
+        for (Node *&child : node->children) {
+            if (child == node->value) child = value;
+        }
+        node->value = value;
+    }
+    scopes.back().insert(node->name);
+    result = node;
+}
+
+void InlineVisitor::visit(TypeNode *node)
+{
+}
+
+void InlineVisitor::visit(IntNode *node)
+{
+}
+
+void InlineVisitor::visit(DoubleNode *node)
+{
+}
+
+void InlineVisitor::visit(StringNode *node)
+{
+}
+
+void InlineVisitor::visit(BoolNode *node)
+{
+}
+
+void InlineVisitor::visit(IdentifierNode *node)
+{
+    // A function used as a value may be called through it, which counts
+    // for recursion
+    if (isLocal(node->name)) return;
+
+    auto it = module->symtab.find(node->name);
+    if (it != module->symtab.end()) {
+        if (FunctionNode *fn = dyn_cast<FunctionNode>(it->second)) {
+            candidateFor(fn);
+        }
+    }
+    result = node;
+}
+
+void InlineVisitor::visit(BinaryOpNode *node)
+{
+    // The target of a compound assignment is not an expression
+    if (node->op != BinaryOp::AddAssign && node->op != BinaryOp::SubAssign) {
+        Node *lhs = rewrite(node->lhs);
+        for (Node *&child : node->children) {
+            if (child == node->lhs) child = lhs;
+        }
+        node->lhs = lhs;
+    }
+
+    Node *rhs = rewrite(node->rhs);
+    for (Node *&child : node->children) {
+        if (child == node->rhs) child = rhs;
+    }
+    node->rhs = rhs;
+    result = node;
+}
+
+void InlineVisitor::visit(UnaryOpNode *node)
+{
+    Node *expr = rewrite(node->expr);
+    node->children[0] = expr;
+    node->expr = expr;
+    result = node;
+}
+
+void InlineVisitor::visit(ReturnNode *node)
+{
+    if (node->expr) {
+        Node *expr = rewrite(node->expr);
+        node->children[0] = expr;
+        node->expr = expr;
+    }
+    result = node;
+}
+
+void InlineVisitor::visit(IfNode *node)
+{
+    Node *cond = rewrite(node->condition);
+    node->children[0] = cond;
+    node->condition = cond;
+
+    if (node->then_block) {
+        node->then_block->visit(this);
+    }
+
+    if (node->else_block) {
+        Node *else_block = rewrite(node->else_block);
+        node->children.back() = else_block;
+        node->else_block = else_block;
+    }
+    result = node;
+}
+
+void InlineVisitor::visit(WhileNode *node)
+{
+    Node *cond = rewrite(node->condition);
+    replaceChild(node, node->condition, cond);
+    node->condition = cond;
+
+    if (node->body) {
+        node->body->visit(this);
+    }
+    result = node;
+}
+
+void InlineVisitor::visit(ForNode *node)
+{
+    // The init let is only visible inside the loop
+    scopes.push_back(std::set<std::string>());
+
+    Node *init = rewrite(node->init);
+    replaceChild(node, node->init, init);
+    node->init = init;
+
+    Node *cond = rewrite(node->condition);
+    replaceChild(node, node->condition, cond);
+    node->condition = cond;
+
+    Node *step = rewrite(node->step);
+    replaceChild(node, node->step, step);
+    node->step = step;
+
+    if (node->body) {
+        node->body->visit(this);
+    }
+
+    scopes.pop_back();
+    result = node;
+}
+
+void InlineVisitor::visit(BreakNode *node)
+{
+}
+
+void InlineVisitor::visit(ContinueNode *node)
+{
+}
+
+void InlineVisitor::visit(BlockNode *node)
+{
+    scopes.push_back(std::set<std::string>());
+    rewriteStatements(node);
+    scopes.pop_back();
+    result = node;
+}
+
+}}
@@ -0,0 +1,94 @@
+#ifndef __PIE_PASS_INLINE__
+#define __PIE_PASS_INLINE__
+
+#include <map>
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "compiler/ast.h"
+
+namespace pie { namespace compiler {
+
+// Splices the bodies of small non-recursive module functions into their
+// call sites, callees first so inlined bodies are already flattened.
+//
+// A call used as a statement becomes a block binding every argument to a
+// renamed let, followed by the renamed body with its trailing return
+// dropped. A call used as a value is replaced by the expression of a body
+// made of a single return, with the arguments substituted for the
+// parameters; that is only done when every argument is still evaluated
+// exactly once and in the same order relative to anything observable.
+class InlineVisitor : public Visitor
+{
+public:
+    static const int kDefaultBudget = 24;
+
+    explicit InlineVisitor(int budget = kDefaultBudget);
+
+    void inlineCalls(ModuleNode *module);
+
+    // Prints one line per inlined call site
+    void setReport(std::ostream *out) { report = out; }
+
+    void visit(Node *node) override;
+
+    #define AST_NODE DECLARE_VISIT
+    AST_NODES
+    #undef AST_NODE
+
+private:
+    enum class State { Pending, Active, Done };
+
+    struct Candidate {
+        bool inlinable;
+        int size;
+        Node *expr;  // operand of a body made of a single return
+        std::set<std::string> free_names;
+    };
+
+    ModuleNode *module;
+    Arena *arena;
+    int budget;
+    std::ostream *report;
+    int sites;
+
+    std::map<FunctionNode *, State> states;
+    std::map<FunctionNode *, Candidate> candidates;
+    std::vector<FunctionNode *> active;  // functions being processed
+    std::set<FunctionNode *> recursive;
+    std::set<std::string> assigned;      // names written by some assignment
+
+    FunctionNode *caller;
+    std::vector<std::set<std::string>> scopes;  // locals visible in caller
+    Node *result;
+
+    // Clone state: renamed locals of the callee or arguments substituted
+    // for its parameters
+    std::vector<std::map<std::string, std::string>> renames;
+    std::map<std::string, Node *> substitutes;
+    std::set<std::string> substituted;
+
+    void process(FunctionNode *fn);
+    FunctionNode *calleeOf(FunctionCallNode *call);
+    const Candidate *candidateFor(FunctionNode *fn);
+    void analyze(FunctionNode *fn);
+
+    Node *rewrite(Node *node);
+    void rewriteStatements(Node *node);
+    BlockNode *inlineStatement(FunctionCallNode *call, FunctionNode *callee, const Candidate &cand);
+    Node *inlineExpression(FunctionCallNode *call, FunctionNode *callee, const Candidate &cand);
+    bool substitutable(FunctionNode *callee, Node *expr, const std::vector<Node *> &args) const;
+    bool shadowed(const Candidate &cand) const;
+    bool isLocal(const std::string &name) const;
+    void logInline(FunctionNode *callee, const char *how, int size);
+
+    Node *clone(Node *node);
+    Node *cloneNode(Node *node);
+    std::string rename(const std::string &name) const;
+};
+
+}}
+
+#endif
@@ -0,0 +1,614 @@
+#include <cstdint>
+#include <limits>
+
+#include "compiler/pass/optimize.h"
+
+namespace pie { namespace compiler {
+
+// Two's complement wrap around, as the evaluator's int64_t arithmetic does
+static inline int64_t wrapAdd(int64_t a, int64_t b) { return (int64_t)((uint64_t)a + (uint64_t)b); }
+static inline int64_t wrapSub(int64_t a, int64_t b) { return (int64_t)((uint64_t)a - (uint64_t)b); }
+static inline int64_t wrapMul(int64_t a, int64_t b) { return (int64_t)((uint64_t)a * (uint64_t)b); }
+
+static void replaceChild(Node *parent, Node *old_child, Node *new_child)
+{
+    for (size_t i = 0; i < parent->children.size(); i++) {
+        if (parent->children[i] == old_child) {
+            if (new_child) {
+                if (!new_child->line) new_child->line = old_child->line;
+                parent->children[i] = new_child;
+            } else {
+                parent->children.erase(parent->children.begin() + i);
+            }
+            return;
+        }
+    }
+}
+
+static bool isInt(Node *node, int64_t value)
+{
+    IntNode *lit = dyn_cast<IntNode>(node);
+    return lit && lit->value == value;
+}
+
+static bool isDouble(Node *node, double value)
+{
+    DoubleNode *lit = dyn_cast<DoubleNode>(node);
+    return lit && lit->value == value;
+}
+
+static bool isEmptyString(Node *node)
+{
+    StringNode *lit = dyn_cast<StringNode>(node);
+    return lit && lit->str.empty();
+}
+
+OptimizeVisitor::OptimizeVisitor() : arena(nullptr), result(nullptr), open_imports(false)
+{
+}
+
+// Names the program may bind to something else than a builtin
+static void collectBound(Node *node, std::set<std::string> &bound)
+{
+    if (!node) return;
+
+    if (LetNode *let = dyn_cast<LetNode>(node)) {
+        bound.insert(let->name);
+    } else if (AssignNode *assign = dyn_cast<AssignNode>(node)) {
+        if (IdentifierNode *id = dyn_cast<IdentifierNode>(assign->var)) bound.insert(id->name);
+    } else if (BinaryOpNode *op = dyn_cast<BinaryOpNode>(node)) {
+        IdentifierNode *id = dyn_cast<IdentifierNode>(op->lhs);
+        if (id && (op->op == BinaryOp::AddAssign || op->op == BinaryOp::SubAssign)) bound.insert(id->name);
+    }
+
+    for (Node *child : node->children) {
+        collectBound(child, bound);
+    }
+}
+
+void OptimizeVisitor::optimize(ModuleNode *module)
+{
+    bound.clear();
+    open_imports = false;
+    for (ImportNode *import : module->imports) {
+        open_imports = open_imports || import->import_all;
+    }
+    for (FunctionNode *fn : module->functions) {
+        bound.insert(fn->name);
+        for (auto &param : fn->params) {
+            bound.insert(param.first);
+        }
+        collectBound(fn, bound);
+    }
+
+    arena = &module->arena;
+    for (FunctionNode *fn : module->functions) {
+        optimizeStatements(fn);
+    }
+    arena = nullptr;
+}
+
+Node *OptimizeVisitor::optimize(Node *node)
+{
+    if (!node) return nullptr;
+
+    result = node;
+    node->visit(this);
+    return result;
+}
+
+void OptimizeVisitor::optimizeStatements(Node *node)
+{
+    std::vector<Node *> statements;
+    statements.reserve(node->children.size());
+
+    for (Node *stmt : node->children) {
+        Node *optimized = optimize(stmt);
+
+        // Literals left as statements have no effect
+        Value ignored;
+        if (!optimized || constant(optimized, ignored)) continue;
+
+        statements.push_back(optimized);
+    }
+
+    node->children.swap(statements);
+}
+
+Node *OptimizeVisitor::literal(const Value &value)
+{
+    switch (value.type) {
+        case Value::Type::Int: return arena->make<IntNode>(value.int_val);
+        case Value::Type::Double: return arena->make<DoubleNode>(value.double_val);
+        case Value::Type::Bool: return arena->make<BoolNode>(value.bool_val);
+        case Value::Type::String: return arena->make<StringNode>(value.string_val->str());
+        default: return nullptr;
+    }
+}
+
+bool OptimizeVisitor::constant(Node *node, Value &value)
+{
+    if (IntNode *lit = dyn_cast<IntNode>(node)) {
+        value = Value::makeInt(lit->value);
+    } else if (DoubleNode *lit = dyn_cast<DoubleNode>(node)) {
+        value = Value::makeDouble(lit->value);
+    } else if (StringNode *lit = dyn_cast<StringNode>(node)) {
+        value = Value::makeString(lit->str);
+    } else if (BoolNode *lit = dyn_cast<BoolNode>(node)) {
+        value = Value::makeBool(lit->value);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Mirrors EvalVisitor::visit(BinaryOpNode*), false when the operation has
+// to be left to the runtime
+bool OptimizeVisitor::fold(BinaryOp op, const Value &lhs, const Value &rhs, Value &out)
+{
+    bool ints = lhs.type == Value::Type::Int && rhs.type == Value::Type::Int;
+
+    switch (op) {
+        case BinaryOp::Add:
+            if (lhs.type == Value::Type::String || rhs.type == Value::Type::String) {
+                out = Value::makeString(lhs.toString() + rhs.toString());
+            } else if (ints) {
+                out = Value::makeInt(wrapAdd(lhs.int_val, rhs.int_val));
+            } else {
+                out = Value::makeDouble(lhs.toDouble() + rhs.toDouble());
+            }
+            return true;
+
+        case BinaryOp::Sub:
+            out = ints ? Value::makeInt(wrapSub(lhs.int_val, rhs.int_val))
+                       : Value::makeDouble(lhs.toDouble() - rhs.toDouble());
+            return true;
+
+        case BinaryOp::Mul:
+            out = ints ? Value::makeInt(wrapMul(lhs.int_val, rhs.int_val))
+                       : Value::makeDouble(lhs.toDouble() * rhs.toDouble());
+            return true;
+
+        case BinaryOp::Div:
+            if (rhs.toDouble() == 0.0) return false;
+            if (ints) {
+                if (lhs.int_val == std::numeric_limits<int64_t>::min() && rhs.int_val == -1) return false;
+                out = Value::makeInt(lhs.int_val / rhs.int_val);
+            } else {
+                out = Value::makeDouble(lhs.toDouble() / rhs.toDouble());
+            }
+            return true;
+
+        case BinaryOp::Mod:
+            if (!ints || rhs.int_val == 0) return false;
+            if (lhs.int_val == std::numeric_limits<int64_t>::min() && rhs.int_val == -1) return false;
+            out = Value::makeInt(lhs.int_val % rhs.int_val);
+            return true;
+
+        case BinaryOp::Lt:
+            out = Value::makeBool(lhs.toDouble() < rhs.toDouble());
+            return true;
+
+        case BinaryOp::Gt:
+            out = Value::makeBool(lhs.toDouble() > rhs.toDouble());
+            return true;
+
+        case BinaryOp::Le:
+            out = Value::makeBool(lhs.toDouble() <= rhs.toDouble());
+            return true;
+
+        case BinaryOp::Ge:
+            out = Value::makeBool(lhs.toDouble() >= rhs.toDouble());
+            return true;
+
+        case BinaryOp::Eq:
+        case BinaryOp::Ne:
+        {
+            bool equal;
+            if (lhs.type == Value::Type::String && rhs.type == Value::Type::String) {
+                equal = String::equals(lhs.string_val, rhs.string_val);
+            } else if (lhs.isNumeric() && rhs.isNumeric()) {
+                equal = lhs.toDouble() == rhs.toDouble();
+            } else {
+                equal = lhs.type == rhs.type && lhs.toBool() == rhs.toBool();
+            }
+            out = Value::makeBool(op == BinaryOp::Eq ? equal : !equal);
+            return true;
+        }
+
+        default:
+            return false;
+    }
+}
+
+OptimizeVisitor::Kind OptimizeVisitor::kindOf(Node *node)
+{
+    if (dyn_cast<IntNode>(node)) return Kind::Int;
+    if (dyn_cast<DoubleNode>(node)) return Kind::Double;
+    if (dyn_cast<StringNode>(node)) return Kind::String;
+    if (dyn_cast<BoolNode>(node)) return Kind::Bool;
+
+    // Arithmetic only produces Int when both operands are Int and converts
+    // anything else with toDouble()
+    auto arith = [](Kind lhs, Kind rhs) {
+        if (lhs == Kind::Int && rhs == Kind::Int) return Kind::Int;
+        auto maybeInt = [](Kind kind) {
+            return kind == Kind::Unknown || kind == Kind::Int || kind == Kind::Number;
+        };
+        return maybeInt(lhs) && maybeInt(rhs) ? Kind::Number : Kind::Double;
+    };
+
+    if (BinaryOpNode *op = dyn_cast<BinaryOpNode>(node)) {
+        switch (op->op) {
+            case BinaryOp::Lt:
+            case BinaryOp::Gt:
+            case BinaryOp::Le:
+            case BinaryOp::Ge:
+            case BinaryOp::Eq:
+            case BinaryOp::Ne:
+            case BinaryOp::And:
+            case BinaryOp::Or:
+                return Kind::Bool;
+            case BinaryOp::Mod:
+                return Kind::Int;
+            case BinaryOp::Add:
+            {
+                Kind lhs = kindOf(op->lhs);
+                Kind rhs = kindOf(op->rhs);
+                if (lhs == Kind::String || rhs == Kind::String) return Kind::String;
+                if (lhs == Kind::Unknown || rhs == Kind::Unknown) return Kind::Unknown;
+                return arith(lhs, rhs);
+            }
+            case BinaryOp::Sub:
+            case BinaryOp::Mul:
+            case BinaryOp::Div:
+            case BinaryOp::AddAssign:
+            case BinaryOp::SubAssign:
+                return arith(kindOf(op->lhs), kindOf(op->rhs));
+            default:
+                return Kind::Unknown;
+        }
+    }
+
+    if (UnaryOpNode *op = dyn_cast<UnaryOpNode>(node)) {
+        if (op->op == UnaryOp::Not) return Kind::Bool;
+        if (op->op == UnaryOp::CastInt) return Kind::Int;
+        if (op->op == UnaryOp::CastDouble) return Kind::Double;
+        if (op->op == UnaryOp::Neg) {
+            Kind kind = kindOf(op->expr);
+            if (kind == Kind::Int) return Kind::Int;
+            if (kind == Kind::Unknown || kind == Kind::Number) return Kind::Number;
+            return Kind::Double;
+        }
+    }
+
+    return Kind::Unknown;
+}
+
+// Identities that hold for every value of the known kind, the remaining
+// operand is still evaluated exactly once
+Node *OptimizeVisitor::simplify(BinaryOpNode *node)
+{
+    auto numeric = [](Kind kind) {
+        return kind == Kind::Int || kind == Kind::Double || kind == Kind::Number;
+    };
+
+    Kind lhs = kindOf(node->lhs);
+    Kind rhs = kindOf(node->rhs);
+    bool lhs_num = numeric(lhs);
+    bool rhs_num = numeric(rhs);
+
+    switch (node->op) {
+        case BinaryOp::Add:
+            // Not for doubles: -0.0 + 0 is 0.0
+            if (isInt(node->rhs, 0) && lhs == Kind::Int) return node->lhs;
+            if (isInt(node->lhs, 0) && rhs == Kind::Int) return node->rhs;
+            if (isEmptyString(node->rhs) && lhs == Kind::String) return node->lhs;
+            if (isEmptyString(node->lhs) && rhs == Kind::String) return node->rhs;
+            break;
+
+        case BinaryOp::Sub:
+            if (isInt(node->rhs, 0) && lhs_num) return node->lhs;
+            if (isDouble(node->rhs, 0.0) && lhs == Kind::Double) return node->lhs;
+            break;
+
+        case BinaryOp::Mul:
+            if (isInt(node->rhs, 1) && lhs_num) return node->lhs;
+            if (isInt(node->lhs, 1) && rhs_num) return node->rhs;
+            if (isDouble(node->rhs, 1.0) && lhs == Kind::Double) return node->lhs;
+            if (isDouble(node->lhs, 1.0) && rhs == Kind::Double) return node->rhs;
+            break;
+
+        case BinaryOp::Div:
+            if (isInt(node->rhs, 1) && lhs_num) return node->lhs;
+            if (isDouble(node->rhs, 1.0) && lhs == Kind::Double) return node->lhs;
+            break;
+
+        default:
+            break;
+    }
+
+    return node;
+}
+
+void OptimizeVisitor::visit(Node *node)
+{
+    if (node) {
+        node->visit(this);
+    }
+}
+
+void OptimizeVisitor::visit(ModuleNode *node)
+{
+    optimize(node);
+    result = node;
+}
+
+void OptimizeVisitor::visit(ImportNode *node)
+{
+}
+
+void OptimizeVisitor::visit(FunctionNode *node)
+{
+    // Nested declarations are optimized from the module's function list
+}
+
+void OptimizeVisitor::visit(ClosureNode *node)
+{
+}
+
+void OptimizeVisitor::visit(FunctionCallNode *node)
+{
+    for (Node *&arg : node->children) {
+        arg = optimize(arg);
+    }
+    result = node;
+
+    // A pure builtin on constants: len("abc") is 3. Modules are optimized
+    // before they are linked, a name an import a.* brings in is not known.
+    std::string name = node->qualifiedName();
+    const Builtin *builtin = findBuiltin(name);
+    size_t nargs = node->children.size();
+    if (!builtin || !builtin->pure || bound.count(name) || (open_imports && node->scope.empty()) ||
+        nargs < builtin->min_args || nargs > builtin->max_args) {
+        return;
+    }
+
+    std::vector<Value> args(nargs);
+    for (size_t i = 0; i < nargs; i++) {
+        if (!constant(node->children[i], args[i])) return;
+    }
+    try {
+        if (Node *folded = literal(builtin->fn(Args{ args.data(), nargs }))) {
+            result = folded;
+        }
+    } catch (const std::exception &) {
+        // Left for the runtime to report
+    }
+}
+
+void OptimizeVisitor::visit(AssignNode *node)
+{
+    Node *value = optimize(node->value);
+    replaceChild(node, node->value, value);
+    node->value = value;
+    result = node;
+}
+
+void OptimizeVisitor::visit(LetNode *node)
+{
+    if (node->value) {
+        Node *value = optimize(node->value);
+        replaceChild(node, node->value, value);
+        node->value = value;
+    }
+    result = node;
+}
+
+void OptimizeVisitor::visit(TypeNode *node)
+{
+}
+
+void OptimizeVisitor::visit(IntNode *node)
+{
+}
+
+void OptimizeVisitor::visit(DoubleNode *node)
+{
+}
+
+void OptimizeVisitor::visit(StringNode *node)
+{
+}
+
+void OptimizeVisitor::visit(BoolNode *node)
+{
+}
+
+void OptimizeVisitor::visit(IdentifierNode *node)
+{
+}
+
+void OptimizeVisitor::visit(BinaryOpNode *node)
+{
+    // The target of a compound assignment is not an expression
+    if (node->op != BinaryOp::AddAssign && node->op != BinaryOp::SubAssign) {
+        Node *lhs = optimize(node->lhs);
+        replaceChild(node, node->lhs, lhs);
+        node->lhs = lhs;
+    }
+    Node *rhs = optimize(node->rhs);
+    replaceChild(node, node->rhs, rhs);
+    node->rhs = rhs;
+    result = node;
+
+    if (node->op == BinaryOp::AddAssign || node->op == BinaryOp::SubAssign) {
+        return;
+    }
+
+    Value lhs, rhs_value;
+    bool lhs_const = constant(node->lhs, lhs);
+    bool rhs_const = constant(node->rhs, rhs_value);
+
+    if (node->op == BinaryOp::And || node->op == BinaryOp::Or) {
+        bool is_and = node->op == BinaryOp::And;
+        if (lhs_const) {
+            // A deciding left operand short-circuits, rhs is never evaluated
+            if (lhs.toBool() != is_and) {
+                result = arena->make<BoolNode>(!is_and);
+            } else if (rhs_const) {
+                result = arena->make<BoolNode>(rhs_value.toBool());
+            } else if (kindOf(node->rhs) == Kind::Bool) {
+                result = node->rhs;
+            }
+        } else if (rhs_const && rhs_value.toBool() == is_and && kindOf(node->lhs) == Kind::Bool) {
+            // x && true, x || false
+            result = node->lhs;
+        }
+        return;
+    }
+
+    Value value;
+    if (lhs_const && rhs_const && fold(node->op, lhs, rhs_value, value)) {
+        result = literal(value);
+        return;
+    }
+
+    result = simplify(node);
+}
+
+void OptimizeVisitor::visit(UnaryOpNode *node)
+{
+    Node *expr = optimize(node->expr);
+    replaceChild(node, node->expr, expr);
+    node->expr = expr;
+    result = node;
+
+    Value value;
+    if (constant(expr, value)) {
+        if (node->op == UnaryOp::Neg) {
+            if (value.type == Value::Type::Int) {
+                result = literal(Value::makeInt(wrapSub(0, value.int_val)));
+            } else {
+                result = literal(Value::makeDouble(-value.toDouble()));
+            }
+        } else if (node->op == UnaryOp::Not) {
+            result = literal(Value::makeBool(!value.toBool()));
+        } else if (node->op == UnaryOp::CastDouble && value.isNumeric()) {
+            result = literal(Value::makeDouble(value.toDouble()));
+        } else if (node->op == UnaryOp::CastInt && value.type == Value::Type::Int) {
+            result = expr;
+        }
+        return;
+    }
+
+    // A cast to the kind the operand already has is a no-op
+    Kind kind = kindOf(expr);
+    if ((node->op == UnaryOp::CastInt && kind == Kind::Int) ||
+        (node->op == UnaryOp::CastDouble && kind == Kind::Double)) {
+        result = expr;
+        return;
+    }
+
+    // --x and !!x cancel out when x already has the right kind
+    UnaryOpNode *inner = dyn_cast<UnaryOpNode>(expr);
+    if (inner && inner->op == node->op) {
+        Kind kind = kindOf(inner->expr);
+        if (node->op == UnaryOp::Neg && (kind == Kind::Int || kind == Kind::Double || kind == Kind::Number)) {
+            result = inner->expr;
+        } else if (node->op == UnaryOp::Not && kind == Kind::Bool) {
+            result = inner->expr;
+        }
+    }
+}
+
+void OptimizeVisitor::visit(ReturnNode *node)
+{
+    if (node->expr) {
+        Node *expr = optimize(node->expr);
+        replaceChild(node, node->expr, expr);
+        node->expr = expr;
+    }
+    result = node;
+}
+
+void OptimizeVisitor::visit(IfNode *node)
+{
+    Node *cond = optimize(node->condition);
+    replaceChild(node, node->condition, cond);
+    node->condition = cond;
+
+    if (node->then_block) {
+        optimizeStatements(node->then_block);
+    }
+
+    if (node->else_block) {
+        Node *else_block = optimize(node->else_block);
+        replaceChild(node, node->else_block, else_block);
+        node->else_block = else_block;
+    }
+
+    result = node;
+
+    // Only the branch taken survives, its block keeps its own scope
+    Value value;
+    if (constant(cond, value)) {
+        result = value.toBool() ? node->then_block : node->else_block;
+    }
+}
+
+void OptimizeVisitor::visit(WhileNode *node)
+{
+    Node *cond = optimize(node->condition);
+    replaceChild(node, node->condition, cond);
+    node->condition = cond;
+
+    if (node->body) {
+        optimizeStatements(node->body);
+    }
+
+    // A loop that never runs is dropped
+    Value value;
+    result = constant(cond, value) && !value.toBool() ? nullptr : node;
+}
+
+void OptimizeVisitor::visit(ForNode *node)
+{
+    Node *init = optimize(node->init);
+    replaceChild(node, node->init, init);
+    node->init = init;
+
+    Node *cond = optimize(node->condition);
+    replaceChild(node, node->condition, cond);
+    node->condition = cond;
+
+    // A constant step has no effect
+    Value value;
+    Node *step = optimize(node->step);
+    if (step && constant(step, value)) step = nullptr;
+    replaceChild(node, node->step, step);
+    node->step = step;
+
+    if (node->body) {
+        optimizeStatements(node->body);
+    }
+    result = node;
+}
+
+void OptimizeVisitor::visit(BreakNode *node)
+{
+    result = node;
+}
+
+void OptimizeVisitor::visit(ContinueNode *node)
+{
+    result = node;
+}
+
+void OptimizeVisitor::visit(BlockNode *node)
+{
+    optimizeStatements(node);
+    result = node;
+}
+
+}}
@@ -0,0 +1,61 @@
+#ifndef __PIE_PASS_OPTIMIZE__
+#define __PIE_PASS_OPTIMIZE__
+
+#include <set>
+#include <string>
+
+#include "compiler/ast.h"
+#include "compiler/backend/eval.h"
+
+namespace pie { namespace compiler {
+
+// Constant folding and algebraic simplification, run before execution.
+// Constant subtrees are computed with the evaluator's rules and replaced by
+// literals allocated in the module arena, identities such as x * 1 are only
+// applied when x is statically known to be numeric, and if statements with a
+// constant condition keep the taken branch only. Calls of pure builtins on
+// constants are computed, unless the program binds the builtin's name.
+// Folds that would fail at runtime, like a division by zero, are left for
+// the runtime to report.
+class OptimizeVisitor : public Visitor
+{
+public:
+    OptimizeVisitor();
+
+    void optimize(ModuleNode *module);
+
+    void visit(Node *node) override;
+
+    #define AST_NODE DECLARE_VISIT
+    AST_NODES
+    #undef AST_NODE
+
+private:
+    // What an expression is known to evaluate to without running it
+    enum class Kind {
+        Unknown,
+        Int,
+        Double,
+        Number,  // Int or Double
+        Bool,
+        String
+    };
+
+    Arena *arena;
+    Node *result;  // replacement for the visited node, nullptr to drop it
+    std::set<std::string> bound;  // names of functions, parameters, locals and assigned globals
+    bool open_imports;  // the module imports a.*, which may export any name
+
+    Node *optimize(Node *node);
+    void optimizeStatements(Node *node);
+    Node *literal(const Value &value);
+    Node *simplify(BinaryOpNode *node);
+
+    static bool constant(Node *node, Value &value);
+    static bool fold(BinaryOp op, const Value &lhs, const Value &rhs, Value &out);
+    static Kind kindOf(Node *node);
+};
+
+}}
+
+#endif
@@ -0,0 +1,202 @@
+#include "compiler/pass/resolve.h"
+
+namespace pie { namespace compiler {
+
+ResolveVisitor::ResolveVisitor() : next_slot(0), frame_size(0)
+{
+}
+
+void ResolveVisitor::resolve(ModuleNode *module)
+{
+    for (FunctionNode *fn : module->functions) {
+        resolve(fn);
+    }
+}
+
+void ResolveVisitor::resolve(FunctionNode *function)
+{
+    scopes.clear();
+    scopes.push_back(std::map<std::string, int>());
+    next_slot = 0;
+    frame_size = 0;
+
+    // Parameter i always lives in slot i, a repeated name binds the last one
+    for (size_t i = 0; i < function->params.size(); i++) {
+        scopes.back()[function->params[i].first] = next_slot++;
+    }
+    frame_size = next_slot;
+
+    visitChildren(function);
+
+    function->frame_size = frame_size;
+    scopes.clear();
+}
+
+int ResolveVisitor::declare(const std::string &name)
+{
+    auto &scope = scopes.back();
+    auto it = scope.find(name);
+    if (it != scope.end()) {
+        // Redeclaring in the same scope overwrites the variable
+        return it->second;
+    }
+
+    int slot = next_slot++;
+    scope[name] = slot;
+    if (next_slot > frame_size) {
+        frame_size = next_slot;
+    }
+    return slot;
+}
+
+int ResolveVisitor::lookup(const std::string &name, int &depth) const
+{
+    for (size_t i = scopes.size(); i > 0; i--) {
+        auto it = scopes[i - 1].find(name);
+        if (it != scopes[i - 1].end()) {
+            depth = (int)i - 1;
+            return it->second;
+        }
+    }
+    depth = -1;
+    return -1;
+}
+
+void ResolveVisitor::visitChildren(Node *node)
+{
+    for (Node *child : node->children) {
+        if (child) child->visit(this);
+    }
+}
+
+void ResolveVisitor::visit(Node *node)
+{
+    if (node) {
+        node->visit(this);
+    }
+}
+
+void ResolveVisitor::visit(ModuleNode *node)
+{
+    resolve(node);
+}
+
+void ResolveVisitor::visit(ImportNode *node)
+{
+}
+
+void ResolveVisitor::visit(FunctionNode *node)
+{
+    // Nested declarations are registered at module level, not executed
+}
+
+void ResolveVisitor::visit(ClosureNode *node)
+{
+}
+
+void ResolveVisitor::visit(FunctionCallNode *node)
+{
+    visitChildren(node);
+
+    // Dotted names are never locals
+    if (node->scope.empty()) {
+        node->slot = lookup(node->name, node->depth);
+    }
+}
+
+void ResolveVisitor::visit(AssignNode *node)
+{
+    visitChildren(node);
+}
+
+void ResolveVisitor::visit(LetNode *node)
+{
+    // The initializer still sees an outer variable of the same name
+    visitChildren(node);
+    node->slot = declare(node->name);
+    node->depth = (int)scopes.size() - 1;
+}
+
+void ResolveVisitor::visit(TypeNode *node)
+{
+}
+
+void ResolveVisitor::visit(IntNode *node)
+{
+}
+
+void ResolveVisitor::visit(DoubleNode *node)
+{
+}
+
+void ResolveVisitor::visit(StringNode *node)
+{
+}
+
+void ResolveVisitor::visit(BoolNode *node)
+{
+}
+
+void ResolveVisitor::visit(IdentifierNode *node)
+{
+    node->slot = lookup(node->name, node->depth);
+}
+
+void ResolveVisitor::visit(BinaryOpNode *node)
+{
+    visitChildren(node);
+}
+
+void ResolveVisitor::visit(UnaryOpNode *node)
+{
+    visitChildren(node);
+}
+
+void ResolveVisitor::visit(ReturnNode *node)
+{
+    visitChildren(node);
+}
+
+void ResolveVisitor::visit(IfNode *node)
+{
+    visitChildren(node);
+}
+
+void ResolveVisitor::visit(WhileNode *node)
+{
+    visitChildren(node);
+}
+
+void ResolveVisitor::visit(ForNode *node)
+{
+    // The init let gets a scope around the whole loop
+    int saved_slot = next_slot;
+    scopes.push_back(std::map<std::string, int>());
+
+    visitChildren(node);
+
+    scopes.pop_back();
+    next_slot = saved_slot;
+}
+
+void ResolveVisitor::visit(BreakNode *node)
+{
+}
+
+void ResolveVisitor::visit(ContinueNode *node)
+{
+}
+
+void ResolveVisitor::visit(BlockNode *node)
+{
+    int saved_slot = next_slot;
+    scopes.push_back(std::map<std::string, int>());
+
+    visitChildren(node);
+
+    node->num_locals = (int)scopes.back().size();
+    scopes.pop_back();
+    next_slot = saved_slot;
+}
+
+}}
@@ -0,0 +1,42 @@
+#ifndef __PIE_PASS_RESOLVE__
+#define __PIE_PASS_RESOLVE__
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "compiler/ast.h"
+
+namespace pie { namespace compiler {
+
+// Static scope resolution. Every parameter and let gets a slot in the flat
+// frame of its function, slots of sibling blocks are reused. Identifiers,
+// assignments and calls naming a local get its (depth, slot), anything else
+// keeps slot -1 and is looked up in the global scope at runtime.
+class ResolveVisitor : public Visitor
+{
+public:
+    ResolveVisitor();
+
+    void resolve(ModuleNode *module);
+    void resolve(FunctionNode *function);
+
+    void visit(Node *node) override;
+
+    #define AST_NODE DECLARE_VISIT
+    AST_NODES
+    #undef AST_NODE
+
+private:
+    std::vector<std::map<std::string, int>> scopes;
+    int next_slot;
+    int frame_size;
+
+    int declare(const std::string &name);
+    int lookup(const std::string &name, int &depth) const;
+    void visitChildren(Node *node);
+};
+
+}}
+
+#endif
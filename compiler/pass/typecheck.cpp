@@ -0,0 +1,650 @@
+#include "compiler/pass/typecheck.h"
+
+namespace pie { namespace compiler {
+
+static void replaceChild(Node *parent, Node *old_child, Node *new_child)
+{
+    for (Node *&child : parent->children) {
+        if (child == old_child) {
+            child = new_child;
+            return;
+        }
+    }
+}
+
+static void collectAssigned(Node *node, std::set<std::string> &names)
+{
+    if (!node) return;
+
+    IdentifierNode *id = nullptr;
+    if (AssignNode *assign = dyn_cast<AssignNode>(node)) {
+        id = dyn_cast<IdentifierNode>(assign->var);
+    } else if (BinaryOpNode *op = dyn_cast<BinaryOpNode>(node)) {
+        if (op->op == BinaryOp::AddAssign || op->op == BinaryOp::SubAssign) {
+            id = dyn_cast<IdentifierNode>(op->lhs);
+        }
+    }
+    if (id) names.insert(id->name);
+
+    for (Node *child : node->children) {
+        collectAssigned(child, names);
+    }
+}
+
+static bool returnsValue(Node *node)
+{
+    if (!node) return true;
+
+    ReturnNode *ret = dyn_cast<ReturnNode>(node);
+    if (ret && !ret->expr) return false;
+
+    for (Node *child : node->children) {
+        if (!returnsValue(child)) return false;
+    }
+    return true;
+}
+
+// Whether running stmt always ends in a return
+static bool alwaysReturns(Node *stmt)
+{
+    if (!stmt) return false;
+    if (dyn_cast<ReturnNode>(stmt)) return true;
+
+    IfNode *branch = dyn_cast<IfNode>(stmt);
+    if (!branch || !branch->then_block || !branch->else_block) return false;
+
+    Node *then_block = branch->then_block;
+    Node *else_block = branch->else_block;
+    if (then_block->children.empty() || !alwaysReturns(then_block->children.back())) return false;
+    if (dyn_cast<IfNode>(else_block)) return alwaysReturns(else_block);
+    return !else_block->children.empty() && alwaysReturns(else_block->children.back());
+}
+
+TypeCheckVisitor::TypeCheckVisitor()
+    : module(nullptr), arena(nullptr), function(nullptr), return_type(Type::None), result(nullptr)
+{
+}
+
+TypeCheckVisitor::Type TypeCheckVisitor::annotation(TypeNode *type)
+{
+    if (!type || type->is_array) return Type::None;
+    if (type->name == "int") return Type::Int;
+    if (type->name == "double") return Type::Double;
+    return Type::None;
+}
+
+TypeCheckVisitor::Type TypeCheckVisitor::join(Type a, Type b)
+{
+    if (a == Type::None) return b;
+    if (b == Type::None || a == b) return a;
+    return Type::Any;
+}
+
+// Arithmetic yields Int only for two Ints, anything else goes through
+// toDouble()
+TypeCheckVisitor::Type TypeCheckVisitor::arith(Type lhs, Type rhs)
+{
+    if (lhs == Type::None || rhs == Type::None) return Type::None;
+    if (lhs == Type::Int && rhs == Type::Int) return Type::Int;
+    if ((lhs == Type::Int || lhs == Type::Any) && (rhs == Type::Int || rhs == Type::Any)) return Type::Any;
+    return Type::Double;
+}
+
+void TypeCheckVisitor::check(ModuleNode *module)
+{
+    this->module = module;
+    arena = &module->arena;
+
+    for (FunctionNode *fn : module->functions) {
+        collectAssigned(fn, assigned);
+    }
+
+    // A call has the annotated result type when the callee can not be
+    // rebound and returns a value on every path
+    for (FunctionNode *fn : module->functions) {
+        Type type = annotation(fn->return_type);
+        if (type == Type::None || assigned.count(fn->name)) continue;
+
+        auto it = module->symtab.find(fn->name);
+        if (it == module->symtab.end() || it->second != fn) continue;
+
+        if (!fn->children.empty() && alwaysReturns(fn->children.back()) && returnsValue(fn)) {
+            returns[fn->name] = type;
+        }
+    }
+
+    // What every direct call passes, a parameter proven by all of them
+    // needs no guard
+    for (FunctionNode *fn : module->functions) {
+        analyze(fn);
+        for (FunctionCallNode *call : calls) {
+            auto it = module->symtab.find(call->name);
+            if (it == module->symtab.end() || !dyn_cast<FunctionNode>(it->second)) continue;
+
+            FunctionNode *callee = static_cast<FunctionNode*>(it->second);
+            std::vector<Type> &types = passed[callee->name];
+            types.resize(callee->params.size(), Type::None);
+            for (size_t i = 0; i < types.size(); i++) {
+                Type type = i < call->children.size() ? typeOf(call->children[i]) : Type::Any;
+                types[i] = join(types[i], type);
+            }
+        }
+    }
+
+    for (FunctionNode *fn : module->functions) {
+        checkFunction(fn);
+    }
+
+    this->module = nullptr;
+    arena = nullptr;
+}
+
+void TypeCheckVisitor::analyze(FunctionNode *fn)
+{
+    function = fn;
+    return_type = annotation(fn->return_type);
+    vars.clear();
+    defs.clear();
+    var_of.clear();
+    calls.clear();
+    scopes.assign(1, std::map<std::string, int>());
+
+    // Parameters are set by the caller: their type is the annotation, which
+    // the guards below enforce, or unknown
+    for (const auto &param : fn->params) {
+        Type type = annotation(param.second);
+        declare(param.first, type == Type::None ? Type::Any : type, true);
+    }
+
+    for (Node *stmt : fn->children) {
+        collect(stmt);
+    }
+    infer();
+}
+
+// Whether every caller of fn is known to pass a value of type as param
+bool TypeCheckVisitor::provenArgument(FunctionNode *fn, size_t param, Type type) const
+{
+    // main is called by the runtime, an escaped function by anyone, a
+    // public one by other modules with whatever they pass
+    if (fn->name == "main" || fn->access_level > 0 || escaped.count(fn->name) ||
+        assigned.count(fn->name)) {
+        return false;
+    }
+
+    auto entry = module->symtab.find(fn->name);
+    if (entry == module->symtab.end() || entry->second != fn) return false;
+
+    auto it = passed.find(fn->name);
+    return it != passed.end() && it->second[param] == type;
+}
+
+void TypeCheckVisitor::checkFunction(FunctionNode *fn)
+{
+    analyze(fn);
+
+    for (Node *&stmt : fn->children) {
+        stmt = rewrite(stmt);
+    }
+
+    std::vector<Node *> guards;
+    for (size_t i = 0; i < fn->params.size(); i++) {
+        Type type = vars[i].type;
+        if (type != Type::Int && type != Type::Double) continue;
+        if (provenArgument(fn, i, type)) continue;
+
+        const std::string &name = fn->params[i].first;
+        UnaryOp op = type == Type::Int ? UnaryOp::CastInt : UnaryOp::CastDouble;
+        Node *value = arena->make<UnaryOpNode>(op, arena->make<IdentifierNode>(name));
+        guards.push_back(arena->make<AssignNode>(arena->make<IdentifierNode>(name), value));
+    }
+    fn->children.insert(fn->children.begin(), guards.begin(), guards.end());
+
+    function = nullptr;
+    scopes.clear();
+}
+
+int TypeCheckVisitor::declare(const std::string &name, Type type, bool fixed)
+{
+    // A redeclaration starts a new variable, later reads only see its values
+    int var = (int)vars.size();
+    vars.push_back({ type, fixed });
+    scopes.back()[name] = var;
+    return var;
+}
+
+int TypeCheckVisitor::lookup(const std::string &name) const
+{
+    for (size_t i = scopes.size(); i > 0; i--) {
+        auto it = scopes[i - 1].find(name);
+        if (it != scopes[i - 1].end()) return it->second;
+    }
+    return -1;
+}
+
+// Binds every use of a local to its variable and records every value
+// stored into one, following the scoping of ResolveVisitor
+void TypeCheckVisitor::collect(Node *node)
+{
+    if (!node) return;
+
+    if (LetNode *let = dyn_cast<LetNode>(node)) {
+        collect(let->value);
+        Type type = annotation(let->type);
+        int var = declare(let->name, type, type != Type::None);
+        var_of[let] = var;
+        defs.push_back({ var, let->value, BinaryOp::Assign });
+        return;
+    }
+
+    // The init let of a for is scoped to the loop
+    if (dyn_cast<BlockNode>(node) || dyn_cast<ForNode>(node)) {
+        scopes.push_back(std::map<std::string, int>());
+        for (Node *child : node->children) {
+            collect(child);
+        }
+        scopes.pop_back();
+        return;
+    }
+
+    if (dyn_cast<FunctionNode>(node) || dyn_cast<ClosureNode>(node)) {
+        return;
+    }
+
+    if (IdentifierNode *id = dyn_cast<IdentifierNode>(node)) {
+        int var = lookup(id->name);
+        if (var >= 0) {
+            var_of[id] = var;
+        } else {
+            // A function used as a value may be called from anywhere
+            escaped.insert(id->name);
+        }
+        return;
+    }
+
+    if (FunctionCallNode *call = dyn_cast<FunctionCallNode>(node)) {
+        int var = call->scope.empty() ? lookup(call->name) : -1;
+        if (var >= 0) {
+            var_of[call] = var;
+        } else if (call->scope.empty()) {
+            calls.push_back(call);
+        }
+    }
+
+    for (Node *child : node->children) {
+        collect(child);
+    }
+
+    if (AssignNode *assign = dyn_cast<AssignNode>(node)) {
+        auto it = var_of.find(assign->var);
+        if (it != var_of.end()) defs.push_back({ it->second, assign->value, BinaryOp::Assign });
+    } else if (BinaryOpNode *op = dyn_cast<BinaryOpNode>(node)) {
+        if (op->op == BinaryOp::AddAssign || op->op == BinaryOp::SubAssign) {
+            auto it = var_of.find(op->lhs);
+            if (it != var_of.end()) defs.push_back({ it->second, op->rhs, op->op });
+        }
+    }
+}
+
+// Joins the types stored into every unannotated local until nothing changes
+void TypeCheckVisitor::infer()
+{
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (const Def &def : defs) {
+            Var &var = vars[def.var];
+            if (var.fixed) continue;
+
+            Type value = def.value ? typeOf(def.value) : Type::Any;  // let without value is nil
+            if (def.op != BinaryOp::Assign) {
+                value = arith(var.type, value);
+            }
+
+            Type type = join(var.type, value);
+            if (type != var.type) {
+                var.type = type;
+                changed = true;
+            }
+        }
+    }
+
+    for (Var &var : vars) {
+        if (var.type == Type::None) var.type = Type::Any;
+    }
+}
+
+TypeCheckVisitor::Type TypeCheckVisitor::varType(Node *node) const
+{
+    auto it = var_of.find(node);
+    return it != var_of.end() ? vars[it->second].type : Type::Any;
+}
+
+TypeCheckVisitor::Type TypeCheckVisitor::typeOf(Node *node) const
+{
+    if (dyn_cast<IntNode>(node)) return Type::Int;
+    if (dyn_cast<DoubleNode>(node)) return Type::Double;
+    if (dyn_cast<StringNode>(node)) return Type::String;
+    if (dyn_cast<BoolNode>(node)) return Type::Bool;
+    if (dyn_cast<IdentifierNode>(node)) return varType(node);
+
+    if (FunctionCallNode *call = dyn_cast<FunctionCallNode>(node)) {
+        if (!call->scope.empty() || var_of.count(call)) return Type::Any;
+        auto it = returns.find(call->name);
+        return it != returns.end() ? it->second : Type::Any;
+    }
+
+    if (AssignNode *assign = dyn_cast<AssignNode>(node)) {
+        return typeOf(assign->value);
+    }
+
+    if (UnaryOpNode *op = dyn_cast<UnaryOpNode>(node)) {
+        switch (op->op) {
+            case UnaryOp::Not: return Type::Bool;
+            case UnaryOp::CastInt: return Type::Int;
+            case UnaryOp::CastDouble: return Type::Double;
+            case UnaryOp::Neg:
+            {
+                Type type = typeOf(op->expr);
+                if (type == Type::Int || type == Type::Any || type == Type::None) return type;
+                return Type::Double;
+            }
+            default: return Type::Any;
+        }
+    }
+
+    BinaryOpNode *op = dyn_cast<BinaryOpNode>(node);
+    if (!op) return Type::Any;
+
+    switch (op->op) {
+        case BinaryOp::Lt:
+        case BinaryOp::Gt:
+        case BinaryOp::Le:
+        case BinaryOp::Ge:
+        case BinaryOp::Eq:
+        case BinaryOp::Ne:
+        case BinaryOp::And:
+        case BinaryOp::Or:
+            return Type::Bool;
+        case BinaryOp::Mod:
+            return Type::Int;
+        case BinaryOp::Add:
+        {
+            Type lhs = typeOf(op->lhs);
+            Type rhs = typeOf(op->rhs);
+            if (lhs == Type::String || rhs == Type::String) return Type::String;
+            if (lhs == Type::None || rhs == Type::None) return Type::None;
+            if (lhs == Type::Any || rhs == Type::Any) return Type::Any;
+            return arith(lhs, rhs);
+        }
+        case BinaryOp::Sub:
+        case BinaryOp::Mul:
+        case BinaryOp::Div:
+            return arith(typeOf(op->lhs), typeOf(op->rhs));
+        case BinaryOp::AddAssign:
+        case BinaryOp::SubAssign:
+            return arith(varType(op->lhs), typeOf(op->rhs));
+        default:
+            return Type::Any;
+    }
+}
+
+// Makes node produce a value of type, a no-op when that is already proven
+Node *TypeCheckVisitor::cast(Node *node, Type type)
+{
+    if (!node || (type != Type::Int && type != Type::Double) || typeOf(node) == type) {
+        return node;
+    }
+    return arena->make<UnaryOpNode>(type == Type::Int ? UnaryOp::CastInt : UnaryOp::CastDouble, node);
+}
+
+void TypeCheckVisitor::specialize(BinaryOpNode *node)
+{
+    switch (node->op) {
+        case BinaryOp::Add:
+        case BinaryOp::Sub:
+        case BinaryOp::Mul:
+        case BinaryOp::Div:
+        case BinaryOp::Mod:
+        case BinaryOp::Lt:
+        case BinaryOp::Gt:
+        case BinaryOp::Le:
+        case BinaryOp::Ge:
+        case BinaryOp::Eq:
+        case BinaryOp::Ne:
+        case BinaryOp::AddAssign:
+        case BinaryOp::SubAssign:
+            break;
+        default:
+            return;
+    }
+
+    bool update = node->op == BinaryOp::AddAssign || node->op == BinaryOp::SubAssign;
+    Type lhs = update ? varType(node->lhs) : typeOf(node->lhs);
+    Type rhs = typeOf(node->rhs);
+
+    if (lhs == Type::Int && rhs == Type::Int) {
+        node->operand_type = OperandType::Int;
+        return;
+    }
+
+    bool lhs_num = lhs == Type::Int || lhs == Type::Double;
+    bool rhs_num = rhs == Type::Int || rhs == Type::Double;
+    if (node->op == BinaryOp::Mod || !lhs_num || !rhs_num) return;
+
+    // Mixed operands: widen the Int side once instead of on every use.
+    // The target of an update can not be widened.
+    if (lhs == Type::Int) {
+        if (update) return;
+        Node *widened = cast(node->lhs, Type::Double);
+        replaceChild(node, node->lhs, widened);
+        node->lhs = widened;
+    }
+    Node *widened = cast(node->rhs, Type::Double);
+    replaceChild(node, node->rhs, widened);
+    node->rhs = widened;
+
+    node->operand_type = OperandType::Double;
+}
+
+Node *TypeCheckVisitor::rewrite(Node *node)
+{
+    if (!node) return nullptr;
+
+    result = node;
+    node->visit(this);
+    return result;
+}
+
+void TypeCheckVisitor::visit(Node *node)
+{
+    if (node) {
+        node->visit(this);
+    }
+}
+
+void TypeCheckVisitor::visit(ModuleNode *node)
+{
+    check(node);
+    result = node;
+}
+
+void TypeCheckVisitor::visit(ImportNode *node)
+{
+}
+
+void TypeCheckVisitor::visit(FunctionNode *node)
+{
+    // Nested declarations are checked from the module's function list
+}
+
+void TypeCheckVisitor::visit(ClosureNode *node)
+{
+}
+
+void TypeCheckVisitor::visit(FunctionCallNode *node)
+{
+    for (Node *&arg : node->children) {
+        arg = rewrite(arg);
+    }
+    result = node;
+}
+
+void TypeCheckVisitor::visit(AssignNode *node)
+{
+    Node *value = rewrite(node->value);
+    auto it = var_of.find(node->var);
+    if (it != var_of.end() && vars[it->second].fixed) {
+        value = cast(value, vars[it->second].type);
+    }
+    replaceChild(node, node->value, value);
+    node->value = value;
+    result = node;
+}
+
+void TypeCheckVisitor::visit(LetNode *node)
+{
+    if (node->value) {
+        Node *value = rewrite(node->value);
+        const Var &var = vars[var_of[node]];
+        if (var.fixed) {
+            value = cast(value, var.type);
+        }
+        replaceChild(node, node->value, value);
+        node->value = value;
+    }
+    result = node;
+}
+
+void TypeCheckVisitor::visit(TypeNode *node)
+{
+}
+
+void TypeCheckVisitor::visit(IntNode *node)
+{
+}
+
+void TypeCheckVisitor::visit(DoubleNode *node)
+{
+}
+
+void TypeCheckVisitor::visit(StringNode *node)
+{
+}
+
+void TypeCheckVisitor::visit(BoolNode *node)
+{
+}
+
+void TypeCheckVisitor::visit(IdentifierNode *node)
+{
+}
+
+void TypeCheckVisitor::visit(BinaryOpNode *node)
+{
+    bool update = node->op == BinaryOp::AddAssign || node->op == BinaryOp::SubAssign;
+
+    if (!update) {
+        Node *lhs = rewrite(node->lhs);
+        replaceChild(node, node->lhs, lhs);
+        node->lhs = lhs;
+    }
+
+    Node *rhs = rewrite(node->rhs);
+    auto it = var_of.find(node->lhs);
+    if (update && it != var_of.end() && vars[it->second].fixed && vars[it->second].type == Type::Int) {
+        // An int local only stays an int when an int is added to it
+        rhs = cast(rhs, Type::Int);
+    }
+    replaceChild(node, node->rhs, rhs);
+    node->rhs = rhs;
+
+    specialize(node);
+    result = node;
+}
+
+void TypeCheckVisitor::visit(UnaryOpNode *node)
+{
+    Node *expr = rewrite(node->expr);
+    replaceChild(node, node->expr, expr);
+    node->expr = expr;
+    result = node;
+}
+
+void TypeCheckVisitor::visit(ReturnNode *node)
+{
+    if (node->expr) {
+        Node *expr = cast(rewrite(node->expr), return_type);
+        replaceChild(node, node->expr, expr);
+        node->expr = expr;
+    }
+    result = node;
+}
+
+void TypeCheckVisitor::visit(IfNode *node)
+{
+    Node *cond = rewrite(node->condition);
+    replaceChild(node, node->condition, cond);
+    node->condition = cond;
+
+    if (node->then_block) {
+        node->then_block->visit(this);
+    }
+
+    if (node->else_block) {
+        node->else_block->visit(this);
+    }
+    result = node;
+}
+
+void TypeCheckVisitor::visit(WhileNode *node)
+{
+    Node *cond = rewrite(node->condition);
+    replaceChild(node, node->condition, cond);
+    node->condition = cond;
+
+    if (node->body) {
+        node->body->visit(this);
+    }
+    result = node;
+}
+
+void TypeCheckVisitor::visit(ForNode *node)
+{
+    Node *init = rewrite(node->init);
+    replaceChild(node, node->init, init);
+    node->init = init;
+
+    Node *cond = rewrite(node->condition);
+    replaceChild(node, node->condition, cond);
+    node->condition = cond;
+
+    Node *step = rewrite(node->step);
+    replaceChild(node, node->step, step);
+    node->step = step;
+
+    if (node->body) {
+        node->body->visit(this);
+    }
+    result = node;
+}
+
+void TypeCheckVisitor::visit(BreakNode *node)
+{
+    result = node;
+}
+
+void TypeCheckVisitor::visit(ContinueNode *node)
+{
+    result = node;
+}
+
+void TypeCheckVisitor::visit(BlockNode *node)
+{
+    for (Node *&stmt : node->children) {
+        stmt = rewrite(stmt);
+    }
+    result = node;
+}
+
+}}
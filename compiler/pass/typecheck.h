@@ -0,0 +1,91 @@
+#ifndef __PIE_PASS_TYPECHECK__
+#define __PIE_PASS_TYPECHECK__
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "compiler/ast.h"
+
+namespace pie { namespace compiler {
+
+// Propagates int and double annotations and specializes arithmetic.
+//
+// Annotated lets, parameters and return values get a CastInt/CastDouble
+// wherever their value is not already proven to have that type, so the
+// annotation holds at runtime. A parameter of a private function every
+// caller passes the right type needs none. Unannotated locals take the
+// join of the types of every value assigned to them. A BinaryOpNode whose
+// operands are then proven Int, or Double after widening an Int operand,
+// gets its operand_type set and runs without tag checks. Other annotations
+// are ignored.
+class TypeCheckVisitor : public Visitor
+{
+public:
+    TypeCheckVisitor();
+
+    void check(ModuleNode *module);
+
+    void visit(Node *node) override;
+
+    #define AST_NODE DECLARE_VISIT
+    AST_NODES
+    #undef AST_NODE
+
+private:
+    // None is the type of a local no value reaches yet, Any is unknown
+    enum class Type { None, Int, Double, Bool, String, Any };
+
+    // fixed: the type is declared (annotations, parameters), not inferred
+    struct Var {
+        Type type;
+        bool fixed;
+    };
+
+    // A value stored into a local: a let, an assignment or a compound
+    // assignment (op is AddAssign or SubAssign)
+    struct Def {
+        int var;
+        Node *value;
+        BinaryOp op;
+    };
+
+    ModuleNode *module;
+    Arena *arena;
+    std::set<std::string> assigned;
+    std::map<std::string, Type> returns;  // proven results of module functions
+    std::map<std::string, std::vector<Type>> passed;  // join of the arguments of all calls
+    std::set<std::string> escaped;  // globals read as values
+
+    FunctionNode *function;
+    Type return_type;
+    std::vector<Var> vars;
+    std::vector<Def> defs;
+    std::vector<std::map<std::string, int>> scopes;
+    std::map<Node *, int> var_of;  // local named by an identifier, let or call
+    std::vector<FunctionCallNode *> calls;  // calls to globals
+    Node *result;
+
+    void analyze(FunctionNode *fn);
+    void checkFunction(FunctionNode *fn);
+    bool provenArgument(FunctionNode *fn, size_t param, Type type) const;
+    void collect(Node *node);
+    void infer();
+    int declare(const std::string &name, Type type, bool fixed);
+    int lookup(const std::string &name) const;
+
+    Type typeOf(Node *node) const;
+    Type varType(Node *node) const;
+    Node *rewrite(Node *node);
+    Node *cast(Node *node, Type type);
+    void specialize(BinaryOpNode *node);
+
+    static Type annotation(TypeNode *type);
+    static Type join(Type a, Type b);
+    static Type arith(Type lhs, Type rhs);
+};
+
+}}
+
+#endif
@@ -0,0 +1,98 @@
+#include "compiler/pool.h"
+
+namespace pie { namespace compiler {
+
+TaskPool::TaskPool(unsigned threads)
+    : max_workers(threads > 1 ? threads - 1 : 0), idle(0), running(0), stopping(false)
+{
+}
+
+TaskPool::~TaskPool()
+{
+    {
+        std::lock_guard<std::mutex> held(lock);
+        stopping = true;
+    }
+    changed.notify_all();
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+void TaskPool::submit(std::function<void()> task)
+{
+    std::lock_guard<std::mutex> held(lock);
+    tasks.push_back(std::move(task));
+
+    if (idle > 0) {
+        changed.notify_all();
+    }
+    // One queued task is left for the thread that submitted it
+    if (tasks.size() > idle + 1 && workers.size() < max_workers) {
+        workers.emplace_back(&TaskPool::work, this);
+    }
+}
+
+void TaskPool::wait()
+{
+    std::unique_lock<std::mutex> held(lock);
+    while (!tasks.empty() || running > 0) {
+        if (!tasks.empty()) {
+            runOne(held);
+            continue;
+        }
+        idle++;
+        changed.wait(held);
+        idle--;
+    }
+
+    if (error) {
+        std::exception_ptr thrown = error;
+        error = nullptr;
+        std::rethrow_exception(thrown);
+    }
+}
+
+void TaskPool::work()
+{
+    std::unique_lock<std::mutex> held(lock);
+    while (true) {
+        if (!tasks.empty()) {
+            runOne(held);
+            continue;
+        }
+        if (stopping) {
+            return;
+        }
+        idle++;
+        changed.wait(held);
+        idle--;
+    }
+}
+
+void TaskPool::runOne(std::unique_lock<std::mutex> &held)
+{
+    std::function<void()> task = std::move(tasks.front());
+    tasks.pop_front();
+    running++;
+    held.unlock();
+
+    std::exception_ptr thrown;
+    try {
+        task();
+    } catch (...) {
+        thrown = std::current_exception();
+    }
+
+    held.lock();
+    running--;
+    if (thrown && !error) {
+        error = thrown;
+    }
+    // wait() returns once the last task is done
+    if (running == 0 && tasks.empty() && idle > 0) {
+        changed.notify_all();
+    }
+}
+
+}}
@@ -0,0 +1,50 @@
+#ifndef __PIE_POOL__
+#define __PIE_POOL__
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pie { namespace compiler {
+
+// Runs tasks on the thread calling wait() and on up to threads - 1 more.
+// Workers are only started once tasks queue up faster than the running
+// threads take them, a single module compiles without starting any.
+class TaskPool {
+public:
+    explicit TaskPool(unsigned threads);
+    ~TaskPool();
+
+    TaskPool(const TaskPool &) = delete;
+    TaskPool &operator=(const TaskPool &) = delete;
+
+    // May be called from a running task
+    void submit(std::function<void()> task);
+
+    // Runs tasks until none is queued or running, then rethrows the first
+    // exception a task threw
+    void wait();
+
+private:
+    std::mutex lock;
+    std::condition_variable changed;
+    std::deque<std::function<void()>> tasks;
+    std::vector<std::thread> workers;
+    unsigned max_workers;
+    unsigned idle;     // threads waiting for a task
+    unsigned running;  // tasks being run
+    bool stopping;
+    std::exception_ptr error;
+
+    void work();
+    // Pops a task and runs it with the lock released
+    void runOne(std::unique_lock<std::mutex> &held);
+};
+
+}}
+
+#endif
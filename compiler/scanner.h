@@ -1,35 +1,56 @@
 #ifndef __PIE_SCANNER__
 #define __PIE_SCANNER__
 
+#include <cstdint>
+#include <deque>
 #include <string>
 
 namespace pie { namespace compiler {
 
+class Source;
+
+// Text of a token: a view of the source, or of a string literal the
+// scanner had to decode. Valid as long as the scanner and its source,
+// the AST copies what it keeps.
+struct TokenText {
+	const char *data;
+	uint32_t length;
+
+	std::string str() const { return std::string(data, length); }
+};
+
+// Scans a Source in place: token text is never copied out of it
 class Scanner {
 public:
-	Scanner() : m_file(stdin), m_line(0), m_yyscanner(nullptr) {}
-	Scanner(FILE *file);
+	explicit Scanner(Source &source);
 	~Scanner();
 
 	int scan();
 
-	FILE *file() { return m_file; }
-
 	// Get the text of the last scanned token
 	const char *tokenText() const;
 
 	// Get the length of the last scanned token
 	int tokenLength() const;
 
-	// Get the accumulated string value (for T_STRING tokens)
-	const std::string &stringValue() const;
+	// Line of the last scanned token, from 1
+	int line() const;
+
+	// Contents of the last T_STRING token, escapes replaced
+	TokenText stringValue() const { return m_string; }
 
 public:
 	std::string m_filename;
 	int m_line;
-	FILE *m_file;
+	bool m_debug;  // DEBUG_LEX was set when the scanner was created
 
 	void *m_yyscanner;
+
+	// String literal being scanned: a view until its first escape, then
+	// decoded into m_decoded
+	TokenText m_string;
+	bool m_escaped;
+	std::deque<std::string> m_decoded;
 };
 
 }}
@@ -0,0 +1,115 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define PIE_SOURCE_MMAP 1
+#else
+#define PIE_SOURCE_MMAP 0
+#endif
+
+#include "compiler/source.h"
+
+namespace pie { namespace compiler {
+
+Source::Source() : text(nullptr), length(0), mapped(0)
+{
+}
+
+Source::~Source()
+{
+    close();
+}
+
+bool Source::open(const std::string &path)
+{
+    close();
+    name = path;
+
+#if PIE_SOURCE_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        size_t size = (size_t)st.st_size;
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        size_t total = (size + 2 + page - 1) & ~(page - 1);
+
+        // Zero pages for the whole range, then the file over their start:
+        // the bytes after its end read as zero in both
+        void *base = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+        if (base != MAP_FAILED) {
+            if (mmap(base, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) != MAP_FAILED) {
+                ::close(fd);
+                text = (char *)base;
+                length = size;
+                mapped = total;
+                return true;
+            }
+            munmap(base, total);
+        }
+    }
+    ::close(fd);
+#endif
+
+    return readAll();
+}
+
+void Source::copy(const std::string &path, const char *data, size_t size)
+{
+    close();
+    name = path;
+
+    text = (char *)malloc(size + 2);
+    memcpy(text, data, size);
+    text[size] = '\0';
+    text[size + 1] = '\0';
+    length = size;
+}
+
+bool Source::readAll()
+{
+    FILE *file = fopen(name.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+
+    size_t capacity = 64 * 1024;
+    text = (char *)malloc(capacity);
+    size_t n;
+    while ((n = fread(text + length, 1, capacity - length - 2, file)) > 0) {
+        length += n;
+        if (capacity - length - 2 == 0) {
+            capacity *= 2;
+            text = (char *)realloc(text, capacity);
+        }
+    }
+    fclose(file);
+
+    text[length] = '\0';
+    text[length + 1] = '\0';
+    return true;
+}
+
+void Source::close()
+{
+#if PIE_SOURCE_MMAP
+    if (mapped) {
+        munmap(text, mapped);
+        text = nullptr;
+    }
+#endif
+    free(text);
+    text = nullptr;
+    length = 0;
+    mapped = 0;
+}
+
+}}
@@ -0,0 +1,44 @@
+#ifndef __PIE_SOURCE__
+#define __PIE_SOURCE__
+
+#include <cstddef>
+#include <string>
+
+namespace pie { namespace compiler {
+
+// Text of one source file, followed by the two NUL bytes flex needs to
+// scan it in place. Regular files are mmap'd, anything else (pipes,
+// terminals) is read into memory.
+//
+// The scanner writes into the text while it runs, so the mapping is
+// private: the file itself is never changed.
+class Source {
+public:
+    Source();
+    ~Source();
+
+    Source(const Source &) = delete;
+    Source &operator=(const Source &) = delete;
+
+    // False when path cannot be opened or read
+    bool open(const std::string &path);
+    // A copy of text already in memory, named path
+    void copy(const std::string &path, const char *data, size_t size);
+
+    char *data() const { return text; }
+    size_t size() const { return length; }
+    const std::string &path() const { return name; }
+
+private:
+    std::string name;
+    char *text;
+    size_t length;
+    size_t mapped;  // bytes mmap'd, 0 when text was allocated
+
+    bool readAll();
+    void close();
+};
+
+}}
+
+#endif
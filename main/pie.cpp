@@ -2,36 +2,178 @@
 #include <stdlib.h>
 #include <string.h>
 #include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
 
-#include "compiler/scanner.h"
-#include "compiler/parser.h"
+#include "compiler/driver.h"
 #include "compiler/backend/print.h"
 #include "compiler/backend/eval.h"
+#include "compiler/backend/closure.h"
+#include "compiler/backend/profile.h"
+#include "compiler/backend/vm.h"
+#include "compiler/pass/inline.h"
+#include "runtime/io.h"
 
 using namespace pie::compiler;
 
+// lib/prelude.pie and lib/std/, compiled by the build (tools/snapshot.cpp)
+namespace pie { namespace compiler {
+extern const EmbeddedModule stdlib[];
+extern const size_t stdlib_size;
+}}
+
+// Written when the program ends, however it ends, while the functions it
+// names are alive: when main returns, before the Driver frees them, and
+// from atexit() when exit() ends the program without returning to main
+static std::unique_ptr<Profiler> profiler;
+static std::string profile_path;
+
+static void writeProfile()
+{
+    if (!profiler) return;
+
+    profiler->stop();
+    pie::io::flushAll();
+
+    std::ofstream out(profile_path.c_str());
+    profiler->writeFolded(out);
+    out.close();
+    if (out) {
+        std::cerr << "Profile written to " << profile_path << ": ";
+    } else {
+        std::cerr << "Failed to write profile: " << profile_path << "\nProfile: ";
+    }
+    profiler->writeSummary(std::cerr, 10);
+    profiler.reset();
+}
+
+// Writes the profile when main returns, declared after the Driver
+struct ProfileWriter {
+    ~ProfileWriter() { writeProfile(); }
+};
+
+// Samples the engine from now on, see Profiler
+template <typename Engine>
+static bool startProfile(Engine &engine)
+{
+    if (profile_path.empty()) return true;
+
+    profiler.reset(new Profiler());
+    if (!profiler->start()) {
+        fprintf(stderr, "Failed to start the profiler\n");
+        return false;
+    }
+    engine.setProfiler(profiler.get());
+    atexit(writeProfile);
+    return true;
+}
+
+// Runs module on engine, the int main returns is the exit code
+template <typename Engine>
+static int runProgram(Engine &engine, ModuleNode *module)
+{
+    try {
+        Value result = engine.run(module);
+
+        // If main returned a value, use it as exit code
+        if (result.type == Value::Type::Int) {
+            return (int)result.int_val;
+        }
+    } catch (const std::exception &e) {
+        // Output printed before the error goes out first
+        pie::io::flushAll();
+        fprintf(stderr, "Runtime error: %s\n", e.what());
+        return 3;
+    }
+    return 0;
+}
+
 void printUsage(const char *prog)
 {
     fprintf(stderr, "Usage: %s [options] <file.pie>\n", prog);
     fprintf(stderr, "Options:\n");
     fprintf(stderr, "  --print    Print the AST (don't execute)\n");
+    fprintf(stderr, "  --bytecode Print the VM bytecode (don't execute)\n");
+    fprintf(stderr, "  --vm       Run on the register-based bytecode VM\n");
+    fprintf(stderr, "  --engine=E Execution engine: tree (default), closure or vm\n");
     fprintf(stderr, "  --debug    Run interpreter with step-by-step debugger\n");
+    fprintf(stderr, "  --break=L  Debug, running until line L or function L is reached\n");
+    fprintf(stderr, "  --O0       Disable constant folding, simplification and inlining\n");
+    fprintf(stderr, "  --inline-budget=N  Inline functions of at most N nodes (default %d)\n",
+            InlineVisitor::kDefaultBudget);
+    fprintf(stderr, "  --inline-report    Print every inlined call site\n");
+    fprintf(stderr, "  --no-jit   Never compile numeric functions to machine code\n");
+    fprintf(stderr, "  --jit-threshold=N  Compile a function after N calls (default %u)\n",
+            JitCompiler::kDefaultThreshold);
+    fprintf(stderr, "  --jobs=N   Compile imported modules on N threads (default: one per core)\n");
+    fprintf(stderr, "  --no-cache Parse and analyse every module, don't use the module cache\n");
+    fprintf(stderr, "  --cache-dir=DIR    Keep analysed modules in DIR (default %s)\n",
+            ModuleCache::defaultDir().c_str());
+    fprintf(stderr, "  --profile=FILE     Sample the running functions, write folded stacks to FILE\n");
     fprintf(stderr, "  --help     Show this help message\n");
 }
 
 int main(int argc, char **argv)
 {
-    FILE *file = NULL;
     bool print_mode = false;
     bool debug_mode = false;
+    bool vm_mode = false;
+    bool closure_mode = false;
+    bool bytecode_mode = false;
+    bool optimize = true;
+    bool inline_report = false;
+    int inline_budget = InlineVisitor::kDefaultBudget;
+    bool jit = true;
+    uint32_t jit_threshold = JitCompiler::kDefaultThreshold;
+    unsigned jobs = 0;
+    bool cache = true;
+    std::string cache_dir = ModuleCache::defaultDir();
+    std::vector<std::string> breakpoints;
     const char *filename = nullptr;
 
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--print") == 0) {
             print_mode = true;
+        } else if (strcmp(argv[i], "--vm") == 0) {
+            vm_mode = true;
+        } else if (strncmp(argv[i], "--engine=", 9) == 0) {
+            const char *engine = argv[i] + 9;
+            vm_mode = strcmp(engine, "vm") == 0;
+            closure_mode = strcmp(engine, "closure") == 0;
+            if (!vm_mode && !closure_mode && strcmp(engine, "tree") != 0) {
+                fprintf(stderr, "Unknown engine: %s\n", engine);
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--bytecode") == 0) {
+            bytecode_mode = true;
         } else if (strcmp(argv[i], "--debug") == 0) {
             debug_mode = true;
+        } else if (strncmp(argv[i], "--break=", 8) == 0) {
+            breakpoints.push_back(argv[i] + 8);
+            debug_mode = true;
+        } else if (strcmp(argv[i], "--O0") == 0) {
+            optimize = false;
+        } else if (strncmp(argv[i], "--inline-budget=", 16) == 0) {
+            inline_budget = atoi(argv[i] + 16);
+        } else if (strcmp(argv[i], "--inline-report") == 0) {
+            inline_report = true;
+        } else if (strcmp(argv[i], "--no-jit") == 0) {
+            jit = false;
+        } else if (strncmp(argv[i], "--jit-threshold=", 16) == 0) {
+            jit_threshold = (uint32_t)std::max(1, atoi(argv[i] + 16));
+        } else if (strncmp(argv[i], "--jobs=", 7) == 0) {
+            jobs = (unsigned)std::max(1, atoi(argv[i] + 7));
+        } else if (strcmp(argv[i], "--no-cache") == 0) {
+            cache = false;
+        } else if (strncmp(argv[i], "--cache-dir=", 12) == 0) {
+            cache_dir = argv[i] + 12;
+        } else if (strncmp(argv[i], "--profile=", 10) == 0) {
+            profile_path = argv[i] + 10;
         } else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
             printUsage(argv[0]);
             return 0;
@@ -44,53 +186,104 @@ int main(int argc, char **argv)
         }
     }
 
-    if (filename) {
-        file = fopen(filename, "r");
-        if (!file) {
-            fprintf(stderr, "Failed to open file: %s\n", filename);
-            return 1;
-        }
-    } else {
+    if (!filename) {
         fprintf(stderr, "No input file specified.\n");
         printUsage(argv[0]);
         return 1;
     }
 
-    // Parse the source file
-    Scanner scanner(file);
-    Parser parser(scanner);
+    if (vm_mode && debug_mode) {
+        fprintf(stderr, "The debugger is not supported with --vm\n");
+        return 1;
+    }
 
-    int ret = parser.parse();
+    if (vm_mode && !profile_path.empty()) {
+        fprintf(stderr, "The profiler is not supported with --vm\n");
+        return 1;
+    }
+
+    if (closure_mode && debug_mode) {
+        fprintf(stderr, "The debugger is not supported with --engine=closure\n");
+        return 1;
+    }
 
-    fclose(file);
+    // Parse the program with its imports, analyse every module and bind
+    // the functions the program calls.
+    // --print shows the tree as parsed, everything else runs it type
+    // checked, so annotations mean the same under the debugger, and
+    // optimized. The debugger steps through calls as written, not inlined.
+    Driver driver(jobs);
+    ProfileWriter profile_writer;
+    driver.setLibrary(stdlib, stdlib_size);
+    if (cache) driver.setCacheDir(cache_dir);
+    driver.setTypeCheck(!print_mode);
+    driver.setOptimize(optimize && !print_mode, debug_mode ? 0 : inline_budget);
+    if (inline_report) driver.setInlineReport(&std::cerr);
 
-    if (ret != 0) {
-        fprintf(stderr, "Failed to parse: %s\n", filename);
+    switch (driver.compile(filename)) {
+    case Driver::Compiled:
+        break;
+    case Driver::OpenFailed:
+        return 1;
+    case Driver::ParseFailed:
+    case Driver::LinkFailed:
         return 2;
     }
 
-    ModuleNode *module = parser.module;
+    ModuleNode *module = driver.root();
 
     if (print_mode) {
         // Print mode: output the AST
         PrintVisitor printer;
         module->visit(&printer);
         std::cout << printer.output();
-    } else {
-        // Execution mode: run the program
+    } else if (vm_mode || bytecode_mode) {
+        // Compile to bytecode and run it on the VM
         try {
-            EvalVisitor interpreter;
-            interpreter.setDebugMode(debug_mode);
-            Value result = interpreter.run(module);
+            pie::vm::Program program;
+            VmCompilerVistor compiler(program);
+            compiler.compile(module);
+
+            if (bytecode_mode) {
+                std::cout << program.disassemble();
+                return 0;
+            }
+
+            pie::vm::Interpreter interpreter;
+            pie::vm::Value result = interpreter.run(program);
 
             // If main returned a value, use it as exit code
-            if (result.type == Value::Type::Int) {
+            if (result.type == pie::vm::Value::Type::Int) {
                 return (int)result.int_val;
             }
         } catch (const std::exception &e) {
+            // Output printed before the error goes out first
+            pie::io::flushAll();
             fprintf(stderr, "Runtime error: %s\n", e.what());
             return 3;
         }
+    } else if (closure_mode) {
+        // Compile every function to closures and run them
+        ClosureCompilerVisitor engine;
+        if (!startProfile(engine)) return 1;
+        return runProgram(engine, module);
+    } else if (debug_mode) {
+        DebugEvalVisitor interpreter;
+        for (const std::string &where : breakpoints) {
+            if (!where.empty() && strspn(where.c_str(), "0123456789") == where.size()) {
+                interpreter.breakAtLine(atoi(where.c_str()));
+            } else {
+                interpreter.breakAtFunction(where);
+            }
+        }
+        if (!startProfile(interpreter)) return 1;
+        return runProgram(interpreter, module);
+    } else {
+        // Execution mode: run the program
+        EvalVisitor interpreter;
+        interpreter.setJit(jit, jit_threshold);
+        if (!startProfile(interpreter)) return 1;
+        return runProgram(interpreter, module);
     }
 
     return 0;
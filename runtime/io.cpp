@@ -0,0 +1,187 @@
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <vector>
+
+#include "runtime/io.h"
+
+namespace pie { namespace io {
+
+static void catchCrashes();
+
+Writer::Writer(int fd)
+    : fd(fd), interactive(fd == 2 || (fd == 1 && isatty(fd))), used(0), buffer(new char[kBufferSize])
+{
+    if (fd == 1) {
+        catchCrashes();
+    }
+}
+
+Writer::~Writer()
+{
+    flush();
+    if (fd > 2) {
+        ::close(fd);
+    }
+}
+
+void Writer::write(const char *bytes, size_t length)
+{
+    if (used + length > kBufferSize) {
+        flush();
+        // Too big to be worth copying into the buffer
+        if (length >= kBufferSize) {
+            while (length > 0) {
+                ssize_t n = ::write(fd, bytes, length);
+                if (n < 0) {
+                    if (errno == EINTR) continue;
+                    return;
+                }
+                bytes += n;
+                length -= (size_t)n;
+            }
+            return;
+        }
+    }
+    std::memcpy(buffer.get() + used, bytes, length);
+    used += length;
+}
+
+bool Writer::flush()
+{
+    if (fd == 2) {
+        out().flush();
+    }
+
+    const char *bytes = buffer.get();
+    size_t left = used;
+    used = 0;
+    while (left > 0) {
+        ssize_t n = ::write(fd, bytes, left);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        bytes += n;
+        left -= (size_t)n;
+    }
+    return true;
+}
+
+Writer &out()
+{
+    static Writer writer(1);
+    return writer;
+}
+
+Writer &err()
+{
+    // Flushing stderr goes through stdout, which has to outlive it
+    out();
+    static Writer writer(2);
+    return writer;
+}
+
+// Files opened by programs, the writer of handle h is files[h - 3]
+static std::vector<std::unique_ptr<Writer>> &files()
+{
+    static std::vector<std::unique_ptr<Writer>> files;
+    return files;
+}
+
+int64_t open(const std::string &path, bool append)
+{
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC);
+    int fd = ::open(path.c_str(), flags, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+
+    std::vector<std::unique_ptr<Writer>> &open_files = files();
+    for (size_t i = 0; i < open_files.size(); i++) {
+        if (!open_files[i]) {
+            open_files[i].reset(new Writer(fd));
+            return (int64_t)i + 3;
+        }
+    }
+    open_files.emplace_back(new Writer(fd));
+    return (int64_t)open_files.size() + 2;
+}
+
+bool close(int64_t handle)
+{
+    std::vector<std::unique_ptr<Writer>> &open_files = files();
+    if (handle < 3 || handle - 3 >= (int64_t)open_files.size() || !open_files[handle - 3]) {
+        return false;
+    }
+    bool ok = open_files[handle - 3]->flush();
+    open_files[handle - 3].reset();
+    return ok;
+}
+
+Writer *writer(int64_t handle)
+{
+    if (handle == kStdout) return &out();
+    if (handle == kStderr) return &err();
+
+    std::vector<std::unique_ptr<Writer>> &open_files = files();
+    if (handle < 3 || handle - 3 >= (int64_t)open_files.size()) {
+        return nullptr;
+    }
+    return open_files[handle - 3].get();
+}
+
+// A crash writes out the buffers before the signal takes its previous
+// action. stderr holds nothing between calls. flush() only calls write(),
+// which a signal handler may call.
+static const int kFatalSignals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+static struct sigaction previous[sizeof(kFatalSignals) / sizeof(kFatalSignals[0])];
+
+static void flushOnCrash(int sig, siginfo_t *info, void *)
+{
+    for (std::unique_ptr<Writer> &file : files()) {
+        if (file) file->flush();
+    }
+    out().flush();
+
+    for (size_t i = 0; i < sizeof(kFatalSignals) / sizeof(kFatalSignals[0]); i++) {
+        if (kFatalSignals[i] == sig) sigaction(sig, &previous[i], nullptr);
+    }
+    // A faulting instruction faults again once this returns, a signal
+    // that was sent (abort()) has to be sent again
+    if (info->si_code <= 0) {
+        raise(sig);
+    }
+}
+
+static void catchCrashes()
+{
+    // A stack overflow leaves no stack to run the handler on
+    static char stack[64 * 1024];
+    stack_t alternate;
+    alternate.ss_sp = stack;
+    alternate.ss_size = sizeof(stack);
+    alternate.ss_flags = 0;
+    sigaltstack(&alternate, nullptr);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = flushOnCrash;
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigemptyset(&action.sa_mask);
+    for (size_t i = 0; i < sizeof(kFatalSignals) / sizeof(kFatalSignals[0]); i++) {
+        sigaction(kFatalSignals[i], &action, &previous[i]);
+    }
+}
+
+void flushAll()
+{
+    for (std::unique_ptr<Writer> &file : files()) {
+        if (file) file->flush();
+    }
+    err().flush();
+}
+
+}}
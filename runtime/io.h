@@ -0,0 +1,76 @@
+#ifndef __PIE_IO__
+#define __PIE_IO__
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace pie { namespace io {
+
+// Output layer of the std.io native module: a userspace buffer in front
+// of a file descriptor, written out when full or on flush(). What stdout
+// and the files buffered is also written out when the process crashes on
+// a fatal signal (SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT).
+class Writer
+{
+public:
+    static const size_t kBufferSize = 64 * 1024;
+
+    // Takes ownership of fd unless it is stdout or stderr
+    explicit Writer(int fd);
+    ~Writer();
+
+    Writer(const Writer &) = delete;
+    Writer &operator=(const Writer &) = delete;
+
+    void write(const char *bytes, size_t length);
+    void write(const std::string &text) { write(text.data(), text.size()); }
+    void put(char c)
+    {
+        if (used == kBufferSize) flush();
+        buffer[used++] = c;
+    }
+
+    // False when the descriptor refused the bytes. Flushing stderr
+    // flushes stdout first, so the two stay in order on a terminal.
+    bool flush();
+
+    // Ends one call of a builtin that wrote here, stderr and a terminal
+    // are not kept buffered across calls
+    void done()
+    {
+        if (interactive) flush();
+    }
+
+private:
+    int fd;
+    bool interactive;
+    size_t used;
+    std::unique_ptr<char[]> buffer;
+};
+
+// Handles as seen by programs: 1 and 2 are stdout and stderr, open()
+// numbers files from 3
+enum : int64_t {
+    kStdout = 1,
+    kStderr = 2
+};
+
+Writer &out();
+Writer &err();
+
+// Opens path for writing, truncated or appended to, -1 on failure
+int64_t open(const std::string &path, bool append);
+// Flushes and closes a handle from open(), false for any other handle
+bool close(int64_t handle);
+// The writer behind handle, null when it is not open
+Writer *writer(int64_t handle);
+
+// Writes out everything buffered: before exiting, before an error message
+// and before anything else writes to the terminal
+void flushAll();
+
+}}
+
+#endif
@@ -0,0 +1,128 @@
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "runtime/string.h"
+
+namespace pie {
+
+String *String::make(const std::string &bytes)
+{
+    return make(std::string(bytes));
+}
+
+String *String::make(std::string &&bytes)
+{
+    String *s = new String();
+    s->flat = std::move(bytes);
+    s->size = s->flat.size();
+    s->bytes = s->flat.data();
+    return s;
+}
+
+String *String::concat(String *lhs, String *rhs)
+{
+    if (rhs->empty() || lhs->empty()) {
+        String *s = rhs->empty() ? lhs : rhs;
+        s->refcount++;
+        return s;
+    }
+
+    size_t total = lhs->size + rhs->size;
+    if (total <= kFlatLimit) {
+        std::string bytes;
+        bytes.reserve(total);
+        bytes.append(lhs->data(), lhs->size);
+        bytes.append(rhs->data(), rhs->size);
+        return make(std::move(bytes));
+    }
+
+    String *s = new String();
+    s->kind = Kind::Rope;
+    s->size = total;
+    s->left = lhs;
+    s->right = rhs;
+    lhs->refcount++;
+    rhs->refcount++;
+    return s;
+}
+
+String *String::slice(String *s, size_t start, size_t length)
+{
+    start = std::min(start, s->size);
+    length = std::min(length, s->size - start);
+    if (start == 0 && length == s->size) {
+        s->refcount++;
+        return s;
+    }
+    if (length == 0) {
+        return make(std::string());
+    }
+
+    const char *bytes = s->data();
+    String *view = new String();
+    view->kind = Kind::Slice;
+    view->size = length;
+    view->bytes = bytes + start;
+    // Slices of slices point at the flat string underneath
+    view->left = s->kind == Kind::Slice ? s->left : s;
+    view->left->refcount++;
+    return view;
+}
+
+bool String::equals(String *lhs, String *rhs)
+{
+    if (lhs == rhs) return true;
+    if (lhs->size != rhs->size) return false;
+    return std::memcmp(lhs->data(), rhs->data(), lhs->size) == 0;
+}
+
+// Joins the leaves left to right without recursing, a string built one
+// piece at a time is a rope as deep as the number of pieces
+void String::flatten()
+{
+    std::string joined;
+    joined.reserve(size);
+
+    std::vector<String *> pending(1, this);
+    while (!pending.empty()) {
+        String *s = pending.back();
+        pending.pop_back();
+        if (s->kind == Kind::Rope) {
+            pending.push_back(s->right);
+            pending.push_back(s->left);
+        } else {
+            joined.append(s->bytes, s->size);
+        }
+    }
+
+    String *lhs = left, *rhs = right;
+    kind = Kind::Flat;
+    flat = std::move(joined);
+    bytes = flat.data();
+    left = right = nullptr;
+    release(lhs);
+    release(rhs);
+}
+
+void String::destroy(String *s)
+{
+    if (s->kind == Kind::Flat) {
+        delete s;
+        return;
+    }
+
+    // Deep ropes are freed with a worklist for the same reason
+    std::vector<String *> dead(1, s);
+    while (!dead.empty()) {
+        String *d = dead.back();
+        dead.pop_back();
+        String *parts[] = { d->left, d->right };
+        for (String *part : parts) {
+            if (part && --part->refcount == 0) dead.push_back(part);
+        }
+        delete d;
+    }
+}
+
+}
@@ -0,0 +1,79 @@
+#ifndef __PIE_STRING__
+#define __PIE_STRING__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace pie {
+
+// Immutable heap string shared by reference count, used for the string
+// values of every engine.
+//
+// Concatenation is lazy: unless the result is short, it makes a rope node
+// holding both halves, so building a string piece by piece does not copy
+// the prefix again on every step. The bytes are joined the first time
+// they are needed (data(), str(), equals()) and the rope then becomes
+// flat in place. A slice shares the bytes of its parent instead of
+// copying them. length() never flattens.
+class String
+{
+public:
+    uint32_t refcount;
+
+    static String *make(const std::string &bytes);
+    static String *make(std::string &&bytes);
+
+    // lhs followed by rhs, both stay owned by the caller
+    static String *concat(String *lhs, String *rhs);
+
+    // length bytes of s from start, clamped to its end
+    static String *slice(String *s, size_t start, size_t length);
+
+    static void release(String *s)
+    {
+        if (--s->refcount == 0) {
+            destroy(s);
+        }
+    }
+
+    size_t length() const { return size; }
+    bool empty() const { return size == 0; }
+
+    // The contiguous bytes, not null terminated
+    const char *data()
+    {
+        if (kind == Kind::Rope) flatten();
+        return bytes;
+    }
+
+    std::string str() { return std::string(data(), size); }
+
+    static bool equals(String *lhs, String *rhs);
+
+private:
+    enum class Kind : uint8_t {
+        Flat,   // owns flat
+        Rope,   // left followed by right, bytes is null
+        Slice   // bytes point into left, a flat string
+    };
+
+    // Concatenations up to this many bytes are copied instead of roped
+    static const size_t kFlatLimit = 64;
+
+    Kind kind;
+    size_t size;
+    const char *bytes;
+    std::string flat;
+    String *left;
+    String *right;
+
+    String() : refcount(1), kind(Kind::Flat), size(0), bytes(nullptr), left(nullptr), right(nullptr) {}
+
+    void flatten();
+    static void destroy(String *s);
+};
+
+}
+
+#endif
@@ -1,8 +1,158 @@
 #ifndef __PIE_VM_BYTECODE__
 #define __PIE_VM_BYTECODE__
 
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "runtime/vm/value.h"
+
 namespace pie { namespace vm {
 
+/*
+ * Register machine instruction set. R[x] is a register of the current
+ * frame, K[x] a constant of the current function, G[x] a global slot.
+ * Bx is the unsigned 32 bit operand made of b|c<<16, sBx its signed form
+ * used for pc relative jumps.
+ */
+#define VM_OPCODES                                                  \
+    OPCODE(Nop)             /*                                  */  \
+    OPCODE(LoadNil)         /* R[a] = nil                       */  \
+    OPCODE(LoadK)           /* R[a] = K[Bx]                     */  \
+    OPCODE(LoadGlobal)      /* R[a] = G[Bx]                     */  \
+    OPCODE(StoreGlobal)     /* G[Bx] = R[a]                     */  \
+    OPCODE(Move)            /* R[a] = R[b]                      */  \
+    OPCODE(Add)             /* R[a] = R[b] + R[c]               */  \
+    OPCODE(AddNum)          /* R[a] = R[b] + R[c], no concat    */  \
+    OPCODE(Sub)             /* R[a] = R[b] - R[c]               */  \
+    OPCODE(Mul)             /* R[a] = R[b] * R[c]               */  \
+    OPCODE(Div)             /* R[a] = R[b] / R[c]               */  \
+    OPCODE(Mod)             /* R[a] = R[b] % R[c]               */  \
+    OPCODE(Lt)              /* R[a] = R[b] < R[c]               */  \
+    OPCODE(Gt)              /* R[a] = R[b] > R[c]               */  \
+    OPCODE(Le)              /* R[a] = R[b] <= R[c]              */  \
+    OPCODE(Ge)              /* R[a] = R[b] >= R[c]              */  \
+    OPCODE(Eq)              /* R[a] = R[b] == R[c]              */  \
+    OPCODE(Ne)              /* R[a] = R[b] != R[c]              */  \
+    OPCODE(AddI)            /* R[a] = R[b] + R[c], both ints    */  \
+    OPCODE(SubI)            /* R[a] = R[b] - R[c], both ints    */  \
+    OPCODE(MulI)            /* R[a] = R[b] * R[c], both ints    */  \
+    OPCODE(DivI)            /* R[a] = R[b] / R[c], both ints    */  \
+    OPCODE(ModI)            /* R[a] = R[b] % R[c], both ints    */  \
+    OPCODE(LtI)             /* R[a] = R[b] < R[c], both ints    */  \
+    OPCODE(LeI)             /* R[a] = R[b] <= R[c], both ints   */  \
+    OPCODE(EqI)             /* R[a] = R[b] == R[c], both ints   */  \
+    OPCODE(NeI)             /* R[a] = R[b] != R[c], both ints   */  \
+    OPCODE(AddD)            /* R[a] = R[b] + R[c], both doubles */  \
+    OPCODE(SubD)            /* R[a] = R[b] - R[c], both doubles */  \
+    OPCODE(MulD)            /* R[a] = R[b] * R[c], both doubles */  \
+    OPCODE(DivD)            /* R[a] = R[b] / R[c], both doubles */  \
+    OPCODE(LtD)             /* R[a] = R[b] < R[c], both doubles */  \
+    OPCODE(LeD)             /* R[a] = R[b] <= R[c], both doubles*/  \
+    OPCODE(EqD)             /* R[a] = R[b] == R[c], both doubles*/  \
+    OPCODE(NeD)             /* R[a] = R[b] != R[c], both doubles*/  \
+    OPCODE(CastInt)         /* R[a] = R[b], error if not an int */  \
+    OPCODE(CastDouble)      /* R[a] = double(R[b]), int or double */ \
+    OPCODE(Neg)             /* R[a] = -R[b]                     */  \
+    OPCODE(Not)             /* R[a] = !R[b]                     */  \
+    OPCODE(Bool)            /* R[a] = bool(R[b])                */  \
+    OPCODE(Jmp)             /* pc += sBx                        */  \
+    OPCODE(JmpIf)           /* if R[a] then pc += sBx           */  \
+    OPCODE(JmpIfNot)        /* if not R[a] then pc += sBx       */  \
+    OPCODE(Call)            /* R[a] = R[a](R[a+1] .. R[a+b]),   */  \
+                            /*   K[c] is the callee name        */  \
+    OPCODE(CallGlobal)      /* R[a] = G[c](R[a+1] .. R[a+b])    */  \
+    OPCODE(TailCall)        /* return R[a](R[a+1] .. R[a+b])    */  \
+    OPCODE(TailCallGlobal)  /* return G[c](R[a+1] .. R[a+b])    */  \
+    OPCODE(Return)          /* return R[a]                      */  \
+    OPCODE(ReturnNil)       /* return nil                       */
+
+enum class Opcode : uint8_t {
+#define OPCODE(op) op,
+    VM_OPCODES
+#undef OPCODE
+};
+
+const char *opcodeName(Opcode op);
+
+struct Instruction {
+    Opcode op;
+    uint16_t a;
+    uint16_t b;
+    uint16_t c;
+
+    Instruction(Opcode op, uint16_t a = 0, uint16_t b = 0, uint16_t c = 0)
+        : op(op), a(a), b(b), c(c) {}
+
+    uint32_t bx() const {
+        return (uint32_t)b | ((uint32_t)c << 16);
+    }
+
+    int32_t sbx() const {
+        return (int32_t)bx();
+    }
+
+    void setBx(uint32_t v) {
+        b = (uint16_t)(v & 0xffff);
+        c = (uint16_t)(v >> 16);
+    }
+};
+
+// A compiled function: code plus its constant pool
+struct Function {
+    std::string name;
+    uint16_t num_params;
+    uint16_t num_regs;
+    std::vector<Instruction> code;
+    std::vector<Value> constants;
+
+    Function(const std::string &name) : name(name), num_params(0), num_regs(0) {}
+};
+
+// Native builtins receive their arguments in place on the register stack
+typedef Value (*NativeFn)(Value *args, int nargs);
+
+// As pie::compiler::Builtin: the interpreter checks the number of
+// arguments before fn runs, pure builtins have no effect
+struct Builtin {
+    static const uint8_t kVariadic = 255;  // as max_args, no limit
+
+    const char *name;
+    NativeFn fn;
+    uint8_t min_args;
+    uint8_t max_args;
+    bool pure;
+};
+
+struct Global {
+    std::string name;
+    Value value;
+    bool defined;
+
+    Global(const std::string &name) : name(name), defined(false) {}
+};
+
+// A compiled module ready to be executed by the Interpreter
+class Program {
+public:
+    Program() : main(nullptr) {}
+
+    Function *newFunction(const std::string &name);
+
+    // Slot of a global, reserving an undefined one for unknown names
+    uint32_t globalSlot(const std::string &name);
+    void defineGlobal(const std::string &name, const Value &value);
+
+    std::string disassemble() const;
+
+public:
+    std::vector<std::unique_ptr<Function>> functions;
+    std::vector<Global> globals;
+    std::map<std::string, uint32_t> global_slots;
+    Function *main;
+};
 
 }}
 #endif
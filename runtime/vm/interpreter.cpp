@@ -0,0 +1,531 @@
+#include <stdexcept>
+#include <string>
+
+#include "runtime/vm/interpreter.h"
+
+#if defined(__GNUC__)
+# define VM_COMPUTED_GOTO 1
+#else
+# define VM_COMPUTED_GOTO 0
+#endif
+
+namespace pie { namespace vm {
+
+static const size_t kInitialStackSize = 1024;
+static const size_t kMaxStackSize = 1 << 22;
+
+Interpreter::Interpreter() : program(nullptr)
+{
+    stack.resize(kInitialStackSize);
+}
+
+Value Interpreter::run(Program &program)
+{
+    this->program = &program;
+
+    if (!program.main) {
+        return Value::makeNil();
+    }
+
+    return execute(program.main);
+}
+
+void Interpreter::growStack(size_t needed)
+{
+    if (needed > kMaxStackSize) {
+        throw std::runtime_error("Stack overflow");
+    }
+
+    size_t size = stack.size();
+    while (size < needed) {
+        size *= 2;
+    }
+    stack.resize(size);
+}
+
+// Same message as the other engines
+[[noreturn]] static void arityError(const Builtin *builtin, int nargs)
+{
+    std::string expected;
+    if (builtin->max_args == Builtin::kVariadic) {
+        expected = "at least " + std::to_string(builtin->min_args);
+    } else if (builtin->min_args == builtin->max_args) {
+        expected = std::to_string(builtin->min_args);
+    } else {
+        expected = std::to_string(builtin->min_args) + " to " + std::to_string(builtin->max_args);
+    }
+    bool one = builtin->min_args == 1 && builtin->max_args == 1;
+    throw std::runtime_error(std::string(builtin->name) + ": expected " + expected +
+                             (one ? " argument" : " arguments") + ", got " + std::to_string(nargs));
+}
+
+static inline void concat(Value &dst, const Value &lhs, const Value &rhs)
+{
+    dst = Value::concat(lhs, rhs);
+}
+
+static inline bool equals(const Value &lhs, const Value &rhs)
+{
+    if (lhs.type == Value::Type::String && rhs.type == Value::Type::String) {
+        return String::equals(lhs.string_val, rhs.string_val);
+    }
+    if (lhs.isNumeric() && rhs.isNumeric()) {
+        return lhs.toDouble() == rhs.toDouble();
+    }
+    return lhs.type == rhs.type && lhs.toBool() == rhs.toBool();
+}
+
+Value Interpreter::execute(Function *entry)
+{
+    frames.clear();
+    if (entry->num_regs > stack.size()) {
+        growStack(entry->num_regs);
+    }
+    for (size_t i = 0; i < entry->num_params; i++) {
+        stack[i] = Value::makeNil();
+    }
+    frames.push_back({ entry, entry->code.data(), 0, 0 });
+
+    Function *fn;
+    const Instruction *pc;
+    size_t base;
+    Value *R;
+    const Value *K;
+    Instruction ins(Opcode::Nop);
+
+#define LOAD_FRAME() do {                   \
+        const Frame &frame = frames.back(); \
+        fn = frame.function;                \
+        pc = frame.pc;                      \
+        base = frame.base;                  \
+        R = stack.data() + base;            \
+        K = fn->constants.data();           \
+    } while (0)
+
+#if VM_COMPUTED_GOTO
+    static void *dispatch_table[] = {
+#define OPCODE(op) &&op_##op,
+        VM_OPCODES
+#undef OPCODE
+    };
+# define DISPATCH() do { ins = *pc++; goto *dispatch_table[(size_t)ins.op]; } while (0)
+# define CASE(op) op_##op:
+#else
+# define DISPATCH() break
+# define CASE(op) case Opcode::op:
+#endif
+
+#define INT_OR_DOUBLE(OP) do {                                          \
+        const Value &lhs = R[ins.b];                                    \
+        const Value &rhs = R[ins.c];                                    \
+        if (lhs.type == Value::Type::Int && rhs.type == Value::Type::Int) { \
+            R[ins.a].setInt(lhs.int_val OP rhs.int_val);                \
+        } else {                                                        \
+            R[ins.a].setDouble(lhs.toDouble() OP rhs.toDouble());       \
+        }                                                               \
+    } while (0)
+
+#define COMPARE(OP) do {                                                \
+        R[ins.a].setBool(R[ins.b].toDouble() OP R[ins.c].toDouble());   \
+    } while (0)
+
+    LOAD_FRAME();
+
+    const Value *callee;
+    const char *callee_name;
+    bool tail;
+
+#if VM_COMPUTED_GOTO
+    DISPATCH();
+#else
+    for (;;) {
+        ins = *pc++;
+        switch (ins.op) {
+#endif
+
+    CASE(Nop)
+        DISPATCH();
+
+    CASE(LoadNil)
+        R[ins.a] = Value::makeNil();
+        DISPATCH();
+
+    CASE(LoadK)
+        R[ins.a] = K[ins.bx()];
+        DISPATCH();
+
+    CASE(LoadGlobal)
+    {
+        const Global &global = program->globals[ins.bx()];
+        if (!global.defined) {
+            throw std::runtime_error("Undefined variable: " + global.name);
+        }
+        R[ins.a] = global.value;
+        DISPATCH();
+    }
+
+    CASE(StoreGlobal)
+    {
+        Global &global = program->globals[ins.bx()];
+        if (!global.defined) {
+            throw std::runtime_error("Undefined variable: " + global.name);
+        }
+        global.value = R[ins.a];
+        DISPATCH();
+    }
+
+    CASE(Move)
+        R[ins.a] = R[ins.b];
+        DISPATCH();
+
+    CASE(Add)
+    {
+        const Value &lhs = R[ins.b];
+        const Value &rhs = R[ins.c];
+        if (lhs.type == Value::Type::Int && rhs.type == Value::Type::Int) {
+            R[ins.a].setInt(lhs.int_val + rhs.int_val);
+        } else if (lhs.type == Value::Type::String || rhs.type == Value::Type::String) {
+            concat(R[ins.a], lhs, rhs);
+        } else {
+            R[ins.a].setDouble(lhs.toDouble() + rhs.toDouble());
+        }
+        DISPATCH();
+    }
+
+    CASE(AddNum)
+        INT_OR_DOUBLE(+);
+        DISPATCH();
+
+    CASE(Sub)
+        INT_OR_DOUBLE(-);
+        DISPATCH();
+
+    CASE(Mul)
+        INT_OR_DOUBLE(*);
+        DISPATCH();
+
+    CASE(Div)
+    {
+        const Value &lhs = R[ins.b];
+        const Value &rhs = R[ins.c];
+        if (rhs.toDouble() == 0.0) {
+            throw std::runtime_error("Division by zero");
+        }
+        if (lhs.type == Value::Type::Int && rhs.type == Value::Type::Int) {
+            R[ins.a].setInt(lhs.int_val / rhs.int_val);
+        } else {
+            R[ins.a].setDouble(lhs.toDouble() / rhs.toDouble());
+        }
+        DISPATCH();
+    }
+
+    CASE(Mod)
+    {
+        int64_t rhs = R[ins.c].toInt();
+        if (rhs == 0) {
+            throw std::runtime_error("Modulo by zero");
+        }
+        R[ins.a].setInt(R[ins.b].toInt() % rhs);
+        DISPATCH();
+    }
+
+    CASE(Lt)
+        COMPARE(<);
+        DISPATCH();
+
+    CASE(Gt)
+        COMPARE(>);
+        DISPATCH();
+
+    CASE(Le)
+        COMPARE(<=);
+        DISPATCH();
+
+    CASE(Ge)
+        COMPARE(>=);
+        DISPATCH();
+
+    CASE(Eq)
+        R[ins.a].setBool(equals(R[ins.b], R[ins.c]));
+        DISPATCH();
+
+    CASE(Ne)
+        R[ins.a].setBool(!equals(R[ins.b], R[ins.c]));
+        DISPATCH();
+
+    // Typed forms emitted when TypeCheckVisitor proved both operands,
+    // ints still compare as doubles like the generic opcodes
+    CASE(AddI)
+        R[ins.a].setInt(R[ins.b].int_val + R[ins.c].int_val);
+        DISPATCH();
+
+    CASE(SubI)
+        R[ins.a].setInt(R[ins.b].int_val - R[ins.c].int_val);
+        DISPATCH();
+
+    CASE(MulI)
+        R[ins.a].setInt(R[ins.b].int_val * R[ins.c].int_val);
+        DISPATCH();
+
+    CASE(DivI)
+    {
+        int64_t rhs = R[ins.c].int_val;
+        if (rhs == 0) {
+            throw std::runtime_error("Division by zero");
+        }
+        R[ins.a].setInt(R[ins.b].int_val / rhs);
+        DISPATCH();
+    }
+
+    CASE(ModI)
+    {
+        int64_t rhs = R[ins.c].int_val;
+        if (rhs == 0) {
+            throw std::runtime_error("Modulo by zero");
+        }
+        R[ins.a].setInt(R[ins.b].int_val % rhs);
+        DISPATCH();
+    }
+
+    CASE(LtI)
+        R[ins.a].setBool((double)R[ins.b].int_val < (double)R[ins.c].int_val);
+        DISPATCH();
+
+    CASE(LeI)
+        R[ins.a].setBool((double)R[ins.b].int_val <= (double)R[ins.c].int_val);
+        DISPATCH();
+
+    CASE(EqI)
+        R[ins.a].setBool((double)R[ins.b].int_val == (double)R[ins.c].int_val);
+        DISPATCH();
+
+    CASE(NeI)
+        R[ins.a].setBool((double)R[ins.b].int_val != (double)R[ins.c].int_val);
+        DISPATCH();
+
+    CASE(AddD)
+        R[ins.a].setDouble(R[ins.b].double_val + R[ins.c].double_val);
+        DISPATCH();
+
+    CASE(SubD)
+        R[ins.a].setDouble(R[ins.b].double_val - R[ins.c].double_val);
+        DISPATCH();
+
+    CASE(MulD)
+        R[ins.a].setDouble(R[ins.b].double_val * R[ins.c].double_val);
+        DISPATCH();
+
+    CASE(DivD)
+    {
+        double rhs = R[ins.c].double_val;
+        if (rhs == 0.0) {
+            throw std::runtime_error("Division by zero");
+        }
+        R[ins.a].setDouble(R[ins.b].double_val / rhs);
+        DISPATCH();
+    }
+
+    CASE(LtD)
+        R[ins.a].setBool(R[ins.b].double_val < R[ins.c].double_val);
+        DISPATCH();
+
+    CASE(LeD)
+        R[ins.a].setBool(R[ins.b].double_val <= R[ins.c].double_val);
+        DISPATCH();
+
+    CASE(EqD)
+        R[ins.a].setBool(R[ins.b].double_val == R[ins.c].double_val);
+        DISPATCH();
+
+    CASE(NeD)
+        R[ins.a].setBool(R[ins.b].double_val != R[ins.c].double_val);
+        DISPATCH();
+
+    CASE(CastInt)
+    {
+        const Value &val = R[ins.b];
+        if (val.type != Value::Type::Int) {
+            throw std::runtime_error(std::string("Type error: expected int, got ") + val.typeName());
+        }
+        R[ins.a] = val;
+        DISPATCH();
+    }
+
+    CASE(CastDouble)
+    {
+        const Value &val = R[ins.b];
+        if (val.type == Value::Type::Int) {
+            R[ins.a].setDouble((double)val.int_val);
+        } else if (val.type == Value::Type::Double) {
+            R[ins.a] = val;
+        } else {
+            throw std::runtime_error(std::string("Type error: expected double, got ") + val.typeName());
+        }
+        DISPATCH();
+    }
+
+    CASE(Neg)
+    {
+        const Value &val = R[ins.b];
+        if (val.type == Value::Type::Int) {
+            R[ins.a].setInt(-val.int_val);
+        } else {
+            R[ins.a].setDouble(-val.toDouble());
+        }
+        DISPATCH();
+    }
+
+    CASE(Not)
+        R[ins.a].setBool(!R[ins.b].toBool());
+        DISPATCH();
+
+    CASE(Bool)
+        R[ins.a].setBool(R[ins.b].toBool());
+        DISPATCH();
+
+    CASE(Jmp)
+        pc += ins.sbx();
+        DISPATCH();
+
+    CASE(JmpIf)
+        if (R[ins.a].toBool()) {
+            pc += ins.sbx();
+        }
+        DISPATCH();
+
+    CASE(JmpIfNot)
+        if (!R[ins.a].toBool()) {
+            pc += ins.sbx();
+        }
+        DISPATCH();
+
+    CASE(Call)
+        callee = &R[ins.a];
+        callee_name = nullptr;
+        tail = false;
+        goto do_call;
+
+    CASE(CallGlobal)
+    {
+        const Global &global = program->globals[ins.c];
+        if (!global.defined) {
+            throw std::runtime_error("Undefined function: " + global.name);
+        }
+        callee = &global.value;
+        callee_name = global.name.c_str();
+        tail = false;
+        goto do_call;
+    }
+
+    CASE(TailCall)
+        callee = &R[ins.a];
+        callee_name = nullptr;
+        tail = true;
+        goto do_call;
+
+    CASE(TailCallGlobal)
+    {
+        const Global &global = program->globals[ins.c];
+        if (!global.defined) {
+            throw std::runtime_error("Undefined function: " + global.name);
+        }
+        callee = &global.value;
+        callee_name = global.name.c_str();
+        tail = true;
+        goto do_call;
+    }
+
+    CASE(Return)
+do_return:
+    {
+        Value ret = std::move(R[ins.a]);
+        size_t slot = frames.back().ret;
+        frames.pop_back();
+        if (frames.empty()) {
+            return ret;
+        }
+        stack[slot] = std::move(ret);
+        LOAD_FRAME();
+        DISPATCH();
+    }
+
+    CASE(ReturnNil)
+    {
+        size_t slot = frames.back().ret;
+        frames.pop_back();
+        if (frames.empty()) {
+            return Value::makeNil();
+        }
+        stack[slot] = Value::makeNil();
+        LOAD_FRAME();
+        DISPATCH();
+    }
+
+#if !VM_COMPUTED_GOTO
+        }
+        continue;
+#endif
+
+do_call:
+    if (callee->type == Value::Type::Function && tail) {
+        // The callee takes over the running frame: its arguments move down
+        // to the base and the caller's other registers are released
+        Function *target = callee->function_val;
+        size_t used = base + fn->num_regs;
+        size_t needed = base + target->num_regs;
+        if (needed > stack.size()) {
+            growStack(needed);
+        }
+        for (size_t i = 0; i < ins.b; i++) {
+            stack[base + i] = std::move(stack[base + ins.a + 1 + i]);
+        }
+        for (size_t i = base + ins.b; i < used; i++) {
+            stack[i] = Value();
+        }
+        for (size_t i = ins.b; i < target->num_params; i++) {
+            stack[base + i] = Value::makeNil();
+        }
+        Frame &frame = frames.back();
+        frame.function = target;
+        frame.pc = target->code.data();
+        LOAD_FRAME();
+    } else if (callee->type == Value::Type::Function) {
+        Function *target = callee->function_val;
+        size_t new_base = base + ins.a + 1;
+        size_t needed = new_base + target->num_regs;
+
+        frames.back().pc = pc;
+        if (needed > stack.size()) {
+            growStack(needed);
+        }
+        for (size_t i = ins.b; i < target->num_params; i++) {
+            stack[new_base + i] = Value::makeNil();
+        }
+        frames.push_back({ target, target->code.data(), new_base, base + ins.a });
+        LOAD_FRAME();
+    } else if (callee->type == Value::Type::Builtin) {
+        const Builtin *builtin = callee->builtin_val;
+        if (ins.b < builtin->min_args || (ins.b > builtin->max_args && builtin->max_args != Builtin::kVariadic)) {
+            arityError(builtin, ins.b);
+        }
+        R[ins.a] = builtin->fn(&R[ins.a + 1], ins.b);
+        if (tail) goto do_return;
+    } else {
+        std::string name = callee_name ? callee_name : K[ins.c].toString();
+        throw std::runtime_error("Not a function: " + name);
+    }
+
+#if VM_COMPUTED_GOTO
+    DISPATCH();
+#else
+    }
+#endif
+
+#undef LOAD_FRAME
+#undef DISPATCH
+#undef CASE
+#undef INT_OR_DOUBLE
+#undef COMPARE
+}
+
+}}
@@ -0,0 +1,37 @@
+#ifndef __PIE_VM_INTERPRETER__
+#define __PIE_VM_INTERPRETER__
+
+#include <vector>
+
+#include "runtime/vm/bytecode.h"
+
+namespace pie { namespace vm {
+
+// Executes a Program. All frames share one register stack, a call only
+// moves the frame base so arguments are passed without copying.
+class Interpreter
+{
+public:
+    Interpreter();
+
+    Value run(Program &program);
+
+private:
+    struct Frame {
+        Function *function;
+        const Instruction *pc;
+        size_t base;
+        size_t ret;     // stack index receiving the return value
+    };
+
+    std::vector<Value> stack;
+    std::vector<Frame> frames;
+    Program *program;
+
+    Value execute(Function *entry);
+    void growStack(size_t needed);
+};
+
+}}
+
+#endif
@@ -0,0 +1,202 @@
+#ifndef __PIE_VM_VALUE__
+#define __PIE_VM_VALUE__
+
+#include <cstdint>
+#include <string>
+#include <utility>
+
+#include "runtime/string.h"
+
+namespace pie { namespace vm {
+
+struct Function;
+struct Builtin;
+
+// Register value: a type tag plus an 8 byte payload. Only strings own
+// heap memory, every other type is copied by value.
+class Value {
+public:
+    enum class Type : uint8_t {
+        Nil,
+        Int,
+        Double,
+        Bool,
+        String,
+        Function,
+        Builtin
+    };
+
+    Type type;
+    union {
+        uint64_t bits;
+        int64_t int_val;
+        double double_val;
+        bool bool_val;
+        String *string_val;
+        Function *function_val;
+        const Builtin *builtin_val;
+    };
+
+    Value() : type(Type::Nil), bits(0) {}
+
+    Value(const Value &other) : type(other.type), bits(other.bits)
+    {
+        if (type == Type::String) string_val->refcount++;
+    }
+
+    Value(Value &&other) noexcept : type(other.type), bits(other.bits)
+    {
+        other.type = Type::Nil;
+    }
+
+    ~Value()
+    {
+        release();
+    }
+
+    Value &operator=(const Value &other)
+    {
+        if (other.type == Type::String) other.string_val->refcount++;
+        release();
+        type = other.type;
+        bits = other.bits;
+        return *this;
+    }
+
+    Value &operator=(Value &&other) noexcept
+    {
+        if (this != &other) {
+            release();
+            type = other.type;
+            bits = other.bits;
+            other.type = Type::Nil;
+        }
+        return *this;
+    }
+
+    static Value makeNil() {
+        return Value();
+    }
+
+    static Value makeInt(int64_t v) {
+        Value val;
+        val.type = Type::Int;
+        val.int_val = v;
+        return val;
+    }
+
+    static Value makeDouble(double v) {
+        Value val;
+        val.type = Type::Double;
+        val.double_val = v;
+        return val;
+    }
+
+    static Value makeBool(bool v) {
+        Value val;
+        val.type = Type::Bool;
+        val.bits = 0;
+        val.bool_val = v;
+        return val;
+    }
+
+    static Value makeString(const std::string &v) {
+        Value val;
+        val.type = Type::String;
+        val.string_val = String::make(v);
+        return val;
+    }
+
+    static Value makeString(std::string &&v) {
+        Value val;
+        val.type = Type::String;
+        val.string_val = String::make(std::move(v));
+        return val;
+    }
+
+    // Shares the bytes of string operands, see String::concat
+    static Value concat(const Value &lhs, const Value &rhs) {
+        Value l = lhs.type == Type::String ? lhs : makeString(lhs.toString());
+        Value r = rhs.type == Type::String ? rhs : makeString(rhs.toString());
+        Value val;
+        val.type = Type::String;
+        val.string_val = String::concat(l.string_val, r.string_val);
+        return val;
+    }
+
+    static Value makeFunction(Function *fn) {
+        Value val;
+        val.type = Type::Function;
+        val.function_val = fn;
+        return val;
+    }
+
+    static Value makeBuiltin(const Builtin *fn) {
+        Value val;
+        val.type = Type::Builtin;
+        val.builtin_val = fn;
+        return val;
+    }
+
+    // In-place setters used by the interpreter loop to avoid temporaries
+    void setInt(int64_t v) {
+        release();
+        type = Type::Int;
+        int_val = v;
+    }
+
+    void setDouble(double v) {
+        release();
+        type = Type::Double;
+        double_val = v;
+    }
+
+    void setBool(bool v) {
+        release();
+        type = Type::Bool;
+        bits = 0;
+        bool_val = v;
+    }
+
+    double toDouble() const {
+        if (type == Type::Int) return (double)int_val;
+        if (type == Type::Double) return double_val;
+        return 0.0;
+    }
+
+    int64_t toInt() const {
+        if (type == Type::Int) return int_val;
+        if (type == Type::Double) return (int64_t)double_val;
+        return 0;
+    }
+
+    bool toBool() const {
+        switch (type) {
+            case Type::Nil: return false;
+            case Type::Bool: return bool_val;
+            case Type::Int: return int_val != 0;
+            case Type::Double: return double_val != 0.0;
+            case Type::String: return !string_val->empty();
+            default: return true;
+        }
+    }
+
+    bool isNumeric() const {
+        return type == Type::Int || type == Type::Double;
+    }
+
+    std::string toString() const;
+    const char *typeName() const;
+
+private:
+    void release()
+    {
+        if (type == Type::String) {
+            String::release(string_val);
+        }
+    }
+};
+
+}}
+
+#endif
@@ -0,0 +1,260 @@
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+
+#include "runtime/io.h"
+#include "runtime/vm/vm.h"
+
+namespace pie { namespace vm {
+
+std::string Value::toString() const
+{
+    switch (type) {
+        case Type::Nil: return "nil";
+        case Type::Bool: return bool_val ? "true" : "false";
+        case Type::Int: return std::to_string(int_val);
+        case Type::Double: return std::to_string(double_val);
+        case Type::String: return string_val->str();
+        case Type::Function: return "<function>";
+        case Type::Builtin: return "<builtin>";
+        default: return "<unknown>";
+    }
+}
+
+const char *Value::typeName() const
+{
+    switch (type) {
+        case Type::Nil: return "nil";
+        case Type::Int: return "int";
+        case Type::Double: return "double";
+        case Type::Bool: return "bool";
+        case Type::String: return "string";
+        case Type::Function: return "function";
+        case Type::Builtin: return "builtin";
+        default: return "unknown";
+    }
+}
+
+const char *opcodeName(Opcode op)
+{
+    switch (op) {
+#define OPCODE(name) case Opcode::name: return #name;
+        VM_OPCODES
+#undef OPCODE
+    }
+    return "<unknown>";
+}
+
+Function *Program::newFunction(const std::string &name)
+{
+    functions.emplace_back(new Function(name));
+    return functions.back().get();
+}
+
+uint32_t Program::globalSlot(const std::string &name)
+{
+    auto it = global_slots.find(name);
+    if (it != global_slots.end()) {
+        return it->second;
+    }
+
+    uint32_t slot = (uint32_t)globals.size();
+    globals.emplace_back(name);
+    global_slots[name] = slot;
+    return slot;
+}
+
+void Program::defineGlobal(const std::string &name, const Value &value)
+{
+    Global &global = globals[globalSlot(name)];
+    global.value = value;
+    global.defined = true;
+}
+
+static void disassembleFunction(std::stringstream &out, const Program &program, const Function &fn)
+{
+    out << "fn " << fn.name << " (params " << fn.num_params
+        << ", registers " << fn.num_regs << ")" << std::endl;
+
+    for (size_t i = 0; i < fn.code.size(); i++) {
+        const Instruction &ins = fn.code[i];
+        out << "  " << i << "\t" << opcodeName(ins.op) << "\t";
+
+        switch (ins.op) {
+            case Opcode::LoadK:
+                out << ins.a << " " << ins.bx() << "\t; " << fn.constants[ins.bx()].toString();
+                break;
+            case Opcode::LoadGlobal:
+            case Opcode::StoreGlobal:
+                out << ins.a << " " << ins.bx() << "\t; " << program.globals[ins.bx()].name;
+                break;
+            case Opcode::Jmp:
+                out << ins.sbx() << "\t; to " << (long)i + 1 + ins.sbx();
+                break;
+            case Opcode::JmpIf:
+            case Opcode::JmpIfNot:
+                out << ins.a << " " << ins.sbx() << "\t; to " << (long)i + 1 + ins.sbx();
+                break;
+            case Opcode::CallGlobal:
+            case Opcode::TailCallGlobal:
+                out << ins.a << " " << ins.b << " " << ins.c << "\t; " << program.globals[ins.c].name;
+                break;
+            default:
+                out << ins.a << " " << ins.b << " " << ins.c;
+                break;
+        }
+        out << std::endl;
+    }
+}
+
+std::string Program::disassemble() const
+{
+    std::stringstream out;
+    for (const auto &fn : functions) {
+        disassembleFunction(out, *this, *fn);
+        out << std::endl;
+    }
+    return out.str();
+}
+
+// Builtins
+
+// Writes args from first on, print separates them with spaces and ends
+// the line, write runs them together
+static void writeValues(io::Writer &writer, Value *args, int nargs, int first, bool line)
+{
+    for (int i = first; i < nargs; i++) {
+        if (line && i > first) writer.put(' ');
+        if (args[i].type == Value::Type::String) {
+            String *str = args[i].string_val;
+            writer.write(str->data(), str->length());
+        } else {
+            writer.write(args[i].toString());
+        }
+    }
+    if (line) writer.put('\n');
+    writer.done();
+}
+
+static io::Writer &handleWriter(Value *args, int nargs, const char *name)
+{
+    io::Writer *writer = nargs == 0 ? nullptr : io::writer(args[0].toInt());
+    if (!writer || args[0].type != Value::Type::Int) {
+        throw std::runtime_error(std::string(name) + ": not an open file handle");
+    }
+    return *writer;
+}
+
+static Value builtinPrint(Value *args, int nargs)
+{
+    writeValues(io::out(), args, nargs, 0, true);
+    return Value::makeNil();
+}
+
+static Value builtinWrite(Value *args, int nargs)
+{
+    writeValues(io::out(), args, nargs, 0, false);
+    return Value::makeNil();
+}
+
+static Value builtinEprint(Value *args, int nargs)
+{
+    writeValues(io::err(), args, nargs, 0, true);
+    return Value::makeNil();
+}
+
+static Value builtinOpen(Value *args, int nargs)
+{
+    if (args[0].type != Value::Type::String) return Value::makeNil();
+    bool append = nargs > 1 && args[1].toBool();
+    int64_t handle = io::open(args[0].string_val->str(), append);
+    return handle < 0 ? Value::makeNil() : Value::makeInt(handle);
+}
+
+static Value builtinFprint(Value *args, int nargs)
+{
+    writeValues(handleWriter(args, nargs, "io.fprint"), args, nargs, 1, true);
+    return Value::makeNil();
+}
+
+static Value builtinFwrite(Value *args, int nargs)
+{
+    writeValues(handleWriter(args, nargs, "io.fwrite"), args, nargs, 1, false);
+    return Value::makeNil();
+}
+
+static Value builtinFlush(Value *args, int nargs)
+{
+    if (nargs == 0) {
+        io::flushAll();
+        return Value::makeNil();
+    }
+    return Value::makeBool(handleWriter(args, nargs, "io.flush").flush());
+}
+
+static Value builtinClose(Value *args, int nargs)
+{
+    return Value::makeBool(io::close(args[0].toInt()));
+}
+
+static Value builtinExit(Value *args, int nargs)
+{
+    int code = 0;
+    if (nargs > 0) {
+        code = (int)args[0].toInt();
+    }
+    io::flushAll();
+    std::exit(code);
+    return Value::makeNil();  // Never reached
+}
+
+static Value builtinLen(Value *args, int nargs)
+{
+    if (args[0].type == Value::Type::String) {
+        return Value::makeInt(args[0].string_val->length());
+    }
+    return Value::makeInt(0);
+}
+
+// substr(s, start, length): shares the bytes of s
+static Value builtinSubstr(Value *args, int nargs)
+{
+    if (args[0].type != Value::Type::String) return Value::makeNil();
+    int64_t start = nargs > 1 ? std::max<int64_t>(args[1].toInt(), 0) : 0;
+    int64_t length = nargs > 2 ? std::max<int64_t>(args[2].toInt(), 0) : INT64_MAX;
+    Value val;
+    val.type = Value::Type::String;
+    val.string_val = String::slice(args[0].string_val, (size_t)start, (size_t)length);
+    return val;
+}
+
+static Value builtinType(Value *args, int nargs)
+{
+    return Value::makeString(args[0].typeName());
+}
+
+static const Builtin builtins[] = {
+    { "print", builtinPrint, 0, Builtin::kVariadic, false },
+    { "io.print", builtinPrint, 0, Builtin::kVariadic, false },
+    { "io.write", builtinWrite, 0, Builtin::kVariadic, false },
+    { "io.eprint", builtinEprint, 0, Builtin::kVariadic, false },
+    { "io.open", builtinOpen, 1, 2, false },
+    { "io.fprint", builtinFprint, 1, Builtin::kVariadic, false },
+    { "io.fwrite", builtinFwrite, 1, Builtin::kVariadic, false },
+    { "io.flush", builtinFlush, 0, 1, false },
+    { "io.close", builtinClose, 1, 1, false },
+    { "exit", builtinExit, 0, 1, false },
+    { "len", builtinLen, 1, 1, true },
+    { "substr", builtinSubstr, 1, 3, true },
+    { "type", builtinType, 1, 1, true },
+};
+
+void registerBuiltins(Program &program)
+{
+    for (const Builtin &builtin : builtins) {
+        program.defineGlobal(builtin.name, Value::makeBuiltin(&builtin));
+    }
+}
+
+}}
@@ -0,0 +1,15 @@
+#ifndef __PIE_VM__
+#define __PIE_VM__
+
+#include "runtime/vm/value.h"
+#include "runtime/vm/bytecode.h"
+#include "runtime/vm/interpreter.h"
+
+namespace pie { namespace vm {
+
+// Define print, io.print, exit, len and type as globals of the program
+void registerBuiltins(Program &program);
+
+}}
+
+#endif
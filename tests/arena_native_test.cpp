@@ -0,0 +1,57 @@
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include "compiler/arena.h"
+#include "compiler/ast.h"
+
+using namespace pie::compiler;
+
+static int destroyed = 0;
+
+struct Tracked {
+    std::string name;
+
+    Tracked(const std::string &name) : name(name) {}
+    ~Tracked() { destroyed++; }
+};
+
+int main()
+{
+    // Test 1: objects are destroyed in one go, allocations stay aligned.
+    {
+        Arena arena(64);
+        for (int i = 0; i < 100; i++) {
+            Tracked *obj = arena.make<Tracked>("a rather long name that does not fit in SSO");
+            assert(((uintptr_t)obj % alignof(Tracked)) == 0);
+            double *d = arena.make<double>(1.5);
+            assert(((uintptr_t)d % alignof(double)) == 0);
+        }
+        assert(destroyed == 0);
+        arena.clear();
+        assert(destroyed == 100);
+        assert(arena.bytesUsed() == 0);
+
+        // The arena is reusable after clear()
+        arena.make<Tracked>("again");
+    }
+    assert(destroyed == 101);
+
+    // Test 2: deleting a module drops every node allocated in its arena.
+    {
+        destroyed = 0;
+        ModuleNode *module = new ModuleNode();
+        FunctionNode *main_fn = module->arena.make<FunctionNode>("main", 0);
+        main_fn->push(module->arena.make<ReturnNode>(module->arena.make<IntNode>(1)));
+        module->functions.push_back(main_fn);
+        module->arena.make<Tracked>("marker");
+        assert(module->arena.bytesUsed() > 0);
+
+        delete module;
+        assert(destroyed == 1);
+    }
+
+    std::cout << "arena_native_test: ok" << std::endl;
+    return 0;
+}
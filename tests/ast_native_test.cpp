@@ -0,0 +1,68 @@
+#include <cassert>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "compiler/ast.h"
+
+using namespace pie::compiler;
+
+// Records the class of the last node visited
+class NameVisitor : public Visitor {
+public:
+    std::string last;
+
+    void visit(Node *node) override
+    {
+        node->visit(this);
+    }
+
+    #define AST_NODE(type) void visit(type *node) override { last = #type; }
+    AST_NODES
+    #undef AST_NODE
+};
+
+int main()
+{
+    // Test 1: every node is tagged with its own class.
+    {
+        IntNode lit(1);
+        IdentifierNode id("a");
+        BinaryOpNode op(BinaryOp::Add, &lit, &id);
+        ReturnNode ret(&op);
+
+        assert(lit.kind == NodeKind::IntNode);
+        assert(isa<IntNode>(&lit) && !isa<DoubleNode>(&lit));
+        assert(dyn_cast<BinaryOpNode>(ret.expr) == &op);
+        assert(dyn_cast<IdentifierNode>(op.lhs) == nullptr);
+        assert(cast<IdentifierNode>(op.rhs)->name == "a");
+
+        // Null stays null, as with dynamic_cast
+        assert(!isa<IntNode>(nullptr));
+        assert(dyn_cast<IntNode>(nullptr) == nullptr);
+    }
+
+    // Test 2: dispatch() reaches the same visit() as node->visit().
+    {
+        std::vector<std::unique_ptr<Node>> nodes;
+        nodes.emplace_back(new ModuleNode());
+        nodes.emplace_back(new FunctionNode("f", 0));
+        nodes.emplace_back(new StringNode("s"));
+        nodes.emplace_back(new BoolNode(true));
+        nodes.emplace_back(new BreakNode());
+        nodes.emplace_back(new BlockNode());
+
+        NameVisitor virtual_calls;
+        NameVisitor switched;
+        for (auto &node : nodes) {
+            node->visit(&virtual_calls);
+            dispatch(&switched, node.get());
+            assert(!switched.last.empty() && switched.last == virtual_calls.last);
+        }
+        assert(switched.last == "BlockNode");
+    }
+
+    std::cout << "ast_native_test: ok" << std::endl;
+    return 0;
+}
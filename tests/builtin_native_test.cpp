@@ -0,0 +1,110 @@
+#include <cassert>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "compiler/parser.h"
+#include "compiler/scanner.h"
+#include "compiler/source.h"
+#include "compiler/backend/closure.h"
+#include "compiler/backend/eval.h"
+#include "compiler/backend/vm.h"
+#include "compiler/pass/optimize.h"
+
+using namespace pie::compiler;
+
+static ModuleNode *parse(const std::string &text)
+{
+    Source source;
+    source.copy("main.pie", text.data(), text.size());
+    Scanner scanner(source);
+    Parser parser(scanner);
+    assert(parser.parse() == 0);
+    return parser.module;
+}
+
+template <typename Engine>
+static std::string runError(const std::string &text)
+{
+    std::unique_ptr<ModuleNode> module(parse(text));
+    Engine engine;
+    try {
+        engine.run(module.get());
+    } catch (const std::exception &e) {
+        return e.what();
+    }
+    return "";
+}
+
+static std::string vmError(const std::string &text)
+{
+    std::unique_ptr<ModuleNode> module(parse(text));
+    pie::vm::Program program;
+    VmCompilerVistor compiler(program);
+    compiler.compile(module.get());
+    pie::vm::Interpreter interpreter;
+    try {
+        interpreter.run(program);
+    } catch (const std::exception &e) {
+        return e.what();
+    }
+    return "";
+}
+
+static Node *returned(ModuleNode *module)
+{
+    ReturnNode *ret = cast<ReturnNode>(module->symtab["main"]->children.back());
+    return ret->expr;
+}
+
+int main()
+{
+    // Test 1: builtins take their arguments in place.
+    {
+        const Builtin *len = findBuiltin("len");
+        assert(len && len->pure && len->min_args == 1 && len->max_args == 1);
+        assert(!findBuiltin("print")->pure && findBuiltin("print")->max_args == Builtin::kVariadic);
+
+        Value args[] = { Value::makeString("abcd") };
+        Value result = len->fn(Args{ args, 1 });
+        assert(result.type == Value::Type::Int && result.int_val == 4);
+    }
+
+    // Test 2: every engine rejects a call with the wrong number of
+    // arguments, with the same message.
+    {
+        std::string text = "module main\n\nfn main() {\n\treturn substr()\n}\n";
+        std::string expected = "substr: expected 1 to 3 arguments, got 0";
+        assert(runError<EvalVisitor>(text) == expected);
+        assert(runError<ClosureCompilerVisitor>(text) == expected);
+        assert(vmError(text) == expected);
+
+        text = "module main\n\nfn main() {\n\treturn len(\"a\", \"b\")\n}\n";
+        assert(runError<EvalVisitor>(text) == "len: expected 1 argument, got 2");
+    }
+
+    // Test 3: pure builtins on constants are folded, unless the program
+    // defines the name.
+    {
+        std::unique_ptr<ModuleNode> module(parse("module main\n\nfn main() {\n\treturn len(\"abc\") + 1\n}\n"));
+        OptimizeVisitor().optimize(module.get());
+        IntNode *folded = dyn_cast<IntNode>(returned(module.get()));
+        assert(folded && folded->value == 4);
+
+        module.reset(parse("module main\n\nfn len(s) {\n\treturn 7\n}\n\nfn main() {\n\treturn len(\"abc\")\n}\n"));
+        OptimizeVisitor().optimize(module.get());
+        assert(isa<FunctionCallNode>(returned(module.get())));
+
+        // An imported module may export a function of the name
+        module.reset(parse("module main\n\nimport shadow.*\n\nfn main() {\n\treturn len(\"abc\")\n}\n"));
+        OptimizeVisitor().optimize(module.get());
+        assert(isa<FunctionCallNode>(returned(module.get())));
+
+        module.reset(parse("module main\n\nfn main() {\n\treturn print(\"x\")\n}\n"));
+        OptimizeVisitor().optimize(module.get());
+        assert(isa<FunctionCallNode>(returned(module.get())));
+    }
+
+    std::cout << "builtin_native_test: ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,111 @@
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "compiler/cache.h"
+#include "compiler/parser.h"
+#include "compiler/scanner.h"
+#include "compiler/source.h"
+#include "compiler/backend/eval.h"
+#include "compiler/backend/print.h"
+#include "compiler/pass/optimize.h"
+#include "compiler/pass/typecheck.h"
+
+using namespace pie::compiler;
+
+static std::string dir = "/tmp/pie_cache_native_test";
+
+static std::string text =
+    "module main\n"
+    "import std.io\n"
+    "public import prelude.*\n"
+    "fn half(n: int): double {\n\treturn n / 2.0\n}\n"
+    "fn main() {\n"
+    "\tlet s = \"a\\tb\"\n"
+    "\tfor (let i = 0; i < 10; i += 1) {\n"
+    "\t\tif (i == 3) {\n\t\t\tcontinue\n\t\t} else {\n\t\t\tbreak\n\t\t}\n"
+    "\t}\n"
+    "\twhile (1 > 2) {\n\t}\n"
+    "\treturn len(s) + half(6) + -2\n"
+    "}\n";
+
+static std::string print(ModuleNode *module)
+{
+    PrintVisitor printer;
+    module->visit(&printer);
+    return printer.output();
+}
+
+int main()
+{
+    std::string path = dir + "/main.pie";
+    std::string mkdir = "mkdir -p " + dir;
+    assert(system(mkdir.c_str()) == 0);
+    FILE *file = fopen(path.c_str(), "wb");
+    fputs(text.c_str(), file);
+    fclose(file);
+
+    Source source;
+    assert(source.open(path));
+    uint64_t key = ModuleCache::key(source.data(), source.size(), "typecheck=1");
+    assert(key != ModuleCache::key(source.data(), source.size(), "typecheck=0"));
+
+    Scanner scanner(source);
+    Parser parser(scanner);
+    assert(parser.parse() == 0);
+    std::unique_ptr<ModuleNode> parsed(parser.module);
+    TypeCheckVisitor checker;
+    checker.check(parsed.get());
+    OptimizeVisitor optimizer;
+    optimizer.optimize(parsed.get());
+
+    // Test 1: a stored module loads back as the same tree, and runs.
+    {
+        ModuleCache cache(dir + "/entries");
+        assert(!cache.load(key));
+        assert(cache.store(key, parsed.get()));
+
+        std::unique_ptr<ModuleNode> loaded(cache.load(key));
+        assert(loaded);
+        assert(print(loaded.get()) == print(parsed.get()));
+        assert(loaded->imports.size() == 2 && loaded->imports[1]->access_level == 1);
+        assert(loaded->symtab["half"] == loaded->functions[0]);
+
+        EvalVisitor interpreter;
+        Value result = interpreter.run(loaded.get());
+        assert(result.type == Value::Type::Double && result.double_val == 4.0);
+    }
+
+    // Test 2: a truncated or damaged entry, or one under another key, is
+    // a miss.
+    {
+        ModuleCache cache(dir + "/entries");
+        char name[32];
+        snprintf(name, sizeof(name), "/%016llx.pic", (unsigned long long)key);
+        std::string entry = dir + "/entries" + name;
+        std::string copy = "cp " + entry + " " + dir + "/entries/0000000000000001.pic";
+        assert(system(copy.c_str()) == 0);
+        assert(!cache.load(1));
+
+        std::string encoded = ModuleCache::encode(key, parsed.get());
+        std::unique_ptr<ModuleNode> decoded(ModuleCache::decode(encoded.data(), encoded.size(), key));
+        assert(decoded);
+        // Still a well formed tree, the name is another one
+        size_t at = encoded.rfind("half");
+        assert(at != std::string::npos);
+        encoded[at] = 'H';
+        assert(!ModuleCache::decode(encoded.data(), encoded.size(), key));
+
+        std::string truncate = "truncate -s -5 " + entry;
+        assert(system(truncate.c_str()) == 0);
+        assert(!cache.load(key));
+    }
+
+    std::string rm = "rm -rf " + dir;
+    assert(system(rm.c_str()) == 0);
+    std::cout << "cache_native_test: ok" << std::endl;
+    return 0;
+}
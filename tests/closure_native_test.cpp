@@ -0,0 +1,97 @@
+#include <cassert>
+#include <iostream>
+#include <string>
+
+#include "compiler/ast.h"
+#include "compiler/backend/closure.h"
+#include "compiler/backend/eval.h"
+#include "tests/test_util.h"
+
+using namespace pie::compiler;
+
+// fn main() { let s = "n="; return <ret> }
+static ModuleNode *buildModule(Node *ret)
+{
+    ModuleNode *module = new ModuleNode();
+    module->name = "main";
+
+    addFunction(module, buildFib());
+
+    FunctionNode *main_fn = addFunction(module, new FunctionNode("main", 0));
+    main_fn->children.push_back(new LetNode("s", nullptr, new StringNode("n=")));
+    main_fn->children.push_back(new ReturnNode(ret));
+
+    return module;
+}
+
+int main()
+{
+    // Test 1: recursive calls agree with the tree-walking evaluator.
+    {
+        FunctionCallNode *call = new FunctionCallNode("fib");
+        call->push(new IntNode(15));
+        ModuleNode *module = buildModule(call);
+
+        ClosureCompilerVisitor engine;
+        Value result = engine.run(module);
+        assert(result.type == Value::Type::Int);
+        assert(result.int_val == 610);
+
+        EvalVisitor eval;
+        Value expected = eval.run(module);
+        assert(expected.int_val == result.int_val);
+    }
+
+    // Test 2: strings concatenate with numbers like the evaluator.
+    {
+        ModuleNode *module = buildModule(
+            new BinaryOpNode(BinaryOp::Add, new IdentifierNode("s"), new IntNode(3)));
+
+        ClosureCompilerVisitor engine;
+        Value result = engine.run(module);
+        assert(result.type == Value::Type::String);
+        assert(result.string_val->str() == "n=3");
+    }
+
+    // Test 3: runtime errors carry the evaluator's messages.
+    {
+        ModuleNode *module = buildModule(new FunctionCallNode("missing"));
+
+        bool thrown = false;
+        try {
+            ClosureCompilerVisitor engine;
+            engine.run(module);
+        } catch (const std::exception &e) {
+            thrown = std::string(e.what()) == "Undefined function: missing";
+        }
+        assert(thrown);
+    }
+
+    // Test 4: closures, ++ and -- are refused by both engines, not run
+    // as nil or a no-op.
+    {
+        Node *unsupported[] = { new ClosureNode(), new UnaryOpNode(UnaryOp::Dec, new IntNode(1)) };
+        const char *messages[] = { "Closures are not supported", "Increment and decrement are not supported" };
+        for (int i = 0; i < 2; i++) {
+            ModuleNode *module = buildModule(unsupported[i]);
+
+            std::string closure_error, eval_error;
+            try {
+                ClosureCompilerVisitor engine;
+                engine.run(module);
+            } catch (const std::exception &e) {
+                closure_error = e.what();
+            }
+            try {
+                EvalVisitor eval;
+                eval.run(module);
+            } catch (const std::exception &e) {
+                eval_error = e.what();
+            }
+            assert(closure_error == messages[i] && eval_error == messages[i]);
+        }
+    }
+
+    std::cout << "closure_native_test: ok" << std::endl;
+    return 0;
+}
@@ -24,6 +24,43 @@ static ModuleNode *buildSimpleModule()
     return module;
 }
 
+static ModuleNode *buildCallModule()
+{
+    ModuleNode *module = new ModuleNode();
+    module->name = "main";
+
+    FunctionNode *inc_fn = new FunctionNode("inc", 0);
+    inc_fn->params.push_back({ "n", nullptr });
+    inc_fn->children.push_back(new ReturnNode(new BinaryOpNode(BinaryOp::Add, new IdentifierNode("n"), new IntNode(1))));
+
+    FunctionCallNode *call = new FunctionCallNode("inc");
+    call->push(new IntNode(41));
+    FunctionNode *main_fn = new FunctionNode("main", 0);
+    main_fn->children.push_back(new ReturnNode(call));
+
+    for (FunctionNode *fn : { inc_fn, main_fn }) {
+        module->functions.push_back(fn);
+        module->symtab[fn->name] = fn;
+    }
+
+    return module;
+}
+
+static std::string debug(DebugEvalVisitor &eval, ModuleNode *module, const char *input, Value &result)
+{
+    std::istringstream in(input);
+    std::ostringstream out;
+
+    std::streambuf *old_in = std::cin.rdbuf(in.rdbuf());
+    std::streambuf *old_out = std::cout.rdbuf(out.rdbuf());
+
+    result = eval.run(module);
+
+    std::cin.rdbuf(old_in);
+    std::cout.rdbuf(old_out);
+    return out.str();
+}
+
 static bool contains(const std::string &haystack, const std::string &needle)
 {
     return haystack.find(needle) != std::string::npos;
@@ -34,8 +71,7 @@ int main()
     // Test 1: step once then continue.
     {
         ModuleNode *module = buildSimpleModule();
-        EvalVisitor eval;
-        eval.setDebugMode(true);
+        DebugEvalVisitor eval;
 
         std::istringstream in("s\nc\n");
         std::ostringstream out;
@@ -59,8 +95,7 @@ int main()
     // Test 2: print a single variable before stepping.
     {
         ModuleNode *module = buildSimpleModule();
-        EvalVisitor eval;
-        eval.setDebugMode(true);
+        DebugEvalVisitor eval;
 
         std::istringstream in("s\ns\np a\nc\n");
         std::ostringstream out;
@@ -80,6 +115,39 @@ int main()
         assert(contains(text, "[debug] a = 1"));
     }
 
+    // Test 3: a line breakpoint runs silently up to the statement.
+    {
+        ModuleNode *module = buildSimpleModule();
+        module->functions[0]->children[1]->line = 3;
+        DebugEvalVisitor eval;
+        eval.breakAtLine(3);
+
+        Value result;
+        std::string text = debug(eval, module, "p a\nc\n", result);
+        assert(result.type == Value::Type::Int && result.int_val == 3);
+        assert(text.find("[debug] breakpoint: line 3") == 0);
+        assert(contains(text, "line 3: "));
+        assert(contains(text, "[debug] a = 1"));
+        assert(!contains(text, "step 1 "));
+    }
+
+    // Test 4: a function breakpoint stops at its first statement, unknown
+    // functions are reported.
+    {
+        ModuleNode *module = buildCallModule();
+        DebugEvalVisitor eval;
+        eval.breakAtFunction("inc");
+        eval.breakAtFunction("missing");
+
+        Value result;
+        std::string text = debug(eval, module, "p n\nb\nc\n", result);
+        assert(result.type == Value::Type::Int && result.int_val == 42);
+        assert(contains(text, "[debug] no function: missing"));
+        assert(contains(text, "[debug] breakpoint: fn inc"));
+        assert(contains(text, "[debug] n = 41"));
+        assert(contains(text, "[debug] breakpoints: fn inc\n"));
+    }
+
     std::cout << "debugger_native_test: ok" << std::endl;
     return 0;
 }
@@ -0,0 +1,243 @@
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "compiler/driver.h"
+#include "compiler/parser.h"
+#include "compiler/scanner.h"
+#include "compiler/source.h"
+#include "compiler/backend/closure.h"
+#include "compiler/backend/eval.h"
+#include "compiler/backend/vm.h"
+
+using namespace pie::compiler;
+
+static std::string dir = "/tmp/pie_driver_native_test";
+
+static void writeModule(const std::string &file, const std::string &text)
+{
+    FILE *out = fopen((dir + "/" + file).c_str(), "wb");
+    assert(out);
+    fputs(text.c_str(), out);
+    fclose(out);
+}
+
+// The message of the error running the compiled program raises, on each
+// engine
+template <typename Engine>
+static std::string runError(ModuleNode *module)
+{
+    try {
+        Engine engine;
+        engine.run(module);
+    } catch (const std::exception &e) {
+        return e.what();
+    }
+    return "";
+}
+
+static std::string vmError(ModuleNode *module)
+{
+    try {
+        pie::vm::Program program;
+        VmCompilerVistor compiler(program);
+        compiler.compile(module);
+        pie::vm::Interpreter interpreter;
+        interpreter.run(program);
+    } catch (const std::exception &e) {
+        return e.what();
+    }
+    return "";
+}
+
+static int position(const std::vector<ModuleNode *> &modules, const std::string &name)
+{
+    for (size_t i = 0; i < modules.size(); i++) {
+        if (modules[i]->name == name) return (int)i;
+    }
+    return -1;
+}
+
+int main()
+{
+    std::string mkdir = "mkdir -p " + dir + "/shapes";
+    assert(system(mkdir.c_str()) == 0);
+
+    writeModule("main.pie",
+        "module main\n"
+        "import std.io\n"
+        "import left\n"
+        "import right\n"
+        "fn main() {\n\treturn 0\n}\n");
+    writeModule("left.pie", "module left\nimport shapes.square\nfn l() {\n\treturn 1 + 2\n}\n");
+    writeModule("right.pie", "module right\nimport shapes.square\nfn r() {\n\treturn 3\n}\n");
+    writeModule("shapes/square.pie", "module shapes.square\nfn area(x) {\n\treturn x * x\n}\n");
+    writeModule("cycle.pie", "module cycle\nimport back\nfn main() {\n\treturn 0\n}\n");
+    writeModule("back.pie", "module back\nimport cycle\n");
+    writeModule("broken.pie", "module broken\nimport bad\n");
+    writeModule("bad.pie", "module bad\nfn (\n");
+    writeModule("typo.pie", "module typo\nimport std.io\nimport shapes.sqaure\nfn main() {\n\treturn 0\n}\n");
+
+    // Test 1: every module once, each after its imports, whatever the
+    // number of threads. std.io has no file and stays unresolved.
+    for (unsigned threads : { 1u, 4u }) {
+        Driver driver(threads);
+        assert(driver.compile(dir + "/main.pie") == Driver::Compiled);
+        assert(driver.root()->name == "main");
+
+        const std::vector<ModuleNode *> &modules = driver.modules();
+        assert(modules.size() == 4);
+        assert(position(modules, "shapes.square") < position(modules, "left"));
+        assert(position(modules, "shapes.square") < position(modules, "right"));
+        assert(position(modules, "left") < position(modules, "main"));
+        assert(position(modules, "right") < position(modules, "main"));
+        assert(modules.back() == driver.root());
+    }
+
+    // Test 2: an import cycle still compiles both modules once.
+    {
+        Driver driver(2);
+        assert(driver.compile(dir + "/cycle.pie") == Driver::Compiled);
+        assert(driver.modules().size() == 2);
+    }
+
+    // Test 3: errors in the program or its imports.
+    {
+        Driver missing(2);
+        assert(missing.compile(dir + "/nothere.pie") == Driver::OpenFailed);
+
+        Driver broken(2);
+        assert(broken.compile(dir + "/broken.pie") == Driver::ParseFailed);
+
+        // Only the runtime's own modules may have no file
+        Driver typo(2);
+        assert(typo.compile(dir + "/typo.pie") == Driver::LinkFailed);
+    }
+
+    // Test 4: only the functions the program calls are bound, found
+    // through the search path, a qualifier or an import of a.*.
+    {
+        std::string lib = "mkdir -p " + dir + "/lib/text";
+        assert(system(lib.c_str()) == 0);
+        writeModule("lib/text/format.pie",
+            "module text.format\n"
+            "fn pad(s) {\n\treturn s + \" \"\n}\n"
+            "public fn cell(s) {\n\treturn pad(s)\n}\n"
+            "public fn unused() {\n\treturn 0\n}\n");
+        writeModule("lib/util.pie", "module util\npublic fn twice(x) {\n\treturn x * 2\n}\n");
+        writeModule("app.pie",
+            "module main\n"
+            "import text.format\n"
+            "import util.*\n"
+            "fn pad(s) {\n\treturn s\n}\n"
+            "fn main() {\n\treturn len(format.cell(\"a\")) + twice(1) + len(pad(\"b\"))\n}\n");
+        writeModule("private.pie", "module main\nimport text.format\nfn main() {\n\treturn format.pad(1)\n}\n");
+
+        // Without inlining, which would leave no call of pad()
+        Driver driver(2);
+        driver.addSearchPath(dir + "/lib");
+        driver.setOptimize(false, 0);
+        assert(driver.compile(dir + "/app.pie") == Driver::Compiled);
+
+        ModuleNode *program = driver.root();
+        assert(program->symtab.count("text.format.cell"));
+        assert(program->symtab.count("text.format.pad"));
+        assert(program->symtab.count("util.twice"));
+        assert(!program->symtab.count("text.format.unused"));
+        assert(program->functions.size() == 5);
+
+        Driver denied(2);
+        denied.addSearchPath(dir + "/lib");
+        assert(denied.compile(dir + "/private.pie") == Driver::LinkFailed);
+    }
+
+    // Test 5: a module of the library wins over the search path. Its entry
+    // is used with the default options, its text with others.
+    {
+        writeModule("lib/util.pie", "module util\npublic fn fromFile() {\n\treturn 0\n}\n");
+        writeModule("embedded.pie",
+            "module main\n"
+            "import util.*\n"
+            "fn main() {\n\treturn fromEntry() + fromText() + fromFile()\n}\n");
+
+        std::string text = "module util\npublic fn fromText() {\n\treturn 1\n}\n";
+        std::string other = "module util\npublic fn fromEntry() {\n\treturn 2\n}\n";
+        Source source;
+        source.copy("util.pie", other.data(), other.size());
+        Scanner scanner(source);
+        Parser parser(scanner);
+        assert(parser.parse() == 0);
+        std::unique_ptr<ModuleNode> parsed(parser.module);
+
+        Driver defaults(1);
+        std::string entry = ModuleCache::encode(
+            ModuleCache::key(text.data(), text.size(), defaults.analysisOptions()), parsed.get());
+        EmbeddedModule library[] = { { "util", text.data(), text.size(), entry.data(), entry.size() } };
+
+        defaults.setLibrary(library, 1);
+        defaults.addSearchPath(dir + "/lib");
+        assert(defaults.compile(dir + "/embedded.pie") == Driver::Compiled);
+        assert(defaults.root()->symtab.count("util.fromEntry"));
+        assert(!defaults.root()->symtab.count("util.fromText"));
+        assert(!defaults.root()->symtab.count("util.fromFile"));
+
+        Driver unchecked(1);
+        unchecked.setLibrary(library, 1);
+        unchecked.setTypeCheck(false);
+        assert(unchecked.compile(dir + "/embedded.pie") == Driver::Compiled);
+        assert(unchecked.root()->symtab.count("util.fromText"));
+        assert(!unchecked.root()->symtab.count("util.fromEntry"));
+    }
+
+    // Test 6: a public function keeps the guards of its annotations, even
+    // when its own module only passes the right type: other modules may
+    // pass anything.
+    {
+        writeModule("lib1.pie",
+            "module lib1\n"
+            "public fn inc(x: int) {\n\treturn x + 1\n}\n"
+            "fn one() {\n\treturn inc(1)\n}\n");
+        writeModule("guarded.pie",
+            "module main\n"
+            "import lib1\n"
+            "fn main() {\n\treturn lib1.inc(\"abc\")\n}\n");
+
+        Driver driver(1);
+        assert(driver.compile(dir + "/guarded.pie") == Driver::Compiled);
+        std::string expected = "Type error: expected int, got string";
+        assert(runError<EvalVisitor>(driver.root()) == expected);
+        assert(runError<ClosureCompilerVisitor>(driver.root()) == expected);
+        assert(vmError(driver.root()) == expected);
+    }
+
+    // Test 7: a function used as a value is linked like a call, to the
+    // function of its own module, not the program's of the same name.
+    {
+        writeModule("lib2.pie",
+            "module lib2\n"
+            "fn sq(x) {\n\treturn x * x\n}\n"
+            "public fn get() {\n\tlet f = sq\n\treturn f(3)\n}\n");
+        writeModule("values.pie",
+            "module main\n"
+            "import lib2\n"
+            "fn sq(x) {\n\treturn 100\n}\n"
+            "fn main() {\n\treturn lib2.get() + sq(0)\n}\n");
+
+        Driver driver(1);
+        assert(driver.compile(dir + "/values.pie") == Driver::Compiled);
+        assert(driver.root()->symtab.count("lib2.sq"));
+
+        EvalVisitor interpreter;
+        Value result = interpreter.run(driver.root());
+        assert(result.type == Value::Type::Int && result.int_val == 109);
+    }
+
+    std::string rm = "rm -rf " + dir;
+    assert(system(rm.c_str()) == 0);
+    std::cout << "driver_native_test: ok" << std::endl;
+    return 0;
+}
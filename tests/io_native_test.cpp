@@ -0,0 +1,92 @@
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <csignal>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "runtime/io.h"
+
+using namespace pie;
+
+static std::string readFile(const std::string &path)
+{
+    std::ifstream in(path);
+    std::stringstream text;
+    text << in.rdbuf();
+    return text.str();
+}
+
+int main()
+{
+    std::string path = "/tmp/pie_io_native_test.txt";
+
+    // Test 1: bytes stay buffered until a flush, a close writes them out.
+    {
+        int64_t handle = io::open(path, false);
+        assert(handle >= 3);
+        io::Writer *writer = io::writer(handle);
+        assert(writer);
+
+        writer->write("hello ");
+        writer->put('!');
+        assert(readFile(path).empty());
+        assert(writer->flush());
+        assert(readFile(path) == "hello !");
+
+        writer->write(std::string(3 * io::Writer::kBufferSize, 'x'));
+        assert(io::close(handle));
+        assert(readFile(path).size() == 7 + 3 * io::Writer::kBufferSize);
+        assert(!io::writer(handle));
+        assert(!io::close(handle));
+    }
+
+    // Test 2: appending keeps the file, handles of closed files are reused.
+    {
+        int64_t first = io::open(path, false);
+        io::writer(first)->write("a");
+        assert(io::close(first));
+
+        int64_t second = io::open(path, true);
+        assert(second == first);
+        io::writer(second)->write("b");
+        io::flushAll();
+        assert(readFile(path) == "ab");
+        assert(io::close(second));
+    }
+
+    // Test 3: stdout and stderr are always open, nothing else is.
+    {
+        assert(io::writer(io::kStdout) == &io::out());
+        assert(io::writer(io::kStderr) == &io::err());
+        assert(!io::writer(0) && !io::writer(42));
+        assert(io::open("/nonexistent/dir/file", false) == -1);
+    }
+
+    // Test 4: a crash writes out what stdout buffered, then still kills
+    // the process with its signal.
+    {
+        io::flushAll();
+        pid_t pid = fork();
+        if (pid == 0) {
+            int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            dup2(fd, 1);
+            io::out().write("before the crash");
+            abort();
+        }
+
+        int status = 0;
+        assert(waitpid(pid, &status, 0) == pid);
+        assert(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT);
+        assert(readFile(path) == "before the crash");
+    }
+
+    std::remove(path.c_str());
+    std::cout << "io_native_test: ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,186 @@
+#include <cassert>
+#include <iostream>
+#include <string>
+
+#include "compiler/ast.h"
+#include "compiler/backend/eval.h"
+#include "compiler/backend/jit.h"
+#include "tests/test_util.h"
+
+using namespace pie::compiler;
+
+// fn half(n) { return n / 2 }
+static FunctionNode *buildHalf()
+{
+    FunctionNode *half = new FunctionNode("half", 0);
+    half->params.push_back(std::make_pair(std::string("n"), (TypeNode*)nullptr));
+    half->children.push_back(new ReturnNode(
+        new BinaryOpNode(BinaryOp::Div, new IdentifierNode("n"), new IntNode(2))));
+    return half;
+}
+
+// fn scale(x: double, k): double {
+//     let y = x * k
+//     if (y < 0.5) { return -y }
+//     return y + 0.25
+// }
+static FunctionNode *buildScale()
+{
+    FunctionNode *scale = new FunctionNode("scale", 0);
+    scale->params.push_back(std::make_pair(std::string("x"), new TypeNode("double")));
+    scale->params.push_back(std::make_pair(std::string("k"), (TypeNode*)nullptr));
+    scale->return_type = new TypeNode("double");
+
+    scale->children.push_back(new LetNode("y", nullptr,
+        new BinaryOpNode(BinaryOp::Mul, new IdentifierNode("x"), new IdentifierNode("k"))));
+    BlockNode *then_block = new BlockNode();
+    then_block->addStatement(new ReturnNode(new UnaryOpNode(UnaryOp::Neg, new IdentifierNode("y"))));
+    scale->children.push_back(new IfNode(
+        new BinaryOpNode(BinaryOp::Lt, new IdentifierNode("y"), new DoubleNode(0.5)),
+        then_block));
+    scale->children.push_back(new ReturnNode(
+        new BinaryOpNode(BinaryOp::Add, new IdentifierNode("y"), new DoubleNode(0.25))));
+    return scale;
+}
+
+// fn order(x: double): double {
+//     if (x < 1.0) { return 1.0 }
+//     if (x == x) { return 2.0 }
+//     return 3.0
+// }
+static FunctionNode *buildOrder()
+{
+    FunctionNode *order = new FunctionNode("order", 0);
+    order->params.push_back(std::make_pair(std::string("x"), new TypeNode("double")));
+    order->return_type = new TypeNode("double");
+
+    BlockNode *less = new BlockNode();
+    less->addStatement(new ReturnNode(new DoubleNode(1.0)));
+    order->children.push_back(new IfNode(
+        new BinaryOpNode(BinaryOp::Lt, new IdentifierNode("x"), new DoubleNode(1.0)), less));
+    BlockNode *equal = new BlockNode();
+    equal->addStatement(new ReturnNode(new DoubleNode(2.0)));
+    order->children.push_back(new IfNode(
+        new BinaryOpNode(BinaryOp::Eq, new IdentifierNode("x"), new IdentifierNode("x")), equal));
+    order->children.push_back(new ReturnNode(new DoubleNode(3.0)));
+    return order;
+}
+
+// fn main() { return <ret> }
+static ModuleNode *buildModule(Node *ret)
+{
+    ModuleNode *module = new ModuleNode();
+    module->name = "main";
+
+    addFunction(module, buildFib());
+    addFunction(module, buildHalf());
+    addFunction(module, buildScale());
+    addFunction(module, buildOrder());
+
+    FunctionNode *main_fn = addFunction(module, new FunctionNode("main", 0));
+    main_fn->children.push_back(new ReturnNode(ret));
+
+    return module;
+}
+
+static FunctionCallNode *call(const std::string &name, Node *arg, Node *other = nullptr)
+{
+    FunctionCallNode *node = new FunctionCallNode(name);
+    node->push(arg);
+    if (other) node->push(other);
+    return node;
+}
+
+static Node *add(Node *lhs, Node *rhs)
+{
+    return new BinaryOpNode(BinaryOp::Add, lhs, rhs);
+}
+
+// The result of main with and without the JIT, which must agree
+static Value runBoth(Node *(*build)(), bool &compiled, size_t fn)
+{
+    ModuleNode *interpreted = buildModule(build());
+    EvalVisitor plain;
+    Value expected = plain.run(interpreted);
+
+    ModuleNode *module = buildModule(build());
+    EvalVisitor eval;
+    eval.setJit(true, 1);
+    Value result = eval.run(module);
+    assert(result.type == expected.type);
+    assert(result.type != Value::Type::Double || result.double_val == expected.double_val);
+    compiled = module->functions[fn]->native_code != nullptr;
+    return result;
+}
+
+int main()
+{
+    // Test 1: a hot int function runs as machine code with the same result.
+    {
+        ModuleNode *module = buildModule(call("fib", new IntNode(20)));
+
+        EvalVisitor eval;
+        eval.setJit(true, 3);
+        Value result = eval.run(module);
+        assert(result.type == Value::Type::Int);
+        assert(result.int_val == 6765);
+        assert((module->functions[0]->native_code != nullptr) == JitCompiler::supported());
+    }
+
+    // Test 2: division does not qualify, the function stays interpreted.
+    {
+        ModuleNode *module = buildModule(
+            new BinaryOpNode(BinaryOp::Add, call("half", new IntNode(7)), call("half", new IntNode(9))));
+
+        EvalVisitor eval;
+        eval.setJit(true, 1);
+        Value result = eval.run(module);
+        assert(result.type == Value::Type::Int);
+        assert(result.int_val == 7);
+        assert(module->functions[1]->native_code == nullptr);
+    }
+
+    // Test 3: an unannotated parameter is only entered with an int.
+    {
+        ModuleNode *module = buildModule(
+            new BinaryOpNode(BinaryOp::Add, call("fib", new IntNode(10)), call("fib", new DoubleNode(1.5))));
+
+        EvalVisitor eval;
+        eval.setJit(true, 1);
+        Value result = eval.run(module);
+        assert(result.type == Value::Type::Double);
+        assert(result.double_val == 56.5);
+    }
+
+    // Test 4: double parameters, locals and results. An int argument is
+    // widened for a double parameter.
+    {
+        bool compiled;
+        Value result = runBoth([]() -> Node * {
+            return add(add(call("scale", new DoubleNode(1.5), new IntNode(3)),
+                           call("scale", new DoubleNode(0.25), new IntNode(1))),
+                       call("scale", new IntNode(3), new IntNode(1)));
+        }, compiled, 2);
+        assert(result.type == Value::Type::Double);
+        assert(result.double_val == 4.75 - 0.25 + 3.25);
+        assert(compiled == JitCompiler::supported());
+    }
+
+    // Test 5: a NaN compares false, like in the evaluator.
+    {
+        bool compiled;
+        Value result = runBoth([]() -> Node * {
+            Node *inf = new BinaryOpNode(BinaryOp::Mul, new DoubleNode(1e308), new DoubleNode(10.0));
+            Node *nan = new BinaryOpNode(BinaryOp::Sub, inf,
+                new BinaryOpNode(BinaryOp::Mul, new DoubleNode(1e308), new DoubleNode(10.0)));
+            return add(add(call("order", nan), call("order", new DoubleNode(0.5))),
+                       call("order", new DoubleNode(2.0)));
+        }, compiled, 3);
+        assert(result.type == Value::Type::Double);
+        assert(result.double_val == 3.0 + 1.0 + 2.0);
+        assert(compiled == JitCompiler::supported());
+    }
+
+    std::cout << "jit_native_test: ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include <cassert>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include "compiler/parser.h"
+#include "compiler/scanner.h"
+#include "compiler/source.h"
+#include "compiler/backend/closure.h"
+#include "compiler/backend/eval.h"
+#include "compiler/backend/profile.h"
+
+using namespace pie::compiler;
+
+static std::string text =
+    "module main\n"
+    "\n"
+    "fn spin(n) {\n"
+    "\tlet s = 0\n"
+    "\twhile (s < n) {\n\t\ts += 1\n\t}\n"
+    "\treturn s\n"
+    "}\n"
+    "\n"
+    "fn main() {\n"
+    "\treturn spin(3000000)\n"
+    "}\n";
+
+static ModuleNode *parse()
+{
+    Source source;
+    source.copy("main.pie", text.data(), text.size());
+    Scanner scanner(source);
+    Parser parser(scanner);
+    assert(parser.parse() == 0);
+    return parser.module;
+}
+
+static bool contains(const std::string &haystack, const std::string &needle)
+{
+    return haystack.find(needle) != std::string::npos;
+}
+
+int main()
+{
+    if (!Profiler::supported()) {
+        std::cout << "profile_native_test: skipped" << std::endl;
+        return 0;
+    }
+
+    // Test 1: functions keep the line they are declared on.
+    {
+        std::unique_ptr<ModuleNode> module(parse());
+        assert(module->symtab["spin"]->line == 3);
+        assert(module->symtab["main"]->line == 11);
+    }
+
+    // Test 2: a tail call replaces its caller on the sampled stack, a
+    // second profiler cannot start while one runs.
+    {
+        std::unique_ptr<ModuleNode> module(parse());
+        Profiler profiler;
+        EvalVisitor eval;
+        eval.setJit(false);
+        eval.setProfiler(&profiler);
+
+        assert(profiler.start());
+        Profiler other;
+        assert(!other.start());
+        Value result = eval.run(module.get());
+        profiler.stop();
+
+        assert(result.type == Value::Type::Int && result.int_val == 3000000);
+        assert(profiler.samples() > 0);
+
+        std::ostringstream folded;
+        profiler.writeFolded(folded);
+        assert(contains(folded.str(), "spin:3 "));
+        assert(!contains(folded.str(), "main:11;"));
+
+        std::ostringstream summary;
+        profiler.writeSummary(summary, 10);
+        assert(contains(summary.str(), "spin:3"));
+    }
+
+    // Test 3: the closure engine.
+    {
+        std::unique_ptr<ModuleNode> module(parse());
+        Profiler profiler;
+        ClosureCompilerVisitor engine;
+        engine.setProfiler(&profiler);
+
+        assert(profiler.start());
+        engine.run(module.get());
+        profiler.stop();
+
+        std::ostringstream folded;
+        profiler.writeFolded(folded);
+        assert(contains(folded.str(), "spin:3 "));
+    }
+
+    std::cout << "profile_native_test: ok" << std::endl;
+    return 0;
+}
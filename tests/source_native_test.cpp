@@ -0,0 +1,92 @@
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "compiler/parser.h"
+#include "compiler/scanner.h"
+#include "compiler/source.h"
+
+using namespace pie::compiler;
+
+static void writeFile(const std::string &path, const std::string &text)
+{
+    FILE *file = fopen(path.c_str(), "wb");
+    assert(file);
+    fwrite(text.data(), 1, text.size(), file);
+    fclose(file);
+}
+
+// The value main returns, or false when the text does not parse
+static bool parseReturn(const std::string &text, Node *&returned, std::unique_ptr<ModuleNode> &module)
+{
+    Source source;
+    source.copy("main.pie", text.data(), text.size());
+    Scanner scanner(source);
+    Parser parser(scanner);
+    int status = parser.parse();
+    module.reset(parser.module);
+    if (status != 0) return false;
+
+    returned = cast<ReturnNode>(module->symtab["main"]->children.back())->expr;
+    return true;
+}
+
+int main()
+{
+    std::string path = "/tmp/pie_source_native_test.pie";
+
+    // Test 1: the text is followed by two NULs, whatever its size relative
+    // to a page.
+    {
+        size_t sizes[] = { 1, 100, 4094, 4095, 4096, 4097, 8192, 100000 };
+        for (size_t size : sizes) {
+            std::string text(size, 'x');
+            for (size_t i = 0; i < size; i += 7) text[i] = (char)('a' + i % 26);
+            writeFile(path, text);
+
+            Source source;
+            assert(source.open(path));
+            assert(source.size() == size);
+            assert(std::memcmp(source.data(), text.data(), size) == 0);
+            assert(source.data()[size] == '\0' && source.data()[size + 1] == '\0');
+
+            // The scanner writes into the text, the file stays as it was
+            source.data()[0] = '\0';
+        }
+        Source again;
+        assert(again.open(path));
+        assert(again.data()[0] != '\0');
+    }
+
+    // Test 2: empty files and missing ones.
+    {
+        writeFile(path, "");
+        Source empty;
+        assert(empty.open(path));
+        assert(empty.size() == 0);
+        assert(empty.data()[0] == '\0' && empty.data()[1] == '\0');
+
+        Source missing;
+        assert(!missing.open("/nonexistent/dir/file.pie"));
+    }
+
+    // Test 3: integer literals up to the largest int scan in place, a
+    // larger one is a parse error rather than a wrapped value.
+    {
+        Node *returned = nullptr;
+        std::unique_ptr<ModuleNode> module;
+        assert(parseReturn("module main\n\nfn main() {\n\treturn 9223372036854775807\n}\n", returned, module));
+        assert(cast<IntNode>(returned)->value == INT64_MAX);
+
+        assert(!parseReturn("module main\n\nfn main() {\n\treturn 9223372036854775808\n}\n", returned, module));
+        assert(!parseReturn("module main\n\nfn main() {\n\treturn 99999999999999999999\n}\n", returned, module));
+    }
+
+    std::remove(path.c_str());
+    std::cout << "source_native_test: ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include <cassert>
+#include <iostream>
+#include <string>
+
+#include "runtime/string.h"
+
+using pie::String;
+
+int main()
+{
+    // Test 1: long concatenations stay ropes until the bytes are needed.
+    {
+        String *acc = String::make(std::string());
+        String *piece = String::make("0123456789");
+        for (int i = 0; i < 100000; i++) {
+            String *next = String::concat(acc, piece);
+            String::release(acc);
+            acc = next;
+        }
+        assert(acc->length() == 1000000);
+        assert(acc->str().substr(999990) == "0123456789");
+        assert(piece->refcount == 1);
+        String::release(acc);
+        String::release(piece);
+    }
+
+    // Test 2: slices share the parent's bytes, slices of slices too.
+    {
+        String *s = String::make("hello, world");
+        String *world = String::slice(s, 7, 100);
+        String *orl = String::slice(world, 1, 3);
+        assert(world->str() == "world");
+        assert(orl->str() == "orl");
+        assert(orl->data() == s->data() + 8);
+        assert(s->refcount == 3);
+
+        String *same = String::slice(s, 0, 12);
+        assert(same == s);
+        String::release(same);
+        String::release(world);
+        String::release(orl);
+        assert(s->refcount == 1);
+        String::release(s);
+    }
+
+    // Test 3: equality compares bytes, whatever the shape of the strings.
+    {
+        String *a = String::make(std::string(40, 'a'));
+        String *b = String::make(std::string(40, 'b'));
+        String *ab = String::concat(a, b);
+        String *whole = String::make(std::string(40, 'a') + std::string(40, 'b'));
+        String *tail = String::slice(whole, 40, 40);
+        assert(String::equals(ab, whole));
+        assert(String::equals(tail, b));
+        assert(!String::equals(tail, a));
+        String *parts[] = { a, b, ab, whole, tail };
+        for (String *part : parts) {
+            String::release(part);
+        }
+    }
+
+    std::cout << "string_native_test: ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,56 @@
+#ifndef __PIE_TESTS_TEST_UTIL__
+#define __PIE_TESTS_TEST_UTIL__
+
+#include <string>
+#include <utility>
+
+#include "compiler/ast.h"
+#include "compiler/backend/vm.h"
+
+// Helpers of the engine tests, which build their trees by hand
+
+namespace pie { namespace compiler {
+
+// fn fib(n) { if (n < 2) { return n } return fib(n - 1) + fib(n - 2) }
+inline FunctionNode *buildFib()
+{
+    FunctionNode *fib = new FunctionNode("fib", 0);
+    fib->params.push_back(std::make_pair(std::string("n"), (TypeNode*)nullptr));
+
+    BlockNode *then_block = new BlockNode();
+    then_block->addStatement(new ReturnNode(new IdentifierNode("n")));
+    fib->children.push_back(new IfNode(
+        new BinaryOpNode(BinaryOp::Lt, new IdentifierNode("n"), new IntNode(2)),
+        then_block));
+
+    FunctionCallNode *lhs = new FunctionCallNode("fib");
+    lhs->push(new BinaryOpNode(BinaryOp::Sub, new IdentifierNode("n"), new IntNode(1)));
+    FunctionCallNode *rhs = new FunctionCallNode("fib");
+    rhs->push(new BinaryOpNode(BinaryOp::Sub, new IdentifierNode("n"), new IntNode(2)));
+    fib->children.push_back(new ReturnNode(new BinaryOpNode(BinaryOp::Add, lhs, rhs)));
+
+    return fib;
+}
+
+// Declares fn in module, as the parser does
+inline FunctionNode *addFunction(ModuleNode *module, FunctionNode *fn)
+{
+    module->functions.push_back(fn);
+    module->symtab[fn->name] = fn;
+    return fn;
+}
+
+// Compiles module to bytecode and runs it on the VM
+inline pie::vm::Value runVm(ModuleNode *module)
+{
+    pie::vm::Program program;
+    VmCompilerVistor compiler(program);
+    compiler.compile(module);
+
+    pie::vm::Interpreter interpreter;
+    return interpreter.run(program);
+}
+
+}}
+
+#endif
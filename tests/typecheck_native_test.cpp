@@ -0,0 +1,91 @@
+#include <cassert>
+#include <iostream>
+#include <string>
+
+#include "compiler/ast.h"
+#include "compiler/backend/eval.h"
+#include "compiler/backend/vm.h"
+#include "compiler/pass/typecheck.h"
+#include "tests/test_util.h"
+
+using namespace pie::compiler;
+
+// fn half(n: int): double { return n / 2.0 }
+// fn main() { return half(arg) }
+static ModuleNode *buildModule(Node *arg)
+{
+    ModuleNode *module = new ModuleNode();
+    module->name = "main";
+
+    FunctionNode *half = addFunction(module, new FunctionNode("half", 0));
+    half->params.push_back(std::make_pair(std::string("n"), new TypeNode("int")));
+    half->return_type = new TypeNode("double");
+    half->children.push_back(new ReturnNode(
+        new BinaryOpNode(BinaryOp::Div, new IdentifierNode("n"), new DoubleNode(2.0))));
+
+    FunctionCallNode *call = new FunctionCallNode("half");
+    call->push(arg);
+    FunctionNode *main_fn = addFunction(module, new FunctionNode("main", 0));
+    main_fn->children.push_back(new ReturnNode(call));
+
+    return module;
+}
+
+static BinaryOpNode *division(ModuleNode *module)
+{
+    ReturnNode *ret = static_cast<ReturnNode*>(module->functions[0]->children.back());
+    return dynamic_cast<BinaryOpNode*>(ret->expr);
+}
+
+int main()
+{
+    // Test 1: the int operand is widened once and the division runs on
+    // doubles, no guard is needed when every caller passes an int.
+    {
+        ModuleNode *module = buildModule(new IntNode(5));
+        TypeCheckVisitor checker;
+        checker.check(module);
+
+        BinaryOpNode *div = division(module);
+        assert(div && div->operand_type == OperandType::Double);
+        assert(module->functions[0]->children.size() == 1);
+
+        EvalVisitor eval;
+        Value result = eval.run(module);
+        assert(result.type == Value::Type::Double);
+        assert(result.double_val == 2.5);
+
+        pie::vm::Value vm_result = runVm(module);
+        assert(vm_result.type == pie::vm::Value::Type::Double);
+        assert(vm_result.double_val == 2.5);
+    }
+
+    // Test 2: an argument of unknown type is checked on entry.
+    {
+        ModuleNode *module = buildModule(new StringNode("5"));
+        TypeCheckVisitor checker;
+        checker.check(module);
+        assert(module->functions[0]->children.size() == 2);
+
+        std::string expected = "Type error: expected int, got string";
+        bool thrown = false;
+        try {
+            EvalVisitor eval;
+            eval.run(module);
+        } catch (const std::exception &e) {
+            thrown = e.what() == expected;
+        }
+        assert(thrown);
+
+        thrown = false;
+        try {
+            runVm(module);
+        } catch (const std::exception &e) {
+            thrown = e.what() == expected;
+        }
+        assert(thrown);
+    }
+
+    std::cout << "typecheck_native_test: ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include <cassert>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "compiler/ast.h"
+#include "compiler/backend/eval.h"
+#include "compiler/backend/vm.h"
+#include "tests/test_util.h"
+
+using namespace pie::compiler;
+
+static ModuleNode *buildModule(Node *ret)
+{
+    ModuleNode *module = new ModuleNode();
+    module->name = "main";
+
+    addFunction(module, buildFib());
+
+    FunctionNode *main_fn = addFunction(module, new FunctionNode("main", 0));
+    main_fn->children.push_back(new LetNode("s", nullptr, new StringNode("n=")));
+    main_fn->children.push_back(new BinaryOpNode(BinaryOp::AddAssign, new IdentifierNode("s"), new IntNode(0)));
+    main_fn->children.push_back(new ReturnNode(ret));
+
+    return module;
+}
+
+int main()
+{
+    // Test 1: recursive calls agree with the tree-walking evaluator.
+    {
+        FunctionCallNode *call = new FunctionCallNode("fib");
+        call->push(new IntNode(15));
+        ModuleNode *module = buildModule(call);
+
+        pie::vm::Value result = runVm(module);
+        assert(result.type == pie::vm::Value::Type::Int);
+        assert(result.int_val == 610);
+
+        EvalVisitor eval;
+        Value expected = eval.run(module);
+        assert(expected.type == Value::Type::Int);
+        assert(expected.int_val == result.int_val);
+    }
+
+    // Test 2: += on a string only adds numerically, like the evaluator.
+    {
+        ModuleNode *module = buildModule(new IdentifierNode("s"));
+
+        pie::vm::Value result = runVm(module);
+        assert(result.type == pie::vm::Value::Type::Double);
+        assert(result.double_val == 0.0);
+    }
+
+    // Test 3: runtime errors carry the evaluator's messages.
+    {
+        ModuleNode *module = buildModule(new IdentifierNode("missing"));
+
+        bool thrown = false;
+        try {
+            runVm(module);
+        } catch (const std::exception &e) {
+            thrown = std::string(e.what()) == "Undefined variable: missing";
+        }
+        assert(thrown);
+    }
+
+    // Test 4: closures, ++ and -- are refused, not run as nil or a no-op.
+    {
+        Node *unsupported[] = { new ClosureNode(), new UnaryOpNode(UnaryOp::Inc, new IntNode(1)) };
+        const char *messages[] = { "Closures are not supported", "Increment and decrement are not supported" };
+        for (int i = 0; i < 2; i++) {
+            ModuleNode *module = buildModule(unsupported[i]);
+
+            bool thrown = false;
+            try {
+                runVm(module);
+            } catch (const std::exception &e) {
+                thrown = std::string(e.what()) == messages[i];
+            }
+            assert(thrown);
+        }
+    }
+
+    std::cout << "vm_native_test: ok" << std::endl;
+    return 0;
+}
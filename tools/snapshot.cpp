@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+
+#include "compiler/cache.h"
+#include "compiler/driver.h"
+#include "compiler/source.h"
+
+using namespace pie::compiler;
+
+// Compiles the standard library into a C++ file that pie links in: the
+// text of every module and its cache entry, as the default options
+// analyse it. Both are string literals, read-only data of the binary.
+//
+//   pie-snapshot stdlib.cpp lib/ prelude.pie std/io.pie ...
+//
+// The modules are compiled by a Driver with the default options, which
+// keeps their entries in a cache next to the output.
+
+// A string literal holding bytes, escaped where they are not printable
+static std::string literal(const std::string &name, const std::string &bytes)
+{
+    std::string out = "static const char " + name + "[] =\n    \"";
+    size_t column = 0;
+    for (unsigned char c : bytes) {
+        if (column >= 72) {
+            out += "\"\n    \"";
+            column = 0;
+        }
+        // Octal escapes are never continued by the next character
+        if (c >= ' ' && c <= '~' && c != '"' && c != '\\' && c != '?') {
+            out += (char)c;
+            column++;
+        } else {
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\%03o", c);
+            out += escape;
+            column += 4;
+        }
+    }
+    return out + "\";\n\n";
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <out.cpp> <libdir> [module.pie...]\n", argv[0]);
+        return 1;
+    }
+
+    std::string output = argv[1];
+    std::string lib = argv[2];
+    if (!lib.empty() && lib.back() != '/') lib += "/";
+    std::string cache_dir = output + ".cache";
+
+    std::string table;
+    std::string literals;
+    int count = 0;
+
+    for (int i = 3; i < argc; i++) {
+        std::string file = argv[i];
+        std::string path = lib + file;
+        std::string name = file.substr(0, file.rfind(".pie"));
+        std::replace(name.begin(), name.end(), '/', '.');
+
+        Driver driver;
+        driver.addSearchPath(lib);
+        driver.setCacheDir(cache_dir);
+        if (driver.compile(path) != Driver::Compiled) {
+            return 1;
+        }
+
+        Source source;
+        uint64_t key = 0;
+        std::unique_ptr<ModuleNode> module;
+        if (source.open(path)) {
+            key = ModuleCache::key(source.data(), source.size(), driver.analysisOptions());
+            module.reset(ModuleCache(cache_dir).load(key));
+        }
+        if (!module) {
+            fprintf(stderr, "No cache entry for %s in %s\n", path.c_str(), cache_dir.c_str());
+            return 1;
+        }
+
+        std::string text(source.data(), source.size());
+        std::string entry = ModuleCache::encode(key, module.get());
+
+        std::string id = std::to_string(count);
+        literals += literal("text_" + id, text);
+        literals += literal("entry_" + id, entry);
+
+        table += "    { \"" + name + "\", text_" + id + ", sizeof(text_" + id + ") - 1, entry_" + id +
+                 ", sizeof(entry_" + id + ") - 1 },\n";
+        count++;
+    }
+
+    FILE *out = fopen(output.c_str(), "wb");
+    if (!out) {
+        fprintf(stderr, "Failed to open file: %s\n", output.c_str());
+        return 1;
+    }
+
+    fprintf(out, "// Generated by pie-snapshot from %s, do not edit\n\n", lib.c_str());
+    fprintf(out, "#include \"compiler/driver.h\"\n\n");
+    fprintf(out, "namespace pie { namespace compiler {\n\n");
+    fputs(literals.c_str(), out);
+    fprintf(out, "extern const EmbeddedModule stdlib[] = {\n%s", table.c_str());
+    // Never empty, a zero length array is not C++
+    fprintf(out, "    { nullptr, nullptr, 0, nullptr, 0 }\n};\n\n");
+    fprintf(out, "extern const size_t stdlib_size = %d;\n\n}}\n", count);
+
+    return fclose(out) == 0 ? 0 : 1;
+}